@@ -140,6 +140,10 @@ int quiet = 0;
 /* Nonzero means args are expressions to be evaluated.  --eval.  */
 int eval = 0;
 
+/* Nonzero means evaluate the expressions on standard input one at a
+   time over a single connection.  --stream.  */
+int stream = 0;
+
 /* Nonzero means don't open a new frame.  Inverse of --create-frame.  */
 int current_frame = 1;
 
@@ -177,6 +181,7 @@ struct option longopts[] =
   { "no-wait",	no_argument,	   NULL, 'n' },
   { "quiet",	no_argument,	   NULL, 'q' },
   { "eval",	no_argument,	   NULL, 'e' },
+  { "stream",	no_argument,	   NULL, 'S' },
   { "help",	no_argument,	   NULL, 'H' },
   { "version",	no_argument,	   NULL, 'V' },
   { "tty",	no_argument,       NULL, 't' },
@@ -210,6 +215,20 @@ xmalloc (size_t size)
   return result;
 }
 
+/* Like realloc but get fatal error if memory is exhausted.  */
+
+static void *
+xrealloc (void *ptr, size_t size)
+{
+  void *result = realloc (ptr, size);
+  if (result == NULL)
+    {
+      perror ("realloc");
+      exit (EXIT_FAILURE);
+    }
+  return result;
+}
+
 /* From sysdep.c */
 #if !defined (HAVE_GET_CURRENT_DIR_NAME) || defined (BROKEN_GET_CURRENT_DIR_NAME)
 
@@ -583,6 +602,11 @@ decode_options (int argc, char **argv)
 	  eval = 1;
 	  break;
 
+	case 'S':
+	  eval = 1;
+	  stream = 1;
+	  break;
+
 	case 'q':
 	  quiet = 1;
 	  break;
@@ -690,6 +714,8 @@ The following OPTIONS are accepted:\n\
 -F ALIST, --frame-parameters=ALIST\n\
 			Set the parameters of a new frame\n\
 -e, --eval    		Evaluate the FILE arguments as ELisp expressions\n\
+--stream		Evaluate the ELisp expressions on standard input,\n\
+			one per line, and print each value on a line\n\
 -n, --no-wait		Don't wait for the server to return\n\
 -q, --quiet		Don't display messages on success\n\
 -d DISPLAY, --display=DISPLAY\n\
@@ -1490,6 +1516,222 @@ w32_give_focus (void)
 }
 #endif
 
+/* In stream mode, Emacs sends its replies as frames of the form
+   "LENGTH:DATA,", where LENGTH is the number of bytes in DATA, written
+   in decimal.  This buffer holds the data received from Emacs that has
+   not been handled yet, starting at reply_start.  */
+static char *reply_buffer;
+static size_t reply_size, reply_start, reply_len;
+
+/* Read more data from Emacs into reply_buffer.  Return zero at the end
+   of the connection or on an error.  */
+static int
+read_reply_data (HSOCKET s)
+{
+  int rl;
+
+  if (reply_start > 0)
+    {
+      memmove (reply_buffer, reply_buffer + reply_start,
+	       reply_len - reply_start);
+      reply_len -= reply_start;
+      reply_start = 0;
+    }
+  if (reply_size - reply_len < BUFSIZ + 1)
+    {
+      reply_size = 2 * reply_size + BUFSIZ + 1;
+      reply_buffer = xrealloc (reply_buffer, reply_size);
+    }
+  do
+    {
+      errno = 0;
+      rl = recv (s, reply_buffer + reply_len, BUFSIZ, 0);
+    }
+  while (rl < 0 && errno == EINTR);
+  if (rl <= 0)
+    return 0;
+  reply_len += rl;
+  return 1;
+}
+
+/* Return the next line that Emacs sent, without its newline, or NULL
+   at the end of the connection.  */
+static char *
+read_reply_line (HSOCKET s)
+{
+  char *line, *nl;
+
+  while (! (nl = memchr (reply_buffer + reply_start, '\n',
+			 reply_len - reply_start)))
+    if (!read_reply_data (s))
+      return NULL;
+  *nl = '\0';
+  line = reply_buffer + reply_start;
+  reply_start = nl + 1 - reply_buffer;
+  return line;
+}
+
+/* Return the data of the next frame that Emacs sent, and store its
+   length in *LEN.  The data is followed by a null byte.  Return NULL
+   at the end of the connection or if the frame is malformed.  */
+static char *
+read_reply_frame (HSOCKET s, size_t *len)
+{
+  char *colon, *end, *data;
+  size_t length, offset;
+
+  while (! (colon = memchr (reply_buffer + reply_start, ':',
+			    reply_len - reply_start)))
+    if (reply_len - reply_start > 20 || !read_reply_data (s))
+      return NULL;
+  errno = 0;
+  length = strtoul (reply_buffer + reply_start, &end, 10);
+  if (end != colon || errno)
+    return NULL;
+  /* read_reply_data may move the data, so remember where it starts
+     relative to reply_start.  */
+  offset = colon + 1 - (reply_buffer + reply_start);
+  while (reply_len - reply_start < offset + length + 1)
+    if (!read_reply_data (s))
+      return NULL;
+  data = reply_buffer + reply_start + offset;
+  if (data[length] != ',')
+    return NULL;
+  data[length] = '\0';
+  reply_start += offset + length + 1;
+  *len = length;
+  return data;
+}
+
+/* Send the LEN bytes at DATA to Emacs right away.  */
+static void
+send_bytes_to_emacs (HSOCKET s, const char *data, size_t len)
+{
+  while (len > 0)
+    {
+      int sent = send (s, data, len, 0);
+      if (sent < 0 && errno == EINTR)
+	continue;
+      if (sent < 0)
+	{
+	  message (TRUE, "%s: failed to send %d bytes to socket: %s\n",
+		   progname, (int) len, strerror (errno));
+	  fail ();
+	}
+      data += sent;
+      len -= sent;
+    }
+}
+
+/* Read a line from standard input into *LINE, which has room for
+   *SIZE bytes and is enlarged as needed.  Remove the newline.  Return
+   zero at the end of the input.  */
+static int
+read_stdin_line (char **line, size_t *size)
+{
+  size_t len = 0;
+
+  for (;;)
+    {
+      if (*size - len < BUFSIZ)
+	{
+	  *size = 2 * *size + BUFSIZ;
+	  *line = xrealloc (*line, *size);
+	}
+      if (!fgets (*line + len, *size - len, stdin))
+	return len > 0;
+      len += strlen (*line + len);
+      if (len > 0 && (*line)[len - 1] == '\n')
+	{
+	  (*line)[--len] = '\0';
+	  return 1;
+	}
+    }
+}
+
+/* Evaluate the expressions on standard input, one per line, in Emacs
+   through socket S, and print the value of each on a line of its own
+   as soon as it arrives.  For an expression that signals an error,
+   print an empty line, and the error on standard error.
+
+   Emacs has been sent the "-stream" command.  After acknowledging it,
+   Emacs reads each expression as a frame "LENGTH:EXPRESSION,", where
+   LENGTH is the number of bytes in EXPRESSION written in decimal, and
+   answers with a frame holding "-print VALUE" or "-error DESCRIPTION".
+   Neither the expressions nor the answers are quoted.  Return the exit
+   status for emacsclient.  */
+static int
+stream_eval (HSOCKET s)
+{
+  int exit_status = EXIT_SUCCESS;
+  char *line = NULL, *frame = NULL;
+  size_t size = 0, frame_size = 0;
+  char *p;
+
+  /* Wait for Emacs to acknowledge the -stream command.  */
+  while ((p = read_reply_line (s)))
+    {
+      if (strprefix ("-emacs-pid ", p))
+	emacs_pid = strtol (p + strlen ("-emacs-pid"), NULL, 10);
+      else if (strcmp (p, "-stream") == 0)
+	break;
+      else if (strprefix ("-error ", p))
+	{
+	  message (TRUE, "*ERROR*: %s\n",
+		   unquote_argument (p + strlen ("-error ")));
+	  return EXIT_FAILURE;
+	}
+    }
+  if (!p)
+    {
+      message (TRUE, "%s: connection to Emacs lost\n", progname);
+      return EXIT_FAILURE;
+    }
+
+  while (read_stdin_line (&line, &size))
+    {
+      size_t len = strlen (line), header_len;
+
+      if (strspn (line, " \t\r") == len)
+	continue;
+
+      /* Send the whole frame at once, so that a TCP connection does
+	 not hold back its last bytes waiting for an acknowledgement.  */
+      if (frame_size < len + sizeof (unsigned long) * 3 + 3)
+	{
+	  frame_size = len + sizeof (unsigned long) * 3 + 3;
+	  frame = xrealloc (frame, frame_size);
+	}
+      header_len = sprintf (frame, "%lu:", (unsigned long) len);
+      memcpy (frame + header_len, line, len);
+      frame[header_len + len] = ',';
+      send_bytes_to_emacs (s, frame, header_len + len + 1);
+
+      p = read_reply_frame (s, &len);
+      if (!p)
+	{
+	  message (TRUE, "%s: connection to Emacs lost\n", progname);
+	  exit_status = EXIT_FAILURE;
+	  break;
+	}
+      if (strprefix ("-print ", p))
+	fwrite (p + strlen ("-print "), 1, len - strlen ("-print "), stdout);
+      else
+	{
+	  if (strprefix ("-error ", p))
+	    p += strlen ("-error ");
+	  fprintf (stderr, "*ERROR*: %s\n", p);
+	  exit_status = EXIT_FAILURE;
+	}
+      putchar ('\n');
+      fflush (stdout);
+    }
+
+  free (line);
+  free (frame);
+  return exit_status;
+}
+
 /* Start the emacs daemon and try to connect to it.  */
 
 static void
@@ -1674,6 +1916,14 @@ main (int argc, char **argv)
   if (!current_frame && !tty)
     send_to_emacs (emacs_socket, "-window-system ");
 
+  if (stream)
+    {
+      send_to_emacs (emacs_socket, "-stream \n");
+      exit_status = stream_eval (emacs_socket);
+      CLOSE_SOCKET (emacs_socket);
+      return exit_status;
+    }
+
   if ((argc - optind > 0))
     {
       int i;
@@ -626,14 +626,12 @@ return nil if there are no matches.
 This is a destructive function; it reuses the storage of SEQ if possible.
 \nKeywords supported:  :key
 \n(fn SEQ PREDICATE [KEYWORD VALUE]...)"
-  (if (nlistp cl-seq)
+  (if (not (or (listp cl-seq) (vectorp cl-seq)))
       (cl-replace cl-seq (apply 'cl-sort (append cl-seq nil) cl-pred cl-keys))
     (cl--parsing-keywords (:key) ()
       (if (memq cl-key '(nil identity))
 	  (sort cl-seq cl-pred)
-	(sort cl-seq (function (lambda (cl-x cl-y)
-				 (funcall cl-pred (funcall cl-key cl-x)
-					  (funcall cl-key cl-y)))))))))
+	(sort cl-seq cl-pred :key cl-key)))))
 
 ;;;###autoload
 (defun cl-stable-sort (cl-seq cl-pred &rest cl-keys)
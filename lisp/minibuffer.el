@@ -259,6 +259,11 @@ the form (concat S2 S)."
              (lambda (sym) (funcall pred (concat prefix (symbol-name sym)))))
             ((hash-table-p table)
              (lambda (s _v) (funcall pred (concat prefix s))))
+            ((completion-index-p table)
+             (lambda (s &optional _v)
+               (funcall pred (concat prefix (cond ((consp s) (car s))
+                                                  ((symbolp s) (symbol-name s))
+                                                  (t s))))))
             ((functionp table)
              (lambda (s) (funcall pred (concat prefix s))))
             (t                          ;Lists and alists.
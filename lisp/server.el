@@ -941,6 +941,11 @@ The following commands are accepted by the server:
   Evaluate EXPR as a Lisp expression and return the
   result in -print commands.
 
+`-stream'
+  Switch the connection to stream mode, in which the client sends
+  expressions to evaluate one at a time, in frames rather than
+  in commands.  See `server-process-stream'.
+
 `-window-system'
   Open a new X frame.
 
@@ -984,6 +989,9 @@ The following commands are accepted by the client:
 `-error DESCRIPTION'
   Signal an error and delete process PROC.
 
+`-stream'
+  Acknowledges the -stream command; the frames follow.
+
 `-suspend'
   Suspend this terminal, i.e., stop the client process.
   Sent when the user presses C-z."
@@ -1005,6 +1013,11 @@ The following commands are accepted by the client:
       (delete-process proc)
       ;; We return immediately.
       (cl-return-from server-process-filter)))
+  (when (process-get proc 'stream)
+    (condition-case err
+	(server-process-stream proc string)
+      (error (server-return-error proc err)))
+    (cl-return-from server-process-filter))
   (let ((prev (process-get proc 'previous-string)))
     (when prev
       (setq string (concat prev string))
@@ -1029,6 +1042,7 @@ The following commands are accepted by the client:
 				    (or file-name-coding-system
 					default-file-name-coding-system)))
 		nowait     ; t if emacsclient does not want to wait for us.
+		stream     ; t if emacsclient will send expressions in frames.
 		frame      ; Frame opened for the client (if any).
 		display    ; Open frame on this display.
 		parent-id  ; Window ID for XEmbed
@@ -1054,6 +1068,9 @@ The following commands are accepted by the client:
                 ;; -nowait:  Emacsclient won't wait for a result.
                 (`"-nowait" (setq nowait t))
 
+                ;; -stream:  Evaluate expressions sent in frames.
+                (`"-stream" (setq stream t))
+
                 ;; -current-frame:  Don't create frames.
                 (`"-current-frame" (setq use-current-frame t))
 
@@ -1172,6 +1189,12 @@ The following commands are accepted by the client:
                 ;; Unknown command.
                 (arg (error "Unknown command: %s" arg))))
 
+	    ;; In stream mode, the rest of the connection is frames.
+	    (when stream
+	      (process-put proc 'stream t)
+	      (server-send-string proc "-stream\n")
+	      (cl-return-from server-process-filter))
+
 	    ;; If both -no-wait and -tty are given with file or sexp
 	    ;; arguments, use an existing frame.
 	    (and nowait
@@ -1218,6 +1241,83 @@ The following commands are accepted by the client:
     ;; condition-case
     (error (server-return-error proc err))))
 
+(defun server-process-stream (proc string)
+  "Evaluate the expressions that client PROC sent in STRING.
+After the `-stream' command, the client sends each expression as a
+frame \"LENGTH:EXPR,\", where LENGTH is the number of bytes in EXPR,
+written in decimal.  The server answers each frame with a frame
+holding \"-print VALUE\" or \"-error DESCRIPTION\".  Nothing is
+&-quoted.  An incomplete frame at the end of STRING is kept until the
+rest arrives; the pieces of a frame are joined only once it is
+complete, so a long frame that comes in many reads is not copied
+again for each of them."
+  ;; The frames are decoded in Lisp, like the rest of the protocol.
+  ;; Decoding a frame takes one `string-match' and one `substring',
+  ;; which is little next to reading, evaluating and printing the
+  ;; expression.
+  (let ((pending (process-get proc 'stream-pending)))
+    ;; PENDING is (NEEDED RECEIVED . PIECES), where PIECES are the
+    ;; strings received so far, the last first, RECEIVED is their total
+    ;; length, and NEEDED is the length that completes the first frame.
+    (when pending
+      (setcar (cdr pending) (+ (cadr pending) (length string)))
+      (setcdr (cdr pending) (cons string (cddr pending)))
+      (setq string
+	    (unless (< (cadr pending) (car pending))
+	      (process-put proc 'stream-pending nil)
+	      (apply 'concat (nreverse (cddr pending))))))
+    (when string
+      (let ((start 0)
+	    end)
+	(while (and (eq (string-match "\\([0-9]+\\):" string start) start)
+		    (< (setq end (+ (match-end 0)
+				    (string-to-number (match-string 1 string))))
+		       (length string)))
+	  (unless (eq (aref string end) ?,)
+	    (error "Invalid frame from client"))
+	  (server-stream-eval (substring string (match-end 0) end) proc)
+	  (setq start (1+ end)))
+	(when (< start (length string))
+	  (let ((rest (substring string start)))
+	    (process-put
+	     proc 'stream-pending
+	     (list (cond
+		    ((string-match "\\`\\([0-9]+\\):" rest)
+		     (+ (match-end 0)
+			(string-to-number (match-string 1 rest))
+			1))
+		    ((string-match "[^0-9]" rest)
+		     (error "Invalid frame from client"))
+		    ;; Wait for the rest of the length.
+		    (t (1+ (length rest))))
+		   (length rest)
+		   rest))))))))
+
+(defun server-stream-eval (expr proc)
+  "Evaluate EXPR and send the result back to client PROC in a frame.
+This is for clients in stream mode; see `server-process-stream'."
+  (let* ((coding-system (and (default-value 'enable-multibyte-characters)
+			     (or file-name-coding-system
+				 default-file-name-coding-system)))
+	 (dir (process-get proc 'server-client-directory))
+	 (reply
+	  (condition-case err
+	      (let ((v (with-current-buffer (get-buffer-create server-buffer)
+			 (let ((default-directory
+				 (if (and dir (file-directory-p dir))
+				     dir default-directory)))
+			   (if coding-system
+			       (setq expr (decode-coding-string
+					   expr coding-system)))
+			   (with-local-quit
+			     (eval (car (read-from-string expr))))))))
+		(let ((print-escape-newlines t))
+		  (concat "-print " (prin1-to-string v))))
+	    (error (concat "-error " (error-message-string err))))))
+    (if coding-system
+	(setq reply (encode-coding-string reply coding-system)))
+    (server-send-string proc (format "%d:%s," (string-bytes reply) reply))))
+
 (defun server-execute (proc files nowait commands dontkill frame tty-name)
   ;; This is run from timers and process-filters, i.e. "asynchronously".
   ;; But w.r.t the user, this is not really asynchronous since the timer
@@ -1015,6 +1015,13 @@ position of the drag."
   "Return the multi-click count of EVENT, a click or drag event.
 The return value is a positive integer."
   (if (and (consp event) (integerp (nth 2 event))) (nth 2 event) 1))
+
+(defsubst event-line-count (event)
+  "Return the number of wheel events that EVENT stands for.
+This is more than 1 if several wheel events were combined into EVENT
+because they came faster than they could be processed; see
+`coalesce-wheel-events'."
+  (if (and (consp event) (integerp (nth 3 event))) (nth 3 event) 1))
 
 ;;;; Extracting fields of the positions in an event.
 
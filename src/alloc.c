@@ -280,6 +280,7 @@ enum
   {
     header_size = offsetof (struct Lisp_Vector, contents),
     bool_header_size = offsetof (struct Lisp_Bool_Vector, data),
+    numeric_header_size = offsetof (struct Lisp_Numeric_Vector, data),
     word_size = sizeof (Lisp_Object)
   };
 
@@ -2375,6 +2376,74 @@ LENGTH must be a number.  INIT matters only in whether it is t or nil.  */)
 }
 
 
+/* Return a new numeric vector of LENGTH elements of type TYPE, all
+   zero.  */
+
+Lisp_Object
+make_numeric_vector (enum numeric_vector_type type, EMACS_INT length)
+{
+  Lisp_Object val;
+  struct Lisp_Numeric_Vector *p;
+  int elt_size = NUMERIC_VECTOR_ELT_SIZE (type);
+  ptrdiff_t nbytes_max = min (PTRDIFF_MAX, SIZE_MAX);
+
+  if ((nbytes_max - numeric_header_size) / elt_size < length)
+    memory_full (SIZE_MAX);
+
+  /* allocate_vector does the remaining size checks.  */
+  XSETVECTOR (val, allocate_vector ((numeric_header_size - header_size
+				     + length * elt_size + word_size - 1)
+				    / word_size));
+
+  /* No Lisp_Object to trace in there.  */
+  XSETPVECTYPESIZE (XVECTOR (val), PVEC_NUMERIC_VECTOR, 0);
+
+  p = XNUMERIC_VECTOR (val);
+  p->size = length;
+  p->type = type;
+  memset (&p->data, 0, length * elt_size);
+  return val;
+}
+
+DEFUN ("make-numeric-vector", Fmake_numeric_vector, Smake_numeric_vector,
+       2, 3, 0,
+       doc: /* Return a new numeric vector of type TYPE and length LENGTH.
+TYPE is one of the symbols `uint8', `int32', `int64' and `float64',
+and says what kind of numbers the vector holds: unsigned 8-bit
+integers, signed 32-bit or 64-bit integers, or floating point numbers.
+Each element is initialized to INIT, which defaults to zero.
+
+A numeric vector stores its elements unboxed, so it takes much less
+memory than an ordinary vector of the same numbers.  Use `aref', `aset',
+`length' and `fillarray' to access it.  */)
+  (Lisp_Object type, Lisp_Object length, Lisp_Object init)
+{
+  Lisp_Object val;
+  enum numeric_vector_type t = numeric_vector_type (type);
+
+  CHECK_NATNUM (length);
+  val = make_numeric_vector (t, XFASTINT (length));
+  if (!NILP (init))
+    numeric_vector_fill (XNUMERIC_VECTOR (val), init);
+  return val;
+}
+
+DEFUN ("numeric-vector", Fnumeric_vector, Snumeric_vector, 1, MANY, 0,
+       doc: /* Return a new numeric vector of type TYPE holding NUMBERS.
+See `make-numeric-vector' for the possible types.
+usage: (numeric-vector TYPE &rest NUMBERS)  */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object val;
+  ptrdiff_t i;
+
+  val = make_numeric_vector (numeric_vector_type (args[0]), nargs - 1);
+  for (i = 1; i < nargs; i++)
+    numeric_vector_set (XNUMERIC_VECTOR (val), i - 1, args[i]);
+  return val;
+}
+
+
 /* Make a string from NBYTES bytes at CONTENTS, and compute the number
    of characters from the contents.  This string may be unibyte or
    multibyte, depending on the contents.  */
@@ -3089,6 +3158,18 @@ allocate_vector_from_block (size_t nbytes)
    ? vector->header.size & PSEUDOVECTOR_SIZE_MASK	\
    : vector->header.next.nbytes)
 
+/* Free the memory outside the Lisp heap owned by VECTOR, which is
+   about to be reclaimed.  */
+
+static inline void
+cleanup_vector (struct Lisp_Vector *vector)
+{
+  if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_HASH_TABLE))
+    free_hash_table_index ((struct Lisp_Hash_Table *) vector);
+  else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_STRING_BUILDER))
+    xfree (((struct Lisp_String_Builder *) vector)->data);
+}
+
 /* Reclaim space used by unmarked vectors.  */
 
 static void
@@ -3121,6 +3202,7 @@ sweep_vectors (void)
 	      ptrdiff_t nbytes = PSEUDOVECTOR_NBYTES (vector);
 	      ptrdiff_t total_bytes = nbytes;
 
+	      cleanup_vector (vector);
 	      next = ADVANCE (vector, nbytes);
 
 	      /* While NEXT is not marked, try to coalesce with VECTOR,
@@ -3130,6 +3212,7 @@ sweep_vectors (void)
 		{
 		  if (VECTOR_MARKED_P (next))
 		    break;
+		  cleanup_vector (next);
 		  nbytes = PSEUDOVECTOR_NBYTES (next);
 		  total_bytes += nbytes;
 		  next = ADVANCE (next, nbytes);
@@ -3170,11 +3253,20 @@ sweep_vectors (void)
 	{
 	  VECTOR_UNMARK (vector);
 	  total_vectors++;
-	  if (vector->header.size & PSEUDOVECTOR_FLAG)
+	  if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_NUMERIC_VECTOR))
+	    {
+	      struct Lisp_Numeric_Vector *n
+		= (struct Lisp_Numeric_Vector *) vector;
+
+	      total_vector_slots
+		+= (numeric_header_size
+		    + n->size * NUMERIC_VECTOR_ELT_SIZE (n->type)) / word_size;
+	    }
+	  else if (vector->header.size & PSEUDOVECTOR_FLAG)
 	    {
 	      struct Lisp_Bool_Vector *b = (struct Lisp_Bool_Vector *) vector;
 
-	      /* All non-bool pseudovectors are small enough to be allocated
+	      /* All other pseudovectors are small enough to be allocated
 		 from vector blocks.  This code should be redesigned if some
 		 pseudovector type grows beyond VBLOCK_BYTES_MAX.  */
 	      eassert (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_BOOL_VECTOR));
@@ -5884,6 +5976,9 @@ mark_object (Lisp_Object arg)
   if (PURE_POINTER_P (XPNTR (obj)))
     return;
 
+  if (marking_weak_tables)
+    weak_object_reached (obj);
+
   last_marked[last_marked_index++] = obj;
   if (last_marked_index == LAST_MARKED_SIZE)
     last_marked_index = 0;
@@ -6047,7 +6142,8 @@ mark_object (Lisp_Object arg)
 	    break;
 
 	  case PVEC_BOOL_VECTOR:
-	    /* No Lisp_Objects to mark in a bool vector.  */
+	  case PVEC_NUMERIC_VECTOR:
+	    /* No Lisp_Objects to mark in a bool or numeric vector.  */
 	    VECTOR_MARK (ptr);
 	    break;
 
@@ -6851,6 +6947,8 @@ The time is in seconds as a floating point value.  */);
   defsubr (&Smake_vector);
   defsubr (&Smake_string);
   defsubr (&Smake_bool_vector);
+  defsubr (&Smake_numeric_vector);
+  defsubr (&Snumeric_vector);
   defsubr (&Smake_symbol);
   defsubr (&Smake_marker);
   defsubr (&Spurecopy);
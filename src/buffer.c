@@ -5388,6 +5388,11 @@ A list of the form `(:propertize ELT PROPS...)' is processed by
  processing ELT as the mode line construct, and adding the text
  properties PROPS to the result.
 
+A list of the form `(:cache DEPENDENCIES ELT)' is processed like ELT,
+ but the result is reused for the same window as long as the values of
+ DEPENDENCIES are unchanged.  Each dependency is a variable, standing
+ for its value, or a form to evaluate.
+
 A list whose car is a symbol is processed by examining the symbol's
  value, and, if that value is non-nil, processing the cadr of the list
  recursively; and if that value is nil, processing the caddr of the
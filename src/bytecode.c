@@ -1358,49 +1358,81 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	CASE (Bgtr):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = Fgtr (TOP, v1);
-	    AFTER_POTENTIAL_GC ();
+	    if (INTEGERP (TOP) && INTEGERP (v1))
+	      TOP = XINT (TOP) > XINT (v1) ? Qt : Qnil;
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Fgtr (TOP, v1);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Blss):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = Flss (TOP, v1);
-	    AFTER_POTENTIAL_GC ();
+	    if (INTEGERP (TOP) && INTEGERP (v1))
+	      TOP = XINT (TOP) < XINT (v1) ? Qt : Qnil;
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Flss (TOP, v1);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Bleq):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = Fleq (TOP, v1);
-	    AFTER_POTENTIAL_GC ();
+	    if (INTEGERP (TOP) && INTEGERP (v1))
+	      TOP = XINT (TOP) <= XINT (v1) ? Qt : Qnil;
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Fleq (TOP, v1);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Bgeq):
 	  {
 	    Lisp_Object v1;
-	    BEFORE_POTENTIAL_GC ();
 	    v1 = POP;
-	    TOP = Fgeq (TOP, v1);
-	    AFTER_POTENTIAL_GC ();
+	    if (INTEGERP (TOP) && INTEGERP (v1))
+	      TOP = XINT (TOP) >= XINT (v1) ? Qt : Qnil;
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Fgeq (TOP, v1);
+		AFTER_POTENTIAL_GC ();
+	      }
 	    NEXT;
 	  }
 
 	CASE (Bdiff):
-	  BEFORE_POTENTIAL_GC ();
-	  DISCARD (1);
-	  TOP = Fminus (2, &TOP);
-	  AFTER_POTENTIAL_GC ();
-	  NEXT;
+	  {
+	    Lisp_Object v1, v2;
+	    v2 = TOP;
+	    DISCARD (1);
+	    v1 = TOP;
+	    /* The difference of two fixnums fits in an EMACS_INT.  */
+	    if (INTEGERP (v1) && INTEGERP (v2)
+		&& !FIXNUM_OVERFLOW_P (XINT (v1) - XINT (v2)))
+	      XSETINT (TOP, XINT (v1) - XINT (v2));
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Fminus (2, &TOP);
+		AFTER_POTENTIAL_GC ();
+	      }
+	    NEXT;
+	  }
 
 	CASE (Bnegate):
 	  {
@@ -1421,11 +1453,22 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  }
 
 	CASE (Bplus):
-	  BEFORE_POTENTIAL_GC ();
-	  DISCARD (1);
-	  TOP = Fplus (2, &TOP);
-	  AFTER_POTENTIAL_GC ();
-	  NEXT;
+	  {
+	    Lisp_Object v1, v2;
+	    v2 = TOP;
+	    DISCARD (1);
+	    v1 = TOP;
+	    if (INTEGERP (v1) && INTEGERP (v2)
+		&& !FIXNUM_OVERFLOW_P (XINT (v1) + XINT (v2)))
+	      XSETINT (TOP, XINT (v1) + XINT (v2));
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Fplus (2, &TOP);
+		AFTER_POTENTIAL_GC ();
+	      }
+	    NEXT;
+	  }
 
 	CASE (Bmax):
 	  BEFORE_POTENTIAL_GC ();
@@ -1442,11 +1485,23 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (Bmult):
-	  BEFORE_POTENTIAL_GC ();
-	  DISCARD (1);
-	  TOP = Ftimes (2, &TOP);
-	  AFTER_POTENTIAL_GC ();
-	  NEXT;
+	  {
+	    Lisp_Object v1, v2;
+	    v2 = TOP;
+	    DISCARD (1);
+	    v1 = TOP;
+	    if (INTEGERP (v1) && INTEGERP (v2)
+		&& !INT_MULTIPLY_OVERFLOW (XINT (v1), XINT (v2))
+		&& !FIXNUM_OVERFLOW_P (XINT (v1) * XINT (v2)))
+	      XSETINT (TOP, XINT (v1) * XINT (v2));
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Ftimes (2, &TOP);
+		AFTER_POTENTIAL_GC ();
+	      }
+	    NEXT;
+	  }
 
 	CASE (Bquo):
 	  BEFORE_POTENTIAL_GC ();
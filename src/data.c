@@ -72,7 +72,10 @@ Lisp_Object Qchar_or_string_p, Qmarkerp, Qinteger_or_marker_p, Qvectorp;
 Lisp_Object Qbuffer_or_string_p;
 static Lisp_Object Qkeywordp, Qboundp;
 Lisp_Object Qfboundp;
-Lisp_Object Qchar_table_p, Qvector_or_char_table_p;
+Lisp_Object Qchar_table_p, Qvector_or_char_table_p, Qbool_vector_p;
+Lisp_Object Qnumeric_vector_p;
+static Lisp_Object Quint8, Qint32, Qint64, Qfloat64;
+static Lisp_Object Qwrong_length_argument;
 
 Lisp_Object Qcdr;
 static Lisp_Object Qad_advice_info, Qad_activate_internal;
@@ -91,6 +94,7 @@ static Lisp_Object Qprocess, Qmarker;
 static Lisp_Object Qcompiled_function, Qframe;
 Lisp_Object Qbuffer;
 static Lisp_Object Qchar_table, Qbool_vector, Qhash_table;
+static Lisp_Object Qstring_builder, Qnumeric_vector, Qcompletion_index;
 static Lisp_Object Qsubrp, Qmany, Qunevalled;
 Lisp_Object Qfont_spec, Qfont_entity, Qfont_object;
 static Lisp_Object Qdefun;
@@ -205,6 +209,12 @@ for example, (type-of 1) returns `integer'.  */)
 	return Qframe;
       if (HASH_TABLE_P (object))
 	return Qhash_table;
+      if (STRING_BUILDER_P (object))
+	return Qstring_builder;
+      if (NUMERIC_VECTOR_P (object))
+	return Qnumeric_vector;
+      if (COMPLETION_INDEX_P (object))
+	return Qcompletion_index;
       if (FONT_SPEC_P (object))
 	return Qfont_spec;
       if (FONT_ENTITY_P (object))
@@ -338,6 +348,16 @@ DEFUN ("bool-vector-p", Fbool_vector_p, Sbool_vector_p, 1, 1, 0,
   return Qnil;
 }
 
+DEFUN ("numeric-vector-p", Fnumeric_vector_p, Snumeric_vector_p, 1, 1, 0,
+       doc: /* Return t if OBJECT is a numeric vector.
+See `make-numeric-vector'.  */)
+  (Lisp_Object object)
+{
+  if (NUMERIC_VECTOR_P (object))
+    return Qt;
+  return Qnil;
+}
+
 DEFUN ("arrayp", Farrayp, Sarrayp, 1, 1, 0,
        doc: /* Return t if OBJECT is an array (string or vector).  */)
   (Lisp_Object object)
@@ -2064,7 +2084,7 @@ function chain of symbols.  */)
 DEFUN ("aref", Faref, Saref, 2, 2, 0,
        doc: /* Return the element of ARRAY at index IDX.
 ARRAY may be a vector, a string, a char-table, a bool-vector,
-or a byte-code object.  IDX starts at 0.  */)
+a numeric vector, or a byte-code object.  IDX starts at 0.  */)
   (register Lisp_Object array, Lisp_Object idx)
 {
   register EMACS_INT idxval;
@@ -2095,6 +2115,12 @@ or a byte-code object.  IDX starts at 0.  */)
       val = (unsigned char) XBOOL_VECTOR (array)->data[idxval / BOOL_VECTOR_BITS_PER_CHAR];
       return (val & (1 << (idxval % BOOL_VECTOR_BITS_PER_CHAR)) ? Qt : Qnil);
     }
+  else if (NUMERIC_VECTOR_P (array))
+    {
+      if (idxval < 0 || idxval >= XNUMERIC_VECTOR (array)->size)
+	args_out_of_range (array, idx);
+      return numeric_vector_ref (XNUMERIC_VECTOR (array), idxval);
+    }
   else if (CHAR_TABLE_P (array))
     {
       CHECK_CHARACTER (idx);
@@ -2118,14 +2144,22 @@ or a byte-code object.  IDX starts at 0.  */)
 
 DEFUN ("aset", Faset, Saset, 3, 3, 0,
        doc: /* Store into the element of ARRAY at index IDX the value NEWELT.
-Return NEWELT.  ARRAY may be a vector, a string, a char-table or a
-bool-vector.  IDX starts at 0.  */)
+Return NEWELT.  ARRAY may be a vector, a string, a char-table, a
+bool-vector or a numeric vector.  IDX starts at 0.  */)
   (register Lisp_Object array, Lisp_Object idx, Lisp_Object newelt)
 {
   register EMACS_INT idxval;
 
   CHECK_NUMBER (idx);
   idxval = XINT (idx);
+  if (NUMERIC_VECTOR_P (array))
+    {
+      CHECK_IMPURE (array);
+      if (idxval < 0 || idxval >= XNUMERIC_VECTOR (array)->size)
+	args_out_of_range (array, idx);
+      numeric_vector_set (XNUMERIC_VECTOR (array), idxval, newelt);
+      return newelt;
+    }
   CHECK_ARRAY (array, Qarrayp);
   CHECK_IMPURE (array);
 
@@ -2930,6 +2964,705 @@ lowercase l) for small endian machines.  */)
   return make_number (order);
 }
 
+/* Bool-vector set operations.  These work a word at a time on the
+   bytes of the bool-vectors, whose bits past the length are always
+   zero.  Words are loaded and stored with memcpy, since the data of
+   a bool-vector need not be aligned.  */
+
+typedef size_t bool_vector_word;
+
+enum { BOOL_VECTOR_WORD_SIZE = sizeof (bool_vector_word) };
+
+enum bool_vector_op
+  {
+    bool_vector_exclusive_or,
+    bool_vector_union,
+    bool_vector_intersection,
+    bool_vector_set_difference,
+    bool_vector_subsetp
+  };
+
+static inline bool_vector_word
+bool_vector_load (unsigned char const *p)
+{
+  bool_vector_word w;
+  memcpy (&w, p, sizeof w);
+  return w;
+}
+
+static inline void
+bool_vector_store (unsigned char *p, bool_vector_word w)
+{
+  memcpy (p, &w, sizeof w);
+}
+
+/* Return the number of bits that are set in W.  */
+
+static inline int
+bool_vector_popcount (bool_vector_word w)
+{
+#if 4 <= __GNUC__ || (3 == __GNUC__ && 4 <= __GNUC_MINOR__)
+  return __builtin_popcountll (w);
+#else
+  int n = 0;
+  for (; w; w &= w - 1)
+    n++;
+  return n;
+#endif
+}
+
+/* Return the number of bytes of the data of bool-vector A.  */
+
+static ptrdiff_t
+bool_vector_bytes (Lisp_Object a)
+{
+  return ((XBOOL_VECTOR (a)->size + BOOL_VECTOR_BITS_PER_CHAR - 1)
+	  / BOOL_VECTOR_BITS_PER_CHAR);
+}
+
+/* Check that DEST is nil or a bool-vector as long as A, and return a
+   bool-vector to store into.  */
+
+static Lisp_Object
+bool_vector_dest (Lisp_Object a, Lisp_Object dest)
+{
+  if (NILP (dest))
+    return Fmake_bool_vector (make_number (XBOOL_VECTOR (a)->size), Qnil);
+  CHECK_BOOL_VECTOR (dest);
+  CHECK_IMPURE (dest);
+  if (XBOOL_VECTOR (dest)->size != XBOOL_VECTOR (a)->size)
+    xsignal2 (Qwrong_length_argument, a, dest);
+  return dest;
+}
+
+/* Apply OP to the bool-vectors A and B, storing into DEST.  DEST nil
+   means to store into a new bool-vector.  Return the destination, or
+   t or nil for bool_vector_subsetp.  */
+
+static Lisp_Object
+bool_vector_binop_driver (Lisp_Object a, Lisp_Object b, Lisp_Object dest,
+			  enum bool_vector_op op)
+{
+  unsigned char *adata, *bdata, *destdata = NULL;
+  ptrdiff_t i, nbytes;
+
+  CHECK_BOOL_VECTOR (a);
+  CHECK_BOOL_VECTOR (b);
+  if (XBOOL_VECTOR (b)->size != XBOOL_VECTOR (a)->size)
+    xsignal2 (Qwrong_length_argument, a, b);
+  if (op != bool_vector_subsetp)
+    {
+      dest = bool_vector_dest (a, dest);
+      destdata = XBOOL_VECTOR (dest)->data;
+    }
+
+  adata = XBOOL_VECTOR (a)->data;
+  bdata = XBOOL_VECTOR (b)->data;
+  nbytes = bool_vector_bytes (a);
+
+  switch (op)
+    {
+    case bool_vector_exclusive_or:
+      for (i = 0; i + BOOL_VECTOR_WORD_SIZE <= nbytes;
+	   i += BOOL_VECTOR_WORD_SIZE)
+	bool_vector_store (destdata + i, (bool_vector_load (adata + i)
+					  ^ bool_vector_load (bdata + i)));
+      for (; i < nbytes; i++)
+	destdata[i] = adata[i] ^ bdata[i];
+      break;
+
+    case bool_vector_union:
+      for (i = 0; i + BOOL_VECTOR_WORD_SIZE <= nbytes;
+	   i += BOOL_VECTOR_WORD_SIZE)
+	bool_vector_store (destdata + i, (bool_vector_load (adata + i)
+					  | bool_vector_load (bdata + i)));
+      for (; i < nbytes; i++)
+	destdata[i] = adata[i] | bdata[i];
+      break;
+
+    case bool_vector_intersection:
+      for (i = 0; i + BOOL_VECTOR_WORD_SIZE <= nbytes;
+	   i += BOOL_VECTOR_WORD_SIZE)
+	bool_vector_store (destdata + i, (bool_vector_load (adata + i)
+					  & bool_vector_load (bdata + i)));
+      for (; i < nbytes; i++)
+	destdata[i] = adata[i] & bdata[i];
+      break;
+
+    case bool_vector_set_difference:
+      for (i = 0; i + BOOL_VECTOR_WORD_SIZE <= nbytes;
+	   i += BOOL_VECTOR_WORD_SIZE)
+	bool_vector_store (destdata + i, (bool_vector_load (adata + i)
+					  & ~bool_vector_load (bdata + i)));
+      for (; i < nbytes; i++)
+	destdata[i] = adata[i] & ~bdata[i];
+      break;
+
+    case bool_vector_subsetp:
+      for (i = 0; i + BOOL_VECTOR_WORD_SIZE <= nbytes;
+	   i += BOOL_VECTOR_WORD_SIZE)
+	if (bool_vector_load (adata + i) & ~bool_vector_load (bdata + i))
+	  return Qnil;
+      for (; i < nbytes; i++)
+	if (adata[i] & ~bdata[i])
+	  return Qnil;
+      return Qt;
+    }
+
+  return dest;
+}
+
+DEFUN ("bool-vector-exclusive-or", Fbool_vector_exclusive_or,
+       Sbool_vector_exclusive_or, 2, 3, 0,
+       doc: /* Return A ^ B, bitwise exclusive or.
+If optional third argument C is given, store the result into C.
+A, B, and C must be bool vectors of the same length.
+Return the bool vector holding the result.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object c)
+{
+  return bool_vector_binop_driver (a, b, c, bool_vector_exclusive_or);
+}
+
+DEFUN ("bool-vector-union", Fbool_vector_union,
+       Sbool_vector_union, 2, 3, 0,
+       doc: /* Return A | B, bitwise or.
+If optional third argument C is given, store the result into C.
+A, B, and C must be bool vectors of the same length.
+Return the bool vector holding the result.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object c)
+{
+  return bool_vector_binop_driver (a, b, c, bool_vector_union);
+}
+
+DEFUN ("bool-vector-intersection", Fbool_vector_intersection,
+       Sbool_vector_intersection, 2, 3, 0,
+       doc: /* Return A & B, bitwise and.
+If optional third argument C is given, store the result into C.
+A, B, and C must be bool vectors of the same length.
+Return the bool vector holding the result.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object c)
+{
+  return bool_vector_binop_driver (a, b, c, bool_vector_intersection);
+}
+
+DEFUN ("bool-vector-set-difference", Fbool_vector_set_difference,
+       Sbool_vector_set_difference, 2, 3, 0,
+       doc: /* Return A &~ B, set difference.
+If optional third argument C is given, store the result into C.
+A, B, and C must be bool vectors of the same length.
+Return the bool vector holding the result.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object c)
+{
+  return bool_vector_binop_driver (a, b, c, bool_vector_set_difference);
+}
+
+DEFUN ("bool-vector-subsetp", Fbool_vector_subsetp,
+       Sbool_vector_subsetp, 2, 2, 0,
+       doc: /* Return t if every t value in A is also t in B, nil otherwise.
+A and B must be bool vectors of the same length.  */)
+  (Lisp_Object a, Lisp_Object b)
+{
+  return bool_vector_binop_driver (a, b, Qnil, bool_vector_subsetp);
+}
+
+DEFUN ("bool-vector-not", Fbool_vector_not,
+       Sbool_vector_not, 1, 2, 0,
+       doc: /* Compute ~A, set complement.
+If optional second argument B is given, store the result into B.
+A and B must be bool vectors of the same length.
+Return the bool vector holding the result.  */)
+  (Lisp_Object a, Lisp_Object b)
+{
+  unsigned char *adata, *bdata;
+  ptrdiff_t i, nbytes;
+  EMACS_INT nr_bits;
+
+  CHECK_BOOL_VECTOR (a);
+  b = bool_vector_dest (a, b);
+  adata = XBOOL_VECTOR (a)->data;
+  bdata = XBOOL_VECTOR (b)->data;
+  nr_bits = XBOOL_VECTOR (a)->size;
+  nbytes = bool_vector_bytes (a);
+
+  for (i = 0; i + BOOL_VECTOR_WORD_SIZE <= nbytes; i += BOOL_VECTOR_WORD_SIZE)
+    bool_vector_store (bdata + i, ~bool_vector_load (adata + i));
+  for (; i < nbytes; i++)
+    bdata[i] = ~adata[i];
+
+  /* Clear the bits past the end.  */
+  if (nr_bits % BOOL_VECTOR_BITS_PER_CHAR)
+    bdata[nbytes - 1] &= (1 << nr_bits % BOOL_VECTOR_BITS_PER_CHAR) - 1;
+
+  return b;
+}
+
+DEFUN ("bool-vector-count-population", Fbool_vector_count_population,
+       Sbool_vector_count_population, 1, 1, 0,
+       doc: /* Count how many elements in A are t.
+A must be a bool vector.  */)
+  (Lisp_Object a)
+{
+  unsigned char *adata;
+  ptrdiff_t i, nbytes;
+  EMACS_INT count = 0;
+
+  CHECK_BOOL_VECTOR (a);
+  adata = XBOOL_VECTOR (a)->data;
+  nbytes = bool_vector_bytes (a);
+
+  for (i = 0; i + BOOL_VECTOR_WORD_SIZE <= nbytes; i += BOOL_VECTOR_WORD_SIZE)
+    count += bool_vector_popcount (bool_vector_load (adata + i));
+  for (; i < nbytes; i++)
+    count += bool_vector_popcount (adata[i]);
+
+  return make_number (count);
+}
+
+DEFUN ("bool-vector-count-consecutive", Fbool_vector_count_consecutive,
+       Sbool_vector_count_consecutive, 3, 3, 0,
+       doc: /* Count how many consecutive elements in A equal B starting at I.
+A is a bool vector, B is t or nil, and I is an index into A.
+In particular, if B is nil, the value is the distance from I to the
+next element of A that is t, or to the end of A.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object i)
+{
+  unsigned char *adata;
+  unsigned char twiddle;
+  ptrdiff_t byte, nbytes;
+  EMACS_INT nr_bits, pos;
+
+  CHECK_BOOL_VECTOR (a);
+  CHECK_NATNUM (i);
+  nr_bits = XBOOL_VECTOR (a)->size;
+  if (XFASTINT (i) > nr_bits)
+    args_out_of_range (a, i);
+
+  adata = XBOOL_VECTOR (a)->data;
+  nbytes = bool_vector_bytes (a);
+
+  /* After XORing with TWIDDLE, the bits that equal B are zero.  */
+  twiddle = NILP (b) ? 0 : -1;
+  pos = XFASTINT (i);
+
+  /* Look at the bits of the first byte one at a time, then skip whole
+     words and bytes of matching bits, and find the first bit that
+     does not match in the byte where that stops.  */
+  byte = pos / BOOL_VECTOR_BITS_PER_CHAR;
+  if (pos % BOOL_VECTOR_BITS_PER_CHAR)
+    {
+      int shift = pos % BOOL_VECTOR_BITS_PER_CHAR;
+      unsigned char mismatch = (adata[byte] ^ twiddle) >> shift;
+      int bits = BOOL_VECTOR_BITS_PER_CHAR - shift;
+      for (; bits > 0 && ! (mismatch & 1); bits--, mismatch >>= 1)
+	pos++;
+      if (bits > 0)
+	return make_number (min (pos, nr_bits) - XFASTINT (i));
+      byte++;
+    }
+
+  if (byte < nbytes)
+    {
+      bool_vector_word wtwiddle = NILP (b) ? 0 : -1;
+      unsigned char mismatch;
+
+      while (byte + BOOL_VECTOR_WORD_SIZE <= nbytes
+	     && bool_vector_load (adata + byte) == wtwiddle)
+	byte += BOOL_VECTOR_WORD_SIZE;
+      while (byte < nbytes && adata[byte] == twiddle)
+	byte++;
+      pos = byte * BOOL_VECTOR_BITS_PER_CHAR;
+      if (byte < nbytes)
+	for (mismatch = adata[byte] ^ twiddle; ! (mismatch & 1);
+	     mismatch >>= 1)
+	  pos++;
+    }
+
+  return make_number (min (pos, nr_bits) - XFASTINT (i));
+}
+
+/* Numeric vectors.  */
+
+/* Return the element type of numeric vectors that the symbol TYPE
+   stands for.  */
+
+enum numeric_vector_type
+numeric_vector_type (Lisp_Object type)
+{
+  if (EQ (type, Quint8))
+    return NUMERIC_VECTOR_UINT8;
+  if (EQ (type, Qint32))
+    return NUMERIC_VECTOR_INT32;
+  if (EQ (type, Qint64))
+    return NUMERIC_VECTOR_INT64;
+  if (EQ (type, Qfloat64))
+    return NUMERIC_VECTOR_FLOAT64;
+  signal_error ("Invalid numeric vector type", type);
+}
+
+/* Return element IDX of numeric vector V as a Lisp number.  */
+
+Lisp_Object
+numeric_vector_ref (struct Lisp_Numeric_Vector *v, ptrdiff_t idx)
+{
+  switch (v->type)
+    {
+    case NUMERIC_VECTOR_UINT8:
+      return make_number (v->data.u8[idx]);
+    case NUMERIC_VECTOR_INT32:
+      return make_number (v->data.i32[idx]);
+    case NUMERIC_VECTOR_INT64:
+      return make_fixnum_or_float (v->data.i64[idx]);
+    default:
+      return make_float (v->data.f64[idx]);
+    }
+}
+
+/* Store the number VAL into element IDX of numeric vector V.  Signal
+   an error if VAL cannot be represented exactly by the element type
+   of V, except that any number is rounded to a float64 element.  */
+
+void
+numeric_vector_set (struct Lisp_Numeric_Vector *v, ptrdiff_t idx,
+		    Lisp_Object val)
+{
+  switch (v->type)
+    {
+    case NUMERIC_VECTOR_UINT8:
+      CHECK_NUMBER (val);
+      if (! (0 <= XINT (val) && XINT (val) <= UINT8_MAX))
+	args_out_of_range (Quint8, val);
+      v->data.u8[idx] = XINT (val);
+      break;
+
+    case NUMERIC_VECTOR_INT32:
+      CHECK_NUMBER (val);
+      if (! (INT32_MIN <= XINT (val) && XINT (val) <= INT32_MAX))
+	args_out_of_range (Qint32, val);
+      v->data.i32[idx] = XINT (val);
+      break;
+
+    case NUMERIC_VECTOR_INT64:
+      /* `aref' returns a float for an element that is not a fixnum, so
+	 accept floats with an integer value, too.  */
+      CHECK_NUMBER_OR_FLOAT (val);
+      if (INTEGERP (val))
+	v->data.i64[idx] = XINT (val);
+      else
+	{
+	  double d = XFLOAT_DATA (val);
+	  if (! (d == floor (d) && -9.223372036854775808e18 <= d
+		 && d < 9.223372036854775808e18))
+	    args_out_of_range (Qint64, val);
+	  v->data.i64[idx] = d;
+	}
+      break;
+
+    default:
+      CHECK_NUMBER_OR_FLOAT (val);
+      v->data.f64[idx] = XFLOATINT (val);
+      break;
+    }
+}
+
+/* Store the number VAL into all elements of numeric vector V.  */
+
+void
+numeric_vector_fill (struct Lisp_Numeric_Vector *v, Lisp_Object val)
+{
+  ptrdiff_t i, n = v->size;
+
+  if (n == 0)
+    return;
+  numeric_vector_set (v, 0, val);
+  switch (v->type)
+    {
+    case NUMERIC_VECTOR_UINT8:
+      memset (v->data.u8, v->data.u8[0], n);
+      break;
+    case NUMERIC_VECTOR_INT32:
+      for (i = 1; i < n; i++)
+	v->data.i32[i] = v->data.i32[0];
+      break;
+    case NUMERIC_VECTOR_INT64:
+      for (i = 1; i < n; i++)
+	v->data.i64[i] = v->data.i64[0];
+      break;
+    default:
+      for (i = 1; i < n; i++)
+	v->data.f64[i] = v->data.f64[0];
+      break;
+    }
+}
+
+DEFUN ("numeric-vector-type", Fnumeric_vector_type, Snumeric_vector_type,
+       1, 1, 0,
+       doc: /* Return the element type of numeric vector VECTOR.
+The value is one of the symbols `uint8', `int32', `int64' and `float64'.  */)
+  (Lisp_Object vector)
+{
+  CHECK_NUMERIC_VECTOR (vector);
+  switch (XNUMERIC_VECTOR (vector)->type)
+    {
+    case NUMERIC_VECTOR_UINT8:
+      return Quint8;
+    case NUMERIC_VECTOR_INT32:
+      return Qint32;
+    case NUMERIC_VECTOR_INT64:
+      return Qint64;
+    default:
+      return Qfloat64;
+    }
+}
+
+/* Return the numeric vector to store the result of an operation on A
+   into: DEST if it is non-nil and fits, or a new vector.  */
+
+static Lisp_Object
+numeric_vector_dest (Lisp_Object a, Lisp_Object dest)
+{
+  struct Lisp_Numeric_Vector *va = XNUMERIC_VECTOR (a);
+
+  if (NILP (dest))
+    return make_numeric_vector (va->type, va->size);
+  CHECK_NUMERIC_VECTOR (dest);
+  CHECK_IMPURE (dest);
+  if (XNUMERIC_VECTOR (dest)->type != va->type)
+    signal_error ("Numeric vectors of different types", list2 (a, dest));
+  if (XNUMERIC_VECTOR (dest)->size != va->size)
+    xsignal2 (Qwrong_length_argument, a, dest);
+  return dest;
+}
+
+enum numeric_vector_op
+  {
+    numeric_vector_add,
+    numeric_vector_subtract,
+    numeric_vector_multiply
+  };
+
+/* Apply OP to the elements in the array MEMBER of the data of VA and
+   VB, storing the results into VD.  The elements are computed as
+   UTYPE, so that integers wrap around instead of overflowing.  The
+   loops are kept simple so that the compiler can vectorize them.  */
+
+#define NUMERIC_VECTOR_BINOP(op, member, utype, va, vb, vd, n)		\
+  do {									\
+    ptrdiff_t i_;							\
+    switch (op)								\
+      {									\
+      case numeric_vector_add:						\
+	for (i_ = 0; i_ < (n); i_++)					\
+	  (vd)->data.member[i_] = ((utype) (va)->data.member[i_]	\
+				   + (utype) (vb)->data.member[i_]);	\
+	break;								\
+      case numeric_vector_subtract:					\
+	for (i_ = 0; i_ < (n); i_++)					\
+	  (vd)->data.member[i_] = ((utype) (va)->data.member[i_]	\
+				   - (utype) (vb)->data.member[i_]);	\
+	break;								\
+      case numeric_vector_multiply:					\
+	for (i_ = 0; i_ < (n); i_++)					\
+	  (vd)->data.member[i_] = ((utype) (va)->data.member[i_]	\
+				   * (utype) (vb)->data.member[i_]);	\
+	break;								\
+      }									\
+  } while (0)
+
+static Lisp_Object
+numeric_vector_binop_driver (Lisp_Object a, Lisp_Object b, Lisp_Object dest,
+			     enum numeric_vector_op op)
+{
+  struct Lisp_Numeric_Vector *va, *vb, *vd;
+  ptrdiff_t n;
+
+  CHECK_NUMERIC_VECTOR (a);
+  CHECK_NUMERIC_VECTOR (b);
+  va = XNUMERIC_VECTOR (a);
+  vb = XNUMERIC_VECTOR (b);
+  if (vb->type != va->type)
+    signal_error ("Numeric vectors of different types", list2 (a, b));
+  if (vb->size != va->size)
+    xsignal2 (Qwrong_length_argument, a, b);
+  dest = numeric_vector_dest (a, dest);
+  vd = XNUMERIC_VECTOR (dest);
+  n = va->size;
+
+  switch (va->type)
+    {
+    case NUMERIC_VECTOR_UINT8:
+      NUMERIC_VECTOR_BINOP (op, u8, unsigned int, va, vb, vd, n);
+      break;
+    case NUMERIC_VECTOR_INT32:
+      NUMERIC_VECTOR_BINOP (op, i32, uint32_t, va, vb, vd, n);
+      break;
+    case NUMERIC_VECTOR_INT64:
+      NUMERIC_VECTOR_BINOP (op, i64, uint64_t, va, vb, vd, n);
+      break;
+    default:
+      NUMERIC_VECTOR_BINOP (op, f64, double, va, vb, vd, n);
+      break;
+    }
+
+  return dest;
+}
+
+DEFUN ("numeric-vector-add", Fnumeric_vector_add,
+       Snumeric_vector_add, 2, 3, 0,
+       doc: /* Return the element-wise sum of numeric vectors A and B.
+A and B must have the same type and length.  If optional argument C
+is given, store the result into C and return C; it must have the same
+type and length as A.  Integer elements wrap around on overflow.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object c)
+{
+  return numeric_vector_binop_driver (a, b, c, numeric_vector_add);
+}
+
+DEFUN ("numeric-vector-subtract", Fnumeric_vector_subtract,
+       Snumeric_vector_subtract, 2, 3, 0,
+       doc: /* Return the element-wise difference of numeric vectors A and B.
+A and B must have the same type and length.  If optional argument C
+is given, store the result into C and return C; it must have the same
+type and length as A.  Integer elements wrap around on overflow.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object c)
+{
+  return numeric_vector_binop_driver (a, b, c, numeric_vector_subtract);
+}
+
+DEFUN ("numeric-vector-multiply", Fnumeric_vector_multiply,
+       Snumeric_vector_multiply, 2, 3, 0,
+       doc: /* Return the element-wise product of numeric vectors A and B.
+A and B must have the same type and length.  If optional argument C
+is given, store the result into C and return C; it must have the same
+type and length as A.  Integer elements wrap around on overflow.  */)
+  (Lisp_Object a, Lisp_Object b, Lisp_Object c)
+{
+  return numeric_vector_binop_driver (a, b, c, numeric_vector_multiply);
+}
+
+DEFUN ("numeric-vector-scale", Fnumeric_vector_scale,
+       Snumeric_vector_scale, 2, 3, 0,
+       doc: /* Return numeric vector A with each element multiplied by X.
+X must be an integer unless A holds floats.  If optional argument B is
+given, store the result into B and return B; it must have the same
+type and length as A.  Integer elements wrap around on overflow.  */)
+  (Lisp_Object a, Lisp_Object x, Lisp_Object b)
+{
+  struct Lisp_Numeric_Vector *va, *vb;
+  ptrdiff_t i, n;
+
+  CHECK_NUMERIC_VECTOR (a);
+  va = XNUMERIC_VECTOR (a);
+  if (va->type == NUMERIC_VECTOR_FLOAT64)
+    CHECK_NUMBER_OR_FLOAT (x);
+  else
+    CHECK_NUMBER (x);
+  b = numeric_vector_dest (a, b);
+  vb = XNUMERIC_VECTOR (b);
+  n = va->size;
+
+  switch (va->type)
+    {
+    case NUMERIC_VECTOR_UINT8:
+      {
+	unsigned int f = XINT (x);
+	for (i = 0; i < n; i++)
+	  vb->data.u8[i] = va->data.u8[i] * f;
+      }
+      break;
+    case NUMERIC_VECTOR_INT32:
+      {
+	uint32_t f = XINT (x);
+	for (i = 0; i < n; i++)
+	  vb->data.i32[i] = (uint32_t) va->data.i32[i] * f;
+      }
+      break;
+    case NUMERIC_VECTOR_INT64:
+      {
+	uint64_t f = XINT (x);
+	for (i = 0; i < n; i++)
+	  vb->data.i64[i] = (uint64_t) va->data.i64[i] * f;
+      }
+      break;
+    default:
+      {
+	double f = XFLOATINT (x);
+	for (i = 0; i < n; i++)
+	  vb->data.f64[i] = va->data.f64[i] * f;
+      }
+      break;
+    }
+
+  return b;
+}
+
+DEFUN ("numeric-vector-sum", Fnumeric_vector_sum,
+       Snumeric_vector_sum, 1, 1, 0,
+       doc: /* Return the sum of the elements of numeric vector A.
+The sum of integer elements is an integer, or a float if it does not
+fit in a fixnum.  */)
+  (Lisp_Object a)
+{
+  struct Lisp_Numeric_Vector *va;
+  ptrdiff_t i, n;
+  intmax_t isum = 0;
+  double fsum = 0;
+  int overflow = 0;
+
+  CHECK_NUMERIC_VECTOR (a);
+  va = XNUMERIC_VECTOR (a);
+  n = va->size;
+
+  switch (va->type)
+    {
+    case NUMERIC_VECTOR_UINT8:
+    case NUMERIC_VECTOR_INT32:
+      /* Sum chunks that cannot overflow an int64_t with a simple loop,
+	 and check only when adding up the chunks.  */
+      for (i = 0; i < n; )
+	{
+	  ptrdiff_t end = n - i < INT32_MAX ? n : i + INT32_MAX;
+	  int64_t chunk = 0;
+
+	  if (va->type == NUMERIC_VECTOR_UINT8)
+	    for (; i < end; i++)
+	      chunk += va->data.u8[i];
+	  else
+	    for (; i < end; i++)
+	      chunk += va->data.i32[i];
+	  if (INT_ADD_OVERFLOW (isum, chunk))
+	    {
+	      overflow = 1;
+	      fsum += isum;
+	      isum = 0;
+	    }
+	  isum += chunk;
+	}
+      break;
+
+    case NUMERIC_VECTOR_INT64:
+      for (i = 0; i < n; i++)
+	{
+	  if (INT_ADD_OVERFLOW (isum, va->data.i64[i]))
+	    {
+	      overflow = 1;
+	      fsum += isum;
+	      isum = 0;
+	    }
+	  isum += va->data.i64[i];
+	}
+      break;
+
+    default:
+      for (i = 0; i < n; i++)
+	fsum += va->data.f64[i];
+      return make_float (fsum);
+    }
+
+  if (overflow)
+    return make_float (fsum + isum);
+  return make_fixnum_or_float (isum);
+}
+
 
 
 void
@@ -2949,6 +3682,7 @@ syms_of_data (void)
   DEFSYM (Qquit, "quit");
   DEFSYM (Qwrong_type_argument, "wrong-type-argument");
   DEFSYM (Qargs_out_of_range, "args-out-of-range");
+  DEFSYM (Qwrong_length_argument, "wrong-length-argument");
   DEFSYM (Qvoid_function, "void-function");
   DEFSYM (Qcyclic_function_indirection, "cyclic-function-indirection");
   DEFSYM (Qcyclic_variable_indirection, "cyclic-variable-indirection");
@@ -2979,6 +3713,12 @@ syms_of_data (void)
   DEFSYM (Qsequencep, "sequencep");
   DEFSYM (Qbufferp, "bufferp");
   DEFSYM (Qvectorp, "vectorp");
+  DEFSYM (Qbool_vector_p, "bool-vector-p");
+  DEFSYM (Qnumeric_vector_p, "numeric-vector-p");
+  DEFSYM (Quint8, "uint8");
+  DEFSYM (Qint32, "int32");
+  DEFSYM (Qint64, "int64");
+  DEFSYM (Qfloat64, "float64");
   DEFSYM (Qchar_or_string_p, "char-or-string-p");
   DEFSYM (Qmarkerp, "markerp");
   DEFSYM (Qbuffer_or_string_p, "buffer-or-string-p");
@@ -3022,6 +3762,7 @@ syms_of_data (void)
   PUT_ERROR (Quser_error, error_tail, "");
   PUT_ERROR (Qwrong_type_argument, error_tail, "Wrong type argument");
   PUT_ERROR (Qargs_out_of_range, error_tail, "Args out of range");
+  PUT_ERROR (Qwrong_length_argument, error_tail, "Wrong length argument");
   PUT_ERROR (Qvoid_function, error_tail,
 	     "Symbol's function definition is void");
   PUT_ERROR (Qcyclic_function_indirection, error_tail,
@@ -3089,7 +3830,10 @@ syms_of_data (void)
   DEFSYM (Qvector, "vector");
   DEFSYM (Qchar_table, "char-table");
   DEFSYM (Qbool_vector, "bool-vector");
+  DEFSYM (Qnumeric_vector, "numeric-vector");
   DEFSYM (Qhash_table, "hash-table");
+  DEFSYM (Qstring_builder, "string-builder");
+  DEFSYM (Qcompletion_index, "completion-index");
   /* Used by Fgarbage_collect.  */
   DEFSYM (Qinterval, "interval");
   DEFSYM (Qmisc, "misc");
@@ -3125,6 +3869,7 @@ syms_of_data (void)
   defsubr (&Schar_table_p);
   defsubr (&Svector_or_char_table_p);
   defsubr (&Sbool_vector_p);
+  defsubr (&Snumeric_vector_p);
   defsubr (&Sarrayp);
   defsubr (&Ssequencep);
   defsubr (&Sbufferp);
@@ -3194,6 +3939,20 @@ syms_of_data (void)
   defsubr (&Ssub1);
   defsubr (&Slognot);
   defsubr (&Sbyteorder);
+  defsubr (&Sbool_vector_exclusive_or);
+  defsubr (&Sbool_vector_union);
+  defsubr (&Sbool_vector_intersection);
+  defsubr (&Sbool_vector_set_difference);
+  defsubr (&Sbool_vector_not);
+  defsubr (&Sbool_vector_subsetp);
+  defsubr (&Sbool_vector_count_population);
+  defsubr (&Sbool_vector_count_consecutive);
+  defsubr (&Snumeric_vector_type);
+  defsubr (&Snumeric_vector_add);
+  defsubr (&Snumeric_vector_subtract);
+  defsubr (&Snumeric_vector_multiply);
+  defsubr (&Snumeric_vector_scale);
+  defsubr (&Snumeric_vector_sum);
   defsubr (&Ssubr_arity);
   defsubr (&Ssubr_name);
 
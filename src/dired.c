@@ -31,6 +31,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 /* The d_nameln member of a struct dirent includes the '\0' character
    on some systems, but not on others.  What's worse, you can't tell
@@ -80,14 +81,38 @@ extern struct direct *readdir (DIR *);
 #include "regex.h"
 #include "blockinput.h"
 
+/* With fstatat, the entries of a directory can be looked up relative to
+   it, and in several threads at once.  */
+#if defined AT_SYMLINK_NOFOLLOW && defined HAVE_PTHREAD
+#define USE_STAT_THREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
 static Lisp_Object Qdirectory_files;
 static Lisp_Object Qdirectory_files_and_attributes;
+static Lisp_Object Qdirectory_files_recursively;
+static Lisp_Object QCkey, Qcar;
 static Lisp_Object Qfile_name_completion;
 static Lisp_Object Qfile_name_all_completions;
 static Lisp_Object Qfile_attributes;
 static Lisp_Object Qfile_attributes_lessp;
 
 static ptrdiff_t scmp (const char *, const char *, ptrdiff_t);
+static Lisp_Object file_attributes (struct stat *, Lisp_Object, Lisp_Object,
+				    int, struct stat *);
+
+/* The mask of all the attributes that `file-attributes' returns.  */
+#define ALL_FILE_ATTRIBUTES ((1 << 12) - 1)
+
+/* Names of recently seen user and group IDs.  Each element is nil or
+   (ID . NAME), where NAME is nil if ID has no name.  User IDs are in the
+   first half, group IDs in the second.  The cache is emptied when it
+   is older than ID_NAME_CACHE_SECONDS.  */
+static Lisp_Object id_name_cache;
+static time_t id_name_cache_time;
+#define ID_NAME_CACHE_SIZE 64
+#define ID_NAME_CACHE_SECONDS 60
 
 #ifdef WINDOWSNT
 Lisp_Object
@@ -108,10 +133,178 @@ directory_files_internal_unwind (Lisp_Object dh)
   return Qnil;
 }
 
+#ifdef AT_SYMLINK_NOFOLLOW
+
+/* The largest number of threads that look up directory entries.  */
+#define MAX_STAT_THREADS 64
+
+/* A share of the entries of a directory to look up.  */
+struct stat_job
+{
+  /* The directory, and the names of all its entries.  */
+  int fd;
+  char const **names;
+
+  /* Where to store the status of each entry, and whether it was
+     found.  */
+  struct stat *sts;
+  char *found;
+
+  /* The indices of the entries in this share.  */
+  ptrdiff_t start, end;
+};
+
+static void *
+stat_job_run (void *arg)
+{
+  struct stat_job *job = arg;
+  ptrdiff_t i;
+
+  for (i = job->start; i < job->end; i++)
+    job->found[i] = (fstatat (job->fd, job->names[i], &job->sts[i],
+			      AT_SYMLINK_NOFOLLOW)
+		     == 0);
+  return NULL;
+}
+
+/* Look up the N entries NAMES of the directory open as FD, storing the
+   status of each in STS and whether it exists in FOUND.  Use up to
+   `directory-files-and-attributes-threads' threads.  */
+
+static void
+stat_directory_entries (int fd, char const **names, struct stat *sts,
+			char *found, ptrdiff_t n)
+{
+  struct stat_job jobs[MAX_STAT_THREADS];
+  int i, njobs = 1;
+
+#ifdef USE_STAT_THREADS
+  /* Threads are not worth starting for a few entries.  */
+  if (directory_files_and_attributes_threads > 1 && n >= 64)
+    njobs = min (directory_files_and_attributes_threads, MAX_STAT_THREADS);
+#endif
+
+  for (i = 0; i < njobs; i++)
+    {
+      jobs[i].fd = fd;
+      jobs[i].names = names;
+      jobs[i].sts = sts;
+      jobs[i].found = found;
+      jobs[i].start = n * i / njobs;
+      jobs[i].end = n * (i + 1) / njobs;
+    }
+
+#ifdef USE_STAT_THREADS
+  if (njobs > 1)
+    {
+      pthread_t threads[MAX_STAT_THREADS];
+      int started;
+      sigset_t all, old;
+
+      /* Signals must be handled in the main thread.  */
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &old);
+      for (started = 1; started < njobs; started++)
+	if (pthread_create (&threads[started], NULL, stat_job_run,
+			    &jobs[started])
+	    != 0)
+	  break;
+      pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+      /* Do the shares of the threads that could not be started, too.  */
+      for (i = started; i < njobs; i++)
+	stat_job_run (&jobs[i]);
+      stat_job_run (&jobs[0]);
+      for (i = 1; i < started; i++)
+	pthread_join (threads[i], NULL);
+      return;
+    }
+#endif
+
+  stat_job_run (&jobs[0]);
+}
+
+#endif /* AT_SYMLINK_NOFOLLOW */
+
+/* Replace each element (FINALNAME NAME . RAW) of LIST with (FINALNAME
+   . ATTRIBUTES).  NAME is the decoded name of a file in DIRECTORY, RAW
+   is its name as read from D, the open directory, and ATTRIBUTES is
+   what `file-attributes' returns for it given ID_FORMAT, except that
+   only the attributes in the mask WANTED are filled in.  ENCODED is
+   the encoded name of DIRECTORY.  Return LIST.  */
+
+static Lisp_Object
+directory_entries_attributes (Lisp_Object list, DIR *d,
+			      Lisp_Object directory, Lisp_Object encoded,
+			      int wanted, Lisp_Object id_format)
+{
+  ptrdiff_t i, n = XFASTINT (Flength (list));
+  Lisp_Object tail, dirname = Qnil;
+  struct stat *sts;
+  char *found;
+  struct stat *psdir = NULL;
+#ifdef BSD4_2
+  struct stat sdir;
+#endif
+  struct gcpro gcpro1, gcpro2, gcpro3;
+  USE_SAFE_ALLOCA;
+
+  SAFE_NALLOCA (sts, 1, n);
+  SAFE_NALLOCA (found, 1, n);
+
+#ifdef AT_SYMLINK_NOFOLLOW
+  {
+    /* Look up all the entries first, relative to the directory, so
+       that only one path lookup is needed for each, and none of them
+       waits for Lisp to process the previous one.  */
+    char const **names;
+
+    SAFE_NALLOCA (names, 1, n);
+    for (i = 0, tail = list; i < n; i++, tail = XCDR (tail))
+      names[i] = SSDATA (XCDR (XCDR (XCAR (tail))));
+    stat_directory_entries (dirfd (d), names, sts, found, n);
+  }
+#endif
+
+#ifdef BSD4_2 /* file gid will be dir gid */
+  if (stat (SSDATA (encoded), &sdir) == 0)
+    psdir = &sdir;
+#endif
+
+  GCPRO3 (list, directory, dirname);
+  dirname = Ffile_name_as_directory (directory);
+  for (i = 0, tail = list; i < n; i++, tail = XCDR (tail))
+    {
+      Lisp_Object elt = XCAR (tail);
+      Lisp_Object fullname = concat2 (dirname, XCAR (XCDR (elt)));
+      Lisp_Object attributes;
+
+      if (!NILP (Ffind_file_name_handler (fullname, Qfile_attributes)))
+	attributes = Ffile_attributes (fullname, id_format);
+      else
+	{
+#ifndef AT_SYMLINK_NOFOLLOW
+	  found[i] = lstat (SSDATA (ENCODE_FILE (fullname)), &sts[i]) == 0;
+#endif
+	  attributes = (found[i]
+			? file_attributes (&sts[i], fullname, id_format,
+					   wanted, psdir)
+			: Qnil);
+	}
+      XSETCDR (elt, attributes);
+    }
+  UNGCPRO;
+
+  SAFE_FREE ();
+  return list;
+}
+
 /* Function shared by Fdirectory_files and Fdirectory_files_and_attributes.
    When ATTRS is zero, return a list of directory filenames; when
    non-zero, return a list of directory filenames and their attributes.
-   In the latter case, ID_FORMAT is passed to Ffile_attributes.  */
+   In the latter case, ATTRS is the mask of the attributes to fill in,
+   as in directory_entries_attributes, and ID_FORMAT is passed to
+   Ffile_attributes.  */
 
 Lisp_Object
 directory_files_internal (Lisp_Object directory, Lisp_Object full, Lisp_Object match, Lisp_Object nosort, int attrs, Lisp_Object id_format)
@@ -228,11 +421,11 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full, Lisp_Object m
 	{
 	  ptrdiff_t len;
 	  int wanted = 0;
-	  Lisp_Object name, finalname;
+	  Lisp_Object name, finalname, raw;
 	  struct gcpro gcpro1, gcpro2;
 
 	  len = NAMLEN (dp);
-	  name = finalname = make_unibyte_string (dp->d_name, len);
+	  raw = name = finalname = make_unibyte_string (dp->d_name, len);
 	  GCPRO2 (finalname, name);
 
 	  /* Note: DECODE_FILE can GC; it should protect its argument,
@@ -285,22 +478,9 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full, Lisp_Object m
 		finalname = name;
 
 	      if (attrs)
-		{
-		  /* Construct an expanded filename for the directory entry.
-		     Use the decoded names for input to Ffile_attributes.  */
-		  Lisp_Object decoded_fullname, fileattrs;
-		  struct gcpro gcpro1, gcpro2;
-
-		  decoded_fullname = fileattrs = Qnil;
-		  GCPRO2 (decoded_fullname, fileattrs);
-
-		  /* Both Fexpand_file_name and Ffile_attributes can GC.  */
-		  decoded_fullname = Fexpand_file_name (name, directory);
-		  fileattrs = Ffile_attributes (decoded_fullname, id_format);
-
-		  list = Fcons (Fcons (finalname, fileattrs), list);
-		  UNGCPRO;
-		}
+		/* The attributes are filled in once all the entries are
+		   read; see directory_entries_attributes.  */
+		list = Fcons (Fcons (finalname, Fcons (name, raw)), list);
 	      else
 		list = Fcons (finalname, list);
 	    }
@@ -309,6 +489,10 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full, Lisp_Object m
 	}
     }
 
+  if (attrs)
+    list = directory_entries_attributes (list, d, directory,
+					 dirfilename, attrs, id_format);
+
   BLOCK_INPUT;
   closedir (d);
   UNBLOCK_INPUT;
@@ -321,8 +505,12 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full, Lisp_Object m
   specpdl_ptr = specpdl + count;
 
   if (NILP (nosort))
-    list = Fsort (Fnreverse (list),
-		  attrs ? Qfile_attributes_lessp : Qstring_lessp);
+    {
+      Lisp_Object args[2];
+      args[0] = Fnreverse (list);
+      args[1] = attrs ? Qfile_attributes_lessp : Qstring_lessp;
+      list = Fsort (2, args);
+    }
 
   RETURN_UNGCPRO (list);
 }
@@ -353,7 +541,7 @@ If NOSORT is non-nil, the list is not sorted--its order is unpredictable.
 }
 
 DEFUN ("directory-files-and-attributes", Fdirectory_files_and_attributes,
-       Sdirectory_files_and_attributes, 1, 5, 0,
+       Sdirectory_files_and_attributes, 1, 6, 0,
        doc: /* Return a list of names of files and their attributes in DIRECTORY.
 There are four optional arguments:
 If FULL is non-nil, return absolute file names.  Otherwise return names
@@ -363,11 +551,25 @@ If NOSORT is non-nil, the list is not sorted--its order is unpredictable.
  NOSORT is useful if you plan to sort the result yourself.
 ID-FORMAT specifies the preferred format of attributes uid and gid, see
 `file-attributes' for further documentation.
+If ATTRIBUTES is non-nil, it is a list of the indices of the attributes
+ that are needed, and the others may be nil in the value, which saves
+ time.  For instance, '(5 7) asks for the modification time and size.
 On MS-Windows, performance depends on `w32-get-true-file-attributes',
 which see.  */)
-  (Lisp_Object directory, Lisp_Object full, Lisp_Object match, Lisp_Object nosort, Lisp_Object id_format)
+  (Lisp_Object directory, Lisp_Object full, Lisp_Object match, Lisp_Object nosort, Lisp_Object id_format, Lisp_Object attributes)
 {
-  Lisp_Object handler;
+  Lisp_Object handler, tail;
+  int wanted = NILP (attributes) ? ALL_FILE_ATTRIBUTES : 0;
+
+  for (tail = attributes; CONSP (tail); tail = XCDR (tail))
+    {
+      CHECK_NUMBER_CAR (tail);
+      if (! (0 <= XINT (XCAR (tail)) && XINT (XCAR (tail)) <= 11))
+	args_out_of_range (XCAR (tail), make_number (11));
+      wanted |= 1 << XINT (XCAR (tail));
+    }
+  CHECK_LIST_END (tail, attributes);
+
   directory = Fexpand_file_name (directory, Qnil);
 
   /* If the file name has special constructs in it,
@@ -377,7 +579,246 @@ which see.  */)
     return call6 (handler, Qdirectory_files_and_attributes,
                   directory, full, match, nosort, id_format);
 
-  return directory_files_internal (directory, full, match, nosort, 1, id_format);
+  return directory_files_internal (directory, full, match, nosort, wanted,
+				   id_format);
+}
+
+
+/* Kinds of directory entries, as seen by directory_files_recursively
+   and file name completion.  ENTRY_UNKNOWN is an entry that has to be
+   looked up each time it is used, such as a symbolic link.  */
+enum entry_kind { ENTRY_FILE, ENTRY_DIRECTORY, ENTRY_LINK_TO_DIRECTORY,
+		  ENTRY_UNKNOWN };
+
+/* Return the kind of the entry DP of the directory D, whose encoded
+   name followed by a slash is the DIRLEN bytes at DIR.  */
+
+static enum entry_kind
+directory_entry_kind (DIR *d, DIRENTRY *dp, const char *dir, ptrdiff_t dirlen)
+{
+  struct stat st;
+  int found;
+
+#ifdef DT_UNKNOWN
+  if (dp->d_type == DT_DIR)
+    return ENTRY_DIRECTORY;
+  if (dp->d_type != DT_LNK && dp->d_type != DT_UNKNOWN)
+    return ENTRY_FILE;
+#endif
+
+#ifdef AT_SYMLINK_NOFOLLOW
+  found = fstatat (dirfd (d), dp->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+  if (found && S_ISLNK (st.st_mode))
+    return (fstatat (dirfd (d), dp->d_name, &st, 0) == 0
+	    && S_ISDIR (st.st_mode)
+	    ? ENTRY_LINK_TO_DIRECTORY : ENTRY_FILE);
+#else
+  {
+    ptrdiff_t len = NAMLEN (dp);
+    char *fullname;
+    USE_SAFE_ALLOCA;
+
+    SAFE_ALLOCA (fullname, char *, dirlen + len + 1);
+    memcpy (fullname, dir, dirlen);
+    memcpy (fullname + dirlen, dp->d_name, len + 1);
+    found = lstat (fullname, &st) == 0;
+    if (found && S_ISLNK (st.st_mode))
+      {
+	found = stat (fullname, &st) == 0 && S_ISDIR (st.st_mode);
+	SAFE_FREE ();
+	return found ? ENTRY_LINK_TO_DIRECTORY : ENTRY_FILE;
+      }
+    SAFE_FREE ();
+  }
+#endif
+  return found && S_ISDIR (st.st_mode) ? ENTRY_DIRECTORY : ENTRY_FILE;
+}
+
+/* Return non-zero if REGEXP matches NAME, as `string-match' would.  */
+
+static int
+directory_entry_match (Lisp_Object regexp, Lisp_Object name)
+{
+  return 0 <= (NILP (BVAR (current_buffer, case_fold_search))
+	       ? fast_string_match (regexp, name)
+	       : fast_string_match_ignore_case (regexp, name));
+}
+
+/* Push onto *RESULT, in reverse order, the names of the files under
+   DIRECTORY, a directory name, that `directory-files-recursively'
+   returns for REGEXP, INCLUDE_DIRECTORIES, PREDICATE and
+   FOLLOW_SYMLINKS.  */
+
+static void
+directory_files_recursively (Lisp_Object directory, Lisp_Object regexp,
+			     int include_directories, Lisp_Object predicate,
+			     int follow_symlinks, Lisp_Object *result)
+{
+  Lisp_Object encoded, entries, files, tail;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5;
+  DIR *d;
+  DIRENTRY *dp;
+
+  QUIT;
+
+  entries = files = Qnil;
+  encoded = ENCODE_FILE (directory);
+  GCPRO5 (directory, regexp, encoded, entries, files);
+
+  BLOCK_INPUT;
+  d = opendir (SSDATA (encoded));
+  UNBLOCK_INPUT;
+  if (d == NULL)
+    {
+      if (EQ (predicate, Qt))
+	{
+	  UNGCPRO;
+	  return;
+	}
+      report_file_error ("Opening directory", Fcons (directory, Qnil));
+    }
+  record_unwind_protect (directory_files_internal_unwind,
+			 make_save_value (d, 0));
+
+  /* Read the whole directory first, so that it is not kept open while
+     the subdirectories are walked.  */
+  for (;;)
+    {
+      Lisp_Object name;
+      enum entry_kind kind;
+      ptrdiff_t len, i;
+
+      errno = 0;
+      dp = readdir (d);
+      if (dp == NULL)
+	{
+#ifdef EINTR
+	  if (errno == EINTR)
+	    {
+	      QUIT;
+	      continue;
+	    }
+#endif
+	  break;
+	}
+
+      len = NAMLEN (dp);
+      if (!DIRENTRY_NONEMPTY (dp)
+	  || (dp->d_name[0] == '.'
+	      && (len == 1 || (len == 2 && dp->d_name[1] == '.'))))
+	continue;
+
+      kind = directory_entry_kind (d, dp, SSDATA (encoded), SBYTES (encoded));
+      name = make_unibyte_string (dp->d_name, len);
+
+      /* Names in ASCII, the vast majority, need no decoding.  */
+      for (i = 0; i < len; i++)
+	if (!ASCII_BYTE_P (dp->d_name[i]))
+	  {
+	    name = DECODE_FILE (name);
+	    break;
+	  }
+
+      /* Directories sort as in `file-name-all-completions'.  */
+      if (kind != ENTRY_FILE)
+	name = concat2 (name, build_string ("/"));
+      entries = Fcons (Fcons (name, make_number (kind)), entries);
+    }
+  unbind_to (count, Qnil);
+
+  {
+    Lisp_Object args[4];
+    args[0] = entries;
+    args[1] = Qstring_lessp;
+    args[2] = QCkey;
+    args[3] = Qcar;
+    entries = Fsort (4, args);
+  }
+
+  for (tail = entries; CONSP (tail); tail = XCDR (tail))
+    {
+      Lisp_Object name = XCAR (XCAR (tail));
+      enum entry_kind kind = XFASTINT (XCDR (XCAR (tail)));
+
+      if (kind == ENTRY_FILE)
+	{
+	  if (directory_entry_match (regexp, name))
+	    files = Fcons (concat2 (directory, name), files);
+	}
+      else
+	{
+	  Lisp_Object leaf = Fsubstring (name, make_number (0),
+					 make_number (-1));
+	  Lisp_Object fullname = concat2 (directory, leaf);
+	  struct gcpro gcpro1, gcpro2;
+
+	  GCPRO2 (leaf, fullname);
+	  if ((kind == ENTRY_DIRECTORY || follow_symlinks)
+	      && (NILP (predicate) || EQ (predicate, Qt)
+		  || !NILP (call1 (predicate, fullname))))
+	    directory_files_recursively (concat2 (fullname,
+						  build_string ("/")),
+					 regexp, include_directories,
+					 predicate, follow_symlinks, result);
+	  if (include_directories && directory_entry_match (regexp, leaf))
+	    *result = Fcons (fullname, *result);
+	  UNGCPRO;
+	}
+    }
+
+  /* The files of a directory come after those of its subdirectories.  */
+  for (tail = Fnreverse (files); CONSP (tail); tail = XCDR (tail))
+    *result = Fcons (XCAR (tail), *result);
+
+  UNGCPRO;
+}
+
+DEFUN ("directory-files-recursively", Fdirectory_files_recursively,
+       Sdirectory_files_recursively, 2, 5, 0,
+       doc: /* Return a list of all the files under DIR whose names match REGEXP.
+This function works recursively.  The files of each directory come
+after those of its subdirectories, and the entries of each directory
+are sorted with `string<'.  File names are returned in absolute form.
+REGEXP is matched against the file names without their directories,
+as `string-match' would, respecting `case-fold-search'.
+
+If INCLUDE-DIRECTORIES is non-nil, also include the directories whose
+names match REGEXP, each after its contents.
+
+PREDICATE says which subdirectories to enter.  If it is nil, all of
+them are entered.  If it is t, all of them are entered, but those that
+cannot be read are ignored instead of signaling an error.  Otherwise
+it is called with the absolute name of each subdirectory, which is
+entered only if the value is non-nil.
+
+Symbolic links to directories are not entered unless FOLLOW-SYMLINKS
+is non-nil; beware that links may form loops.
+
+This is much faster than walking the tree with `directory-files' and
+`file-directory-p' in Lisp.  */)
+  (Lisp_Object dir, Lisp_Object regexp, Lisp_Object include_directories,
+   Lisp_Object predicate, Lisp_Object follow_symlinks)
+{
+  Lisp_Object handler, result = Qnil;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
+
+  CHECK_STRING (regexp);
+  dir = Fexpand_file_name (dir, Qnil);
+
+  /* If the file name has special constructs in it,
+     call the corresponding file handler.  */
+  handler = Ffind_file_name_handler (dir, Qdirectory_files_recursively);
+  if (!NILP (handler))
+    return call6 (handler, Qdirectory_files_recursively, dir, regexp,
+		  include_directories, predicate, follow_symlinks);
+
+  GCPRO4 (dir, regexp, predicate, result);
+  directory_files_recursively (Ffile_name_as_directory (dir), regexp,
+			       !NILP (include_directories), predicate,
+			       !NILP (follow_symlinks), &result);
+  UNGCPRO;
+  return Fnreverse (result);
 }
 
 
@@ -442,13 +883,147 @@ These are all file names in directory DIRECTORY which begin with FILE.  */)
   return file_name_completion (file, directory, 1, 0, Qnil);
 }
 
-static int file_name_completion_stat (Lisp_Object dirname, DIRENTRY *dp, struct stat *st_addr);
+static int file_name_completion_stat (Lisp_Object, const char *, ptrdiff_t,
+				      struct stat *);
 static Lisp_Object Qdefault_directory;
 
+/* The most directories whose listings are kept for completion.  */
+#define COMPLETION_CACHE_SIZE 100
+
+/* Return the kind of the entry DP of the directory D, for file name
+   completion.  If RESOLVE, look up entries whose kind readdir does not
+   tell, unless they are symbolic links; otherwise leave them for later.  */
+
+static enum entry_kind
+completion_entry_kind (DIR *d, DIRENTRY *dp, int resolve)
+{
+#ifdef DT_UNKNOWN
+  if (dp->d_type == DT_DIR)
+    return ENTRY_DIRECTORY;
+  if (dp->d_type != DT_LNK && dp->d_type != DT_UNKNOWN)
+    return ENTRY_FILE;
+  if (dp->d_type == DT_LNK)
+    return ENTRY_UNKNOWN;
+#endif
+#ifdef AT_SYMLINK_NOFOLLOW
+  if (resolve)
+    {
+      struct stat st;
+
+      if (fstatat (dirfd (d), dp->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+	  && !S_ISLNK (st.st_mode))
+	return S_ISDIR (st.st_mode) ? ENTRY_DIRECTORY : ENTRY_FILE;
+    }
+#endif
+  return ENTRY_UNKNOWN;
+}
+
+/* Read the directory whose encoded name is ENCODED for file name
+   completion, and return (NAMES . KINDS).  NAMES is a vector of the
+   encoded names of its entries, and KINDS a vector of their kinds.
+   RESOLVE is as for completion_entry_kind.  DIRNAME is the name to
+   report if the directory cannot be read.  */
+
 static Lisp_Object
-file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int ver_flag, Lisp_Object predicate)
+read_completion_directory (Lisp_Object dirname, Lisp_Object encoded,
+			   int resolve)
 {
+  Lisp_Object names = Qnil, kinds = Qnil;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct gcpro gcpro1, gcpro2;
   DIR *d;
+  DIRENTRY *dp;
+
+  BLOCK_INPUT;
+  d = opendir (SSDATA (encoded));
+  UNBLOCK_INPUT;
+  if (!d)
+    report_file_error ("Opening directory", Fcons (dirname, Qnil));
+
+  record_unwind_protect (directory_files_internal_unwind,
+			 make_save_value (d, 0));
+
+  GCPRO2 (names, kinds);
+  while (1)
+    {
+      errno = 0;
+      dp = readdir (d);
+      if (dp == NULL && (0
+# ifdef EAGAIN
+			 || errno == EAGAIN
+# endif
+# ifdef EINTR
+			 || errno == EINTR
+# endif
+			 ))
+	{ QUIT; continue; }
+
+      if (!dp) break;
+
+      QUIT;
+      if (! DIRENTRY_NONEMPTY (dp))
+	continue;
+      names = Fcons (make_unibyte_string (dp->d_name, NAMLEN (dp)), names);
+      kinds = Fcons (make_number (completion_entry_kind (d, dp, resolve)),
+		     kinds);
+    }
+  names = Fnreverse (names);
+  kinds = Fnreverse (kinds);
+  names = Fvconcat (1, &names);
+  kinds = Fvconcat (1, &kinds);
+  UNGCPRO;
+
+  /* This closes the directory.  */
+  unbind_to (count, Qnil);
+  return Fcons (names, kinds);
+}
+
+/* Return the listing of the directory whose encoded name is ENCODED,
+   as read_completion_directory does, from
+   `file-name-completion-cache' if it is up to date there.  */
+
+static Lisp_Object
+completion_directory_listing (Lisp_Object dirname, Lisp_Object encoded)
+{
+#ifndef DOS_NT
+  struct stat st;
+
+  if (HASH_TABLE_P (Vfile_name_completion_cache)
+      && stat (SSDATA (encoded), &st) == 0)
+    {
+      Lisp_Object table = Vfile_name_completion_cache;
+      Lisp_Object mtime = make_lisp_time (get_stat_mtime (&st));
+      Lisp_Object entry = Fgethash (encoded, table, Qnil);
+
+      if (CONSP (entry) && !NILP (Fequal (XCAR (entry), mtime)))
+	return XCDR (entry);
+
+      /* A file added within the clock resolution of the last change
+	 might not change the modification time, so do not keep the
+	 listing of a directory that changed lately.  */
+      if (st.st_mtime < time (NULL) - 2)
+	{
+	  Lisp_Object listing;
+	  struct gcpro gcpro1, gcpro2;
+
+	  GCPRO2 (table, mtime);
+	  listing = read_completion_directory (dirname, encoded, 1);
+	  UNGCPRO;
+	  if (XHASH_TABLE (table)->count >= COMPLETION_CACHE_SIZE)
+	    Fclrhash (table);
+	  Fputhash (encoded, Fcons (mtime, listing), table);
+	  return listing;
+	}
+      if (!NILP (entry))
+	Fremhash (encoded, table);
+    }
+#endif
+  return read_completion_directory (dirname, encoded, 0);
+}
+
+static Lisp_Object
+file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int ver_flag, Lisp_Object predicate)
+{
   ptrdiff_t bestmatchsize = 0;
   int matchcount = 0;
   /* If ALL_FLAG is 1, BESTMATCH is the list of all matches, decoded.
@@ -457,6 +1032,8 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
   Lisp_Object bestmatch, tem, elt, name;
   Lisp_Object encoded_file;
   Lisp_Object encoded_dir;
+  Lisp_Object listing, entry;
+  ptrdiff_t i;
   struct stat st;
   int directoryp;
   /* If includeall is zero, exclude files in completion-ignored-extensions as
@@ -464,15 +1041,15 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
      anything.  */
   int includeall = 1;
   ptrdiff_t count = SPECPDL_INDEX ();
-  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5, gcpro6;
 
   elt = Qnil;
 
   CHECK_STRING (file);
 
   bestmatch = Qnil;
-  encoded_file = encoded_dir = Qnil;
-  GCPRO5 (file, dirname, bestmatch, encoded_file, encoded_dir);
+  encoded_file = encoded_dir = listing = Qnil;
+  GCPRO6 (file, dirname, bestmatch, encoded_file, encoded_dir, listing);
   specbind (Qdefault_directory, dirname);
 
   /* Do completion on the encoded file name
@@ -485,50 +1062,35 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
 
   encoded_dir = ENCODE_FILE (dirname);
 
-  BLOCK_INPUT;
-  d = opendir (SSDATA (Fdirectory_file_name (encoded_dir)));
-  UNBLOCK_INPUT;
-  if (!d)
-    report_file_error ("Opening directory", Fcons (dirname, Qnil));
+  listing = completion_directory_listing
+    (dirname, Fdirectory_file_name (encoded_dir));
 
-  record_unwind_protect (directory_files_internal_unwind,
-			 make_save_value (d, 0));
-
-  /* Loop reading blocks */
-  /* (att3b compiler bug requires do a null comparison this way) */
-  while (1)
+  for (i = 0; i < ASIZE (XCAR (listing)); i++)
     {
-      DIRENTRY *dp;
       ptrdiff_t len;
       int canexclude = 0;
+      enum entry_kind kind;
 
-      errno = 0;
-      dp = readdir (d);
-      if (dp == NULL && (0
-# ifdef EAGAIN
-			 || errno == EAGAIN
-# endif
-# ifdef EINTR
-			 || errno == EINTR
-# endif
-			 ))
-	{ QUIT; continue; }
-
-      if (!dp) break;
-
-      len = NAMLEN (dp);
+      /* ENTRY is the encoded name of the file.  */
+      entry = AREF (XCAR (listing), i);
+      len = SBYTES (entry);
 
       QUIT;
-      if (! DIRENTRY_NONEMPTY (dp)
-	  || len < SCHARS (encoded_file)
-	  || 0 <= scmp (dp->d_name, SSDATA (encoded_file),
+      if (len < SCHARS (encoded_file)
+	  || 0 <= scmp (SSDATA (entry), SSDATA (encoded_file),
 			SCHARS (encoded_file)))
 	continue;
 
-      if (file_name_completion_stat (encoded_dir, dp, &st) < 0)
-	continue;
-
-      directoryp = S_ISDIR (st.st_mode);
+      kind = XFASTINT (AREF (XCDR (listing), i));
+      if (kind == ENTRY_UNKNOWN)
+	{
+	  if (file_name_completion_stat (encoded_dir, SSDATA (entry), len,
+					 &st) < 0)
+	    continue;
+	  directoryp = S_ISDIR (st.st_mode);
+	}
+      else
+	directoryp = kind == ENTRY_DIRECTORY;
       tem = Qnil;
       /* If all_flag is set, always include all.
 	 It would not actually be helpful to the user to ignore any possible
@@ -546,7 +1108,7 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
 	      && matchcount > 1
 	      && !includeall /* This match may allow includeall to 0.  */
 	      && len >= bestmatchsize
-	      && 0 > scmp (dp->d_name, SSDATA (bestmatch), bestmatchsize))
+	      && 0 > scmp (SSDATA (entry), SSDATA (bestmatch), bestmatchsize))
 	    continue;
 #endif
 
@@ -557,7 +1119,7 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
 #endif
 	      /* "." and ".." are never interesting as completions, and are
 		 actually in the way in a directory with only one file.  */
-	      if (TRIVIAL_DIRECTORY_ENTRY (dp->d_name))
+	      if (TRIVIAL_DIRECTORY_ENTRY (SSDATA (entry)))
 		canexclude = 1;
 	      else if (len > SCHARS (encoded_file))
 		/* Ignore directories if they match an element of
@@ -584,7 +1146,7 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
 		    if (skip < 0)
 		      continue;
 
-		    if (0 <= scmp (dp->d_name + skip, p1, elt_len))
+		    if (0 <= scmp (SSDATA (entry) + skip, p1, elt_len))
 		      continue;
 		    break;
 		  }
@@ -606,7 +1168,7 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
 		    skip = len - SCHARS (elt);
 		    if (skip < 0) continue;
 
-		    if (0 <= scmp (dp->d_name + skip,
+		    if (0 <= scmp (SSDATA (entry) + skip,
 				   SSDATA (elt),
 				   SCHARS (elt)))
 		      continue;
@@ -635,8 +1197,7 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
 	}
       /* FIXME: If we move this `decode' earlier we can eliminate
 	 the repeated ENCODE_FILE on Vcompletion_ignored_extensions.  */
-      name = make_unibyte_string (dp->d_name, len);
-      name = DECODE_FILE (name);
+      name = DECODE_FILE (entry);
 
       {
 	Lisp_Object regexps;
@@ -762,7 +1323,6 @@ file_name_completion (Lisp_Object file, Lisp_Object dirname, int all_flag, int v
     }
 
   UNGCPRO;
-  /* This closes the directory.  */
   bestmatch = unbind_to (count, bestmatch);
 
   if (all_flag || NILP (bestmatch))
@@ -805,9 +1365,9 @@ scmp (const char *s1, const char *s2, ptrdiff_t len)
 }
 
 static int
-file_name_completion_stat (Lisp_Object dirname, DIRENTRY *dp, struct stat *st_addr)
+file_name_completion_stat (Lisp_Object dirname, const char *name,
+			   ptrdiff_t len, struct stat *st_addr)
 {
-  ptrdiff_t len = NAMLEN (dp);
   ptrdiff_t pos = SCHARS (dirname);
   int value;
   char *fullname;
@@ -829,7 +1389,7 @@ file_name_completion_stat (Lisp_Object dirname, DIRENTRY *dp, struct stat *st_ad
   if (!IS_DIRECTORY_SEP (fullname[pos - 1]))
     fullname[pos++] = DIRECTORY_SEP;
 
-  memcpy (fullname + pos, dp->d_name, len);
+  memcpy (fullname + pos, name, len);
   fullname[pos + len] = 0;
 
   /* We want to return success if a link points to a nonexistent file,
@@ -919,21 +1479,14 @@ On some FAT-based filesystems, only the date of last access is recorded,
 so last access time will always be midnight of that day.  */)
   (Lisp_Object filename, Lisp_Object id_format)
 {
-  Lisp_Object values[12];
   Lisp_Object encoded;
   struct stat s;
+  struct stat *psdir = NULL;
 #ifdef BSD4_2
-  Lisp_Object dirname;
   struct stat sdir;
-#endif /* BSD4_2 */
-
-  /* An array to hold the mode string generated by filemodestring,
-     including its terminating space and null byte.  */
-  char modes[sizeof "-rwxr-xr-x "];
-
+#endif
   Lisp_Object handler;
   struct gcpro gcpro1;
-  char *uname = NULL, *gname = NULL;
 
   filename = Fexpand_file_name (filename, Qnil);
 
@@ -951,58 +1504,138 @@ so last access time will always be midnight of that day.  */)
 
   GCPRO1 (filename);
   encoded = ENCODE_FILE (filename);
-  UNGCPRO;
 
   if (lstat (SSDATA (encoded), &s) < 0)
-    return Qnil;
+    RETURN_UNGCPRO (Qnil);
 
-  values[0] = (S_ISLNK (s.st_mode) ? Ffile_symlink_p (filename)
-	       : S_ISDIR (s.st_mode) ? Qt : Qnil);
-  values[1] = make_number (s.st_nlink);
+#ifdef BSD4_2 /* file gid will be dir gid */
+  {
+    Lisp_Object dirname = Ffile_name_directory (filename);
+    if (! NILP (dirname)
+	&& stat (SSDATA (ENCODE_FILE (dirname)), &sdir) == 0)
+      psdir = &sdir;
+  }
+#endif /* BSD4_2 */
 
-  if (!(NILP (id_format) || EQ (id_format, Qinteger)))
+  UNGCPRO;
+  return file_attributes (&s, filename, id_format, ALL_FILE_ATTRIBUTES,
+			  psdir);
+}
+
+/* Return the name of the owner of the file whose status is S, or of its
+   group if GROUP is non-zero, or nil if it has none.  */
+
+static Lisp_Object
+stat_id_name (struct stat *s, int group)
+{
+  uintmax_t id = group ? s->st_gid : s->st_uid;
+  ptrdiff_t slot = (id % ID_NAME_CACHE_SIZE
+		    + (group ? ID_NAME_CACHE_SIZE : 0));
+  time_t now = time (NULL);
+  Lisp_Object entry, name;
+  char *cname;
+
+  /* Users and groups are seldom renamed, but they may be.  */
+  if (now < id_name_cache_time
+      || now - id_name_cache_time > ID_NAME_CACHE_SECONDS)
     {
-      BLOCK_INPUT;
-      uname = stat_uname (&s);
-      gname = stat_gname (&s);
-      UNBLOCK_INPUT;
+      Ffillarray (id_name_cache, Qnil);
+      id_name_cache_time = now;
     }
-  if (uname)
-    values[2] = DECODE_SYSTEM (build_string (uname));
-  else
-    values[2] = make_fixnum_or_float (s.st_uid);
-  if (gname)
-    values[3] = DECODE_SYSTEM (build_string (gname));
-  else
-    values[3] = make_fixnum_or_float (s.st_gid);
 
-  values[4] = make_lisp_time (get_stat_atime (&s));
-  values[5] = make_lisp_time (get_stat_mtime (&s));
-  values[6] = make_lisp_time (get_stat_ctime (&s));
+  entry = AREF (id_name_cache, slot);
+  if (CONSP (entry) && (uintmax_t) XFASTINT (XCAR (entry)) == id)
+    return XCDR (entry);
+
+  BLOCK_INPUT;
+  cname = group ? stat_gname (s) : stat_uname (s);
+  name = cname ? build_string (cname) : Qnil;
+  UNBLOCK_INPUT;
+  if (!NILP (name))
+    name = DECODE_SYSTEM (name);
+
+  if (id <= MOST_POSITIVE_FIXNUM)
+    ASET (id_name_cache, slot, Fcons (make_number (id), name));
+  return name;
+}
+
+/* Return the attributes, as `file-attributes' does given ID_FORMAT, of
+   the file FILENAME, whose status as returned by lstat is S.  Only the
+   attributes whose bits are set in the mask WANTED are filled in; the
+   others are nil.  SDIR is the status of the directory of the file, or
+   NULL if that is unknown.  */
+
+static Lisp_Object
+file_attributes (struct stat *s, Lisp_Object filename, Lisp_Object id_format,
+		 int wanted, struct stat *sdir)
+{
+  Lisp_Object values[12];
+  int i;
+
+  /* An array to hold the mode string generated by filemodestring,
+     including its terminating space and null byte.  */
+  char modes[sizeof "-rwxr-xr-x "];
+
+  for (i = 0; i < 12; i++)
+    values[i] = Qnil;
+
+  if (wanted & (1 << 0))
+    values[0] = (S_ISLNK (s->st_mode) ? Ffile_symlink_p (filename)
+		 : S_ISDIR (s->st_mode) ? Qt : Qnil);
+  if (wanted & (1 << 1))
+    values[1] = make_number (s->st_nlink);
+
+  if (wanted & (1 << 2))
+    {
+      if (!(NILP (id_format) || EQ (id_format, Qinteger)))
+	values[2] = stat_id_name (s, 0);
+      if (NILP (values[2]))
+	values[2] = make_fixnum_or_float (s->st_uid);
+    }
+  if (wanted & (1 << 3))
+    {
+      if (!(NILP (id_format) || EQ (id_format, Qinteger)))
+	values[3] = stat_id_name (s, 1);
+      if (NILP (values[3]))
+	values[3] = make_fixnum_or_float (s->st_gid);
+    }
+
+  if (wanted & (1 << 4))
+    values[4] = make_lisp_time (get_stat_atime (s));
+  if (wanted & (1 << 5))
+    values[5] = make_lisp_time (get_stat_mtime (s));
+  if (wanted & (1 << 6))
+    values[6] = make_lisp_time (get_stat_ctime (s));
 
   /* If the file size is a 4-byte type, assume that files of sizes in
      the 2-4 GiB range wrap around to negative values, as this is a
      common bug on older 32-bit platforms.  */
-  if (sizeof (s.st_size) == 4)
-    values[7] = make_fixnum_or_float (s.st_size & 0xffffffffu);
-  else
-    values[7] = make_fixnum_or_float (s.st_size);
+  if (wanted & (1 << 7))
+    {
+      if (sizeof (s->st_size) == 4)
+	values[7] = make_fixnum_or_float (s->st_size & 0xffffffffu);
+      else
+	values[7] = make_fixnum_or_float (s->st_size);
+    }
 
-  filemodestring (&s, modes);
-  values[8] = make_string (modes, 10);
+  if (wanted & (1 << 8))
+    {
+      filemodestring (s, modes);
+      values[8] = make_string (modes, 10);
+    }
+  if (wanted & (1 << 9))
+    {
 #ifdef BSD4_2 /* file gid will be dir gid */
-  dirname = Ffile_name_directory (filename);
-  if (! NILP (dirname))
-    encoded = ENCODE_FILE (dirname);
-  if (! NILP (dirname) && stat (SDATA (encoded), &sdir) == 0)
-    values[9] = (sdir.st_gid != s.st_gid) ? Qt : Qnil;
-  else					/* if we can't tell, assume worst */
-    values[9] = Qt;
+      /* If we can't tell, assume the worst.  */
+      values[9] = (!sdir || sdir->st_gid != s->st_gid) ? Qt : Qnil;
 #else					/* file gid will be egid */
-  values[9] = (s.st_gid != getegid ()) ? Qt : Qnil;
+      values[9] = (s->st_gid != getegid ()) ? Qt : Qnil;
 #endif	/* not BSD4_2 */
-  values[10] = INTEGER_TO_CONS (s.st_ino);
-  values[11] = INTEGER_TO_CONS (s.st_dev);
+    }
+  if (wanted & (1 << 10))
+    values[10] = INTEGER_TO_CONS (s->st_ino);
+  if (wanted & (1 << 11))
+    values[11] = INTEGER_TO_CONS (s->st_dev);
 
   return Flist (sizeof (values) / sizeof (values[0]), values);
 }
@@ -1059,6 +1692,9 @@ syms_of_dired (void)
 {
   DEFSYM (Qdirectory_files, "directory-files");
   DEFSYM (Qdirectory_files_and_attributes, "directory-files-and-attributes");
+  DEFSYM (Qdirectory_files_recursively, "directory-files-recursively");
+  DEFSYM (QCkey, ":key");
+  DEFSYM (Qcar, "car");
   DEFSYM (Qfile_name_completion, "file-name-completion");
   DEFSYM (Qfile_name_all_completions, "file-name-all-completions");
   DEFSYM (Qfile_attributes, "file-attributes");
@@ -1067,6 +1703,7 @@ syms_of_dired (void)
 
   defsubr (&Sdirectory_files);
   defsubr (&Sdirectory_files_and_attributes);
+  defsubr (&Sdirectory_files_recursively);
   defsubr (&Sfile_name_completion);
   defsubr (&Sfile_name_all_completions);
   defsubr (&Sfile_attributes);
@@ -1081,4 +1718,34 @@ these strings or when displaying a list of completions.
 It ignores directory names if they match any string in this list which
 ends in a slash.  */);
   Vcompletion_ignored_extensions = Qnil;
+
+  DEFVAR_INT ("directory-files-and-attributes-threads",
+	      directory_files_and_attributes_threads,
+	      doc: /* Number of threads that look up the files in a directory.
+`directory-files-and-attributes' looks up the files of large directories
+this many at a time.  This pays off on network file systems, where each
+lookup waits for the server.  Where threads are not supported, files
+are looked up one at a time.  */);
+  directory_files_and_attributes_threads = 1;
+
+  DEFVAR_LISP ("file-name-completion-cache", Vfile_name_completion_cache,
+	       doc: /* Directory listings used by file name completion.
+This is a hash table from encoded directory names to entries of the
+form (MTIME . LISTING), where LISTING records the files in the
+directory and which of them are subdirectories, as of when the
+directory's modification time was MTIME.  `file-name-completion' and
+`file-name-all-completions' use the listing of a directory until its
+modification time changes, instead of reading the directory anew each
+time.  The listings of at most 100 directories are kept.
+
+If the value is nil, directories are read every time.  */);
+  {
+    Lisp_Object args[2];
+    args[0] = QCtest;
+    args[1] = Qequal;
+    Vfile_name_completion_cache = Fmake_hash_table (2, args);
+  }
+
+  id_name_cache = Fmake_vector (make_number (2 * ID_NAME_CACHE_SIZE), Qnil);
+  staticpro (&id_name_cache);
 }
@@ -2765,6 +2765,8 @@ struct image_type
 };
 
 
+struct image_decode_job;
+
 /* Structure describing an image.  Specific image formats like XBM are
    converted into this form, so that display only has to deal with
    this type of image.  */
@@ -2858,6 +2860,19 @@ struct image
 
   /* Hash collision chain.  */
   struct image *next, *prev;
+
+  /* Neighbors in the least-recently-used list of the image cache.
+     LRU_PREV is the image used more recently, LRU_NEXT the one used
+     less recently.  */
+  struct image *lru_next, *lru_prev;
+
+  /* Number of bytes the decoded pixmap and mask of this image take,
+     as last accounted for in the image cache.  */
+  ptrdiff_t size;
+
+  /* If non-null, the image is being decoded in a worker thread, and
+     is displayed as an empty rectangle until that is done.  */
+  struct image_decode_job *decode_job;
 };
 
 
@@ -2880,6 +2895,15 @@ struct image_cache
 
   /* Reference count (number of frames sharing this cache).  */
   ptrdiff_t refcount;
+
+  /* Most and least recently used images in the cache.  */
+  struct image *lru_first, *lru_last;
+
+  /* Total number of bytes taken by the decoded images in the cache.  */
+  ptrdiff_t memory;
+
+  /* Statistics reported by `image-cache-statistics'.  */
+  EMACS_INT hits, misses, evictions;
 };
 
 
@@ -3161,10 +3185,13 @@ extern void x_destroy_all_bitmaps (Display_Info *);
 extern int x_create_bitmap_mask (struct frame *, ptrdiff_t);
 extern Lisp_Object x_find_image_file (Lisp_Object);
 
+extern int image_cache_cleanup_pending;
+
 void x_kill_gs_process (Pixmap, struct frame *);
 struct image_cache *make_image_cache (void);
 void free_image_cache (struct frame *);
 void clear_image_caches (Lisp_Object);
+void clear_image_caches_when_idle (void);
 void mark_image_cache (struct image_cache *);
 int valid_image_p (Lisp_Object);
 void prepare_image_for_display (struct frame *, struct image *);
@@ -240,6 +240,59 @@ Lisp_Object Qwrite_region;
 static Lisp_Object Qverify_visited_file_modtime;
 static Lisp_Object Qset_visited_file_modtime;
 
+/* The value of `file-name-handler-alist' for which the two vectors
+   below were made.  For each element of the alist, they hold its
+   regexp and what regexp_necessary_substrings returned for it, so
+   that most file names are rejected without running the matcher.  */
+static Lisp_Object handler_cache_alist;
+static Lisp_Object handler_cache_regexps, handler_cache_requirements;
+
+/* Return the requirements on a file name matched by REGEXP, the car of
+   element N of `file-name-handler-alist', or nil if there are none.  */
+
+static Lisp_Object
+file_name_handler_requirements (Lisp_Object regexp, ptrdiff_t n)
+{
+  if (!EQ (handler_cache_alist, Vfile_name_handler_alist))
+    {
+      /* The variable was set.  Keep what is known about the regexps
+	 that are still in it.  */
+      Lisp_Object old_regexps = handler_cache_regexps;
+      Lisp_Object old_requirements = handler_cache_requirements;
+      Lisp_Object tail;
+      ptrdiff_t len = XFASTINT (Fsafe_length (Vfile_name_handler_alist));
+      ptrdiff_t i, j;
+
+      handler_cache_alist = Vfile_name_handler_alist;
+      handler_cache_regexps = Fmake_vector (make_number (len), Qnil);
+      handler_cache_requirements = Fmake_vector (make_number (len), Qnil);
+      for (i = 0, tail = Vfile_name_handler_alist; i < len;
+	   i++, tail = XCDR (tail))
+	if (CONSP (XCAR (tail)) && STRINGP (XCAR (XCAR (tail))))
+	  for (j = 0; j < ASIZE (old_regexps); j++)
+	    if (EQ (AREF (old_regexps, j), XCAR (XCAR (tail))))
+	      {
+		ASET (handler_cache_regexps, i, AREF (old_regexps, j));
+		ASET (handler_cache_requirements, i,
+		      AREF (old_requirements, j));
+		break;
+	      }
+    }
+
+  /* The alist may have been extended or changed in place.  */
+  if (n >= ASIZE (handler_cache_regexps))
+    return Qnil;
+  if (!EQ (AREF (handler_cache_regexps, n), regexp))
+    {
+      /* Record the regexp only once it is known to be valid, so that
+	 an invalid one signals an error each time, as it used to.  */
+      Lisp_Object requirements = regexp_necessary_substrings (regexp);
+      ASET (handler_cache_regexps, n, regexp);
+      ASET (handler_cache_requirements, n, requirements);
+    }
+  return AREF (handler_cache_requirements, n);
+}
+
 DEFUN ("find-file-name-handler", Ffind_file_name_handler,
        Sfind_file_name_handler, 2, 2, 0,
        doc: /* Return FILENAME's handler function for OPERATION, if it has one.
@@ -256,6 +309,7 @@ use the standard functions without calling themselves recursively.  */)
   /* This function must not munge the match data.  */
   Lisp_Object chain, inhibited_handlers, result;
   ptrdiff_t pos = -1;
+  ptrdiff_t n;
 
   result = Qnil;
   CHECK_STRING (filename);
@@ -265,8 +319,8 @@ use the standard functions without calling themselves recursively.  */)
   else
     inhibited_handlers = Qnil;
 
-  for (chain = Vfile_name_handler_alist; CONSP (chain);
-       chain = XCDR (chain))
+  for (chain = Vfile_name_handler_alist, n = 0; CONSP (chain);
+       chain = XCDR (chain), n++)
     {
       Lisp_Object elt;
       elt = XCAR (chain);
@@ -277,18 +331,18 @@ use the standard functions without calling themselves recursively.  */)
 	  Lisp_Object handler = XCDR (elt);
 	  Lisp_Object operations = Qnil;
 
-	  if (SYMBOLP (handler))
-	    operations = Fget (handler, Qoperations);
-
+	  /* Most file names lack the strings that the regexps need, so
+	     check for those before running the matcher.  */
 	  if (STRINGP (string)
-	      && (match_pos = fast_string_match (string, filename)) > pos
-	      && (NILP (operations) || ! NILP (Fmemq (operation, operations))))
+	      && string_has_necessary_substrings
+		   (filename, file_name_handler_requirements (string, n))
+	      && (match_pos = fast_string_match (string, filename)) > pos)
 	    {
-	      Lisp_Object tem;
+	      if (SYMBOLP (handler))
+		operations = Fget (handler, Qoperations);
 
-	      handler = XCDR (elt);
-	      tem = Fmemq (handler, inhibited_handlers);
-	      if (NILP (tem))
+	      if ((NILP (operations) || ! NILP (Fmemq (operation, operations)))
+		  && NILP (Fmemq (handler, inhibited_handlers)))
 		{
 		  result = handler;
 		  pos = match_pos;
@@ -5670,6 +5724,12 @@ nothing special to do for a primitive, it should reinvoke the
 primitive to handle the operation \"the usual way\".
 See Info node `(elisp)Magic File Names' for more details.  */);
   Vfile_name_handler_alist = Qnil;
+  handler_cache_alist = Qnil;
+  staticpro (&handler_cache_alist);
+  handler_cache_regexps = Fmake_vector (make_number (0), Qnil);
+  handler_cache_requirements = handler_cache_regexps;
+  staticpro (&handler_cache_regexps);
+  staticpro (&handler_cache_requirements);
 
   DEFVAR_LISP ("set-auto-coding-function",
 	       Vset_auto_coding_function,
@@ -19,6 +19,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <config.h>
 
+#include <stdio.h>
 #include <unistd.h>
 #include <time.h>
 #include <setjmp.h>
@@ -43,6 +44,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #endif /* HAVE_MENUS */
 
 Lisp_Object Qstring_lessp;
+static Lisp_Object QCkey;
 static Lisp_Object Qprovide, Qrequire;
 static Lisp_Object Qyes_or_no_p_history;
 Lisp_Object Qcursor_in_echo_area;
@@ -51,7 +53,7 @@ static Lisp_Object Qcodeset, Qdays, Qmonths, Qpaper;
 
 static Lisp_Object Qmd5, Qsha1, Qsha224, Qsha256, Qsha384, Qsha512;
 
-static int internal_equal (Lisp_Object , Lisp_Object, int, int);
+static int internal_equal (Lisp_Object, Lisp_Object, int);
 
 #ifndef HAVE_UNISTD_H
 extern long time ();
@@ -126,6 +128,8 @@ To get the number of bytes, use `string-bytes'.  */)
     XSETFASTINT (val, MAX_CHAR);
   else if (BOOL_VECTOR_P (sequence))
     XSETFASTINT (val, XBOOL_VECTOR (sequence)->size);
+  else if (NUMERIC_VECTOR_P (sequence))
+    XSETFASTINT (val, XNUMERIC_VECTOR (sequence)->size);
   else if (COMPILEDP (sequence))
     XSETFASTINT (val, ASIZE (sequence) & PSEUDOVECTOR_SIZE_MASK);
   else if (CONSP (sequence))
@@ -428,7 +432,7 @@ usage: (vconcat &rest SEQUENCES)   */)
 
 
 DEFUN ("copy-sequence", Fcopy_sequence, Scopy_sequence, 1, 1, 0,
-       doc: /* Return a copy of a list, vector, string or char-table.
+       doc: /* Return a copy of a list, vector, string, char-table or numeric vector.
 The elements of a list or vector are not copied; they are shared
 with the original.  */)
   (Lisp_Object arg)
@@ -453,6 +457,16 @@ with the original.  */)
       return val;
     }
 
+  if (NUMERIC_VECTOR_P (arg))
+    {
+      struct Lisp_Numeric_Vector *v = XNUMERIC_VECTOR (arg);
+      Lisp_Object val = make_numeric_vector (v->type, v->size);
+
+      memcpy (&XNUMERIC_VECTOR (val)->data, &v->data,
+	      v->size * NUMERIC_VECTOR_ELT_SIZE (v->type));
+      return val;
+    }
+
   if (!CONSP (arg) && !VECTORP (arg) && !STRINGP (arg))
     wrong_type_argument (Qsequencep, arg);
 
@@ -509,7 +523,8 @@ concat (ptrdiff_t nargs, Lisp_Object *args,
     {
       this = args[argnum];
       if (!(CONSP (this) || NILP (this) || VECTORP (this) || STRINGP (this)
-	    || COMPILEDP (this) || BOOL_VECTOR_P (this)))
+	    || COMPILEDP (this) || BOOL_VECTOR_P (this)
+	    || NUMERIC_VECTOR_P (this)))
 	wrong_type_argument (Qsequencep, this);
     }
 
@@ -549,6 +564,19 @@ concat (ptrdiff_t nargs, Lisp_Object *args,
 	      }
 	  else if (BOOL_VECTOR_P (this) && XBOOL_VECTOR (this)->size > 0)
 	    wrong_type_argument (Qintegerp, Faref (this, make_number (0)));
+	  else if (NUMERIC_VECTOR_P (this))
+	    for (i = 0; i < len; i++)
+	      {
+		ch = numeric_vector_ref (XNUMERIC_VECTOR (this), i);
+		CHECK_CHARACTER (ch);
+		c = XFASTINT (ch);
+		this_len_byte = CHAR_BYTES (c);
+		if (STRING_BYTES_BOUND - result_len_byte < this_len_byte)
+		  string_overflow ();
+		result_len_byte += this_len_byte;
+		if (! ASCII_CHAR_P (c) && ! CHAR_BYTE8_P (c))
+		  some_multibyte = 1;
+	      }
 	  else if (CONSP (this))
 	    for (; CONSP (this); this = XCDR (this))
 	      {
@@ -689,6 +717,11 @@ concat (ptrdiff_t nargs, Lisp_Object *args,
 		  elt = Qnil;
 		thisindex++;
 	      }
+	    else if (NUMERIC_VECTOR_P (this))
+	      {
+		elt = numeric_vector_ref (XNUMERIC_VECTOR (this), thisindex);
+		thisindex++;
+	      }
 	    else
 	      {
 		elt = AREF (this, thisindex);
@@ -1110,6 +1143,194 @@ an error is signaled.  */)
   return string;
 }
 
+
+/* String builders.  */
+
+static Lisp_Object Qstring_builder_p;
+
+/* Make room for NBYTES more bytes of text in string builder SB.  */
+
+static void
+string_builder_reserve (struct Lisp_String_Builder *sb, ptrdiff_t nbytes)
+{
+  if (sb->size - sb->nbytes < nbytes)
+    sb->data = xpalloc (sb->data, &sb->size,
+			nbytes - (sb->size - sb->nbytes),
+			STRING_BYTES_BOUND, 1);
+}
+
+/* Convert the text of string builder SB to multibyte, in place.  */
+
+static void
+string_builder_make_multibyte (struct Lisp_String_Builder *sb)
+{
+  if (sb->nbytes > 0)
+    {
+      ptrdiff_t nbytes = count_size_as_multibyte (sb->data, sb->nbytes);
+
+      string_builder_reserve (sb, nbytes - sb->nbytes);
+      sb->nbytes = str_to_multibyte (sb->data, sb->size, sb->nbytes);
+    }
+  sb->multibyte = 1;
+}
+
+DEFUN ("make-string-builder", Fmake_string_builder, Smake_string_builder,
+       0, 1, 0,
+       doc: /* Return a new, empty string builder.
+A string builder accumulates text appended with
+`string-builder-append-string', `string-builder-append-char' and
+`string-builder-append-number', and `string-builder-finish' returns
+the text as a string.  Unlike repeated calls to `concat', this takes
+time proportional to the length of the result, and unlike building the
+string in a temporary buffer, it needs no buffer.
+Optional argument SIZE is the number of bytes to reserve for the text;
+the builder grows as needed regardless.  */)
+  (Lisp_Object size)
+{
+  struct Lisp_String_Builder *sb;
+  Lisp_Object builder;
+
+  if (!NILP (size))
+    CHECK_NATNUM (size);
+  sb = ((struct Lisp_String_Builder *)
+	allocate_pseudovector (VECSIZE (struct Lisp_String_Builder), 0,
+			       PVEC_STRING_BUILDER));
+  sb->data = NULL;
+  sb->size = sb->nbytes = sb->nchars = 0;
+  sb->multibyte = 0;
+  if (!NILP (size))
+    string_builder_reserve (sb, min (XFASTINT (size), STRING_BYTES_BOUND));
+  XSETPSEUDOVECTOR (builder, sb, PVEC_STRING_BUILDER);
+  return builder;
+}
+
+DEFUN ("string-builder-p", Fstring_builder_p, Sstring_builder_p, 1, 1, 0,
+       doc: /* Return t if OBJECT is a string builder.  */)
+  (Lisp_Object object)
+{
+  return STRING_BUILDER_P (object) ? Qt : Qnil;
+}
+
+DEFUN ("string-builder-append-string", Fstring_builder_append_string,
+       Sstring_builder_append_string, 2, 2, 0,
+       doc: /* Append the text of STRING to string builder BUILDER.
+Text properties of STRING are ignored.  Value is BUILDER.  */)
+  (Lisp_Object builder, Lisp_Object string)
+{
+  struct Lisp_String_Builder *sb;
+
+  CHECK_STRING_BUILDER (builder);
+  CHECK_STRING (string);
+  sb = XSTRING_BUILDER (builder);
+
+  if (STRING_MULTIBYTE (string) && !sb->multibyte)
+    string_builder_make_multibyte (sb);
+
+  if (sb->multibyte && !STRING_MULTIBYTE (string))
+    {
+      /* Convert the raw bytes of STRING to eight-bit characters.  */
+      ptrdiff_t nbytes = count_size_as_multibyte (SDATA (string),
+						  SBYTES (string));
+
+      string_builder_reserve (sb, nbytes);
+      sb->nbytes += copy_text (SDATA (string), sb->data + sb->nbytes,
+			       SBYTES (string), 0, 1);
+    }
+  else
+    {
+      string_builder_reserve (sb, SBYTES (string));
+      memcpy (sb->data + sb->nbytes, SDATA (string), SBYTES (string));
+      sb->nbytes += SBYTES (string);
+    }
+  sb->nchars += SCHARS (string);
+  return builder;
+}
+
+DEFUN ("string-builder-append-char", Fstring_builder_append_char,
+       Sstring_builder_append_char, 2, 2, 0,
+       doc: /* Append CHARACTER to string builder BUILDER.
+Value is BUILDER.  */)
+  (Lisp_Object builder, Lisp_Object character)
+{
+  struct Lisp_String_Builder *sb;
+  int c;
+
+  CHECK_STRING_BUILDER (builder);
+  CHECK_CHARACTER (character);
+  sb = XSTRING_BUILDER (builder);
+  c = XFASTINT (character);
+
+  /* Like `concat', keep the text unibyte for eight-bit characters.  */
+  if (!ASCII_CHAR_P (c) && !CHAR_BYTE8_P (c) && !sb->multibyte)
+    string_builder_make_multibyte (sb);
+  string_builder_reserve (sb, MAX_MULTIBYTE_LENGTH);
+  if (ASCII_CHAR_P (c))
+    sb->data[sb->nbytes++] = c;
+  else if (!sb->multibyte)
+    sb->data[sb->nbytes++] = CHAR_TO_BYTE8 (c);
+  else
+    sb->nbytes += CHAR_STRING (c, sb->data + sb->nbytes);
+  sb->nchars++;
+  return builder;
+}
+
+DEFUN ("string-builder-append-number", Fstring_builder_append_number,
+       Sstring_builder_append_number, 2, 2, 0,
+       doc: /* Append the decimal representation of NUMBER to string builder BUILDER.
+The text appended is what `number-to-string' would return.
+Value is BUILDER.  */)
+  (Lisp_Object builder, Lisp_Object number)
+{
+  struct Lisp_String_Builder *sb;
+  char buffer[max (FLOAT_TO_STRING_BUFSIZE, INT_BUFSIZE_BOUND (EMACS_INT))];
+  int len;
+
+  CHECK_STRING_BUILDER (builder);
+  CHECK_NUMBER_OR_FLOAT (number);
+  sb = XSTRING_BUILDER (builder);
+
+  if (FLOATP (number))
+    len = float_to_string (buffer, XFLOAT_DATA (number));
+  else
+    len = sprintf (buffer, "%"pI"d", XINT (number));
+
+  /* The representation is ASCII, so it needs no conversion.  */
+  string_builder_reserve (sb, len);
+  memcpy (sb->data + sb->nbytes, buffer, len);
+  sb->nbytes += len;
+  sb->nchars += len;
+  return builder;
+}
+
+DEFUN ("string-builder-length", Fstring_builder_length,
+       Sstring_builder_length, 1, 1, 0,
+       doc: /* Return the number of characters in string builder BUILDER.  */)
+  (Lisp_Object builder)
+{
+  CHECK_STRING_BUILDER (builder);
+  return make_number (XSTRING_BUILDER (builder)->nchars);
+}
+
+DEFUN ("string-builder-finish", Fstring_builder_finish,
+       Sstring_builder_finish, 1, 1, 0,
+       doc: /* Return the text accumulated in string builder BUILDER.
+The string is multibyte if a multibyte string or a non-ASCII character
+was appended, and unibyte otherwise.  BUILDER is left empty, but keeps
+its storage, so it can be reused to build another string.  */)
+  (Lisp_Object builder)
+{
+  struct Lisp_String_Builder *sb;
+  Lisp_Object string;
+
+  CHECK_STRING_BUILDER (builder);
+  sb = XSTRING_BUILDER (builder);
+  string = make_specified_string ((char *) sb->data, sb->nchars, sb->nbytes,
+				  sb->multibyte);
+  sb->nbytes = sb->nchars = 0;
+  sb->multibyte = 0;
+  return string;
+}
+
 
 DEFUN ("copy-alist", Fcopy_alist, Scopy_alist, 1, 1, 0,
        doc: /* Return a copy of ALIST.
@@ -1375,7 +1596,7 @@ The value is actually the tail of LIST whose car is ELT.  */)
       register Lisp_Object tem;
       CHECK_LIST_CONS (tail, list);
       tem = XCAR (tail);
-      if (FLOATP (tem) && internal_equal (elt, tem, 0, 0))
+      if (FLOATP (tem) && internal_equal (elt, tem, 0))
 	return tail;
       QUIT;
     }
@@ -1738,34 +1959,493 @@ See also the function `nreverse', which is used more often.  */)
 
 Lisp_Object merge (Lisp_Object org_l1, Lisp_Object org_l2, Lisp_Object pred);
 
-DEFUN ("sort", Fsort, Ssort, 2, 2, 0,
-       doc: /* Sort LIST, stably, comparing elements using PREDICATE.
-Returns the sorted list.  LIST is modified by side effects.
-PREDICATE is called with two elements of LIST, and should return non-nil
-if the first element should sort before the second.  */)
-  (Lisp_Object list, Lisp_Object predicate)
+/* Sorting.
+
+   Lists and vectors are sorted with a merge sort along the lines of
+   timsort: the sequence is split into runs that are already in order,
+   short runs are extended with a binary insertion sort, and runs are
+   merged with the help of a stack whose invariants keep the merges
+   balanced.  Inputs that are already partly sorted therefore need
+   far fewer comparisons than N log N.
+
+   The sort works on two parallel arrays: KEYS, which are compared,
+   and VALUES, which are moved along with them.  When sorting a vector
+   without a key function, both are the contents of the vector.  When
+   sorting a list, VALUES are its cons cells, which are linked together
+   again afterwards, so that the cars of the conses do not change.
+   Either way, SEQ is changed only once sorting is done, so that it is
+   left alone if PREDICATE or the key function exits nonlocally.  */
+
+/* Runs shorter than this are extended by binary insertion.  */
+
+enum { SORT_MIN_MERGE = 32 };
+
+/* The predicates that are compared without calling Ffuncall.  */
+
+enum sort_predicate
 {
-  Lisp_Object front, back;
-  register Lisp_Object len, tem;
-  struct gcpro gcpro1, gcpro2;
-  EMACS_INT length;
-
-  front = list;
-  len = Flength (list);
-  length = XINT (len);
-  if (length < 2)
-    return list;
-
-  XSETINT (len, (length / 2) - 1);
-  tem = Fnthcdr (len, list);
-  back = Fcdr (tem);
-  Fsetcdr (tem, Qnil);
-
-  GCPRO2 (front, back);
-  front = Fsort (front, predicate);
-  back = Fsort (back, predicate);
+  SORT_FUNCALL,
+  SORT_LESS,
+  SORT_GREATER,
+  SORT_STRING_LESS,
+  SORT_CAR_LESS
+};
+
+/* A run of LENGTH elements starting at BASE.  */
+
+struct sort_run
+{
+  ptrdiff_t base, length;
+};
+
+struct sort_state
+{
+  /* The predicate and how to call it.  */
+  Lisp_Object predicate;
+  enum sort_predicate fast;
+
+  /* The keys and values being sorted.  VALUES is the same as KEYS if
+     they are the same objects.  */
+  Lisp_Object *keys, *values;
+
+  /* Temporary space for merging, with room for half the elements.  */
+  Lisp_Object *tmp_keys, *tmp_values;
+
+  /* The vectors that hold the arrays above.  The stack is scanned for
+     pointers to the start of a vector only, so the pointers into their
+     contents would not keep them alive while the predicate runs.  */
+  Lisp_Object key_vector, value_vector, tmp_vector;
+
+  /* The stack of pending runs.  It cannot get deeper than the number
+     of bits in a ptrdiff_t, since the lengths of the runs grow at least
+     as fast as the Fibonacci numbers from the top to the bottom.  */
+  struct sort_run runs[2 * CHAR_BIT * sizeof (ptrdiff_t)];
+  int nruns;
+};
+
+/* Return the fast way to call PREDICATE.  */
+
+static enum sort_predicate
+sort_predicate_kind (Lisp_Object predicate)
+{
+  Lisp_Object fun = predicate;
+
+  if (SYMBOLP (fun) && !NILP (fun))
+    fun = indirect_function (fun);
+  if (SUBRP (fun))
+    {
+      struct Lisp_Subr *subr = XSUBR (fun);
+      if (subr->function.a2 == Flss)
+	return SORT_LESS;
+      if (subr->function.a2 == Fgtr)
+	return SORT_GREATER;
+      if (subr->function.a2 == Fstring_lessp)
+	return SORT_STRING_LESS;
+      if (subr->function.a2 == Fcar_less_than_car)
+	return SORT_CAR_LESS;
+    }
+  return SORT_FUNCALL;
+}
+
+/* Value is non-zero if A sorts before B, for the predicates that
+   are not handled inline by sort_lessp.  */
+
+static int
+sort_lessp_1 (struct sort_state *s, Lisp_Object a, Lisp_Object b)
+{
+  switch (s->fast)
+    {
+    case SORT_LESS:
+      return !NILP (Flss (a, b));
+
+    case SORT_GREATER:
+      return !NILP (Fgtr (a, b));
+
+    case SORT_STRING_LESS:
+      return !NILP (Fstring_lessp (a, b));
+
+    case SORT_CAR_LESS:
+      return !NILP (Fcar_less_than_car (a, b));
+
+    default:
+      return !NILP (call2 (s->predicate, a, b));
+    }
+}
+
+/* Value is non-zero if A sorts before B.  */
+
+static inline int
+sort_lessp (struct sort_state *s, Lisp_Object a, Lisp_Object b)
+{
+  if (INTEGERP (a) && INTEGERP (b))
+    {
+      if (s->fast == SORT_LESS)
+	return XINT (a) < XINT (b);
+      if (s->fast == SORT_GREATER)
+	return XINT (a) > XINT (b);
+    }
+  return sort_lessp_1 (s, a, b);
+}
+
+/* Copy N elements of S from index FROM to index TO.  */
+
+static inline void
+sort_move (struct sort_state *s, ptrdiff_t to, ptrdiff_t from, ptrdiff_t n)
+{
+  memmove (s->keys + to, s->keys + from, n * sizeof *s->keys);
+  if (s->values != s->keys)
+    memmove (s->values + to, s->values + from, n * sizeof *s->values);
+}
+
+/* Reverse the elements of S from LO to HI, exclusive.  */
+
+static void
+sort_reverse (struct sort_state *s, ptrdiff_t lo, ptrdiff_t hi)
+{
+  for (hi--; lo < hi; lo++, hi--)
+    {
+      Lisp_Object tem = s->keys[lo];
+      s->keys[lo] = s->keys[hi];
+      s->keys[hi] = tem;
+      if (s->values != s->keys)
+	{
+	  tem = s->values[lo];
+	  s->values[lo] = s->values[hi];
+	  s->values[hi] = tem;
+	}
+    }
+}
+
+/* Return the length of the run of S that starts at LO and ends
+   before HI.  If the run is strictly descending, reverse it first.
+   Strictly, so that reversing it keeps the sort stable.  */
+
+static ptrdiff_t
+sort_count_run (struct sort_state *s, ptrdiff_t lo, ptrdiff_t hi)
+{
+  Lisp_Object *keys = s->keys;
+  ptrdiff_t i = lo + 1;
+
+  if (i == hi)
+    return 1;
+  if (sort_lessp (s, keys[i], keys[lo]))
+    {
+      for (i++; i < hi && sort_lessp (s, keys[i], keys[i - 1]); i++)
+	;
+      sort_reverse (s, lo, i);
+    }
+  else
+    for (i++; i < hi && !sort_lessp (s, keys[i], keys[i - 1]); i++)
+      ;
+  return i - lo;
+}
+
+/* Sort the elements of S from LO to HI, exclusive, of which the ones
+   before START are already sorted.  */
+
+static void
+sort_binary_insertion (struct sort_state *s, ptrdiff_t lo, ptrdiff_t hi,
+		       ptrdiff_t start)
+{
+  for (; start < hi; start++)
+    {
+      Lisp_Object key = s->keys[start], value = s->values[start];
+      ptrdiff_t l = lo, r = start;
+
+      /* Insert after all elements that KEY does not sort before.  */
+      while (l < r)
+	{
+	  ptrdiff_t m = l + (r - l) / 2;
+	  if (sort_lessp (s, key, s->keys[m]))
+	    r = m;
+	  else
+	    l = m + 1;
+	}
+      sort_move (s, l + 1, l, start - l);
+      s->keys[l] = key;
+      s->values[l] = value;
+    }
+}
+
+/* Return the number of the N elements of S starting at BASE that
+   KEY does not sort before, if they are sorted.  With RIGHT zero,
+   return the number of elements that sort before KEY instead.  */
+
+static ptrdiff_t
+sort_search (struct sort_state *s, Lisp_Object key, ptrdiff_t base,
+	     ptrdiff_t n, int right)
+{
+  ptrdiff_t l = 0, r = n;
+
+  while (l < r)
+    {
+      ptrdiff_t m = l + (r - l) / 2;
+      if (right
+	  ? !sort_lessp (s, key, s->keys[base + m])
+	  : sort_lessp (s, s->keys[base + m], key))
+	l = m + 1;
+      else
+	r = m;
+    }
+  return l;
+}
+
+/* Merge the adjacent sorted runs of S of N1 elements at BASE1 and N2
+   elements after them, where N1 <= N2.  */
+
+static void
+sort_merge_lo (struct sort_state *s, ptrdiff_t base1, ptrdiff_t n1,
+	       ptrdiff_t n2)
+{
+  Lisp_Object *keys = s->keys, *values = s->values;
+  Lisp_Object *tmp_values = values != keys ? s->tmp_values : s->tmp_keys;
+  ptrdiff_t i = 0, j = base1 + n1, end = j + n2, dest = base1;
+
+  memcpy (s->tmp_keys, keys + base1, n1 * sizeof *keys);
+  if (values != keys)
+    memcpy (s->tmp_values, values + base1, n1 * sizeof *values);
+
+  while (i < n1 && j < end)
+    {
+      if (sort_lessp (s, keys[j], s->tmp_keys[i]))
+	{
+	  keys[dest] = keys[j];
+	  values[dest++] = values[j++];
+	}
+      else
+	{
+	  keys[dest] = s->tmp_keys[i];
+	  values[dest++] = tmp_values[i++];
+	}
+    }
+
+  memcpy (keys + dest, s->tmp_keys + i, (n1 - i) * sizeof *keys);
+  if (values != keys)
+    memcpy (values + dest, s->tmp_values + i, (n1 - i) * sizeof *values);
+}
+
+/* Like sort_merge_lo, for N1 >= N2.  */
+
+static void
+sort_merge_hi (struct sort_state *s, ptrdiff_t base1, ptrdiff_t n1,
+	       ptrdiff_t n2)
+{
+  Lisp_Object *keys = s->keys, *values = s->values;
+  Lisp_Object *tmp_values = values != keys ? s->tmp_values : s->tmp_keys;
+  ptrdiff_t i = base1 + n1, j = n2, dest = base1 + n1 + n2;
+
+  memcpy (s->tmp_keys, keys + i, n2 * sizeof *keys);
+  if (values != keys)
+    memcpy (s->tmp_values, values + i, n2 * sizeof *values);
+
+  while (i > base1 && j > 0)
+    {
+      if (sort_lessp (s, s->tmp_keys[j - 1], keys[i - 1]))
+	{
+	  keys[--dest] = keys[--i];
+	  values[dest] = values[i];
+	}
+      else
+	{
+	  keys[--dest] = s->tmp_keys[--j];
+	  values[dest] = tmp_values[j];
+	}
+    }
+
+  memcpy (keys + base1, s->tmp_keys, j * sizeof *keys);
+  if (values != keys)
+    memcpy (values + base1, s->tmp_values, j * sizeof *values);
+}
+
+/* Merge the runs at indices I and I + 1 of the stack of S.  */
+
+static void
+sort_merge_at (struct sort_state *s, int i)
+{
+  ptrdiff_t base1 = s->runs[i].base, n1 = s->runs[i].length;
+  ptrdiff_t base2 = s->runs[i + 1].base, n2 = s->runs[i + 1].length;
+  ptrdiff_t k;
+
+  s->runs[i].length = n1 + n2;
+  if (i == s->nruns - 3)
+    s->runs[i + 1] = s->runs[i + 2];
+  s->nruns--;
+
+  /* Elements of the first run that sort before the first element of
+     the second run, and elements of the second run that sort before
+     the last element of the first run, are already in place.  */
+  k = sort_search (s, s->keys[base2], base1, n1, 1);
+  base1 += k;
+  n1 -= k;
+  if (n1 == 0)
+    return;
+  n2 = sort_search (s, s->keys[base1 + n1 - 1], base2, n2, 0);
+  if (n2 == 0)
+    return;
+
+  if (n1 <= n2)
+    sort_merge_lo (s, base1, n1, n2);
+  else
+    sort_merge_hi (s, base1, n1, n2);
+}
+
+/* Merge runs on the stack of S until the lengths of the runs, from
+   the top down, grow faster than the Fibonacci numbers.  */
+
+static void
+sort_merge_collapse (struct sort_state *s)
+{
+  struct sort_run *runs = s->runs;
+
+  while (s->nruns > 1)
+    {
+      int n = s->nruns - 2;
+      if ((n > 0 && runs[n - 1].length <= runs[n].length + runs[n + 1].length)
+	  || (n > 1
+	      && runs[n - 2].length <= runs[n - 1].length + runs[n].length))
+	{
+	  if (runs[n - 1].length < runs[n + 1].length)
+	    n--;
+	}
+      else if (runs[n].length > runs[n + 1].length)
+	break;
+      sort_merge_at (s, n);
+    }
+}
+
+/* Return the minimum length of a run for sorting N elements.  */
+
+static ptrdiff_t
+sort_min_run (ptrdiff_t n)
+{
+  int r = 0;
+
+  while (n >= SORT_MIN_MERGE)
+    {
+      r |= n & 1;
+      n >>= 1;
+    }
+  return n + r;
+}
+
+/* Sort the N elements of S, whose arrays are set up except for the
+   temporary space.  TMP is a vector of at least N / 2 elements, or
+   N elements if the keys and values differ.  */
+
+static void
+sort_array (struct sort_state *s, ptrdiff_t n, Lisp_Object tmp)
+{
+  ptrdiff_t lo = 0, min_run = sort_min_run (n);
+
+  s->tmp_vector = tmp;
+  s->tmp_keys = XVECTOR (tmp)->contents;
+  s->tmp_values = s->tmp_keys + n / 2;
+  s->nruns = 0;
+
+  while (lo < n)
+    {
+      ptrdiff_t length = sort_count_run (s, lo, n);
+
+      if (length < min_run)
+	{
+	  ptrdiff_t forced = min (min_run, n - lo);
+	  sort_binary_insertion (s, lo, lo + forced, lo + length);
+	  length = forced;
+	}
+      s->runs[s->nruns].base = lo;
+      s->runs[s->nruns].length = length;
+      s->nruns++;
+      sort_merge_collapse (s);
+      lo += length;
+      QUIT;
+    }
+
+  while (s->nruns > 1)
+    sort_merge_at (s, s->nruns > 2
+		   && s->runs[s->nruns - 3].length < s->runs[s->nruns - 1].length
+		   ? s->nruns - 3 : s->nruns - 2);
+}
+
+DEFUN ("sort", Fsort, Ssort, 2, MANY, 0,
+       doc: /* Sort SEQ, stably, comparing elements using PREDICATE.
+SEQ should be a list or a vector.  Returns the sorted sequence.  SEQ is
+modified by side effects: a list is sorted by changing the cdrs of its
+conses, and a vector by rearranging its elements.
+PREDICATE is called with two elements of SEQ, and should return non-nil
+if the first element should sort before the second.
+
+The only keyword argument supported is `:key KEY'.  If KEY is non-nil,
+it is called once with each element of SEQ, and PREDICATE compares the
+values it returns instead of the elements themselves.
+
+usage: (sort SEQ PREDICATE &rest KEYWORD-ARGS)  */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object seq = args[0], key = Qnil;
+  Lisp_Object keys = Qnil, values = Qnil, tmp = Qnil, tail;
+  struct sort_state s;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5;
+  ptrdiff_t i, n;
+
+  for (i = 2; i < nargs; i += 2)
+    if (EQ (args[i], QCkey) && i + 1 < nargs)
+      key = args[i + 1];
+    else
+      signal_error ("Invalid argument list", args[i]);
+
+  if (VECTORP (seq))
+    n = ASIZE (seq);
+  else if (CONSP (seq) || NILP (seq))
+    n = XFASTINT (Flength (seq));
+  else
+    wrong_type_argument (Qsequencep, seq);
+  if (n < 2)
+    return seq;
+
+  s.predicate = args[1];
+  s.fast = sort_predicate_kind (s.predicate);
+
+  GCPRO5 (seq, key, keys, values, tmp);
+  if (VECTORP (seq))
+    values = Fcopy_sequence (seq);
+  else
+    {
+      values = Fmake_vector (make_number (n), Qnil);
+      for (i = 0, tail = seq; i < n; i++, tail = XCDR (tail))
+	ASET (values, i, tail);
+    }
+  if (!NILP (key) || !VECTORP (seq))
+    {
+      keys = Fmake_vector (make_number (n), Qnil);
+      for (i = 0; i < n; i++)
+	{
+	  Lisp_Object elt = AREF (values, i);
+	  if (!VECTORP (seq))
+	    elt = XCAR (elt);
+	  ASET (keys, i, NILP (key) ? elt : call1 (key, elt));
+	}
+    }
+  else
+    keys = values;
+  tmp = Fmake_vector (make_number (EQ (keys, values) ? n / 2 : n), Qnil);
+
+  s.key_vector = keys;
+  s.value_vector = values;
+  s.keys = XVECTOR (keys)->contents;
+  s.values = XVECTOR (values)->contents;
+  sort_array (&s, n, tmp);
+
+  if (VECTORP (seq))
+    memcpy (XVECTOR (seq)->contents, s.values, n * sizeof *s.values);
+  else
+    {
+      for (i = 0; i < n - 1; i++)
+	XSETCDR (AREF (values, i), AREF (values, i + 1));
+      XSETCDR (AREF (values, n - 1), Qnil);
+      seq = AREF (values, 0);
+    }
   UNGCPRO;
-  return merge (front, back, predicate);
+  return seq;
 }
 
 Lisp_Object
@@ -1979,7 +2659,7 @@ Floating-point numbers of equal value are `eql', but they may not be `eq'.  */)
   (Lisp_Object obj1, Lisp_Object obj2)
 {
   if (FLOATP (obj1))
-    return internal_equal (obj1, obj2, 0, 0) ? Qt : Qnil;
+    return internal_equal (obj1, obj2, 0) ? Qt : Qnil;
   else
     return EQ (obj1, obj2) ? Qt : Qnil;
 }
@@ -1994,7 +2674,7 @@ Numbers are compared by value, but integers cannot equal floats.
 Symbols must match exactly.  */)
   (register Lisp_Object o1, Lisp_Object o2)
 {
-  return internal_equal (o1, o2, 0, 0) ? Qt : Qnil;
+  return internal_equal (o1, o2, 0) ? Qt : Qnil;
 }
 
 DEFUN ("equal-including-properties", Fequal_including_properties, Sequal_including_properties, 2, 2, 0,
@@ -2003,60 +2683,239 @@ This is like `equal' except that it compares the text properties
 of strings.  (`equal' ignores text properties.)  */)
   (register Lisp_Object o1, Lisp_Object o2)
 {
-  return internal_equal (o1, o2, 0, 1) ? Qt : Qnil;
-}
+  return internal_equal (o1, o2, 1) ? Qt : Qnil;
+}
+
+/* internal_equal compares its arguments without recursion.  It keeps
+   the comparisons that remain to be done on an explicit stack, which
+   starts out on the C stack and moves to the heap if it fills up.  */
+
+enum
+  {
+    /* Number of pending comparisons kept on the C stack.  */
+    EQUAL_STACK_INITIAL = 32,
+    /* Pairs of conses or vectors nested deeper than this, at depths
+       that are multiples of EQUAL_MEMO_STRIDE, are remembered, so that
+       comparing structures with cycles through cars or vector elements
+       terminates.  Such a cycle passes through every depth, so there is
+       no need to pay for remembering every level.  */
+    EQUAL_MEMO_DEPTH = 10,
+    EQUAL_MEMO_STRIDE = 8,
+    /* Vectors at least this long get a shallow pass over their elements
+       before any pair of elements is compared in depth.  */
+    EQUAL_SHALLOW_MIN = 32,
+    /* Lists of atoms up to this long are compared without using the
+       stack.  */
+    EQUAL_FLAT_MAX = 8,
+    /* Values of the N field of struct equal_item below.  */
+    EQUAL_PAIR = -1,
+    EQUAL_TAIL = -2
+  };
 
-/* DEPTH is current depth of recursion.  Signal an error if it
-   gets too deep.
-   PROPS, if non-nil, means compare string text properties too.  */
+/* A pending comparison.  */
+
+struct equal_item
+{
+  /* If N is nonnegative, O1 and O2 are vectors of N elements, of which
+     those from index I on remain to be compared.  Otherwise, O1 and O2
+     themselves remain to be compared; if N is EQUAL_TAIL, they are the
+     tails of lists, and TORTOISE, I and POWER are the state of the
+     check for a cycle in the list of O1.  DEPTH is how deeply O1 and O2
+     are nested in the objects being compared.  */
+  Lisp_Object o1, o2;
+  ptrdiff_t i, n;
+  Lisp_Object tortoise;
+  ptrdiff_t power;
+  int depth;
+};
 
-static int
-internal_equal (register Lisp_Object o1, register Lisp_Object o2, int depth, int props)
+struct equal_state
 {
-  if (depth > 200)
-    error ("Stack overflow in equal");
+  /* The stack of pending comparisons, with SP items in use out of
+     STACK_SIZE.  */
+  struct equal_item *stack;
+  ptrdiff_t sp, stack_size;
 
- tail_recurse:
-  QUIT;
-  if (EQ (o1, o2))
-    return 1;
-  if (XTYPE (o1) != XTYPE (o2))
-    return 0;
+  /* Open-addressed hash set of the pairs of objects already compared,
+     with MEMO_COUNT pairs in MEMO_SIZE slots, which is 2 to the power
+     MEMO_BITS.  Each slot takes two elements; an empty slot starts
+     with nil.  */
+  Lisp_Object *memo;
+  ptrdiff_t memo_size, memo_count;
+  int memo_bits;
 
-  switch (XTYPE (o1))
-    {
-    case Lisp_Float:
-      {
-	double d1, d2;
+  /* If non-nil, save values that free STACK and MEMO on a nonlocal
+     exit.  */
+  Lisp_Object stack_save, memo_save;
+};
 
-	d1 = extract_float (o1);
+/* Make room for another item on the stack of ST, and return it.  */
+
+static struct equal_item *
+equal_push (struct equal_state *st)
+{
+  if (st->sp == st->stack_size)
+    {
+      if (NILP (st->stack_save))
+	{
+	  struct equal_item *stack = xnmalloc (2 * st->stack_size,
+					       sizeof *stack);
+	  memcpy (stack, st->stack, st->stack_size * sizeof *stack);
+	  st->stack = stack;
+	  st->stack_size *= 2;
+	  st->stack_save = make_save_value (stack, 0);
+	  record_unwind_protect (safe_alloca_unwind, st->stack_save);
+	}
+      else
+	{
+	  st->stack = xpalloc (st->stack, &st->stack_size, 1, -1,
+			       sizeof *st->stack);
+	  XSAVE_VALUE (st->stack_save)->pointer = st->stack;
+	}
+    }
+  return &st->stack[st->sp++];
+}
+
+/* Return the slot of the memo of ST that holds the pair O1, O2, or the
+   empty slot where it belongs.  */
+
+static Lisp_Object *
+equal_memo_slot (struct equal_state *st, Lisp_Object o1, Lisp_Object o2)
+{
+  /* Take the high bits of a multiplicative hash, which depend on all
+     the bits of the addresses.  */
+  EMACS_UINT hash = (((EMACS_UINT) XHASH (o1) * 2654435761u
+		      ^ (EMACS_UINT) XHASH (o2))
+		     * 2654435761u);
+  ptrdiff_t mask = st->memo_size - 1;
+  ptrdiff_t i;
+
+  for (i = hash >> (BITS_PER_EMACS_INT - st->memo_bits); ; i = (i + 1) & mask)
+    {
+      Lisp_Object *slot = &st->memo[2 * i];
+      if (NILP (slot[0]) || (EQ (slot[0], o1) && EQ (slot[1], o2)))
+	return slot;
+    }
+}
+
+/* Return 1 if pairs at DEPTH are to be remembered.  */
+
+static inline int
+equal_memo_depth_p (int depth)
+{
+  return depth > EQUAL_MEMO_DEPTH && depth % EQUAL_MEMO_STRIDE == 0;
+}
+
+/* Add the pair O1, O2 to the memo of ST.  Return 1 if it was there
+   already, which means that it has been compared, or is being compared
+   further up the stack.  */
+
+static int
+equal_memo (struct equal_state *st, Lisp_Object o1, Lisp_Object o2)
+{
+  Lisp_Object *slot;
+
+  if (2 * (st->memo_count + 1) > st->memo_size)
+    {
+      /* Double the table and rehash the pairs into it.  */
+      Lisp_Object *old = st->memo;
+      ptrdiff_t old_size = st->memo_size;
+      ptrdiff_t i;
+
+      st->memo_bits = old_size ? st->memo_bits + 1 : 6;
+      st->memo_size = (ptrdiff_t) 1 << st->memo_bits;
+      st->memo = xnmalloc (st->memo_size, 2 * sizeof *st->memo);
+      for (i = 0; i < 2 * st->memo_size; i += 2)
+	st->memo[i] = Qnil;
+      for (i = 0; i < 2 * old_size; i += 2)
+	if (!NILP (old[i]))
+	  {
+	    slot = equal_memo_slot (st, old[i], old[i + 1]);
+	    slot[0] = old[i];
+	    slot[1] = old[i + 1];
+	  }
+
+      if (NILP (st->memo_save))
+	{
+	  st->memo_save = make_save_value (st->memo, 0);
+	  record_unwind_protect (safe_alloca_unwind, st->memo_save);
+	}
+      else
+	{
+	  XSAVE_VALUE (st->memo_save)->pointer = st->memo;
+	  xfree (old);
+	}
+    }
+
+  slot = equal_memo_slot (st, o1, o2);
+  if (!NILP (slot[0]))
+    return 1;
+  slot[0] = o1;
+  slot[1] = o2;
+  st->memo_count++;
+  return 0;
+}
+
+/* Return 1 if vectors O1 and O2 of SIZE elements differ in a way that
+   can be seen without comparing any pair of elements in depth: in the
+   type of a pair of elements, in a pair of integers or symbols, or in
+   the length of a pair of strings.  */
+
+static int
+equal_shallow_mismatch (Lisp_Object o1, Lisp_Object o2, ptrdiff_t size)
+{
+  ptrdiff_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      Lisp_Object v1 = AREF (o1, i), v2 = AREF (o2, i);
+
+      if (EQ (v1, v2))
+	continue;
+      if (XTYPE (v1) != XTYPE (v2)
+	  || INTEGERP (v1) || SYMBOLP (v1)
+	  || (STRINGP (v1) && SBYTES (v1) != SBYTES (v2)))
+	return 1;
+    }
+  return 0;
+}
+
+/* Return 1 if comparing O may need comparing the objects in it: if it
+   is a cons, a vector-like object or an overlay.  */
+
+static inline int
+equal_compound_p (Lisp_Object o)
+{
+  return CONSP (o) || VECTORLIKEP (o) || OVERLAYP (o);
+}
+
+/* Return 1 if O1 and O2 are `equal', where O1 is not compound in the
+   sense of equal_compound_p.  PROPS is as for internal_equal.  */
+
+static int
+equal_atoms (Lisp_Object o1, Lisp_Object o2, int props)
+{
+  if (EQ (o1, o2))
+    return 1;
+  if (XTYPE (o1) != XTYPE (o2))
+    return 0;
+
+  switch (XTYPE (o1))
+    {
+    case Lisp_Float:
+      {
+	double d1, d2;
+
+	d1 = extract_float (o1);
 	d2 = extract_float (o2);
 	/* If d is a NaN, then d != d. Two NaNs should be `equal' even
 	   though they are not =. */
 	return d1 == d2 || (d1 != d1 && d2 != d2);
       }
 
-    case Lisp_Cons:
-      if (!internal_equal (XCAR (o1), XCAR (o2), depth + 1, props))
-	return 0;
-      o1 = XCDR (o1);
-      o2 = XCDR (o2);
-      goto tail_recurse;
-
     case Lisp_Misc:
       if (XMISCTYPE (o1) != XMISCTYPE (o2))
 	return 0;
-      if (OVERLAYP (o1))
-	{
-	  if (!internal_equal (OVERLAY_START (o1), OVERLAY_START (o2),
-			       depth + 1, props)
-	      || !internal_equal (OVERLAY_END (o1), OVERLAY_END (o2),
-				  depth + 1, props))
-	    return 0;
-	  o1 = XOVERLAY (o1)->plist;
-	  o2 = XOVERLAY (o2)->plist;
-	  goto tail_recurse;
-	}
       if (MARKERP (o1))
 	{
 	  return (XMARKER (o1)->buffer == XMARKER (o2)->buffer
@@ -2065,53 +2924,6 @@ internal_equal (register Lisp_Object o1, register Lisp_Object o2, int depth, int
 	}
       break;
 
-    case Lisp_Vectorlike:
-      {
-	register int i;
-	ptrdiff_t size = ASIZE (o1);
-	/* Pseudovectors have the type encoded in the size field, so this test
-	   actually checks that the objects have the same type as well as the
-	   same size.  */
-	if (ASIZE (o2) != size)
-	  return 0;
-	/* Boolvectors are compared much like strings.  */
-	if (BOOL_VECTOR_P (o1))
-	  {
-	    if (XBOOL_VECTOR (o1)->size != XBOOL_VECTOR (o2)->size)
-	      return 0;
-	    if (memcmp (XBOOL_VECTOR (o1)->data, XBOOL_VECTOR (o2)->data,
-			((XBOOL_VECTOR (o1)->size
-			  + BOOL_VECTOR_BITS_PER_CHAR - 1)
-			 / BOOL_VECTOR_BITS_PER_CHAR)))
-	      return 0;
-	    return 1;
-	  }
-	if (WINDOW_CONFIGURATIONP (o1))
-	  return compare_window_configurations (o1, o2, 0);
-
-	/* Aside from them, only true vectors, char-tables, compiled
-	   functions, and fonts (font-spec, font-entity, font-object)
-	   are sensible to compare, so eliminate the others now.  */
-	if (size & PSEUDOVECTOR_FLAG)
-	  {
-	    if (!(size & ((PVEC_COMPILED | PVEC_CHAR_TABLE
-			   | PVEC_SUB_CHAR_TABLE | PVEC_FONT)
-			  << PSEUDOVECTOR_SIZE_BITS)))
-	      return 0;
-	    size &= PSEUDOVECTOR_SIZE_MASK;
-	  }
-	for (i = 0; i < size; i++)
-	  {
-	    Lisp_Object v1, v2;
-	    v1 = AREF (o1, i);
-	    v2 = AREF (o2, i);
-	    if (!internal_equal (v1, v2, depth + 1, props))
-	      return 0;
-	  }
-	return 1;
-      }
-      break;
-
     case Lisp_String:
       if (SCHARS (o1) != SCHARS (o2))
 	return 0;
@@ -2129,11 +2941,300 @@ internal_equal (register Lisp_Object o1, register Lisp_Object o2, int depth, int
 
   return 0;
 }
+
+/* Compare lists O1 and O2 if they are short and their elements are not
+   compound, which is the common case of the elements of an alist or a
+   plist.  Return 1 if they are `equal', 0 if they are not, and -1 if
+   they need the general comparison.  PROPS is as for internal_equal.  */
+
+static int
+equal_flat_lists (Lisp_Object o1, Lisp_Object o2, int props)
+{
+  int n;
+
+  for (n = 0; n < EQUAL_FLAT_MAX; n++)
+    {
+      Lisp_Object car1 = XCAR (o1), car2 = XCAR (o2);
+
+      if (!EQ (car1, car2))
+	{
+	  if (equal_compound_p (car1))
+	    return -1;
+	  if (!equal_atoms (car1, car2, props))
+	    return 0;
+	}
+      o1 = XCDR (o1);
+      o2 = XCDR (o2);
+      if (!CONSP (o1) || !CONSP (o2))
+	{
+	  if (EQ (o1, o2))
+	    return 1;
+	  if (equal_compound_p (o1))
+	    return -1;
+	  return equal_atoms (o1, o2, props);
+	}
+    }
+  return -1;
+}
+
+/* Return 1 if O1 and O2 are `equal'.
+   PROPS, if non-nil, means compare string text properties too.
+   Signal an error if a list in O1 is circular.  */
+
+static int
+internal_equal (Lisp_Object o1, Lisp_Object o2, int props)
+{
+  struct equal_item initial_stack[EQUAL_STACK_INITIAL];
+  struct equal_state st;
+  struct equal_item *item;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  int result = 0;
+
+  /* The state of the comparison of O1 and O2, as in struct
+     equal_item.  */
+  ptrdiff_t n = EQUAL_PAIR;
+  int depth = 0;
+  Lisp_Object tortoise = Qnil;
+  ptrdiff_t steps = 0, power = 0;
+
+  st.stack = initial_stack;
+  st.sp = 0;
+  st.stack_size = EQUAL_STACK_INITIAL;
+  st.memo = NULL;
+  st.memo_size = st.memo_count = 0;
+  st.memo_bits = 0;
+  st.stack_save = st.memo_save = Qnil;
+
+  while (1)
+    {
+      /* Compare O1 with O2.  Leave the loop if they differ; if they
+	 are equal, go on with the next pending comparison.  */
+      QUIT;
+      if (EQ (o1, o2))
+	goto next;
+      if (XTYPE (o1) != XTYPE (o2))
+	goto done;
+
+      switch (XTYPE (o1))
+	{
+	case Lisp_Cons:
+	  {
+	    Lisp_Object car1, car2;
+	    Lisp_Object tail1 = XCDR (o1), tail2 = XCDR (o2);
+
+	    if (n == EQUAL_PAIR)
+	      {
+		/* This is the head of a list.  */
+		if (equal_memo_depth_p (depth) && equal_memo (&st, o1, o2))
+		  goto next;
+		n = EQUAL_TAIL;
+		tortoise = o1;
+		steps = 0;
+		power = 1;
+	      }
+
+	    /* Check for a cycle in the list of O1 with Brent's
+	       algorithm: every power of two steps, the tortoise jumps
+	       to the current cons.  */
+	    if (steps == power)
+	      {
+		tortoise = o1;
+		power *= 2;
+		steps = 0;
+	      }
+	    steps++;
+	    if (EQ (tail1, tortoise))
+	      xsignal1 (Qcircular_list, tail1);
+
+	    car1 = XCAR (o1);
+	    car2 = XCAR (o2);
+	    if (!EQ (car1, car2))
+	      {
+		/* Compare the cars right away if that needs no stack,
+		   else save the tails for later and compare the cars.  */
+		int r = -1;
+
+		if (!equal_compound_p (car1))
+		  r = equal_atoms (car1, car2, props);
+		else if (CONSP (car1) && CONSP (car2))
+		  r = equal_flat_lists (car1, car2, props);
+		if (r == 0)
+		  goto done;
+		if (r < 0)
+		  {
+		    if (!EQ (tail1, tail2))
+		      {
+			item = equal_push (&st);
+			item->o1 = tail1;
+			item->o2 = tail2;
+			item->n = EQUAL_TAIL;
+			item->depth = depth;
+			item->tortoise = tortoise;
+			item->i = steps;
+			item->power = power;
+		      }
+		    o1 = car1;
+		    o2 = car2;
+		    n = EQUAL_PAIR;
+		    depth++;
+		    continue;
+		  }
+	      }
+	    /* Go straight on with the tails.  */
+	    o1 = tail1;
+	    o2 = tail2;
+	    continue;
+	  }
+
+	case Lisp_Misc:
+	  if (OVERLAYP (o1) && OVERLAYP (o2))
+	    {
+	      item = equal_push (&st);
+	      item->o1 = XOVERLAY (o1)->plist;
+	      item->o2 = XOVERLAY (o2)->plist;
+	      item->n = EQUAL_PAIR;
+	      item->depth = depth + 1;
+	      item = equal_push (&st);
+	      item->o1 = OVERLAY_END (o1);
+	      item->o2 = OVERLAY_END (o2);
+	      item->n = EQUAL_PAIR;
+	      item->depth = depth + 1;
+	      o1 = OVERLAY_START (o1);
+	      o2 = OVERLAY_START (o2);
+	      n = EQUAL_PAIR;
+	      depth++;
+	      continue;
+	    }
+	  break;
+
+	case Lisp_Vectorlike:
+	  {
+	    ptrdiff_t size = ASIZE (o1);
+	    /* Pseudovectors have the type encoded in the size field, so this test
+	       actually checks that the objects have the same type as well as the
+	       same size.  */
+	    if (ASIZE (o2) != size)
+	      goto done;
+	    /* Boolvectors are compared much like strings.  */
+	    if (BOOL_VECTOR_P (o1))
+	      {
+		if (XBOOL_VECTOR (o1)->size != XBOOL_VECTOR (o2)->size)
+		  goto done;
+		if (memcmp (XBOOL_VECTOR (o1)->data, XBOOL_VECTOR (o2)->data,
+			    ((XBOOL_VECTOR (o1)->size
+			      + BOOL_VECTOR_BITS_PER_CHAR - 1)
+			     / BOOL_VECTOR_BITS_PER_CHAR)))
+		  goto done;
+		goto next;
+	      }
+	    if (NUMERIC_VECTOR_P (o1))
+	      {
+		struct Lisp_Numeric_Vector *v1 = XNUMERIC_VECTOR (o1);
+		struct Lisp_Numeric_Vector *v2 = XNUMERIC_VECTOR (o2);
+		ptrdiff_t j;
+
+		if (v1->type != v2->type || v1->size != v2->size)
+		  goto done;
+		if (v1->type != NUMERIC_VECTOR_FLOAT64)
+		  {
+		    if (memcmp (&v1->data, &v2->data,
+				v1->size * NUMERIC_VECTOR_ELT_SIZE (v1->type)))
+		      goto done;
+		    goto next;
+		  }
+		/* Compare like floats, see above.  */
+		for (j = 0; j < v1->size; j++)
+		  {
+		    double d1 = v1->data.f64[j], d2 = v2->data.f64[j];
+		    if (! (d1 == d2 || (d1 != d1 && d2 != d2)))
+		      goto done;
+		  }
+		goto next;
+	      }
+	    if (WINDOW_CONFIGURATIONP (o1))
+	      {
+		if (!compare_window_configurations (o1, o2, 0))
+		  goto done;
+		goto next;
+	      }
+
+	    /* Aside from them, only true vectors, char-tables, compiled
+	       functions, and fonts (font-spec, font-entity, font-object)
+	       are sensible to compare, so eliminate the others now.  */
+	    if (size & PSEUDOVECTOR_FLAG)
+	      {
+		if (!(size & ((PVEC_COMPILED | PVEC_CHAR_TABLE
+			       | PVEC_SUB_CHAR_TABLE | PVEC_FONT)
+			      << PSEUDOVECTOR_SIZE_BITS)))
+		  goto done;
+		size &= PSEUDOVECTOR_SIZE_MASK;
+	      }
+	    if (size == 0)
+	      goto next;
+	    if (equal_memo_depth_p (depth) && equal_memo (&st, o1, o2))
+	      goto next;
+	    /* Before descending into the elements of a long vector, look
+	       for a difference that is cheap to find anywhere in it.  */
+	    if (size >= EQUAL_SHALLOW_MIN
+		&& equal_shallow_mismatch (o1, o2, size))
+	      goto done;
+	    item = equal_push (&st);
+	    item->o1 = o1;
+	    item->o2 = o2;
+	    item->i = 0;
+	    item->n = size;
+	    item->depth = depth + 1;
+	    goto next;
+	  }
+
+	default:
+	  break;
+	}
+
+      if (!equal_atoms (o1, o2, props))
+	goto done;
+
+    next:
+      /* Take the next pending comparison from the stack.  */
+      if (st.sp == 0)
+	{
+	  result = 1;
+	  goto done;
+	}
+      item = &st.stack[st.sp - 1];
+      o1 = item->o1;
+      o2 = item->o2;
+      n = item->n;
+      depth = item->depth;
+      if (n >= 0)
+	{
+	  o1 = AREF (o1, item->i);
+	  o2 = AREF (o2, item->i);
+	  n = EQUAL_PAIR;
+	  if (++item->i == item->n)
+	    st.sp--;
+	}
+      else
+	{
+	  if (n == EQUAL_TAIL)
+	    {
+	      tortoise = item->tortoise;
+	      steps = item->i;
+	      power = item->power;
+	    }
+	  st.sp--;
+	}
+    }
+
+ done:
+  unbind_to (count, Qnil);
+  return result;
+}
 
 
 DEFUN ("fillarray", Ffillarray, Sfillarray, 2, 2, 0,
        doc: /* Store each element of ARRAY with ITEM.
-ARRAY is a vector, string, char-table, or bool-vector.  */)
+ARRAY is a vector, string, char-table, bool-vector, or numeric vector.  */)
   (Lisp_Object array, Lisp_Object item)
 {
   register ptrdiff_t size, idx;
@@ -2191,6 +3292,8 @@ ARRAY is a vector, string, char-table, or bool-vector.  */)
 	  p[size - 1] &= (1 << (size % BOOL_VECTOR_BITS_PER_CHAR)) - 1;
 	}
     }
+  else if (NUMERIC_VECTOR_P (array))
+    numeric_vector_fill (XNUMERIC_VECTOR (array), item);
   else
     wrong_type_argument (Qarrayp, array);
   return array;
@@ -2310,6 +3413,15 @@ mapcar1 (EMACS_INT leni, Lisp_Object *vals, Lisp_Object fn, Lisp_Object seq)
 	    vals[i] = dummy;
 	}
     }
+  else if (NUMERIC_VECTOR_P (seq))
+    {
+      for (i = 0; i < leni; i++)
+	{
+	  dummy = call1 (fn, numeric_vector_ref (XNUMERIC_VECTOR (seq), i));
+	  if (vals)
+	    vals[i] = dummy;
+	}
+    }
   else if (STRINGP (seq))
     {
       ptrdiff_t i_byte;
@@ -3567,9 +4679,181 @@ hashfn_user_defined (struct Lisp_Hash_Table *h, Lisp_Object key)
 }
 
 /* An upper bound on the size of a hash table index.  It must fit in
-   ptrdiff_t and be a valid Emacs fixnum.  */
-#define INDEX_SIZE_BOUND \
-  ((ptrdiff_t) min (MOST_POSITIVE_FIXNUM, PTRDIFF_MAX / sizeof (Lisp_Object)))
+   ptrdiff_t and be a valid Emacs fixnum, and the index together with
+   the free list of a table of that size must fit in memory.  */
+#define INDEX_SIZE_BOUND						\
+  ((ptrdiff_t) min (MOST_POSITIVE_FIXNUM,				\
+		    (min (PTRDIFF_MAX, SIZE_MAX)			\
+		     / (sizeof (struct hash_table_slot)			\
+			+ sizeof (ptrdiff_t)))))
+
+/* Hash codes are multiplied with this odd constant, 2**N divided by
+   the golden ratio, before their high-order bits are used to pick an
+   index slot.  This spreads hash codes like those of `eq' tables,
+   whose low-order bits are often all alike, over the whole index.  */
+#if EMACS_INT_MAX >> 31 == 0
+# define HASH_SCRAMBLE ((EMACS_UINT) 0x9e3779b9)
+#else
+# define HASH_SCRAMBLE ((EMACS_UINT) 0x9e3779b97f4a7c15)
+#endif
+
+/* Values of the ENTRY member of index slots that hold no entry.  */
+enum
+  {
+    HASH_SLOT_EMPTY = -1,
+    HASH_SLOT_DELETED = -2
+  };
+
+/* Value is the number of index slots to use for a hash table of SIZE
+   entries and rehash threshold THRESHOLD.  This is a power of 2 that
+   is large enough to keep an eighth of the slots empty when the table
+   is full, which keeps probe sequences short.  Value is greater than
+   INDEX_SIZE_BOUND if the index would be too large.  */
+
+static EMACS_INT
+hash_index_size (EMACS_INT size, double threshold)
+{
+  double wanted = max (size / threshold, size + size / 7.0);
+  EMACS_INT index_size = 8;
+
+  while (index_size < wanted && index_size <= INDEX_SIZE_BOUND)
+    index_size *= 2;
+  return index_size;
+}
+
+/* Value is the number of bytes of the block holding the index and the
+   free list of a hash table with SIZE entries and INDEX_SIZE index
+   slots.  */
+
+static ptrdiff_t
+hash_index_bytes (ptrdiff_t size, ptrdiff_t index_size)
+{
+  return (index_size * sizeof (struct hash_table_slot)
+	  + size * sizeof (ptrdiff_t));
+}
+
+/* Give hash table H a new index with INDEX_SIZE slots and a free list
+   for SIZE entries, freeing the previous ones.  The contents of the
+   new index and free list are not initialized.  */
+
+static void
+allocate_hash_index (struct Lisp_Hash_Table *h, ptrdiff_t size,
+		     ptrdiff_t index_size)
+{
+  struct hash_table_slot *block = xmalloc (hash_index_bytes (size,
+							     index_size));
+  int bits = 0;
+
+  while (((ptrdiff_t) 1 << bits) < index_size)
+    bits++;
+
+  xfree (h->index);
+  h->index = block;
+  h->next = (ptrdiff_t *) (block + index_size);
+  h->index_size = index_size;
+  h->index_deleted = 0;
+  h->index_shift = BITS_PER_EMACS_INT - bits;
+}
+
+/* Free the index and the free list of hash table H.  Called when H is
+   garbage collected.  */
+
+void
+free_hash_table_index (struct Lisp_Hash_Table *h)
+{
+  xfree (h->index);
+  h->index = NULL;
+}
+
+/* Mark all slots of the index of hash table H empty.  */
+
+static void
+clear_hash_index (struct Lisp_Hash_Table *h)
+{
+  ptrdiff_t s;
+
+  for (s = 0; s < h->index_size; ++s)
+    h->index[s].entry = HASH_SLOT_EMPTY;
+  h->index_deleted = 0;
+}
+
+/* Value is the first slot of the probe sequence of hash code HASH in
+   the index of hash table H.  */
+
+static inline ptrdiff_t
+hash_index_start (struct Lisp_Hash_Table *h, EMACS_UINT hash)
+{
+  return (hash * HASH_SCRAMBLE) >> h->index_shift;
+}
+
+/* Enter entry I of hash table H, which has hash code HASH, into the
+   first unused slot of its probe sequence.  */
+
+static void
+hash_index_insert (struct Lisp_Hash_Table *h, ptrdiff_t i, EMACS_UINT hash)
+{
+  ptrdiff_t mask = h->index_size - 1;
+  ptrdiff_t s = hash_index_start (h, hash);
+
+  while (h->index[s].entry >= 0)
+    s = (s + 1) & mask;
+
+  if (h->index[s].entry == HASH_SLOT_DELETED)
+    h->index_deleted--;
+  h->index[s].hash = hash;
+  h->index[s].entry = i;
+}
+
+/* Rebuild the index of hash table H from its entries.  This gets rid
+   of all deleted slots.  */
+
+static void
+rehash_hash_index (struct Lisp_Hash_Table *h)
+{
+  ptrdiff_t i, size = HASH_TABLE_SIZE (h);
+
+  clear_hash_index (h);
+  for (i = 0; i < size; ++i)
+    if (!NILP (HASH_HASH (h, i)))
+      hash_index_insert (h, i, XUINT (HASH_HASH (h, i)));
+}
+
+/* Value is the index slot holding entry I of hash table H, which has
+   hash code HASH.  */
+
+static ptrdiff_t
+hash_index_slot (struct Lisp_Hash_Table *h, ptrdiff_t i, EMACS_UINT hash)
+{
+  ptrdiff_t mask = h->index_size - 1;
+  ptrdiff_t s = hash_index_start (h, hash);
+
+  while (h->index[s].entry != i)
+    s = (s + 1) & mask;
+  return s;
+}
+
+/* Remove entry I, held in index slot S, from hash table H.  Clear the
+   entry and add it to the free list.  */
+
+static void
+hash_remove_entry (struct Lisp_Hash_Table *h, ptrdiff_t s, ptrdiff_t i)
+{
+  /* A probe sequence that reaches S continues to the next slot.  If
+     that one is empty, no sequence needs S any more.  */
+  if (h->index[(s + 1) & (h->index_size - 1)].entry == HASH_SLOT_EMPTY)
+    h->index[s].entry = HASH_SLOT_EMPTY;
+  else
+    {
+      h->index[s].entry = HASH_SLOT_DELETED;
+      h->index_deleted++;
+    }
+
+  HASH_KEY (h, i) = HASH_VALUE (h, i) = HASH_HASH (h, i) = Qnil;
+  h->next[i] = h->next_free;
+  h->next_free = i;
+  h->count--;
+  eassert (h->count >= 0);
+}
 
 /* Create and initialize a new hash table.
 
@@ -3602,7 +4886,6 @@ make_hash_table (Lisp_Object test, Lisp_Object size, Lisp_Object rehash_size,
   Lisp_Object table;
   EMACS_INT index_size, sz;
   ptrdiff_t i;
-  double index_float;
 
   /* Preconditions.  */
   eassert (SYMBOLP (test));
@@ -3617,15 +4900,13 @@ make_hash_table (Lisp_Object test, Lisp_Object size, Lisp_Object rehash_size,
     size = make_number (1);
 
   sz = XFASTINT (size);
-  index_float = sz / XFLOAT_DATA (rehash_threshold);
-  index_size = (index_float < INDEX_SIZE_BOUND + 1
-		? next_almost_prime (index_float)
-		: INDEX_SIZE_BOUND + 1);
+  index_size = hash_index_size (sz, XFLOAT_DATA (rehash_threshold));
   if (INDEX_SIZE_BOUND < max (index_size, 2 * sz))
     error ("Hash table too large");
 
   /* Allocate a table and initialize it.  */
   h = allocate_hash_table ();
+  h->index = NULL;
 
   /* Initialize hash table slots.  */
   h->test = test;
@@ -3658,13 +4939,13 @@ make_hash_table (Lisp_Object test, Lisp_Object size, Lisp_Object rehash_size,
   h->count = 0;
   h->key_and_value = Fmake_vector (make_number (2 * sz), Qnil);
   h->hash = Fmake_vector (size, Qnil);
-  h->next = Fmake_vector (size, Qnil);
-  h->index = Fmake_vector (make_number (index_size), Qnil);
+  allocate_hash_index (h, sz, index_size);
+  clear_hash_index (h);
 
   /* Set up the free list.  */
-  for (i = 0; i < sz - 1; ++i)
-    HASH_NEXT (h, i) = make_number (i + 1);
-  h->next_free = make_number (0);
+  for (i = 0; i < sz; ++i)
+    h->next[i] = i < sz - 1 ? i + 1 : -1;
+  h->next_free = 0;
 
   XSET_HASH_TABLE (table, h);
   eassert (HASH_TABLE_P (table));
@@ -3699,8 +4980,11 @@ copy_hash_table (struct Lisp_Hash_Table *h1)
   h2->header.next.vector = next;
   h2->key_and_value = Fcopy_sequence (h1->key_and_value);
   h2->hash = Fcopy_sequence (h1->hash);
-  h2->next = Fcopy_sequence (h1->next);
-  h2->index = Fcopy_sequence (h1->index);
+  h2->index = NULL;
+  allocate_hash_index (h2, HASH_TABLE_SIZE (h1), h1->index_size);
+  memcpy (h2->index, h1->index,
+	  hash_index_bytes (HASH_TABLE_SIZE (h1), h1->index_size));
+  h2->index_deleted = h1->index_deleted;
   XSET_HASH_TABLE (table, h2);
 
   /* Maybe add this hash table to the list of all weak hash tables.  */
@@ -3720,12 +5004,12 @@ copy_hash_table (struct Lisp_Hash_Table *h1)
 static inline void
 maybe_resize_hash_table (struct Lisp_Hash_Table *h)
 {
-  if (NILP (h->next_free))
+  if (h->next_free < 0)
     {
       ptrdiff_t old_size = HASH_TABLE_SIZE (h);
       EMACS_INT new_size, index_size, nsize;
       ptrdiff_t i;
-      double index_float;
+      Lisp_Object key_and_value, hash;
 
       if (INTEGERP (h->rehash_size))
 	new_size = old_size + XFASTINT (h->rehash_size);
@@ -3741,10 +5025,8 @@ maybe_resize_hash_table (struct Lisp_Hash_Table *h)
 	  else
 	    new_size = INDEX_SIZE_BOUND + 1;
 	}
-      index_float = new_size / XFLOAT_DATA (h->rehash_threshold);
-      index_size = (index_float < INDEX_SIZE_BOUND + 1
-		    ? next_almost_prime (index_float)
-		    : INDEX_SIZE_BOUND + 1);
+      index_size = hash_index_size (new_size,
+				    XFLOAT_DATA (h->rehash_threshold));
       nsize = max (index_size, 2 * new_size);
       if (INDEX_SIZE_BOUND < nsize)
 	error ("Hash table too large to resize");
@@ -3760,41 +5042,50 @@ maybe_resize_hash_table (struct Lisp_Hash_Table *h)
 	}
 #endif
 
-      h->key_and_value = larger_vector (h->key_and_value,
-					2 * (new_size - old_size), -1);
-      h->next = larger_vector (h->next, new_size - old_size, -1);
-      h->hash = larger_vector (h->hash, new_size - old_size, -1);
-      h->index = Fmake_vector (make_number (index_size), Qnil);
+      /* Install the new vectors only once the index could be
+	 allocated, so that H stays consistent if memory runs out.  */
+      key_and_value = larger_vector (h->key_and_value,
+				     2 * (new_size - old_size), 2 * new_size);
+      hash = larger_vector (h->hash, new_size - old_size, new_size);
+      allocate_hash_index (h, new_size, index_size);
+      h->key_and_value = key_and_value;
+      h->hash = hash;
+
+      /* All old entries are in use, so the free list consists of the
+	 new entries.  */
+      for (i = old_size; i < new_size; ++i)
+	h->next[i] = i < new_size - 1 ? i + 1 : -1;
+      h->next_free = old_size;
 
-      /* Update the free list.  Do it so that new entries are added at
-         the end of the free list.  This makes some operations like
-         maphash faster.  */
-      for (i = old_size; i < new_size - 1; ++i)
-	HASH_NEXT (h, i) = make_number (i + 1);
+      /* Rehash.  */
+      rehash_hash_index (h);
+    }
+}
 
-      if (!NILP (h->next_free))
-	{
-	  Lisp_Object last, next;
 
-	  last = h->next_free;
-	  while (next = HASH_NEXT (h, XFASTINT (last)),
-		 !NILP (next))
-	    last = next;
+/* Value is the index slot holding the entry of hash table H that
+   matches KEY, which has hash code HASH, or -1 if there is none.  */
 
-	  HASH_NEXT (h, XFASTINT (last)) = make_number (old_size);
-	}
-      else
-	XSETFASTINT (h->next_free, old_size);
+static ptrdiff_t
+hash_lookup_slot (struct Lisp_Hash_Table *h, Lisp_Object key,
+		  EMACS_UINT hash)
+{
+  ptrdiff_t s = hash_index_start (h, hash);
 
-      /* Rehash.  */
-      for (i = 0; i < old_size; ++i)
-	if (!NILP (HASH_HASH (h, i)))
-	  {
-	    EMACS_UINT hash_code = XUINT (HASH_HASH (h, i));
-	    ptrdiff_t start_of_bucket = hash_code % ASIZE (h->index);
-	    HASH_NEXT (h, i) = HASH_INDEX (h, start_of_bucket);
-	    HASH_INDEX (h, start_of_bucket) = make_number (i);
-	  }
+  /* Reload the index from H at each step because a user-defined
+     comparison function can modify the table.  */
+  for (;; s = (s + 1) & (h->index_size - 1))
+    {
+      ptrdiff_t i = h->index[s].entry;
+
+      if (i == HASH_SLOT_EMPTY)
+	return -1;
+      if (i >= 0
+	  && h->index[s].hash == hash
+	  && (EQ (key, HASH_KEY (h, i))
+	      || (h->cmpfn
+		  && h->cmpfn (h, key, hash, HASH_KEY (h, i), hash))))
+	return s;
     }
 }
 
@@ -3807,29 +5098,14 @@ ptrdiff_t
 hash_lookup (struct Lisp_Hash_Table *h, Lisp_Object key, EMACS_UINT *hash)
 {
   EMACS_UINT hash_code;
-  ptrdiff_t start_of_bucket;
-  Lisp_Object idx;
+  ptrdiff_t s;
 
   hash_code = h->hashfn (h, key);
   if (hash)
     *hash = hash_code;
 
-  start_of_bucket = hash_code % ASIZE (h->index);
-  idx = HASH_INDEX (h, start_of_bucket);
-
-  /* We need not gcpro idx since it's either an integer or nil.  */
-  while (!NILP (idx))
-    {
-      ptrdiff_t i = XFASTINT (idx);
-      if (EQ (key, HASH_KEY (h, i))
-	  || (h->cmpfn
-	      && h->cmpfn (h, key, hash_code,
-			   HASH_KEY (h, i), XUINT (HASH_HASH (h, i)))))
-	break;
-      idx = HASH_NEXT (h, i);
-    }
-
-  return NILP (idx) ? -1 : XFASTINT (idx);
+  s = hash_lookup_slot (h, key, hash_code);
+  return s < 0 ? -1 : h->index[s].entry;
 }
 
 
@@ -3841,7 +5117,7 @@ ptrdiff_t
 hash_put (struct Lisp_Hash_Table *h, Lisp_Object key, Lisp_Object value,
 	  EMACS_UINT hash)
 {
-  ptrdiff_t start_of_bucket, i;
+  ptrdiff_t i;
 
   eassert ((hash & ~INTMASK) == 0);
 
@@ -3850,18 +5126,22 @@ hash_put (struct Lisp_Hash_Table *h, Lisp_Object key, Lisp_Object value,
   h->count++;
 
   /* Store key/value in the key_and_value vector.  */
-  i = XFASTINT (h->next_free);
-  h->next_free = HASH_NEXT (h, i);
+  i = h->next_free;
+  h->next_free = h->next[i];
   HASH_KEY (h, i) = key;
   HASH_VALUE (h, i) = value;
 
   /* Remember its hash code.  */
   HASH_HASH (h, i) = make_number (hash);
 
-  /* Add new entry to its collision chain.  */
-  start_of_bucket = hash % ASIZE (h->index);
-  HASH_NEXT (h, i) = HASH_INDEX (h, start_of_bucket);
-  HASH_INDEX (h, start_of_bucket) = make_number (i);
+  /* Add the new entry to the index.  If deleted slots leave fewer
+     than an eighth of the slots empty, rebuild the index instead,
+     which adds the entry too.  */
+  if (h->index_deleted > 0
+      && h->count + h->index_deleted > h->index_size - (h->index_size >> 3))
+    rehash_hash_index (h);
+  else
+    hash_index_insert (h, i, hash);
   return i;
 }
 
@@ -3872,45 +5152,12 @@ static void
 hash_remove_from_table (struct Lisp_Hash_Table *h, Lisp_Object key)
 {
   EMACS_UINT hash_code;
-  ptrdiff_t start_of_bucket;
-  Lisp_Object idx, prev;
+  ptrdiff_t s;
 
   hash_code = h->hashfn (h, key);
-  start_of_bucket = hash_code % ASIZE (h->index);
-  idx = HASH_INDEX (h, start_of_bucket);
-  prev = Qnil;
-
-  /* We need not gcpro idx, prev since they're either integers or nil.  */
-  while (!NILP (idx))
-    {
-      ptrdiff_t i = XFASTINT (idx);
-
-      if (EQ (key, HASH_KEY (h, i))
-	  || (h->cmpfn
-	      && h->cmpfn (h, key, hash_code,
-			   HASH_KEY (h, i), XUINT (HASH_HASH (h, i)))))
-	{
-	  /* Take entry out of collision chain.  */
-	  if (NILP (prev))
-	    HASH_INDEX (h, start_of_bucket) = HASH_NEXT (h, i);
-	  else
-	    HASH_NEXT (h, XFASTINT (prev)) = HASH_NEXT (h, i);
-
-	  /* Clear slots in key_and_value and add the slots to
-	     the free list.  */
-	  HASH_KEY (h, i) = HASH_VALUE (h, i) = HASH_HASH (h, i) = Qnil;
-	  HASH_NEXT (h, i) = h->next_free;
-	  h->next_free = make_number (i);
-	  h->count--;
-	  eassert (h->count >= 0);
-	  break;
-	}
-      else
-	{
-	  prev = idx;
-	  idx = HASH_NEXT (h, i);
-	}
-    }
+  s = hash_lookup_slot (h, key, hash_code);
+  if (s >= 0)
+    hash_remove_entry (h, s, h->index[s].entry);
 }
 
 
@@ -3925,16 +5172,14 @@ hash_clear (struct Lisp_Hash_Table *h)
 
       for (i = 0; i < size; ++i)
 	{
-	  HASH_NEXT (h, i) = i < size - 1 ? make_number (i + 1) : Qnil;
+	  h->next[i] = i < size - 1 ? i + 1 : -1;
 	  HASH_KEY (h, i) = Qnil;
 	  HASH_VALUE (h, i) = Qnil;
 	  HASH_HASH (h, i) = Qnil;
 	}
 
-      for (i = 0; i < ASIZE (h->index); ++i)
-	ASET (h->index, i, Qnil);
-
-      h->next_free = make_number (0);
+      clear_hash_index (h);
+      h->next_free = 0;
       h->count = 0;
     }
 }
@@ -3953,86 +5198,385 @@ hash_clear (struct Lisp_Hash_Table *h)
 static int
 sweep_weak_table (struct Lisp_Hash_Table *h, int remove_entries_p)
 {
-  ptrdiff_t bucket, n;
+  ptrdiff_t i, n;
   int marked;
 
-  n = ASIZE (h->index) & ~ARRAY_MARK_FLAG;
+  n = ASIZE (h->hash) & ~ARRAY_MARK_FLAG;
   marked = 0;
 
-  for (bucket = 0; bucket < n; ++bucket)
+  for (i = 0; i < n; ++i)
+    if (!NILP (HASH_HASH (h, i)))
+      {
+	int key_known_to_survive_p = survives_gc_p (HASH_KEY (h, i));
+	int value_known_to_survive_p = survives_gc_p (HASH_VALUE (h, i));
+	int remove_p;
+
+	if (EQ (h->weak, Qkey))
+	  remove_p = !key_known_to_survive_p;
+	else if (EQ (h->weak, Qvalue))
+	  remove_p = !value_known_to_survive_p;
+	else if (EQ (h->weak, Qkey_or_value))
+	  remove_p = !(key_known_to_survive_p || value_known_to_survive_p);
+	else if (EQ (h->weak, Qkey_and_value))
+	  remove_p = !(key_known_to_survive_p && value_known_to_survive_p);
+	else
+	  abort ();
+
+	if (remove_entries_p)
+	  {
+	    /* Take entries that don't survive this garbage collection
+	       out of the index, and add them to the free list.  */
+	    if (remove_p)
+	      hash_remove_entry (h, hash_index_slot (h, i,
+						     XUINT (HASH_HASH (h, i))),
+				 i);
+	  }
+	else
+	  {
+	    if (!remove_p)
+	      {
+		/* Make sure key and value survive.  */
+		if (!key_known_to_survive_p)
+		  {
+		    mark_object (HASH_KEY (h, i));
+		    marked = 1;
+		  }
+
+		if (!value_known_to_survive_p)
+		  {
+		    mark_object (HASH_VALUE (h, i));
+		    marked = 1;
+		  }
+	      }
+	  }
+      }
+
+  return marked;
+}
+
+/* Weak hash tables are marked like ephemerons.  An entry of a
+   key-weak table keeps its value alive only once its key is known to
+   be reachable, and similarly for the other kinds of weakness.  An
+   entry that has to wait for an object that is not marked yet is
+   recorded in a map from that object to the waiting entries.  While
+   weak tables are being marked, mark_object calls weak_object_reached
+   for each object it marks, which queues the entries waiting for it.
+   This marks chains of entries, where each value is the key of
+   another entry, in linear time.  Scanning all tables until nothing
+   changes, as a final check, is then a single pass in practice.  */
+
+/* An entry I of table H that waits for an object.  NEXT is the next
+   record waiting for the same object, or in the queue, or -1.  */
+
+struct weak_wait
+{
+  struct Lisp_Hash_Table *h;
+  ptrdiff_t i;
+  ptrdiff_t next;
+};
+
+/* Non-zero while the entries of weak tables are being marked.  */
+
+int marking_weak_tables;
+
+/* The records of waiting entries, WEAK_WAITS_USED of
+   WEAK_WAITS_SIZE.  */
+
+static struct weak_wait *weak_waits;
+static ptrdiff_t weak_waits_size, weak_waits_used;
+
+/* The map from objects to the first record waiting for them, using
+   open addressing with linear probing.  WEAK_WAIT_KEYS holds the
+   objects, and WEAK_WAIT_HEADS the first records, or -1 once the
+   records are queued.  WEAK_WAIT_MAP_SIZE is 0 or a power of 2, and
+   WEAK_WAIT_MAP_SHIFT maps scrambled objects to their first slot.  */
+
+static Lisp_Object *weak_wait_keys;
+static ptrdiff_t *weak_wait_heads;
+static ptrdiff_t weak_wait_map_size, weak_wait_map_used;
+static int weak_wait_map_shift;
+
+/* The first record of the queue of entries whose object was reached,
+   or -1.  */
+
+static ptrdiff_t weak_wait_queue;
+
+/* Weak tables that were reached while entries were waiting, and that
+   still have to be looked at.  */
+
+static struct Lisp_Hash_Table **weak_tables_reached;
+static ptrdiff_t weak_tables_reached_size, weak_tables_reached_used;
+
+/* Non-zero if memory for the above ran out.  The final check then
+   does all the remaining work.  */
+
+static int weak_wait_failed;
+
+/* Value is the map slot of OBJ, or the empty slot where it would
+   go.  */
+
+static ptrdiff_t
+weak_wait_slot (Lisp_Object obj)
+{
+  ptrdiff_t mask = weak_wait_map_size - 1;
+  ptrdiff_t s = (XUINT (obj) * HASH_SCRAMBLE) >> weak_wait_map_shift;
+
+  while (!NILP (weak_wait_keys[s]) && !EQ (weak_wait_keys[s], obj))
+    s = (s + 1) & mask;
+  return s;
+}
+
+/* Make the map large enough for USED objects while keeping at least
+   half of it empty.  Value is zero if memory ran out.  */
+
+static int
+grow_weak_wait_map (ptrdiff_t used)
+{
+  Lisp_Object *old_keys = weak_wait_keys;
+  ptrdiff_t *old_heads = weak_wait_heads;
+  ptrdiff_t s, old_size = weak_wait_map_size;
+  ptrdiff_t new_size = old_size ? old_size : 1024;
+  int bits = 0;
+
+  if (min (PTRDIFF_MAX, SIZE_MAX) / 4 / sizeof *weak_wait_keys < used)
+    return 0;
+  while (new_size < 2 * used)
+    new_size *= 2;
+  if (new_size == old_size)
+    return 1;
+  weak_wait_keys = malloc (new_size * sizeof *weak_wait_keys);
+  weak_wait_heads = malloc (new_size * sizeof *weak_wait_heads);
+  if (!weak_wait_keys || !weak_wait_heads)
     {
-      Lisp_Object idx, next, prev;
+      free (weak_wait_keys);
+      free (weak_wait_heads);
+      weak_wait_keys = old_keys;
+      weak_wait_heads = old_heads;
+      return 0;
+    }
 
-      /* Follow collision chain, removing entries that
-	 don't survive this garbage collection.  */
-      prev = Qnil;
-      for (idx = HASH_INDEX (h, bucket); !NILP (idx); idx = next)
-	{
-	  ptrdiff_t i = XFASTINT (idx);
-	  int key_known_to_survive_p = survives_gc_p (HASH_KEY (h, i));
-	  int value_known_to_survive_p = survives_gc_p (HASH_VALUE (h, i));
-	  int remove_p;
-
-	  if (EQ (h->weak, Qkey))
-	    remove_p = !key_known_to_survive_p;
-	  else if (EQ (h->weak, Qvalue))
-	    remove_p = !value_known_to_survive_p;
-	  else if (EQ (h->weak, Qkey_or_value))
-	    remove_p = !(key_known_to_survive_p || value_known_to_survive_p);
-	  else if (EQ (h->weak, Qkey_and_value))
-	    remove_p = !(key_known_to_survive_p && value_known_to_survive_p);
-	  else
-	    abort ();
+  while (((ptrdiff_t) 1 << bits) < new_size)
+    bits++;
+  weak_wait_map_size = new_size;
+  weak_wait_map_shift = BITS_PER_EMACS_INT - bits;
+  for (s = 0; s < new_size; ++s)
+    weak_wait_keys[s] = Qnil;
+  for (s = 0; s < old_size; ++s)
+    if (!NILP (old_keys[s]))
+      {
+	ptrdiff_t t = weak_wait_slot (old_keys[s]);
+	weak_wait_keys[t] = old_keys[s];
+	weak_wait_heads[t] = old_heads[s];
+      }
 
-	  next = HASH_NEXT (h, i);
+  free (old_keys);
+  free (old_heads);
+  return 1;
+}
 
-	  if (remove_entries_p)
-	    {
-	      if (remove_p)
-		{
-		  /* Take out of collision chain.  */
-		  if (NILP (prev))
-		    HASH_INDEX (h, bucket) = next;
-		  else
-		    HASH_NEXT (h, XFASTINT (prev)) = next;
+/* Make room for USED records.  Value is zero if memory ran out.  */
 
-		  /* Add to free list.  */
-		  HASH_NEXT (h, i) = h->next_free;
-		  h->next_free = idx;
+static int
+grow_weak_waits (ptrdiff_t used)
+{
+  ptrdiff_t new_size = weak_waits_size ? weak_waits_size : 1024;
+  struct weak_wait *p;
 
-		  /* Clear key, value, and hash.  */
-		  HASH_KEY (h, i) = HASH_VALUE (h, i) = Qnil;
-		  HASH_HASH (h, i) = Qnil;
+  if (min (PTRDIFF_MAX, SIZE_MAX) / 2 / sizeof *weak_waits < used)
+    return 0;
+  while (new_size < used)
+    new_size *= 2;
+  if (new_size == weak_waits_size)
+    return 1;
+  p = realloc (weak_waits, new_size * sizeof *weak_waits);
+  if (!p)
+    return 0;
+  weak_waits = p;
+  weak_waits_size = new_size;
+  return 1;
+}
 
-		  h->count--;
-		}
-	      else
-		{
-		  prev = idx;
-		}
-	    }
-	  else
+/* Record that entry I of weak table H waits for OBJ to be marked.  */
+
+static void
+weak_wait_for (Lisp_Object obj, struct Lisp_Hash_Table *h, ptrdiff_t i)
+{
+  ptrdiff_t s, w;
+
+  if (weak_wait_failed
+      || !grow_weak_waits (weak_waits_used + 1)
+      || !grow_weak_wait_map (weak_wait_map_used + 1))
+    {
+      weak_wait_failed = 1;
+      return;
+    }
+
+  s = weak_wait_slot (obj);
+  if (NILP (weak_wait_keys[s]))
+    {
+      weak_wait_keys[s] = obj;
+      weak_wait_heads[s] = -1;
+      weak_wait_map_used++;
+    }
+
+  w = weak_waits_used++;
+  weak_waits[w].h = h;
+  weak_waits[w].i = i;
+  weak_waits[w].next = weak_wait_heads[s];
+  weak_wait_heads[s] = w;
+}
+
+/* Called by mark_object for each object OBJ it marks while weak tables
+   are being marked.  Queue the entries waiting for OBJ, and remember
+   OBJ if it is a weak table that has to be looked at.  */
+
+void
+weak_object_reached (Lisp_Object obj)
+{
+  if (survives_gc_p (obj))
+    return;
+
+  if (HASH_TABLE_P (obj) && !NILP (XHASH_TABLE (obj)->weak))
+    {
+      if (weak_tables_reached_used == weak_tables_reached_size)
+	{
+	  ptrdiff_t new_size = (weak_tables_reached_size
+				? 2 * weak_tables_reached_size : 16);
+	  struct Lisp_Hash_Table **p = NULL;
+	  if (new_size
+	      <= min (PTRDIFF_MAX, SIZE_MAX) / sizeof *weak_tables_reached)
+	    p = realloc (weak_tables_reached,
+			 new_size * sizeof *weak_tables_reached);
+	  if (!p)
 	    {
-	      if (!remove_p)
-		{
-		  /* Make sure key and value survive.  */
-		  if (!key_known_to_survive_p)
-		    {
-		      mark_object (HASH_KEY (h, i));
-		      marked = 1;
-		    }
-
-		  if (!value_known_to_survive_p)
-		    {
-		      mark_object (HASH_VALUE (h, i));
-		      marked = 1;
-		    }
-		}
+	      weak_wait_failed = 1;
+	      return;
 	    }
+	  weak_tables_reached = p;
+	  weak_tables_reached_size = new_size;
 	}
+      weak_tables_reached[weak_tables_reached_used++] = XHASH_TABLE (obj);
     }
 
-  return marked;
+  if (weak_wait_map_used > 0)
+    {
+      ptrdiff_t s = weak_wait_slot (obj);
+      ptrdiff_t w = weak_wait_heads[s];
+
+      if (!NILP (weak_wait_keys[s]) && w >= 0)
+	{
+	  /* Append the queue to the records waiting for OBJ.  */
+	  while (weak_waits[w].next >= 0)
+	    w = weak_waits[w].next;
+	  weak_waits[w].next = weak_wait_queue;
+	  weak_wait_queue = weak_wait_heads[s];
+	  weak_wait_heads[s] = -1;
+	}
+    }
+}
+
+/* Mark what entry I of weak table H keeps alive, if the objects it
+   depends on are marked.  Otherwise, if WAIT is non-zero, record that
+   the entry waits for them.  */
+
+static void
+mark_weak_entry (struct Lisp_Hash_Table *h, ptrdiff_t i, int wait)
+{
+  Lisp_Object key = HASH_KEY (h, i), value = HASH_VALUE (h, i);
+  int key_known_to_survive_p = survives_gc_p (key);
+  int value_known_to_survive_p = survives_gc_p (value);
+
+  if (EQ (h->weak, Qkey))
+    {
+      if (key_known_to_survive_p)
+	mark_object (value);
+      else if (wait)
+	weak_wait_for (key, h, i);
+    }
+  else if (EQ (h->weak, Qvalue))
+    {
+      if (value_known_to_survive_p)
+	mark_object (key);
+      else if (wait)
+	weak_wait_for (value, h, i);
+    }
+  else if (EQ (h->weak, Qkey_or_value))
+    {
+      if (key_known_to_survive_p || value_known_to_survive_p)
+	{
+	  mark_object (key);
+	  mark_object (value);
+	}
+      else if (wait)
+	{
+	  weak_wait_for (key, h, i);
+	  weak_wait_for (value, h, i);
+	}
+    }
+}
+
+/* Mark what the entries of the marked weak hash tables keep alive,
+   as far as the waiting entries can tell.  */
+
+static void
+mark_weak_tables (void)
+{
+  struct Lisp_Hash_Table *h;
+  ptrdiff_t entries = 0;
+
+  /* Most entries of the marked tables wait for something, usually for
+     distinct objects, so make room for them all at once.  */
+  for (h = weak_hash_tables; h; h = h->next_weak)
+    if (h->header.size & ARRAY_MARK_FLAG)
+      entries += min (h->count, PTRDIFF_MAX / 4 - entries);
+  if (entries > 0
+      && !(grow_weak_waits (entries) && grow_weak_wait_map (entries)))
+    weak_wait_failed = 1;
+
+  marking_weak_tables = 1;
+  weak_wait_queue = -1;
+  for (h = weak_hash_tables; h; h = h->next_weak)
+    if (h->header.size & ARRAY_MARK_FLAG)
+      {
+	ptrdiff_t i, n = ASIZE (h->hash) & ~ARRAY_MARK_FLAG;
+	for (i = 0; i < n; ++i)
+	  if (!NILP (HASH_HASH (h, i)))
+	    mark_weak_entry (h, i, 1);
+      }
+
+  while (weak_wait_queue >= 0 || weak_tables_reached_used > 0)
+    {
+      if (weak_wait_queue >= 0)
+	{
+	  struct weak_wait *w = &weak_waits[weak_wait_queue];
+	  weak_wait_queue = w->next;
+	  if (!NILP (HASH_HASH (w->h, w->i)))
+	    mark_weak_entry (w->h, w->i, 0);
+	}
+      else
+	{
+	  ptrdiff_t i, n;
+	  h = weak_tables_reached[--weak_tables_reached_used];
+	  n = ASIZE (h->hash) & ~ARRAY_MARK_FLAG;
+	  for (i = 0; i < n; ++i)
+	    if (!NILP (HASH_HASH (h, i)))
+	      mark_weak_entry (h, i, 1);
+	}
+    }
+
+  marking_weak_tables = 0;
+  free (weak_waits);
+  free (weak_wait_keys);
+  free (weak_wait_heads);
+  free (weak_tables_reached);
+  weak_waits = NULL;
+  weak_wait_keys = NULL;
+  weak_wait_heads = NULL;
+  weak_tables_reached = NULL;
+  weak_waits_size = weak_waits_used = 0;
+  weak_wait_map_size = weak_wait_map_used = 0;
+  weak_tables_reached_size = weak_tables_reached_used = 0;
+  weak_wait_failed = 0;
 }
 
 /* Remove elements from weak hash tables that don't survive the
@@ -4045,12 +5589,17 @@ sweep_weak_hash_tables (void)
   struct Lisp_Hash_Table *h, *used, *next;
   int marked;
 
-  /* Mark all keys and values that are in use.  Keep on marking until
-     there is no more change.  This is necessary for cases like
-     value-weak table A containing an entry X -> Y, where Y is used in a
-     key-weak table B, Z -> Y.  If B comes after A in the list of weak
-     tables, X -> Y might be removed from A, although when looking at B
-     one finds that it shouldn't.  */
+  /* Mark all keys and values that are in use.  */
+  mark_weak_tables ();
+
+  /* Check that nothing more needs to be marked, and keep on marking
+     until there is no more change if it does.  This is necessary for
+     cases like value-weak table A containing an entry X -> Y, where Y
+     is used in a key-weak table B, Z -> Y.  If B comes after A in the
+     list of weak tables, X -> Y might be removed from A, although when
+     looking at B one finds that it shouldn't.  mark_weak_tables
+     handles such cases unless memory ran out, or an object got marked
+     without mark_object noticing it.  */
   do
     {
       marked = 0;
@@ -4092,40 +5641,167 @@ sweep_weak_hash_tables (void)
 
 #define SXHASH_MAX_DEPTH 3
 
-/* Maximum length up to which to take list and vector elements into
-   account.  */
+/* Maximum number of list and vector elements, in all, that sxhash
+   takes into account.  Elements are visited depth first, so lists and
+   vectors that share a long prefix still get different hash codes if
+   they differ within the first SXHASH_MAX_ELEMENTS elements.  */
 
-#define SXHASH_MAX_LEN   7
+#define SXHASH_MAX_ELEMENTS 32
 
 /* Combine two integers X and Y for hashing.  The result might not fit
    into a Lisp integer.  */
 
 #define SXHASH_COMBINE(X, Y)						\
-  ((((EMACS_UINT) (X) << 4) + ((EMACS_UINT) (X) >> (BITS_PER_EMACS_INT - 4))) \
-   + (EMACS_UINT) (Y))
+  (((((EMACS_UINT) (X) << 5)						\
+     | ((EMACS_UINT) (X) >> (BITS_PER_EMACS_INT - 5)))			\
+    ^ (EMACS_UINT) (Y)) * HASH_SCRAMBLE)
 
-/* Hash X, returning a value that fits into a Lisp integer.  */
+/* Hash X, returning a value that fits into a Lisp integer.  This
+   folds the high-order half of X, which the multiplication in
+   SXHASH_COMBINE mixes best, into the low-order half.  */
 #define SXHASH_REDUCE(X) \
-  ((((X) ^ (X) >> (BITS_PER_EMACS_INT - FIXNUM_BITS))) & INTMASK)
+  ((((X) ^ (X) >> (BITS_PER_EMACS_INT / 2))) & INTMASK)
 
-/* Return a hash for string PTR which has length LEN.  The hash value
-   can be any EMACS_UINT value.  */
+/* The seed of the hash codes of strings.  It is a constant, so that
+   hash codes stay valid in a dumped Emacs and across sessions, as
+   for the names of cached image thumbnails.  */
 
-EMACS_UINT
-hash_string (char const *ptr, ptrdiff_t len)
+#define HASH_SEED 0xa0761d6478bd642fULL
+
+/* The multipliers of the string hash function.  */
+
+static uint64_t const hash_secret[4] =
+  {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+  };
+
+/* Multiply A and B as 128-bit numbers and store the low half of the
+   product in *A and the high half in *B.  */
+
+static inline void
+hash_mum (uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = *a;
+  r *= *b;
+  *a = r;
+  *b = r >> 64;
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32;
+  uint64_t la = (uint32_t) *a, lb = (uint32_t) *b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+/* Value is the 128-bit product of A and B folded to 64 bits.  */
+
+static inline uint64_t
+hash_mix (uint64_t a, uint64_t b)
 {
-  char const *p = ptr;
-  char const *end = p + len;
-  unsigned char c;
-  EMACS_UINT hash = 0;
+  hash_mum (&a, &b);
+  return a ^ b;
+}
+
+/* Value is the 8 bytes at P, or the 4 bytes at P, as a number.  */
+
+static inline uint64_t
+hash_read8 (unsigned char const *p)
+{
+  uint64_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
 
-  while (p != end)
+static inline uint64_t
+hash_read4 (unsigned char const *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Return a hash for the LEN bytes at PTR, using SEED.  This is the
+   wyhash function of Wang Yi.  It reads eight bytes at a time, and
+   strings longer than 48 bytes in three independent lanes, which
+   modern processors compute in parallel.  */
+
+static uint64_t
+hash_bytes (char const *ptr, ptrdiff_t len, uint64_t seed)
+{
+  unsigned char const *p = (unsigned char const *) ptr;
+  uint64_t a, b;
+
+  seed ^= hash_mix (seed ^ hash_secret[0], hash_secret[1]);
+  if (len <= 16)
+    {
+      if (len >= 4)
+	{
+	  ptrdiff_t off = (len >> 3) << 2;
+	  a = (hash_read4 (p) << 32) | hash_read4 (p + off);
+	  b = (hash_read4 (p + len - 4) << 32) | hash_read4 (p + len - 4 - off);
+	}
+      else if (len > 0)
+	{
+	  a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8)
+	    | p[len - 1];
+	  b = 0;
+	}
+      else
+	a = b = 0;
+    }
+  else
     {
-      c = *p++;
-      hash = SXHASH_COMBINE (hash, c);
+      ptrdiff_t i = len;
+
+      if (i > 48)
+	{
+	  uint64_t seed1 = seed, seed2 = seed;
+	  do
+	    {
+	      seed = hash_mix (hash_read8 (p) ^ hash_secret[1],
+			       hash_read8 (p + 8) ^ seed);
+	      seed1 = hash_mix (hash_read8 (p + 16) ^ hash_secret[2],
+				hash_read8 (p + 24) ^ seed1);
+	      seed2 = hash_mix (hash_read8 (p + 32) ^ hash_secret[3],
+				hash_read8 (p + 40) ^ seed2);
+	      p += 48;
+	      i -= 48;
+	    }
+	  while (i > 48);
+	  seed ^= seed1 ^ seed2;
+	}
+
+      while (i > 16)
+	{
+	  seed = hash_mix (hash_read8 (p) ^ hash_secret[1],
+			   hash_read8 (p + 8) ^ seed);
+	  i -= 16;
+	  p += 16;
+	}
+
+      a = hash_read8 (p + i - 16);
+      b = hash_read8 (p + i - 8);
     }
 
-  return hash;
+  a ^= hash_secret[1];
+  b ^= seed;
+  hash_mum (&a, &b);
+  return hash_mix (a ^ hash_secret[0] ^ len, b ^ hash_secret[1]);
+}
+
+/* Return a hash for string PTR which has length LEN.  The hash value
+   can be any EMACS_UINT value.  */
+
+EMACS_UINT
+hash_string (char const *ptr, ptrdiff_t len)
+{
+  return hash_bytes (ptr, len, HASH_SEED);
 }
 
 /* Return a hash for string PTR which has length LEN.  The hash
@@ -4138,49 +5814,47 @@ sxhash_string (char const *ptr, ptrdiff_t len)
   return SXHASH_REDUCE (hash);
 }
 
-/* Return a hash for the floating point value VAL.  */
+/* Return a hash for the floating point value VAL.  `equal' compares
+   floats with `=', except that all NaNs are equal, so -0.0 has to
+   hash like 0.0, and all NaNs alike.  */
 
 static EMACS_INT
 sxhash_float (double val)
 {
-  EMACS_UINT hash = 0;
-  enum {
-    WORDS_PER_DOUBLE = (sizeof val / sizeof hash
-			+ (sizeof val % sizeof hash != 0))
-  };
-  union {
-    double val;
-    EMACS_UINT word[WORDS_PER_DOUBLE];
-  } u;
-  int i;
-  u.val = val;
-  memset (&u.val + 1, 0, sizeof u - sizeof u.val);
-  for (i = 0; i < WORDS_PER_DOUBLE; i++)
-    hash = SXHASH_COMBINE (hash, u.word[i]);
+  EMACS_UINT hash;
+
+  if (val == 0)
+    val = 0;
+  if (val != val)
+    hash = 0;
+  else
+    hash = hash_bytes ((char const *) &val, sizeof val, HASH_SEED);
   return SXHASH_REDUCE (hash);
 }
 
+static EMACS_UINT sxhash_1 (Lisp_Object, int, int *);
+
 /* Return a hash for list LIST.  DEPTH is the current depth in the
-   list.  We don't recurse deeper than SXHASH_MAX_DEPTH in it.  */
+   list.  We don't recurse deeper than SXHASH_MAX_DEPTH in it.
+   *BUDGET is the number of elements that may still be looked at.  */
 
 static EMACS_UINT
-sxhash_list (Lisp_Object list, int depth)
+sxhash_list (Lisp_Object list, int depth, int *budget)
 {
   EMACS_UINT hash = 0;
-  int i;
 
   if (depth < SXHASH_MAX_DEPTH)
-    for (i = 0;
-	 CONSP (list) && i < SXHASH_MAX_LEN;
-	 list = XCDR (list), ++i)
+    for (;
+	 CONSP (list) && *budget > 0;
+	 list = XCDR (list), --*budget)
       {
-	EMACS_UINT hash2 = sxhash (XCAR (list), depth + 1);
+	EMACS_UINT hash2 = sxhash_1 (XCAR (list), depth + 1, budget);
 	hash = SXHASH_COMBINE (hash, hash2);
       }
 
   if (!NILP (list))
     {
-      EMACS_UINT hash2 = sxhash (list, depth + 1);
+      EMACS_UINT hash2 = sxhash_1 (list, depth + 1, budget);
       hash = SXHASH_COMBINE (hash, hash2);
     }
 
@@ -4189,18 +5863,18 @@ sxhash_list (Lisp_Object list, int depth)
 
 
 /* Return a hash for vector VECTOR.  DEPTH is the current depth in
-   the Lisp structure.  */
+   the Lisp structure.  *BUDGET is the number of elements that may
+   still be looked at.  */
 
 static EMACS_UINT
-sxhash_vector (Lisp_Object vec, int depth)
+sxhash_vector (Lisp_Object vec, int depth, int *budget)
 {
   EMACS_UINT hash = ASIZE (vec);
-  int i, n;
+  ptrdiff_t i;
 
-  n = min (SXHASH_MAX_LEN, ASIZE (vec));
-  for (i = 0; i < n; ++i)
+  for (i = 0; i < ASIZE (vec) && *budget > 0; ++i, --*budget)
     {
-      EMACS_UINT hash2 = sxhash (AREF (vec, i), depth + 1);
+      EMACS_UINT hash2 = sxhash_1 (AREF (vec, i), depth + 1, budget);
       hash = SXHASH_COMBINE (hash, hash2);
     }
 
@@ -4212,22 +5886,47 @@ sxhash_vector (Lisp_Object vec, int depth)
 static EMACS_UINT
 sxhash_bool_vector (Lisp_Object vec)
 {
-  EMACS_UINT hash = XBOOL_VECTOR (vec)->size;
-  int i, n;
+  struct Lisp_Bool_Vector *b = XBOOL_VECTOR (vec);
+  EMACS_UINT hash = hash_bytes ((char const *) b->data,
+				((b->size + BOOL_VECTOR_BITS_PER_CHAR - 1)
+				 / BOOL_VECTOR_BITS_PER_CHAR),
+				HASH_SEED);
 
-  n = min (SXHASH_MAX_LEN, XBOOL_VECTOR (vec)->header.size);
-  for (i = 0; i < n; ++i)
-    hash = SXHASH_COMBINE (hash, XBOOL_VECTOR (vec)->data[i]);
+  return SXHASH_REDUCE (SXHASH_COMBINE (hash, b->size));
+}
 
-  return SXHASH_REDUCE (hash);
+/* Return a hash for numeric vector VECTOR.  */
+
+static EMACS_UINT
+sxhash_numeric_vector (Lisp_Object vec)
+{
+  struct Lisp_Numeric_Vector *v = XNUMERIC_VECTOR (vec);
+  EMACS_UINT hash;
+
+  if (v->type == NUMERIC_VECTOR_FLOAT64)
+    {
+      /* Their elements are compared like floats.  */
+      ptrdiff_t i;
+      hash = 0;
+      for (i = 0; i < v->size; i++)
+	hash = SXHASH_COMBINE (hash, sxhash_float (v->data.f64[i]));
+    }
+  else
+    hash = hash_bytes ((char const *) &v->data,
+		       v->size * NUMERIC_VECTOR_ELT_SIZE (v->type),
+		       HASH_SEED);
+
+  return SXHASH_REDUCE (SXHASH_COMBINE (hash, v->size));
 }
 
 
 /* Return a hash code for OBJ.  DEPTH is the current depth in the Lisp
-   structure.  Value is an unsigned integer clipped to INTMASK.  */
+   structure, and *BUDGET the number of list and vector elements that
+   may still be looked at.  Value is an unsigned integer clipped to
+   INTMASK.  */
 
-EMACS_UINT
-sxhash (Lisp_Object obj, int depth)
+static EMACS_UINT
+sxhash_1 (Lisp_Object obj, int depth, int *budget)
 {
   EMACS_UINT hash;
 
@@ -4259,9 +5958,11 @@ sxhash (Lisp_Object obj, int depth)
 	   they are `eq', except for strings and bit-vectors.  In
 	   Emacs, this works differently.  We have to compare element
 	   by element.  */
-	hash = sxhash_vector (obj, depth);
+	hash = sxhash_vector (obj, depth, budget);
       else if (BOOL_VECTOR_P (obj))
 	hash = sxhash_bool_vector (obj);
+      else if (NUMERIC_VECTOR_P (obj))
+	hash = sxhash_numeric_vector (obj);
       else
 	/* Others are `equal' if they are `eq', so let's take their
 	   address as hash.  */
@@ -4269,7 +5970,7 @@ sxhash (Lisp_Object obj, int depth)
       break;
 
     case Lisp_Cons:
-      hash = sxhash_list (obj, depth);
+      hash = sxhash_list (obj, depth, budget);
       break;
 
     case Lisp_Float:
@@ -4283,8 +5984,18 @@ sxhash (Lisp_Object obj, int depth)
   return hash;
 }
 
+/* Return a hash code for OBJ.  DEPTH is the current depth in the Lisp
+   structure.  Value is an unsigned integer clipped to INTMASK.  */
+
+EMACS_UINT
+sxhash (Lisp_Object obj, int depth)
+{
+  int budget = SXHASH_MAX_ELEMENTS;
+  return sxhash_1 (obj, depth, &budget);
+}
+
+
 
-
 /***********************************************************************
 			    Lisp Interface
  ***********************************************************************/
@@ -4909,7 +6620,17 @@ syms_of_fns (void)
   defsubr (&Smaphash);
   defsubr (&Sdefine_hash_table_test);
 
+  DEFSYM (Qstring_builder_p, "string-builder-p");
+  defsubr (&Smake_string_builder);
+  defsubr (&Sstring_builder_p);
+  defsubr (&Sstring_builder_append_string);
+  defsubr (&Sstring_builder_append_char);
+  defsubr (&Sstring_builder_append_number);
+  defsubr (&Sstring_builder_length);
+  defsubr (&Sstring_builder_finish);
+
   DEFSYM (Qstring_lessp, "string-lessp");
+  DEFSYM (QCkey, ":key");
   DEFSYM (Qprovide, "provide");
   DEFSYM (Qrequire, "require");
   DEFSYM (Qyes_or_no_p_history, "yes-or-no-p-history");
@@ -818,6 +818,7 @@ extern void syms_of_xfont (void);
 extern void syms_of_ftxfont (void);
 #ifdef HAVE_XFT
 extern struct font_driver xftfont_driver;
+extern void xftfont_flush_glyphs (void);
 extern void syms_of_xftfont (void);
 #elif defined HAVE_FREETYPE
 extern struct font_driver ftxfont_driver;
@@ -22,6 +22,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <math.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <errno.h>
 
 #ifdef HAVE_PNG
 #if defined HAVE_LIBPNG_PNG_H
@@ -64,6 +65,16 @@ typedef struct x_bitmap_record Bitmap_Record;
 
 #define PIX_MASK_RETAIN	0
 #define PIX_MASK_DRAW	1
+
+/* PNG and JPEG images can be decoded in worker threads.  */
+#if defined HAVE_PTHREAD && (defined HAVE_PNG || defined HAVE_JPEG)
+#define USE_DECODE_THREADS 1
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include "keyboard.h"
+#include "process.h"
+#endif
 #endif /* HAVE_X_WINDOWS */
 
 
@@ -560,11 +571,13 @@ static Lisp_Object QCheuristic_mask;
 static Lisp_Object QCcolor_symbols;
 static Lisp_Object QCindex, QCmatrix, QCcolor_adjustment, QCmask, QCgeometry;
 static Lisp_Object QCcrop, QCrotation;
+static Lisp_Object QCmax_width, QCmax_height, QCscale;
 
 /* Other symbols.  */
 
 static Lisp_Object Qcount, Qextension_data, Qdelay;
 static Lisp_Object Qlaplace, Qemboss, Qedge_detection, Qheuristic;
+static Lisp_Object Qmemory, Qlimit, Qhits, Qmisses, Qevictions;
 
 /* Function prototypes.  */
 
@@ -974,6 +987,12 @@ or omitted means use the selected frame.  */)
  ***********************************************************************/
 
 static void free_image (struct frame *f, struct image *img);
+static void image_cache_touch (struct image_cache *c, struct image *img);
+static void image_cache_unlink (struct image_cache *c, struct image *img);
+static void account_image_memory (struct frame *f, struct image *img);
+#ifdef USE_DECODE_THREADS
+static void cancel_image_decode (struct image *img);
+#endif
 
 #define MAX_IMAGE_SIZE 10.0
 /* Allocate and return a new image structure for image specification
@@ -1017,6 +1036,13 @@ free_image (struct frame *f, struct image *img)
 	img->next->prev = img->prev;
 
       c->images[img->id] = NULL;
+      image_cache_unlink (c, img);
+      c->memory -= img->size;
+
+#ifdef USE_DECODE_THREADS
+      if (img->decode_job)
+	cancel_image_decode (img);
+#endif
 
       /* Free resources, then free IMG.  */
       img->type->free (f, img);
@@ -1024,22 +1050,19 @@ free_image (struct frame *f, struct image *img)
     }
 }
 
-/* Return 1 if the given widths and heights are valid for display;
-   otherwise, return 0. */
+/* Store in *MAX_WIDTH and *MAX_HEIGHT the largest image width and
+   height allowed on frame F by `max-image-size'.  F may be null.  */
 
-static int
-check_image_size (struct frame *f, int width, int height)
+static void
+image_size_limits (struct frame *f, int *max_width, int *max_height)
 {
-  int w, h;
-
-  if (width <= 0 || height <= 0)
-    return 0;
-
   if (INTEGERP (Vmax_image_size))
-    return (width <= XINT (Vmax_image_size)
-	    && height <= XINT (Vmax_image_size));
+    *max_width = *max_height = clip_to_bounds (0, XINT (Vmax_image_size),
+					       INT_MAX);
   else if (FLOATP (Vmax_image_size))
     {
+      double w, h;
+
       if (f != NULL)
 	{
 	  w = FRAME_PIXEL_WIDTH (f);
@@ -1047,11 +1070,28 @@ check_image_size (struct frame *f, int width, int height)
 	}
       else
 	w = h = 1024;  /* Arbitrary size for unknown frame. */
-      return (width <= XFLOAT_DATA (Vmax_image_size) * w
-	      && height <= XFLOAT_DATA (Vmax_image_size) * h);
+      w *= XFLOAT_DATA (Vmax_image_size);
+      h *= XFLOAT_DATA (Vmax_image_size);
+      *max_width = w <= 0 ? 0 : w < INT_MAX ? w : INT_MAX;
+      *max_height = h <= 0 ? 0 : h < INT_MAX ? h : INT_MAX;
     }
   else
-    return 1;
+    *max_width = *max_height = INT_MAX;
+}
+
+/* Return 1 if the given widths and heights are valid for display;
+   otherwise, return 0. */
+
+static int
+check_image_size (struct frame *f, int width, int height)
+{
+  int max_width, max_height;
+
+  if (width <= 0 || height <= 0)
+    return 0;
+
+  image_size_limits (f, &max_width, &max_height);
+  return width <= max_width && height <= max_height;
 }
 
 /* Prepare image IMG for display on frame F.  Must be called before
@@ -1062,12 +1102,15 @@ prepare_image_for_display (struct frame *f, struct image *img)
 {
   /* We're about to display IMG, so set its timestamp to `now'.  */
   img->timestamp = current_emacs_time ();
+  image_cache_touch (FRAME_IMAGE_CACHE (f), img);
 
   /* If IMG doesn't have a pixmap yet, load it now, using the image
      type dependent loader function.  */
-  if (img->pixmap == NO_PIXMAP && !img->load_failed_p)
-    img->load_failed_p = img->type->load (f, img) == 0;
-
+  if (img->pixmap == NO_PIXMAP && !img->load_failed_p && !img->decode_job)
+    {
+      img->load_failed_p = img->type->load (f, img) == 0;
+      account_image_memory (f, img);
+    }
 }
 
 
@@ -1394,6 +1437,134 @@ make_image_cache (void)
 }
 
 
+/* Remove IMG from the least-recently-used list of cache C.  */
+
+static void
+image_cache_unlink (struct image_cache *c, struct image *img)
+{
+  if (img->lru_prev)
+    img->lru_prev->lru_next = img->lru_next;
+  else if (c->lru_first == img)
+    c->lru_first = img->lru_next;
+
+  if (img->lru_next)
+    img->lru_next->lru_prev = img->lru_prev;
+  else if (c->lru_last == img)
+    c->lru_last = img->lru_prev;
+
+  img->lru_next = img->lru_prev = NULL;
+}
+
+
+/* Make IMG the most recently used image of cache C.  */
+
+static void
+image_cache_touch (struct image_cache *c, struct image *img)
+{
+  if (c->lru_first == img)
+    return;
+
+  image_cache_unlink (c, img);
+  img->lru_next = c->lru_first;
+  if (c->lru_first)
+    c->lru_first->lru_prev = img;
+  c->lru_first = img;
+  if (!c->lru_last)
+    c->lru_last = img;
+}
+
+
+/* Nonzero means the image caches should be cleaned up, either because
+   redisplay has run often enough that some images may not have been
+   displayed for a while, or because a cache has exceeded its memory
+   budget.  The cleanup itself is done by clear_image_caches_when_idle.  */
+
+int image_cache_cleanup_pending;
+
+/* Return the number of bytes per pixel of pixmaps on frame F.  */
+
+static int
+image_pixel_bytes (struct frame *f)
+{
+  int depth = DefaultDepthOfScreen (FRAME_X_SCREEN (f));
+  return depth > 16 ? 4 : depth > 8 ? 2 : 1;
+}
+
+
+/* Return the number of bytes image cache C may use according to
+   `image-cache-memory-limit', or -1 if it is not limited.  */
+
+static ptrdiff_t
+image_cache_memory_limit (struct image_cache *c)
+{
+  double limit;
+
+  if (INTEGERP (Vimage_cache_memory_limit))
+    limit = XINT (Vimage_cache_memory_limit);
+  else if (FLOATP (Vimage_cache_memory_limit))
+    {
+      /* The limit is relative to the size of the frames sharing the
+	 cache, so that each frame can hold that many frame-fulls of
+	 images.  */
+      Lisp_Object tail, frame;
+      double area = 0;
+
+      FOR_EACH_FRAME (tail, frame)
+	{
+	  struct frame *f = XFRAME (frame);
+	  if (FRAME_WINDOW_P (f) && FRAME_IMAGE_CACHE (f) == c)
+	    area += ((double) FRAME_PIXEL_WIDTH (f) * FRAME_PIXEL_HEIGHT (f)
+		     * image_pixel_bytes (f));
+	}
+      limit = XFLOAT_DATA (Vimage_cache_memory_limit) * area;
+    }
+  else
+    return -1;
+
+  return limit <= 0 ? 0 : limit < PTRDIFF_MAX ? limit : PTRDIFF_MAX;
+}
+
+
+/* Return the number of bytes the decoded pixmap and mask of image IMG
+   take on frame F.  This is an estimate of the memory used by the
+   window system, which we cannot query directly.  */
+
+static ptrdiff_t
+image_memory_size (struct frame *f, struct image *img)
+{
+  ptrdiff_t size = 0;
+
+  if (img->pixmap != NO_PIXMAP)
+    size += (ptrdiff_t) img->width * img->height * image_pixel_bytes (f);
+  if (img->mask != NO_PIXMAP)
+    size += (ptrdiff_t) (img->width + 7) / 8 * img->height;
+  return size + img->ncolors * sizeof *img->colors;
+}
+
+
+/* Recompute the memory taken by image IMG on frame F, and update the
+   total of its image cache accordingly.  Call this whenever IMG's
+   pixmaps have been (re)created.  If the cache grows beyond its
+   budget, arrange for it to be trimmed once Emacs is idle.  */
+
+static void
+account_image_memory (struct frame *f, struct image *img)
+{
+  struct image_cache *c = FRAME_IMAGE_CACHE (f);
+  ptrdiff_t size = image_memory_size (f, img);
+
+  c->memory += size - img->size;
+  img->size = size;
+
+  if (size > 0 && !image_cache_cleanup_pending)
+    {
+      ptrdiff_t limit = image_cache_memory_limit (c);
+      if (limit >= 0 && c->memory > limit)
+	image_cache_cleanup_pending = 1;
+    }
+}
+
+
 /* Find an image matching SPEC in the cache, and return it.  If no
    image is found, return NULL.  */
 static struct image *
@@ -1502,36 +1673,54 @@ clear_image_cache (struct frame *f, Lisp_Object filter)
 		}
 	    }
 	}
-      else if (INTEGERP (Vimage_cache_eviction_delay))
+      else
 	{
-	  /* Free cache based on timestamp.  */
-	  EMACS_TIME old, t;
-	  double delay;
-	  ptrdiff_t nimages = 0;
-
-	  for (i = 0; i < c->used; ++i)
-	    if (c->images[i])
-	      nimages++;
-
-	  /* If the number of cached images has grown unusually large,
-	     decrease the cache eviction delay (Bug#6230).  */
-	  delay = XINT (Vimage_cache_eviction_delay);
-	  if (nimages > 40)
-	    delay = 1600 * delay / nimages / nimages;
-	  delay = max (delay, 1);
+	  ptrdiff_t limit = image_cache_memory_limit (c);
 
-	  t = current_emacs_time ();
-	  old = sub_emacs_time (t, EMACS_TIME_FROM_DOUBLE (delay));
-
-	  for (i = 0; i < c->used; ++i)
+	  if (INTEGERP (Vimage_cache_eviction_delay))
 	    {
-	      struct image *img = c->images[i];
-	      if (img && EMACS_TIME_LT (img->timestamp, old))
+	      /* Free cache based on timestamp.  */
+	      EMACS_TIME old, t;
+	      double delay;
+	      ptrdiff_t nimages = 0;
+
+	      for (i = 0; i < c->used; ++i)
+		if (c->images[i])
+		  nimages++;
+
+	      /* If the number of cached images has grown unusually large,
+		 decrease the cache eviction delay (Bug#6230).  */
+	      delay = XINT (Vimage_cache_eviction_delay);
+	      if (nimages > 40)
+		delay = 1600 * delay / nimages / nimages;
+	      delay = max (delay, 1);
+
+	      t = current_emacs_time ();
+	      old = sub_emacs_time (t, EMACS_TIME_FROM_DOUBLE (delay));
+
+	      for (i = 0; i < c->used; ++i)
 		{
-		  free_image (f, img);
-		  ++nfreed;
+		  struct image *img = c->images[i];
+		  if (img && EMACS_TIME_LT (img->timestamp, old))
+		    {
+		      free_image (f, img);
+		      ++nfreed;
+		      ++c->evictions;
+		    }
 		}
 	    }
+
+	  /* Free the least recently used images until the cache fits
+	     into its memory budget.  Always keep the most recently used
+	     image, so that an image larger than the whole budget can
+	     still be displayed without being reloaded over and over.  */
+	  if (limit >= 0)
+	    while (c->memory > limit && c->lru_last != c->lru_first)
+	      {
+		free_image (f, c->lru_last);
+		++nfreed;
+		++c->evictions;
+	      }
 	}
 
       /* We may be clearing the image cache because, for example,
@@ -1556,6 +1745,22 @@ clear_image_cache (struct frame *f, Lisp_Object filter)
     }
 }
 
+/* Free images according to `image-cache-eviction-delay' and
+   `image-cache-memory-limit'.  This is called when Emacs becomes idle,
+   rather than from redisplay, so that the work of freeing images, and
+   of redrawing the frames that displayed them, is not charged to the
+   redisplay cycle that happened to trigger it.  */
+
+void
+clear_image_caches_when_idle (void)
+{
+  if (image_cache_cleanup_pending)
+    {
+      image_cache_cleanup_pending = 0;
+      clear_image_caches (Qnil);
+    }
+}
+
 void
 clear_image_caches (Lisp_Object filter)
 {
@@ -1618,6 +1823,50 @@ FRAME t means refresh the image on all frames.  */)
 }
 
 
+DEFUN ("image-cache-statistics", Fimage_cache_statistics,
+       Simage_cache_statistics, 0, 1, 0,
+       doc: /* Return statistics about the image cache of FRAME.
+FRAME nil or omitted means use the selected frame.
+The value is an alist with the following elements:
+
+  (count . N)        N is the number of images in the cache.
+  (memory . BYTES)   BYTES is the estimated number of bytes taken
+                     by the decoded images in the cache.
+  (limit . BYTES)    BYTES is the limit imposed by
+                     `image-cache-memory-limit', or nil if none.
+  (hits . N)         N is the number of image lookups satisfied
+                     from the cache.
+  (misses . N)       N is the number of image lookups that required
+                     loading the image.
+  (evictions . N)    N is the number of images freed automatically
+                     to honor `image-cache-eviction-delay' and
+                     `image-cache-memory-limit'.
+
+All frames on the same terminal share one image cache.  */)
+  (Lisp_Object frame)
+{
+  struct image_cache *c = FRAME_IMAGE_CACHE (check_x_frame (frame));
+  ptrdiff_t i, count = 0, limit;
+
+  if (!c)
+    return Qnil;
+
+  for (i = 0; i < c->used; ++i)
+    if (c->images[i])
+      ++count;
+  limit = image_cache_memory_limit (c);
+
+  return Fcons (Fcons (Qcount, make_number (count)),
+		list5 (Fcons (Qmemory, make_fixnum_or_float (c->memory)),
+		       Fcons (Qlimit, (limit < 0 ? Qnil
+				       : make_fixnum_or_float (limit))),
+		       Fcons (Qhits, make_fixnum_or_float (c->hits)),
+		       Fcons (Qmisses, make_fixnum_or_float (c->misses)),
+		       Fcons (Qevictions,
+			      make_fixnum_or_float (c->evictions))));
+}
+
+
 /* Compute masks and transform image IMG on frame F, as specified
    by the image's specification,  */
 
@@ -1717,6 +1966,7 @@ lookup_image (struct frame *f, Lisp_Object spec)
   /* If not found, create a new image and cache it.  */
   if (img == NULL)
     {
+      FRAME_IMAGE_CACHE (f)->misses++;
       BLOCK_INPUT;
       img = make_image (spec, hash);
       cache_image (f, img);
@@ -1770,7 +2020,9 @@ lookup_image (struct frame *f, Lisp_Object spec)
 	      img->vmargin += eabs (img->relief);
 	    }
 
-	  if (! img->background_valid)
+	  /* If the image is still being decoded, this is done when
+	     decoding has finished.  */
+	  if (! img->background_valid && ! img->decode_job)
 	    {
 	      bg = image_spec_value (img->spec, QCbackground, NULL);
 	      if (!NILP (bg))
@@ -1784,15 +2036,19 @@ lookup_image (struct frame *f, Lisp_Object spec)
 
 	  /* Do image transformations and compute masks, unless we
 	     don't have the image yet.  */
-	  if (!EQ (*img->type->type, Qpostscript))
+	  if (!EQ (*img->type->type, Qpostscript) && !img->decode_job)
 	    postprocess_image (f, img);
 	}
 
+      account_image_memory (f, img);
       UNBLOCK_INPUT;
     }
+  else
+    FRAME_IMAGE_CACHE (f)->hits++;
 
   /* We're using IMG, so set its timestamp to `now'.  */
   img->timestamp = current_emacs_time ();
+  image_cache_touch (FRAME_IMAGE_CACHE (f), img);
 
   /* Value is the image id.  */
   return img->id;
@@ -1829,6 +2085,9 @@ cache_image (struct frame *f, struct image *img)
     img->next->prev = img;
   img->prev = NULL;
   c->buckets[i] = img;
+
+  /* IMG is about to be displayed, so it is the most recently used.  */
+  image_cache_touch (c, img);
 }
 
 
@@ -5339,137 +5598,1098 @@ pbm_load (struct frame *f, struct image *img)
 
 
 /***********************************************************************
-				 PNG
+			   Decoding Images
  ***********************************************************************/
 
-#if defined (HAVE_PNG) || defined (HAVE_NS)
+#if defined (HAVE_PNG) || defined (HAVE_JPEG)
 
-/* Function prototypes.  */
+/* PNG and JPEG images are loaded in two steps.  First, a decoder
+   function turns the image data into a buffer of pixels.  Decoders
+   don't use Lisp data or the window system, and can therefore run in a
+   worker thread.  Then load_decoded_image creates the pixmap and mask
+   of the image from that buffer in the main thread.  */
 
-static int png_image_p (Lisp_Object object);
-static int png_load (struct frame *f, struct image *img);
+struct image_decode_job
+{
+  /* Next job in the queue this job is on.  */
+  struct image_decode_job *next;
 
-/* The symbol `png' identifying images of this type.  */
+  /* Function decoding the image.  Value is non-zero if successful.  */
+  int (*decode) (struct image_decode_job *);
 
-static Lisp_Object Qpng;
+  /* The image being decoded and its cache.  IMG is set to null if the
+     image is freed before decoding finishes; it is only accessed from
+     the main thread.  */
+  struct image *img;
+  struct image_cache *cache;
+
+  /* Non-zero if the image has been freed, so that decoding it would
+     be useless.  Protected by decode_mutex.  */
+  int cancelled;
+
+  /* Name of the image file, or the image data and its size.  */
+  char *file;
+  unsigned char *data;
+  ptrdiff_t nbytes;
+
+  /* Non-zero if FILE and DATA are owned by the job.  */
+  int owns_input;
+
+  /* Largest width and height allowed by `max-image-size'.  */
+  int max_width, max_height;
+
+  /* The image is scaled by SCALE, and then made small enough to fit
+     into FIT_WIDTH x FIT_HEIGHT pixels, if these are positive; see the
+     `:scale', `:max-width' and `:max-height' image properties.  */
+  double scale;
+  int fit_width, fit_height;
+
+  /* Size of the image after scaling, as set by the decoder.  The
+     decoder may return a larger image, which is then resized.  */
+  int target_width, target_height;
+
+  /* If non-null, the file caching the scaled image, and the string
+     identifying the original image and the scaling in that file.  */
+  char *thumbnail;
+  char *thumbnail_key;
+
+  /* Color to combine partially transparent pixels with, as RGB values
+     in the range 0..0xffff.  */
+  unsigned short background[3];
+
+  /* Non-zero if the decoder succeeded.  */
+  int ok;
+
+  /* The decoded image consists of WIDTH x HEIGHT pixels of CHANNELS
+     bytes each.  With 3 or 4 channels, the bytes are red, green, blue
+     and alpha values.  With one channel, each byte is an index into
+     COLORMAP, which has NCOLORS entries.  PIXELS is allocated with
+     malloc.  */
+  int width, height, channels;
+  unsigned char *pixels;
+  unsigned char colormap[256][3];
+  int ncolors;
+
+  /* Non-zero means build a mask from the alpha channel.  */
+  int mask_p;
+
+  /* Background color recorded in the image file, if any.  */
+  int file_background_p;
+  unsigned short file_background[3];
+
+  /* Error message from the decoder.  */
+  char message[200];
+};
 
-/* Indices of image specification fields in png_format, below.  */
+/* Record MESSAGE as the error message of JOB.  */
 
-enum png_keyword_index
+static void
+image_decode_error (struct image_decode_job *job, const char *message)
 {
-  PNG_TYPE,
-  PNG_DATA,
-  PNG_FILE,
-  PNG_ASCENT,
-  PNG_MARGIN,
-  PNG_RELIEF,
-  PNG_ALGORITHM,
-  PNG_HEURISTIC_MASK,
-  PNG_MASK,
-  PNG_BACKGROUND,
-  PNG_LAST
-};
+  if (!job->message[0])
+    {
+      strncpy (job->message, message, sizeof job->message - 1);
+      job->message[sizeof job->message - 1] = '\0';
+    }
+}
 
-/* Vector of image_keyword structures describing the format
-   of valid user-defined image specifications.  */
+/* Value is non-zero if WIDTH and HEIGHT are valid dimensions for the
+   image decoded by JOB.  Record an error message if not.  */
 
-static const struct image_keyword png_format[PNG_LAST] =
+static int
+image_decode_check_size (struct image_decode_job *job,
+			 unsigned long width, unsigned long height)
 {
-  {":type",		IMAGE_SYMBOL_VALUE,			1},
-  {":data",		IMAGE_STRING_VALUE,			0},
-  {":file",		IMAGE_STRING_VALUE,			0},
-  {":ascent",		IMAGE_ASCENT_VALUE,			0},
-  {":margin",		IMAGE_NON_NEGATIVE_INTEGER_VALUE_OR_PAIR, 0},
-  {":relief",		IMAGE_INTEGER_VALUE,			0},
-  {":conversion",	IMAGE_DONT_CHECK_VALUE_TYPE,		0},
-  {":heuristic-mask",	IMAGE_DONT_CHECK_VALUE_TYPE,		0},
-  {":mask",		IMAGE_DONT_CHECK_VALUE_TYPE,		0},
-  {":background",	IMAGE_STRING_OR_NIL_VALUE,		0}
-};
+  if (0 < width && width <= job->max_width
+      && 0 < height && height <= job->max_height)
+    return 1;
 
-/* Structure describing the image type `png'.  */
+  image_decode_error (job, "Invalid image size (see `max-image-size')");
+  return 0;
+}
 
-static struct image_type png_type =
+/* Set the size JOB's image has after scaling, given that its original
+   size is WIDTH x HEIGHT.  Value is non-zero if successful.  */
+
+static int
+image_decode_set_target (struct image_decode_job *job, int width, int height)
 {
-  &Qpng,
-  png_image_p,
-  png_load,
-  x_clear_image,
-  NULL
-};
+  double w = width * job->scale, h = height * job->scale;
 
-/* Return non-zero if OBJECT is a valid PNG image specification.  */
+  if (0 < job->fit_width && job->fit_width < w)
+    {
+      h = h * job->fit_width / w;
+      w = job->fit_width;
+    }
+  if (0 < job->fit_height && job->fit_height < h)
+    {
+      w = w * job->fit_height / h;
+      h = job->fit_height;
+    }
+
+  job->target_width = w < 1 ? 1 : w < INT_MAX ? (int) (w + 0.5) : INT_MAX;
+  job->target_height = h < 1 ? 1 : h < INT_MAX ? (int) (h + 0.5) : INT_MAX;
+  return image_decode_check_size (job, job->target_width, job->target_height);
+}
+
+/* Resize the pixels decoded by JOB to the target size of the image.
+   Each new pixel is the average of the pixels it covers.  Pixels that
+   are indices into a colormap cannot be averaged, so the pixel in the
+   middle is used for them.  Value is non-zero if successful.  */
 
 static int
-png_image_p (Lisp_Object object)
+image_decode_resize (struct image_decode_job *job)
 {
-  struct image_keyword fmt[PNG_LAST];
-  memcpy (fmt, png_format, sizeof fmt);
+  int width = job->target_width, height = job->target_height;
+  int n = job->channels;
+  unsigned char *pixels, *p;
+  int x, y, c;
 
-  if (!parse_image_spec (object, fmt, PNG_LAST, Qpng))
-    return 0;
+  if (width == job->width && height == job->height)
+    return 1;
 
-  /* Must specify either the :data or :file keyword.  */
-  return fmt[PNG_FILE].count + fmt[PNG_DATA].count == 1;
-}
+  pixels = malloc ((size_t) width * height * n);
+  if (!pixels)
+    {
+      image_decode_error (job, "Out of memory");
+      return 0;
+    }
 
-#endif /* HAVE_PNG || HAVE_NS */
+  for (y = 0, p = pixels; y < height; ++y)
+    {
+      int y0 = (double) y * job->height / height;
+      int y1 = max (y0 + 1, (double) (y + 1) * job->height / height);
 
+      for (x = 0; x < width; ++x)
+	{
+	  int x0 = (double) x * job->width / width;
+	  int x1 = max (x0 + 1, (double) (x + 1) * job->width / width);
+	  int xx, yy;
 
-#ifdef HAVE_PNG
+	  if (n == 1)
+	    *p++ = job->pixels[(y0 + y1) / 2 * job->width + (x0 + x1) / 2];
+	  else
+	    for (c = 0; c < n; ++c)
+	      {
+		unsigned long sum = 0;
+		for (yy = y0; yy < y1; ++yy)
+		  for (xx = x0; xx < x1; ++xx)
+		    sum += job->pixels[((size_t) yy * job->width + xx) * n + c];
+		*p++ = sum / ((y1 - y0) * (x1 - x0));
+	      }
+	}
+    }
 
-#ifdef HAVE_NTGUI
-/* PNG library details.  */
+  free (job->pixels);
+  job->pixels = pixels;
+  job->width = width;
+  job->height = height;
+  return 1;
+}
 
-DEF_IMGLIB_FN (png_voidp, png_get_io_ptr, (png_structp));
-DEF_IMGLIB_FN (int, png_sig_cmp, (png_bytep, png_size_t, png_size_t));
-DEF_IMGLIB_FN (png_structp, png_create_read_struct, (png_const_charp, png_voidp,
-						     png_error_ptr, png_error_ptr));
-DEF_IMGLIB_FN (png_infop, png_create_info_struct, (png_structp));
-DEF_IMGLIB_FN (void, png_destroy_read_struct, (png_structpp, png_infopp, png_infopp));
-DEF_IMGLIB_FN (void, png_set_read_fn, (png_structp, png_voidp, png_rw_ptr));
-DEF_IMGLIB_FN (void, png_set_sig_bytes, (png_structp, int));
-DEF_IMGLIB_FN (void, png_read_info, (png_structp, png_infop));
-DEF_IMGLIB_FN (png_uint_32, png_get_IHDR, (png_structp, png_infop,
-			      png_uint_32 *, png_uint_32 *,
-			      int *, int *, int *, int *, int *));
-DEF_IMGLIB_FN (png_uint_32, png_get_valid, (png_structp, png_infop, png_uint_32));
-DEF_IMGLIB_FN (void, png_set_strip_16, (png_structp));
-DEF_IMGLIB_FN (void, png_set_expand, (png_structp));
-DEF_IMGLIB_FN (void, png_set_gray_to_rgb, (png_structp));
-DEF_IMGLIB_FN (void, png_set_background, (png_structp, png_color_16p,
-				    int, int, double));
-DEF_IMGLIB_FN (png_uint_32, png_get_bKGD, (png_structp, png_infop, png_color_16p *));
-DEF_IMGLIB_FN (void, png_read_update_info, (png_structp, png_infop));
-DEF_IMGLIB_FN (png_byte, png_get_channels, (png_structp, png_infop));
-DEF_IMGLIB_FN (png_size_t, png_get_rowbytes, (png_structp, png_infop));
-DEF_IMGLIB_FN (void, png_read_image, (png_structp, png_bytepp));
-DEF_IMGLIB_FN (void, png_read_end, (png_structp, png_infop));
-DEF_IMGLIB_FN (void, png_error, (png_structp, png_const_charp));
+/* Thumbnail files cache scaled images, so that they need not be decoded
+   again.  A thumbnail file starts with THUMBNAIL_MAGIC and the key of
+   the image, followed by the fields of struct thumbnail_header and the
+   colormap and pixels of the image.  The numbers are stored in the byte
+   order of the machine, since the files are only meant to be read
+   where they were written.  */
 
-#if (PNG_LIBPNG_VER >= 10500)
-DEF_IMGLIB_FN (void, png_longjmp, (png_structp, int));
-DEF_IMGLIB_FN (jmp_buf *, png_set_longjmp_fn, (png_structp, png_longjmp_ptr, size_t));
-#endif /* libpng version >= 1.5 */
+#define THUMBNAIL_MAGIC "Emacs thumbnail 1\n"
+
+struct thumbnail_header
+{
+  int width, height, channels, ncolors, mask_p, file_background_p;
+  unsigned short file_background[3];
+};
+
+/* Read JOB's image from its thumbnail file.  Value is non-zero if
+   the thumbnail file exists and is valid.  */
 
 static int
-init_png_functions (Lisp_Object libraries)
+read_image_thumbnail (struct image_decode_job *job)
 {
-  HMODULE library;
+  struct thumbnail_header h;
+  size_t keylen = strlen (job->thumbnail_key) + 1;
+  size_t size;
+  char *key;
+  int ok = 0;
+  FILE *fp = fopen (job->thumbnail, "rb");
 
-  if (!(library = w32_delayed_load (libraries, Qpng)))
+  if (!fp)
     return 0;
 
-  LOAD_IMGLIB_FN (library, png_get_io_ptr);
-  LOAD_IMGLIB_FN (library, png_sig_cmp);
-  LOAD_IMGLIB_FN (library, png_create_read_struct);
-  LOAD_IMGLIB_FN (library, png_create_info_struct);
-  LOAD_IMGLIB_FN (library, png_destroy_read_struct);
-  LOAD_IMGLIB_FN (library, png_set_read_fn);
-  LOAD_IMGLIB_FN (library, png_set_sig_bytes);
-  LOAD_IMGLIB_FN (library, png_read_info);
-  LOAD_IMGLIB_FN (library, png_get_IHDR);
-  LOAD_IMGLIB_FN (library, png_get_valid);
+  key = malloc (sizeof THUMBNAIL_MAGIC - 1 + keylen);
+  if (key
+      && fread (key, 1, sizeof THUMBNAIL_MAGIC - 1 + keylen, fp)
+	 == sizeof THUMBNAIL_MAGIC - 1 + keylen
+      && memcmp (key, THUMBNAIL_MAGIC, sizeof THUMBNAIL_MAGIC - 1) == 0
+      && memcmp (key + sizeof THUMBNAIL_MAGIC - 1, job->thumbnail_key,
+		 keylen) == 0
+      && fread (&h, sizeof h, 1, fp) == 1
+      && 0 < h.width && h.width <= job->max_width
+      && 0 < h.height && h.height <= job->max_height
+      && (h.channels == 1 || h.channels == 3 || h.channels == 4)
+      && 0 <= h.ncolors && h.ncolors <= 256
+      && fread (job->colormap, 3, h.ncolors, fp) == h.ncolors)
+    {
+      size = (size_t) h.width * h.height * h.channels;
+      job->pixels = malloc (size);
+      if (job->pixels && fread (job->pixels, 1, size, fp) == size)
+	{
+	  job->width = h.width;
+	  job->height = h.height;
+	  job->channels = h.channels;
+	  job->ncolors = h.ncolors;
+	  job->mask_p = h.mask_p;
+	  job->file_background_p = h.file_background_p;
+	  memcpy (job->file_background, h.file_background,
+		  sizeof h.file_background);
+	  ok = 1;
+	}
+      else
+	{
+	  free (job->pixels);
+	  job->pixels = NULL;
+	}
+    }
+
+  free (key);
+  fclose (fp);
+  return ok;
+}
+
+/* Write JOB's decoded image to its thumbnail file.  The file is written
+   under a temporary name first, so that other Emacs processes never see
+   a partial file.  The cache directory is made when the first thumbnail
+   is written to it.  Errors are ignored.  */
+
+static void
+write_image_thumbnail (struct image_decode_job *job)
+{
+  struct thumbnail_header h;
+  size_t size = (size_t) job->width * job->height * job->channels;
+  char *temp = malloc (strlen (job->thumbnail) + sizeof ".XXXXXX");
+  int fd;
+  FILE *fp;
+  int ok;
+
+  if (!temp)
+    return;
+  strcpy (temp, job->thumbnail);
+  strcat (temp, ".XXXXXX");
+  fd = mkstemp (temp);
+  if (fd < 0 && errno == ENOENT)
+    {
+      char *slash = strrchr (temp, '/');
+      if (slash)
+	{
+	  *slash = '\0';
+	  mkdir (temp, 0700);
+	  *slash = '/';
+	  strcpy (slash + 1 + strlen (slash + 1) - 6, "XXXXXX");
+	  fd = mkstemp (temp);
+	}
+    }
+  if (fd < 0 || !(fp = fdopen (fd, "wb")))
+    {
+      if (fd >= 0)
+	{
+	  close (fd);
+	  unlink (temp);
+	}
+      free (temp);
+      return;
+    }
+
+  memset (&h, 0, sizeof h);
+  h.width = job->width;
+  h.height = job->height;
+  h.channels = job->channels;
+  h.ncolors = job->ncolors;
+  h.mask_p = job->mask_p;
+  h.file_background_p = job->file_background_p;
+  memcpy (h.file_background, job->file_background, sizeof h.file_background);
+
+  ok = (fputs (THUMBNAIL_MAGIC, fp) != EOF
+	&& fwrite (job->thumbnail_key, 1, strlen (job->thumbnail_key) + 1, fp)
+	   == strlen (job->thumbnail_key) + 1
+	&& fwrite (&h, sizeof h, 1, fp) == 1
+	&& fwrite (job->colormap, 3, h.ncolors, fp) == h.ncolors
+	&& fwrite (job->pixels, 1, size, fp) == size);
+  ok &= fclose (fp) == 0;
+  if (!ok || rename (temp, job->thumbnail) != 0)
+    unlink (temp);
+  free (temp);
+}
+
+/* Decode the image of JOB, and scale it as requested.  Use the
+   thumbnail file of JOB if it has one.  Value is non-zero if
+   successful.  This may run in a worker thread.  */
+
+static int
+run_image_decode (struct image_decode_job *job)
+{
+  if (job->thumbnail && read_image_thumbnail (job))
+    return 1;
+
+  if (!job->decode (job) || !image_decode_resize (job))
+    return 0;
+
+  if (job->thumbnail)
+    write_image_thumbnail (job);
+  return 1;
+}
+
+/* Open the image file of JOB for reading.  Value is null, and an error
+   message is recorded, if that fails.  */
+
+static FILE *
+image_decode_open (struct image_decode_job *job)
+{
+  FILE *fp = fopen (job->file, "rb");
+  if (!fp)
+    image_decode_error (job, "Cannot open image file");
+  return fp;
+}
+
+/* Give JOB a thumbnail file in `image-thumbnail-cache-directory' for
+   image IMG, which is read from FILE.  The name of the thumbnail file
+   is a hash of a key made of the type, file name, size and modification
+   time of the image, and of everything that affects the scaled pixels.
+   The key itself is stored in the file, to detect hash collisions.  */
+
+static void
+set_image_thumbnail (struct image_decode_job *job, struct image *img,
+		     Lisp_Object file)
+{
+  struct stat st;
+  Lisp_Object dir = Vimage_thumbnail_cache_directory;
+  Lisp_Object type = SYMBOL_NAME (*img->type->type);
+  char *key;
+  char name[sizeof "0123456789abcdef.thumb"];
+  EMACS_UINT hash;
+
+  if (stat (SSDATA (file), &st) != 0)
+    return;
+
+  key = xmalloc (SBYTES (type) + SBYTES (file) + 200);
+  sprintf (key, "%s\n%s\n%"pMd" %ld\n%.17g %d %d\n%x %x %x",
+	   SSDATA (type), SSDATA (file), (printmax_t) st.st_size,
+	   (long) st.st_mtime, job->scale, job->fit_width, job->fit_height,
+	   job->background[0], job->background[1], job->background[2]);
+  hash = hash_string (key, strlen (key));
+  sprintf (name, "%0*"pI"x.thumb", (int) (2 * sizeof hash), hash);
+
+  /* This may run Lisp, but FILE is still referenced from the stack of
+     our caller.  */
+  dir = Fexpand_file_name (dir, Qnil);
+  job->thumbnail = xstrdup (SSDATA (Fexpand_file_name (build_string (name),
+							dir)));
+  job->thumbnail_key = key;
+}
+
+/* Return a new job for decoding image IMG on frame F with DECODE.
+   Value is null if the image file cannot be found; an error has been
+   reported then.  */
+
+static struct image_decode_job *
+make_image_decode_job (struct frame *f, struct image *img,
+		       int (*decode) (struct image_decode_job *))
+{
+  Lisp_Object specified_file = image_spec_value (img->spec, QCfile, NULL);
+  Lisp_Object specified_data = image_spec_value (img->spec, QCdata, NULL);
+  Lisp_Object specified_bg = image_spec_value (img->spec, QCbackground, NULL);
+  Lisp_Object value;
+  struct image_decode_job *job;
+  XColor color;
+
+  if (!NILP (specified_data) && !STRINGP (specified_data))
+    {
+      image_error ("Invalid image data `%s'", specified_data, Qnil);
+      return NULL;
+    }
+
+  job = xzalloc (sizeof *job);
+  job->decode = decode;
+  job->img = img;
+  job->cache = FRAME_IMAGE_CACHE (f);
+  image_size_limits (f, &job->max_width, &job->max_height);
+
+  /* Partially transparent pixels are combined with the `:background'
+     color of the image, or else with the current frame background.  */
+  if (!(STRINGP (specified_bg)
+	&& x_defined_color (f, SSDATA (specified_bg), &color, 0)))
+    {
+      color.pixel = FRAME_BACKGROUND_PIXEL (f);
+      x_query_color (f, &color);
+    }
+  job->background[0] = color.red;
+  job->background[1] = color.green;
+  job->background[2] = color.blue;
+
+  value = image_spec_value (img->spec, QCscale, NULL);
+  job->scale = NUMBERP (value) && XFLOATINT (value) > 0 ? XFLOATINT (value) : 1;
+  value = image_spec_value (img->spec, QCmax_width, NULL);
+  job->fit_width = NATNUMP (value) ? min (XFASTINT (value), INT_MAX) : 0;
+  value = image_spec_value (img->spec, QCmax_height, NULL);
+  job->fit_height = NATNUMP (value) ? min (XFASTINT (value), INT_MAX) : 0;
+
+  /* Once the job refers to string data, nothing may run Lisp, since
+     GC can relocate that data.  */
+  if (NILP (specified_data))
+    {
+      Lisp_Object file = x_find_image_file (specified_file);
+      if (!STRINGP (file))
+	{
+	  image_error ("Cannot find image file `%s'", specified_file, Qnil);
+	  xfree (job);
+	  return NULL;
+	}
+      if (STRINGP (Vimage_thumbnail_cache_directory)
+	  && (job->scale != 1 || job->fit_width || job->fit_height))
+	set_image_thumbnail (job, img, file);
+      job->file = SSDATA (file);
+    }
+  else
+    {
+      job->data = SDATA (specified_data);
+      job->nbytes = SBYTES (specified_data);
+    }
+
+  return job;
+}
+
+/* Free JOB and the data it owns.  */
+
+static void
+free_image_decode_job (struct image_decode_job *job)
+{
+  if (job->owns_input)
+    {
+      xfree (job->file);
+      xfree (job->data);
+    }
+  xfree (job->thumbnail);
+  xfree (job->thumbnail_key);
+  free (job->pixels);
+  xfree (job);
+}
+
+/* Create the pixmap and mask of image IMG on frame F from the pixels
+   decoded by JOB.  Value is non-zero if successful.  */
+
+static int
+load_decoded_image (struct frame *f, struct image *img,
+		    struct image_decode_job *job)
+{
+  XImagePtr ximg, mask_img = NULL;
+  int width = job->width, height = job->height;
+  unsigned long colors[256];
+  unsigned char *p = job->pixels;
+  int x, y, i;
+
+  if (!x_create_x_image_and_pixmap (f, width, height, 0, &ximg,
+				    &img->pixmap))
+    return 0;
+
+  /* Create an image and pixmap serving as mask if the image contains
+     an alpha channel.  */
+  if (job->channels == 4 && job->mask_p
+      && !x_create_x_image_and_pixmap (f, width, height, 1,
+				       &mask_img, &img->mask))
+    {
+      x_destroy_x_image (ximg);
+      Free_Pixmap (FRAME_X_DISPLAY (f), img->pixmap);
+      img->pixmap = NO_PIXMAP;
+      return 0;
+    }
+
+  /* Use the color table mechanism because it handles colors that
+     cannot be allocated nicely.  Such colors will be replaced with
+     a default color, and we don't have to care about which colors
+     can be freed safely, and which can't.  */
+  init_color_table ();
+
+  /* Multiply RGB values with 256 because X expects RGB values in the
+     range 0..0xffff.  */
+  for (i = 0; i < job->ncolors; ++i)
+    colors[i] = lookup_rgb_color (f, job->colormap[i][0] << 8,
+				  job->colormap[i][1] << 8,
+				  job->colormap[i][2] << 8);
+
+  for (y = 0; y < height; ++y)
+    for (x = 0; x < width; ++x)
+      if (job->channels == 1)
+	XPutPixel (ximg, x, y, colors[*p++]);
+      else
+	{
+	  XPutPixel (ximg, x, y,
+		     lookup_rgb_color (f, p[0] << 8, p[1] << 8, p[2] << 8));
+	  p += 3;
+	  if (job->channels == 4)
+	    {
+	      if (mask_img)
+		XPutPixel (mask_img, x, y,
+			   *p > 0 ? PIX_MASK_DRAW : PIX_MASK_RETAIN);
+	      ++p;
+	    }
+	}
+
+  if (job->file_background_p
+      && NILP (image_spec_value (img->spec, QCbackground, NULL)))
+    /* Set IMG's background color from the image file, unless the user
+       overrode it.  */
+    {
+      img->background = lookup_rgb_color (f, job->file_background[0],
+					  job->file_background[1],
+					  job->file_background[2]);
+      img->background_valid = 1;
+    }
+
+#ifdef COLOR_TABLE_SUPPORT
+  /* Remember colors allocated for this image.  */
+  img->colors = colors_in_color_table (&img->ncolors);
+  free_color_table ();
+#endif /* COLOR_TABLE_SUPPORT */
+
+  img->width = width;
+  img->height = height;
+
+  /* Maybe fill in the background field while we have ximg handy.
+     Casting avoids a GCC warning.  */
+  if (NILP (image_spec_value (img->spec, QCbackground, NULL)))
+    IMAGE_BACKGROUND (img, f, (XImagePtr_or_DC)ximg);
+
+  /* Put the image into the pixmap, then free the X image and its buffer.  */
+  x_put_x_image (f, ximg, img->pixmap, width, height);
+  x_destroy_x_image (ximg);
+
+  /* Same for the mask.  */
+  if (mask_img)
+    {
+      /* Fill in the background_transparent field while we have the
+	 mask handy.  Casting avoids a GCC warning.  */
+      image_background_transparent (img, f, (XImagePtr_or_DC)mask_img);
+
+      x_put_x_image (f, mask_img, img->mask, width, height);
+      x_destroy_x_image (mask_img);
+    }
+
+  return 1;
+}
+
+/* Finish loading image IMG on frame F from JOB, reporting an error if
+   decoding failed.  Value is non-zero if successful.  */
+
+static int
+finish_image_decode (struct frame *f, struct image *img,
+		     struct image_decode_job *job)
+{
+  if (!job->ok)
+    {
+      image_error ("Error loading image `%s': %s", img->spec,
+		   build_string (job->message[0]
+				 ? job->message : "Invalid image data"));
+      return 0;
+    }
+
+  if (!load_decoded_image (f, img, job))
+    {
+      x_clear_image (f, img);
+      return 0;
+    }
+
+  return 1;
+}
+
+/* Functions peeking at the start of image data to find the size of
+   the image, without decoding it.  */
+
+struct image_peek
+{
+  FILE *fp;
+  const unsigned char *data;
+  ptrdiff_t nbytes, pos;
+};
+
+/* Read N bytes into BUF.  Value is non-zero if successful.  */
+
+static int
+image_peek_read (struct image_peek *peek, unsigned char *buf, int n)
+{
+  if (peek->fp)
+    return fread (buf, 1, n, peek->fp) == n;
+  if (peek->nbytes - peek->pos < n)
+    return 0;
+  memcpy (buf, peek->data + peek->pos, n);
+  peek->pos += n;
+  return 1;
+}
+
+#ifdef USE_DECODE_THREADS
+
+/* Maximum number of worker threads decoding images.  */
+
+#define MAX_DECODE_THREADS 4
+
+/* Number of worker threads started, or -1 if they cannot be used.  */
+
+static int decode_threads;
+
+/* Jobs waiting for a worker thread, and jobs that are finished and
+   wait for load_decoded_image.  Protected by decode_mutex.  */
+
+static struct image_decode_job *decode_queue, *decode_queue_tail;
+static struct image_decode_job *decode_done;
+
+static pthread_mutex_t decode_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t decode_cond = PTHREAD_COND_INITIALIZER;
+
+/* Pipe written to by worker threads when a job is finished, to wake
+   up the main thread.  */
+
+static int decode_pipe[2];
+
+/* Body of the worker threads.  */
+
+static void *
+image_decode_thread (void *arg)
+{
+  pthread_mutex_lock (&decode_mutex);
+
+  for (;;)
+    {
+      struct image_decode_job *job;
+
+      while (!decode_queue)
+	pthread_cond_wait (&decode_cond, &decode_mutex);
+
+      job = decode_queue;
+      decode_queue = job->next;
+      if (!decode_queue)
+	decode_queue_tail = NULL;
+
+      if (!job->cancelled)
+	{
+	  pthread_mutex_unlock (&decode_mutex);
+	  job->ok = run_image_decode (job);
+	  pthread_mutex_lock (&decode_mutex);
+	}
+
+      job->next = decode_done;
+      decode_done = job;
+      if (write (decode_pipe[1], "", 1) < 0)
+	/* The pipe is full, so the main thread will wake up anyway.  */
+	;
+    }
+
+  return NULL;
+}
+
+static void image_decode_finished (int, void *, int);
+
+/* Start the worker threads, if that hasn't been tried yet.  Value is
+   non-zero if worker threads can be used.  */
+
+static int
+start_decode_threads (void)
+{
+  if (decode_threads == 0)
+    {
+      long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+      int nthreads = ncpus < 1 ? 1 : min (ncpus, MAX_DECODE_THREADS);
+      sigset_t all, old;
+
+      if (pipe (decode_pipe) != 0)
+	{
+	  decode_threads = -1;
+	  return 0;
+	}
+      fcntl (decode_pipe[0], F_SETFD, FD_CLOEXEC);
+      fcntl (decode_pipe[1], F_SETFD, FD_CLOEXEC);
+      fcntl (decode_pipe[0], F_SETFL, O_NONBLOCK);
+      fcntl (decode_pipe[1], F_SETFL, O_NONBLOCK);
+
+#if !defined SYSTEM_MALLOC && !defined DOUG_LEA_MALLOC
+      {
+	/* The worker threads allocate memory.  */
+	extern void malloc_enable_thread (void);
+	malloc_enable_thread ();
+      }
+#endif
+
+      /* Signals must be handled in the main thread.  */
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &old);
+      while (decode_threads < nthreads)
+	{
+	  pthread_t thread;
+	  if (pthread_create (&thread, NULL, image_decode_thread, NULL) != 0)
+	    break;
+	  pthread_detach (thread);
+	  ++decode_threads;
+	}
+      pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+      if (decode_threads == 0)
+	{
+	  emacs_close (decode_pipe[0]);
+	  emacs_close (decode_pipe[1]);
+	  decode_threads = -1;
+	}
+      else
+	add_read_fd (decode_pipe[0], image_decode_finished, NULL);
+    }
+
+  return decode_threads > 0;
+}
+
+/* Arrange for JOB, which decodes image IMG, to be run by a worker
+   thread.  JOB must own its input.  */
+
+static void
+queue_image_decode (struct image *img, struct image_decode_job *job)
+{
+  img->decode_job = job;
+
+  pthread_mutex_lock (&decode_mutex);
+  job->next = NULL;
+  if (decode_queue_tail)
+    decode_queue_tail->next = job;
+  else
+    decode_queue = job;
+  decode_queue_tail = job;
+  pthread_cond_signal (&decode_cond);
+  pthread_mutex_unlock (&decode_mutex);
+}
+
+/* Forget about decoding image IMG, which is being freed.  */
+
+static void
+cancel_image_decode (struct image *img)
+{
+  struct image_decode_job *job = img->decode_job;
+
+  pthread_mutex_lock (&decode_mutex);
+  job->cancelled = 1;
+  pthread_mutex_unlock (&decode_mutex);
+  job->img = NULL;
+  img->decode_job = NULL;
+}
+
+/* Called in the main thread when worker threads have finished jobs.
+   Create the pixmaps of the decoded images, and redisplay the frames
+   showing them.  */
+
+static void
+image_decode_finished (int fd, void *data, int for_read)
+{
+  struct image_decode_job *job, *done, *next;
+  char buf[64];
+  int redisplay_p = 0;
+
+  while (emacs_read (fd, buf, sizeof buf) > 0)
+    continue;
+
+  pthread_mutex_lock (&decode_mutex);
+  done = decode_done;
+  decode_done = NULL;
+  pthread_mutex_unlock (&decode_mutex);
+
+  BLOCK_INPUT;
+
+  for (job = done; job; job = next)
+    {
+      struct image *img = job->img;
+      next = job->next;
+
+      if (img)
+	{
+	  Lisp_Object tail, frame;
+	  struct frame *f = NULL;
+
+	  img->decode_job = NULL;
+	  FOR_EACH_FRAME (tail, frame)
+	    if (FRAME_WINDOW_P (XFRAME (frame))
+		&& FRAME_IMAGE_CACHE (XFRAME (frame)) == job->cache)
+	      {
+		f = XFRAME (frame);
+		break;
+	      }
+
+	  /* If decoding failed, the image keeps looking the same, so
+	     there is no need to redisplay it.  */
+	  if (f && finish_image_decode (f, img, job))
+	    {
+	      Lisp_Object bg = image_spec_value (img->spec, QCbackground,
+						 NULL);
+	      if (!NILP (bg))
+		{
+		  img->background
+		    = x_alloc_image_color (f, img, bg,
+					   FRAME_BACKGROUND_PIXEL (f));
+		  img->background_valid = 1;
+		}
+	      postprocess_image (f, img);
+	      account_image_memory (f, img);
+
+	      /* Frames displaying the placeholder must redraw it.  */
+	      FOR_EACH_FRAME (tail, frame)
+		if (FRAME_WINDOW_P (XFRAME (frame))
+		    && FRAME_IMAGE_CACHE (XFRAME (frame)) == job->cache)
+		  clear_current_matrices (XFRAME (frame));
+	      redisplay_p = 1;
+	    }
+	  else
+	    img->load_failed_p = 1;
+	}
+
+      free_image_decode_job (job);
+    }
+
+  UNBLOCK_INPUT;
+
+  if (redisplay_p)
+    {
+      ++windows_or_buffers_changed;
+      record_asynch_buffer_change ();
+    }
+}
+
+/* Start decoding image IMG on frame F with JOB in a worker thread,
+   using PEEK_SIZE to find the size of the image meanwhile.  Value is
+   non-zero if successful.  Otherwise, the image should be decoded
+   synchronously.  */
+
+static int
+start_image_decode (struct frame *f, struct image *img,
+		    struct image_decode_job *job,
+		    int (*peek_size) (struct image_peek *,
+				      unsigned long *, unsigned long *))
+{
+  struct image_peek peek;
+  unsigned long width, height;
+  int ok;
+
+  if (!image_decode_asynchronously || !FRAME_X_P (f)
+      || !start_decode_threads ())
+    return 0;
+
+  memset (&peek, 0, sizeof peek);
+  if (job->file)
+    {
+      peek.fp = fopen (job->file, "rb");
+      if (!peek.fp)
+	return 0;
+    }
+  else
+    {
+      peek.data = job->data;
+      peek.nbytes = job->nbytes;
+    }
+  ok = (peek_size (&peek, &width, &height)
+	&& image_decode_check_size (job, width, height)
+	&& image_decode_set_target (job, width, height));
+  if (peek.fp)
+    fclose (peek.fp);
+
+  /* If the image is invalid, decode it synchronously to report the
+     error right away.  */
+  if (!ok)
+    return 0;
+
+  /* The job may outlive the Lisp data of the image spec.  */
+  if (job->file)
+    job->file = xstrdup (job->file);
+  else
+    {
+      unsigned char *data = xmalloc (job->nbytes);
+      memcpy (data, job->data, job->nbytes);
+      job->data = data;
+    }
+  job->owns_input = 1;
+
+  /* Display the image as an empty rectangle of the right size until it
+     has been decoded.  */
+  img->width = job->target_width;
+  img->height = job->target_height;
+  queue_image_decode (img, job);
+  return 1;
+}
+
+#endif /* USE_DECODE_THREADS */
+
+/* Load image IMG on frame F using the decoder DECODE.  PEEK_SIZE is a
+   function finding the size of the image from its header, which makes
+   it possible to decode the image in a worker thread; see
+   `image-decode-asynchronously'.  Value is non-zero if successful.  */
+
+static int
+decode_and_load_image (struct frame *f, struct image *img,
+		       int (*decode) (struct image_decode_job *),
+		       int (*peek_size) (struct image_peek *,
+					 unsigned long *, unsigned long *))
+{
+  struct image_decode_job *job = make_image_decode_job (f, img, decode);
+  int ok;
+
+  if (!job)
+    return 0;
+
+#ifdef USE_DECODE_THREADS
+  if (start_image_decode (f, img, job, peek_size))
+    return 1;
+#endif
+
+  job->ok = run_image_decode (job);
+  ok = finish_image_decode (f, img, job);
+  free_image_decode_job (job);
+  return ok;
+}
+
+#endif /* HAVE_PNG || HAVE_JPEG */
+
+
+/***********************************************************************
+				 PNG
+ ***********************************************************************/
+
+#if defined (HAVE_PNG) || defined (HAVE_NS)
+
+/* Function prototypes.  */
+
+static int png_image_p (Lisp_Object object);
+static int png_load (struct frame *f, struct image *img);
+
+/* The symbol `png' identifying images of this type.  */
+
+static Lisp_Object Qpng;
+
+/* Indices of image specification fields in png_format, below.  */
+
+enum png_keyword_index
+{
+  PNG_TYPE,
+  PNG_DATA,
+  PNG_FILE,
+  PNG_ASCENT,
+  PNG_MARGIN,
+  PNG_RELIEF,
+  PNG_ALGORITHM,
+  PNG_HEURISTIC_MASK,
+  PNG_MASK,
+  PNG_BACKGROUND,
+  PNG_MAX_WIDTH,
+  PNG_MAX_HEIGHT,
+  PNG_SCALE,
+  PNG_LAST
+};
+
+/* Vector of image_keyword structures describing the format
+   of valid user-defined image specifications.  */
+
+static const struct image_keyword png_format[PNG_LAST] =
+{
+  {":type",		IMAGE_SYMBOL_VALUE,			1},
+  {":data",		IMAGE_STRING_VALUE,			0},
+  {":file",		IMAGE_STRING_VALUE,			0},
+  {":ascent",		IMAGE_ASCENT_VALUE,			0},
+  {":margin",		IMAGE_NON_NEGATIVE_INTEGER_VALUE_OR_PAIR, 0},
+  {":relief",		IMAGE_INTEGER_VALUE,			0},
+  {":conversion",	IMAGE_DONT_CHECK_VALUE_TYPE,		0},
+  {":heuristic-mask",	IMAGE_DONT_CHECK_VALUE_TYPE,		0},
+  {":mask",		IMAGE_DONT_CHECK_VALUE_TYPE,		0},
+  {":background",	IMAGE_STRING_OR_NIL_VALUE,		0},
+  {":max-width",	IMAGE_POSITIVE_INTEGER_VALUE,		0},
+  {":max-height",	IMAGE_POSITIVE_INTEGER_VALUE,		0},
+  {":scale",		IMAGE_NUMBER_VALUE,			0}
+};
+
+/* Structure describing the image type `png'.  */
+
+static struct image_type png_type =
+{
+  &Qpng,
+  png_image_p,
+  png_load,
+  x_clear_image,
+  NULL
+};
+
+/* Return non-zero if OBJECT is a valid PNG image specification.  */
+
+static int
+png_image_p (Lisp_Object object)
+{
+  struct image_keyword fmt[PNG_LAST];
+  memcpy (fmt, png_format, sizeof fmt);
+
+  if (!parse_image_spec (object, fmt, PNG_LAST, Qpng))
+    return 0;
+
+  /* Must specify either the :data or :file keyword.  */
+  return fmt[PNG_FILE].count + fmt[PNG_DATA].count == 1;
+}
+
+#endif /* HAVE_PNG || HAVE_NS */
+
+
+#ifdef HAVE_PNG
+
+#ifdef HAVE_NTGUI
+/* PNG library details.  */
+
+DEF_IMGLIB_FN (png_voidp, png_get_io_ptr, (png_structp));
+DEF_IMGLIB_FN (png_voidp, png_get_error_ptr, (png_structp));
+DEF_IMGLIB_FN (int, png_sig_cmp, (png_bytep, png_size_t, png_size_t));
+DEF_IMGLIB_FN (png_structp, png_create_read_struct, (png_const_charp, png_voidp,
+						     png_error_ptr, png_error_ptr));
+DEF_IMGLIB_FN (png_infop, png_create_info_struct, (png_structp));
+DEF_IMGLIB_FN (void, png_destroy_read_struct, (png_structpp, png_infopp, png_infopp));
+DEF_IMGLIB_FN (void, png_set_read_fn, (png_structp, png_voidp, png_rw_ptr));
+DEF_IMGLIB_FN (void, png_set_sig_bytes, (png_structp, int));
+DEF_IMGLIB_FN (void, png_read_info, (png_structp, png_infop));
+DEF_IMGLIB_FN (png_uint_32, png_get_IHDR, (png_structp, png_infop,
+			      png_uint_32 *, png_uint_32 *,
+			      int *, int *, int *, int *, int *));
+DEF_IMGLIB_FN (png_uint_32, png_get_valid, (png_structp, png_infop, png_uint_32));
+DEF_IMGLIB_FN (void, png_set_strip_16, (png_structp));
+DEF_IMGLIB_FN (void, png_set_expand, (png_structp));
+DEF_IMGLIB_FN (void, png_set_gray_to_rgb, (png_structp));
+DEF_IMGLIB_FN (void, png_set_background, (png_structp, png_color_16p,
+				    int, int, double));
+DEF_IMGLIB_FN (png_uint_32, png_get_bKGD, (png_structp, png_infop, png_color_16p *));
+DEF_IMGLIB_FN (void, png_read_update_info, (png_structp, png_infop));
+DEF_IMGLIB_FN (png_byte, png_get_channels, (png_structp, png_infop));
+DEF_IMGLIB_FN (png_size_t, png_get_rowbytes, (png_structp, png_infop));
+DEF_IMGLIB_FN (void, png_read_image, (png_structp, png_bytepp));
+DEF_IMGLIB_FN (void, png_read_end, (png_structp, png_infop));
+DEF_IMGLIB_FN (void, png_error, (png_structp, png_const_charp));
+
+#if (PNG_LIBPNG_VER >= 10500)
+DEF_IMGLIB_FN (void, png_longjmp, (png_structp, int));
+DEF_IMGLIB_FN (jmp_buf *, png_set_longjmp_fn, (png_structp, png_longjmp_ptr, size_t));
+#endif /* libpng version >= 1.5 */
+
+static int
+init_png_functions (Lisp_Object libraries)
+{
+  HMODULE library;
+
+  if (!(library = w32_delayed_load (libraries, Qpng)))
+    return 0;
+
+  LOAD_IMGLIB_FN (library, png_get_io_ptr);
+  LOAD_IMGLIB_FN (library, png_get_error_ptr);
+  LOAD_IMGLIB_FN (library, png_sig_cmp);
+  LOAD_IMGLIB_FN (library, png_create_read_struct);
+  LOAD_IMGLIB_FN (library, png_create_info_struct);
+  LOAD_IMGLIB_FN (library, png_destroy_read_struct);
+  LOAD_IMGLIB_FN (library, png_set_read_fn);
+  LOAD_IMGLIB_FN (library, png_set_sig_bytes);
+  LOAD_IMGLIB_FN (library, png_read_info);
+  LOAD_IMGLIB_FN (library, png_get_IHDR);
+  LOAD_IMGLIB_FN (library, png_get_valid);
   LOAD_IMGLIB_FN (library, png_set_strip_16);
   LOAD_IMGLIB_FN (library, png_set_expand);
   LOAD_IMGLIB_FN (library, png_set_gray_to_rgb);
@@ -5492,6 +6712,7 @@ init_png_functions (Lisp_Object libraries)
 #else
 
 #define fn_png_get_io_ptr		png_get_io_ptr
+#define fn_png_get_error_ptr		png_get_error_ptr
 #define fn_png_sig_cmp			png_sig_cmp
 #define fn_png_create_read_struct	png_create_read_struct
 #define fn_png_create_info_struct	png_create_info_struct
@@ -5531,16 +6752,15 @@ init_png_functions (Lisp_Object libraries)
   (*fn_png_set_longjmp_fn ((ptr), longjmp, sizeof (jmp_buf)))
 #endif
 
-/* Error and warning handlers installed when the PNG library
-   is initialized.  */
+/* Error and warning handlers installed when the PNG library is
+   initialized.  They are called in worker threads too, so they must
+   not use Lisp; the error message is recorded in the decode job.  */
 
 static _Noreturn void
 my_png_error (png_struct *png_ptr, const char *msg)
 {
   eassert (png_ptr != NULL);
-  /* Avoid compiler warning about deprecated direct access to
-     png_ptr's fields in libpng versions 1.4.x.  */
-  image_error ("PNG error: %s", build_string (msg), Qnil);
+  image_decode_error (fn_png_get_error_ptr (png_ptr), msg);
   PNG_LONGJMP (png_ptr);
 }
 
@@ -5549,7 +6769,7 @@ static void
 my_png_warning (png_struct *png_ptr, const char *msg)
 {
   eassert (png_ptr != NULL);
-  image_error ("PNG warning: %s", build_string (msg), Qnil);
+  /* Warnings are ignored; the image is usable anyway.  */
 }
 
 /* Memory source for PNG decoding.  */
@@ -5593,18 +6813,32 @@ png_read_from_file (png_structp png_ptr, png_bytep data, png_size_t length)
     fn_png_error (png_ptr, "Read error");
 }
 
+/* Find the size of a PNG image from its header chunk.  */
 
-/* Load PNG image IMG for use on frame F.  Value is non-zero if
-   successful.  */
+static int
+png_peek_size (struct image_peek *peek, unsigned long *width,
+	       unsigned long *height)
+{
+  static unsigned char const signature[] = "\x89PNG\r\n\x1a\n";
+  unsigned char buf[24];
+
+  if (!image_peek_read (peek, buf, sizeof buf)
+      || memcmp (buf, signature, 8) != 0
+      || memcmp (buf + 12, "IHDR", 4) != 0)
+    return 0;
+  *width = ((unsigned long) buf[16] << 24 | buf[17] << 16
+	    | buf[18] << 8 | buf[19]);
+  *height = ((unsigned long) buf[20] << 24 | buf[21] << 16
+	     | buf[22] << 8 | buf[23]);
+  return 1;
+}
+
+/* Decode the PNG image of JOB.  Value is non-zero if successful.
+   This may run in a worker thread.  */
 
 static int
-png_load (struct frame *f, struct image *img)
+png_decode (struct image_decode_job *job)
 {
-  Lisp_Object file, specified_file;
-  Lisp_Object specified_data;
-  int x, y;
-  ptrdiff_t i;
-  XImagePtr ximg, mask_img = NULL;
   png_struct *png_ptr = NULL;
   png_info *info_ptr = NULL, *end_info = NULL;
   FILE *volatile fp = NULL;
@@ -5615,57 +6849,39 @@ png_load (struct frame *f, struct image *img)
   int bit_depth, color_type, interlace_type;
   png_byte channels;
   png_uint_32 row_bytes;
+  png_color_16 *bg;
   int transparent_p;
+  ptrdiff_t i;
   struct png_memory_storage tbr;  /* Data to be read */
 
-  /* Find out what file to load.  */
-  specified_file = image_spec_value (img->spec, QCfile, NULL);
-  specified_data = image_spec_value (img->spec, QCdata, NULL);
-
-  if (NILP (specified_data))
+  if (job->file)
     {
-      file = x_find_image_file (specified_file);
-      if (!STRINGP (file))
-	{
-	  image_error ("Cannot find image file `%s'", specified_file, Qnil);
-	  return 0;
-	}
-
       /* Open the image file.  */
-      fp = fopen (SSDATA (file), "rb");
+      fp = image_decode_open (job);
       if (!fp)
-	{
-	  image_error ("Cannot open image file `%s'", file, Qnil);
-	  return 0;
-	}
+	return 0;
 
       /* Check PNG signature.  */
       if (fread (sig, 1, sizeof sig, fp) != sizeof sig
 	  || fn_png_sig_cmp (sig, 0, sizeof sig))
 	{
-	  image_error ("Not a PNG file: `%s'", file, Qnil);
+	  image_decode_error (job, "Not a PNG file");
 	  fclose (fp);
 	  return 0;
 	}
     }
   else
     {
-      if (!STRINGP (specified_data))
-	{
-	  image_error ("Invalid image data `%s'", specified_data, Qnil);
-	  return 0;
-	}
-
       /* Read from memory.  */
-      tbr.bytes = SDATA (specified_data);
-      tbr.len = SBYTES (specified_data);
+      tbr.bytes = job->data;
+      tbr.len = job->nbytes;
       tbr.index = 0;
 
       /* Check PNG signature.  */
       if (tbr.len < sizeof sig
 	  || fn_png_sig_cmp (tbr.bytes, 0, sizeof sig))
 	{
-	  image_error ("Not a PNG image: `%s'", img->spec, Qnil);
+	  image_decode_error (job, "Not a PNG image");
 	  return 0;
 	}
 
@@ -5675,7 +6891,7 @@ png_load (struct frame *f, struct image *img)
 
   /* Initialize read and info structs for PNG lib.  */
   png_ptr = fn_png_create_read_struct (PNG_LIBPNG_VER_STRING,
-				       NULL, my_png_error,
+				       job, my_png_error,
 				       my_png_warning);
   if (!png_ptr)
     {
@@ -5706,14 +6922,14 @@ png_load (struct frame *f, struct image *img)
     error:
       if (png_ptr)
         fn_png_destroy_read_struct (&png_ptr, &info_ptr, &end_info);
-      xfree (pixels);
-      xfree (rows);
+      free (pixels);
+      free (rows);
       if (fp) fclose (fp);
       return 0;
     }
 
   /* Read image info.  */
-  if (!NILP (specified_data))
+  if (!fp)
     fn_png_set_read_fn (png_ptr, (void *) &tbr, png_read_from_memory);
   else
     fn_png_set_read_fn (png_ptr, (void *) fp, png_read_from_file);
@@ -5723,17 +6939,8 @@ png_load (struct frame *f, struct image *img)
   fn_png_get_IHDR (png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
 		   &interlace_type, NULL, NULL);
 
-  if (! (width <= INT_MAX && height <= INT_MAX
-	 && check_image_size (f, width, height)))
-    {
-      image_error ("Invalid image size (see `max-image-size')", Qnil, Qnil);
-      goto error;
-    }
-
-  /* Create the X image and pixmap now, so that the work below can be
-     omitted if the image is too large for X.  */
-  if (!x_create_x_image_and_pixmap (f, width, height, 0, &ximg,
-				    &img->pixmap))
+  if (!image_decode_check_size (job, width, height)
+      || !image_decode_set_target (job, width, height))
     goto error;
 
   /* If image contains simply transparency data, we prefer to
@@ -5762,51 +6969,30 @@ png_load (struct frame *f, struct image *img)
 
   /* Handle alpha channel by combining the image with a background
      color.  Do this only if a real alpha channel is supplied.  For
-     simple transparency, we prefer a clipping mask.  */
+     simple transparency, we prefer a clipping mask.
+
+     An alpha channel, aka mask channel, associates variable
+     transparency with an image.  Where other image formats support
+     binary transparency---fully transparent or fully opaque---PNG
+     allows up to 254 levels of partial transparency.  Because the
+     background on which the image is displayed may change, for real
+     alpha channel support, it would be necessary to create a new
+     image for each possible background.  So we combine the image
+     with the `:background' color of the image, or else with the
+     frame's background color, ignoring any default background color
+     set by the image.  */
   if (!transparent_p)
     {
-      /* png_color_16 *image_bg; */
-      Lisp_Object specified_bg
-	= image_spec_value (img->spec, QCbackground, NULL);
       int shift = (bit_depth == 16) ? 0 : 8;
+      png_color_16 background;
 
-      if (STRINGP (specified_bg))
-	/* The user specified `:background', use that.  */
-	{
-	  XColor color;
-	  if (x_defined_color (f, SSDATA (specified_bg), &color, 0))
-	    {
-	      png_color_16 user_bg;
-
-	      memset (&user_bg, 0, sizeof user_bg);
-	      user_bg.red = color.red >> shift;
-	      user_bg.green = color.green >> shift;
-	      user_bg.blue = color.blue >> shift;
-
-	      fn_png_set_background (png_ptr, &user_bg,
-				     PNG_BACKGROUND_GAMMA_SCREEN, 0, 1.0);
-	    }
-	}
-      else
-	{
-	  /* We use the current frame background, ignoring any default
-	     background color set by the image.  */
-#if defined (HAVE_X_WINDOWS) || defined (HAVE_NTGUI)
-	  XColor color;
-	  png_color_16 frame_background;
-
-	  color.pixel = FRAME_BACKGROUND_PIXEL (f);
-	  x_query_color (f, &color);
+      memset (&background, 0, sizeof background);
+      background.red = job->background[0] >> shift;
+      background.green = job->background[1] >> shift;
+      background.blue = job->background[2] >> shift;
 
-	  memset (&frame_background, 0, sizeof frame_background);
-	  frame_background.red = color.red >> shift;
-	  frame_background.green = color.green >> shift;
-	  frame_background.blue = color.blue >> shift;
-#endif /* HAVE_X_WINDOWS */
-
-	  fn_png_set_background (png_ptr, &frame_background,
-				 PNG_BACKGROUND_GAMMA_SCREEN, 0, 1.0);
-	}
+      fn_png_set_background (png_ptr, &background,
+			     PNG_BACKGROUND_GAMMA_SCREEN, 0, 1.0);
     }
 
   /* Update info structure.  */
@@ -5825,10 +7011,19 @@ png_load (struct frame *f, struct image *img)
 
   /* Allocate memory for the image.  */
   if (min (PTRDIFF_MAX, SIZE_MAX) / sizeof *rows < height
-      || min (PTRDIFF_MAX, SIZE_MAX) / sizeof *pixels / height < row_bytes)
-    memory_full (SIZE_MAX);
-  pixels = xmalloc (sizeof *pixels * row_bytes * height);
-  rows = xmalloc (height * sizeof *rows);
+      || min (PTRDIFF_MAX, SIZE_MAX) / sizeof *pixels / height < row_bytes
+      || row_bytes != width * channels)
+    {
+      image_decode_error (job, "Image too large");
+      goto error;
+    }
+  pixels = malloc (sizeof *pixels * row_bytes * height);
+  rows = malloc (height * sizeof *rows);
+  if (!pixels || !rows)
+    {
+      image_decode_error (job, "Out of memory");
+      goto error;
+    }
   for (i = 0; i < height; ++i)
     rows[i] = pixels + i * row_bytes;
 
@@ -5841,105 +7036,35 @@ png_load (struct frame *f, struct image *img)
       fp = NULL;
     }
 
-  /* Create an image and pixmap serving as mask if the PNG image
-     contains an alpha channel.  */
-  if (channels == 4
-      && !transparent_p
-      && !x_create_x_image_and_pixmap (f, width, height, 1,
-				       &mask_img, &img->mask))
-    {
-      x_destroy_x_image (ximg);
-      Free_Pixmap (FRAME_X_DISPLAY (f), img->pixmap);
-      img->pixmap = NO_PIXMAP;
-      goto error;
-    }
-
-  /* Fill the X image and mask from PNG data.  */
-  init_color_table ();
-
-  for (y = 0; y < height; ++y)
-    {
-      png_byte *p = rows[y];
-
-      for (x = 0; x < width; ++x)
-	{
-	  int r, g, b;
-
-	  r = *p++ << 8;
-	  g = *p++ << 8;
-	  b = *p++ << 8;
-	  XPutPixel (ximg, x, y, lookup_rgb_color (f, r, g, b));
-	  /* An alpha channel, aka mask channel, associates variable
-	     transparency with an image.  Where other image formats
-	     support binary transparency---fully transparent or fully
-	     opaque---PNG allows up to 254 levels of partial transparency.
-	     The PNG library implements partial transparency by combining
-	     the image with a specified background color.
-
-	     I'm not sure how to handle this here nicely: because the
-	     background on which the image is displayed may change, for
-	     real alpha channel support, it would be necessary to create
-	     a new image for each possible background.
-
-	     What I'm doing now is that a mask is created if we have
-	     boolean transparency information.  Otherwise I'm using
-	     the frame's background color to combine the image with.  */
-
-	  if (channels == 4)
-	    {
-	      if (mask_img)
-		XPutPixel (mask_img, x, y, *p > 0 ? PIX_MASK_DRAW : PIX_MASK_RETAIN);
-	      ++p;
-	    }
-	}
-    }
-
-  if (NILP (image_spec_value (img->spec, QCbackground, NULL)))
-    /* Set IMG's background color from the PNG image, unless the user
-       overrode it.  */
+  /* Remember the background color of the PNG image.  */
+  if (fn_png_get_bKGD (png_ptr, info_ptr, &bg))
     {
-      png_color_16 *bg;
-      if (fn_png_get_bKGD (png_ptr, info_ptr, &bg))
-	{
-	  img->background = lookup_rgb_color (f, bg->red, bg->green, bg->blue);
-	  img->background_valid = 1;
-	}
+      job->file_background_p = 1;
+      job->file_background[0] = bg->red;
+      job->file_background[1] = bg->green;
+      job->file_background[2] = bg->blue;
     }
 
-#ifdef COLOR_TABLE_SUPPORT
-  /* Remember colors allocated for this image.  */
-  img->colors = colors_in_color_table (&img->ncolors);
-  free_color_table ();
-#endif /* COLOR_TABLE_SUPPORT */
-
   /* Clean up.  */
   fn_png_destroy_read_struct (&png_ptr, &info_ptr, &end_info);
-  xfree (rows);
-  xfree (pixels);
+  free (rows);
 
-  img->width = width;
-  img->height = height;
-
-  /* Maybe fill in the background field while we have ximg handy.
-     Casting avoids a GCC warning.  */
-  IMAGE_BACKGROUND (img, f, (XImagePtr_or_DC)ximg);
-
-  /* Put the image into the pixmap, then free the X image and its buffer.  */
-  x_put_x_image (f, ximg, img->pixmap, width, height);
-  x_destroy_x_image (ximg);
+  job->width = width;
+  job->height = height;
+  job->channels = channels;
+  job->pixels = pixels;
+  job->mask_p = !transparent_p;
+  return 1;
+}
 
-  /* Same for the mask.  */
-  if (mask_img)
-    {
-      /* Fill in the background_transparent field while we have the
-	 mask handy.  Casting avoids a GCC warning.  */
-      image_background_transparent (img, f, (XImagePtr_or_DC)mask_img);
 
-      x_put_x_image (f, mask_img, img->mask, img->width, img->height);
-      x_destroy_x_image (mask_img);
-    }
+/* Load PNG image IMG for use on frame F.  Value is non-zero if
+   successful.  */
 
-  return 1;
+static int
+png_load (struct frame *f, struct image *img)
+{
+  return decode_and_load_image (f, img, png_decode, png_peek_size);
 }
 
 #else /* HAVE_PNG */
@@ -5986,6 +7111,9 @@ enum jpeg_keyword_index
   JPEG_HEURISTIC_MASK,
   JPEG_MASK,
   JPEG_BACKGROUND,
+  JPEG_MAX_WIDTH,
+  JPEG_MAX_HEIGHT,
+  JPEG_SCALE,
   JPEG_LAST
 };
 
@@ -6003,7 +7131,10 @@ static const struct image_keyword jpeg_format[JPEG_LAST] =
   {":conversions",	IMAGE_DONT_CHECK_VALUE_TYPE,		0},
   {":heuristic-mask",	IMAGE_DONT_CHECK_VALUE_TYPE,		0},
   {":mask",		IMAGE_DONT_CHECK_VALUE_TYPE,		0},
-  {":background",	IMAGE_STRING_OR_NIL_VALUE,		0}
+  {":background",	IMAGE_STRING_OR_NIL_VALUE,		0},
+  {":max-width",	IMAGE_POSITIVE_INTEGER_VALUE,		0},
+  {":max-height",	IMAGE_POSITIVE_INTEGER_VALUE,		0},
+  {":scale",		IMAGE_NUMBER_VALUE,			0}
 };
 
 /* Structure describing the image type `jpeg'.  */
@@ -6144,9 +7275,11 @@ our_common_term_source (j_decompress_ptr cinfo)
 
 /* Fill input buffer method for JPEG data source manager.  Called
    whenever more data is needed.  We read the whole image in one step,
-   so this only adds a fake end of input marker at the end.  */
+   so this only adds a fake end of input marker at the end.  The
+   marker is constant, because images can be decoded in several
+   threads at once.  */
 
-static JOCTET our_memory_buffer[2];
+static JOCTET const our_memory_buffer[2] = { 0xFF, JPEG_EOI };
 
 static boolean
 our_memory_fill_input_buffer (j_decompress_ptr cinfo)
@@ -6154,9 +7287,6 @@ our_memory_fill_input_buffer (j_decompress_ptr cinfo)
   /* Insert a fake EOI marker.  */
   struct jpeg_source_mgr *src = cinfo->src;
 
-  our_memory_buffer[0] = (JOCTET) 0xFF;
-  our_memory_buffer[1] = (JOCTET) JPEG_EOI;
-
   src->next_input_byte = our_memory_buffer;
   src->bytes_in_buffer = 2;
   return 1;
@@ -6321,48 +7451,89 @@ jpeg_file_src (j_decompress_ptr cinfo, FILE *fp)
 }
 
 
-/* Load image IMG for use on frame F.  Patterned after example.c
-   from the JPEG lib.  */
+/* Skip N bytes.  Value is non-zero if successful.  */
 
 static int
-jpeg_load (struct frame *f, struct image *img)
+image_peek_skip (struct image_peek *peek, long n)
 {
-  struct jpeg_decompress_struct cinfo;
-  struct my_jpeg_error_mgr mgr;
-  Lisp_Object file, specified_file;
-  Lisp_Object specified_data;
-  FILE * volatile fp = NULL;
-  JSAMPARRAY buffer;
-  int row_stride, x, y;
-  XImagePtr ximg = NULL;
-  int rc;
-  unsigned long *colors;
-  int width, height;
+  if (peek->fp)
+    return fseek (peek->fp, n, SEEK_CUR) == 0;
+  if (peek->nbytes - peek->pos < n)
+    return 0;
+  peek->pos += n;
+  return 1;
+}
 
-  /* Open the JPEG file.  */
-  specified_file = image_spec_value (img->spec, QCfile, NULL);
-  specified_data = image_spec_value (img->spec, QCdata, NULL);
+/* Find the size of a JPEG image from its start-of-frame marker.  */
 
-  if (NILP (specified_data))
+static int
+jpeg_peek_size (struct image_peek *peek, unsigned long *width,
+		unsigned long *height)
+{
+  unsigned char buf[9];
+
+  if (!image_peek_read (peek, buf, 2) || buf[0] != 0xFF || buf[1] != 0xD8)
+    return 0;
+
+  for (;;)
     {
-      file = x_find_image_file (specified_file);
-      if (!STRINGP (file))
+      int marker, length;
+
+      if (!image_peek_read (peek, buf, 2) || buf[0] != 0xFF)
+	return 0;
+      marker = buf[1];
+      if (marker == 0xFF)
 	{
-	  image_error ("Cannot find image file `%s'", specified_file, Qnil);
-	  return 0;
+	  /* Fill byte; the marker code follows.  */
+	  image_peek_skip (peek, -1);
+	  continue;
 	}
+      if (marker == 0x01 || (0xD0 <= marker && marker <= 0xD7))
+	/* Markers without a segment.  */
+	continue;
+      if (!image_peek_read (peek, buf, 2))
+	return 0;
+      length = buf[0] << 8 | buf[1];
+      if (length < 2)
+	return 0;
 
-      fp = fopen (SSDATA (file), "rb");
-      if (fp == NULL)
+      /* SOF0 to SOF15, except DHT, JPG and DAC.  */
+      if (0xC0 <= marker && marker <= 0xCF
+	  && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
 	{
-	  image_error ("Cannot open `%s'", file, Qnil);
-	  return 0;
+	  if (length < 7 || !image_peek_read (peek, buf, 5))
+	    return 0;
+	  *height = buf[1] << 8 | buf[2];
+	  *width = buf[3] << 8 | buf[4];
+	  return 1;
 	}
+
+      if (!image_peek_skip (peek, length - 2))
+	return 0;
     }
-  else if (!STRINGP (specified_data))
+}
+
+/* Decode the JPEG image of JOB.  Patterned after example.c from the
+   JPEG lib.  Value is non-zero if successful.  This may run in a
+   worker thread.  */
+
+static int
+jpeg_decode (struct image_decode_job *job)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct my_jpeg_error_mgr mgr;
+  FILE * volatile fp = NULL;
+  JSAMPARRAY buffer;
+  int row_stride, x, y, i, ir, ig, ib;
+  unsigned char * volatile pixels = NULL;
+  unsigned char *p;
+  int width, height;
+
+  if (job->file)
     {
-      image_error ("Invalid image data `%s'", specified_data, Qnil);
-      return 0;
+      fp = image_decode_open (job);
+      if (fp == NULL)
+	return 0;
     }
 
   /* Customize libjpeg's error handling to call my_error_exit when an
@@ -6370,27 +7541,21 @@ jpeg_load (struct frame *f, struct image *img)
   cinfo.err = fn_jpeg_std_error (&mgr.pub);
   mgr.pub.error_exit = my_error_exit;
 
-  if ((rc = setjmp (mgr.setjmp_buffer)) != 0)
+  if (setjmp (mgr.setjmp_buffer) != 0)
     {
-      if (rc == 1)
+      if (!job->message[0])
 	{
-	  /* Called from my_error_exit.  Display a JPEG error.  */
+	  /* Called from my_error_exit.  Record the JPEG error.  */
 	  char buf[JMSG_LENGTH_MAX];
 	  cinfo.err->format_message ((j_common_ptr) &cinfo, buf);
-	  image_error ("Error reading JPEG image `%s': %s", img->spec,
-		       build_string (buf));
+	  image_decode_error (job, buf);
 	}
 
       /* Close the input file and destroy the JPEG object.  */
       if (fp)
 	fclose ((FILE *) fp);
       fn_jpeg_destroy_decompress (&cinfo);
-
-      /* If we already have an XImage, free that.  */
-      x_destroy_x_image (ximg);
-
-      /* Free pixmap and colors.  */
-      x_clear_image (f, img);
+      free (pixels);
       return 0;
     }
 
@@ -6398,79 +7563,74 @@ jpeg_load (struct frame *f, struct image *img)
 	 Read the JPEG image header.  */
   fn_jpeg_CreateDecompress (&cinfo, JPEG_LIB_VERSION, sizeof (cinfo));
 
-  if (NILP (specified_data))
+  if (fp)
     jpeg_file_src (&cinfo, (FILE *) fp);
   else
-    jpeg_memory_src (&cinfo, SDATA (specified_data),
-		     SBYTES (specified_data));
+    jpeg_memory_src (&cinfo, job->data, job->nbytes);
 
   fn_jpeg_read_header (&cinfo, 1);
 
+  if (!image_decode_check_size (job, cinfo.image_width, cinfo.image_height)
+      || !image_decode_set_target (job, cinfo.image_width,
+				   cinfo.image_height))
+    longjmp (mgr.setjmp_buffer, 2);
+
+  /* When the image is made smaller, let the JPEG lib do most of the
+     work while decoding: it can scale by 1/2, 1/4 and 1/8 cheaply.
+     Use the smallest of these scales that still gives an image at
+     least as large as needed; image_decode_resize does the rest.  */
+  cinfo.scale_num = 8;
+  cinfo.scale_denom = 8;
+  while (cinfo.scale_num > 1
+	 && (cinfo.image_width * (cinfo.scale_num / 2) + 7) / 8
+	    >= job->target_width
+	 && (cinfo.image_height * (cinfo.scale_num / 2) + 7) / 8
+	    >= job->target_height)
+    cinfo.scale_num /= 2;
+
   /* Customize decompression so that color quantization will be used.
 	 Start decompression.  */
   cinfo.quantize_colors = 1;
   fn_jpeg_start_decompress (&cinfo);
-  width = img->width = cinfo.output_width;
-  height = img->height = cinfo.output_height;
+  width = cinfo.output_width;
+  height = cinfo.output_height;
 
-  if (!check_image_size (f, width, height))
+  pixels = malloc ((size_t) width * height);
+  if (!pixels)
     {
-      image_error ("Invalid image size (see `max-image-size')", Qnil, Qnil);
+      image_decode_error (job, "Out of memory");
       longjmp (mgr.setjmp_buffer, 2);
     }
 
-  /* Create X image and pixmap.  */
-  if (!x_create_x_image_and_pixmap (f, width, height, 0, &ximg, &img->pixmap))
-    longjmp (mgr.setjmp_buffer, 2);
-
-  /* Allocate colors.  When color quantization is used,
+  /* Record the colormap.  When color quantization is used,
      cinfo.actual_number_of_colors has been set with the number of
      colors generated, and cinfo.colormap is a two-dimensional array
      of color indices in the range 0..cinfo.actual_number_of_colors.
      No more than 255 colors will be generated.  */
-  {
-    int i, ir, ig, ib;
-
-    if (cinfo.out_color_components > 2)
-      ir = 0, ig = 1, ib = 2;
-    else if (cinfo.out_color_components > 1)
-      ir = 0, ig = 1, ib = 0;
-    else
-      ir = 0, ig = 0, ib = 0;
-
-    /* Use the color table mechanism because it handles colors that
-       cannot be allocated nicely.  Such colors will be replaced with
-       a default color, and we don't have to care about which colors
-       can be freed safely, and which can't.  */
-    init_color_table ();
-    colors = alloca (cinfo.actual_number_of_colors * sizeof *colors);
-
-    for (i = 0; i < cinfo.actual_number_of_colors; ++i)
-      {
-	/* Multiply RGB values with 255 because X expects RGB values
-	   in the range 0..0xffff.  */
-	int r = cinfo.colormap[ir][i] << 8;
-	int g = cinfo.colormap[ig][i] << 8;
-	int b = cinfo.colormap[ib][i] << 8;
-	colors[i] = lookup_rgb_color (f, r, g, b);
-      }
+  if (cinfo.out_color_components > 2)
+    ir = 0, ig = 1, ib = 2;
+  else if (cinfo.out_color_components > 1)
+    ir = 0, ig = 1, ib = 0;
+  else
+    ir = 0, ig = 0, ib = 0;
 
-#ifdef COLOR_TABLE_SUPPORT
-    /* Remember those colors actually allocated.  */
-    img->colors = colors_in_color_table (&img->ncolors);
-    free_color_table ();
-#endif /* COLOR_TABLE_SUPPORT */
-  }
+  job->ncolors = min (cinfo.actual_number_of_colors, 256);
+  for (i = 0; i < job->ncolors; ++i)
+    {
+      job->colormap[i][0] = cinfo.colormap[ir][i];
+      job->colormap[i][1] = cinfo.colormap[ig][i];
+      job->colormap[i][2] = cinfo.colormap[ib][i];
+    }
 
   /* Read pixels.  */
   row_stride = width * cinfo.output_components;
   buffer = cinfo.mem->alloc_sarray ((j_common_ptr) &cinfo, JPOOL_IMAGE,
 				    row_stride, 1);
-  for (y = 0; y < height; ++y)
+  for (y = 0, p = pixels; y < height; ++y)
     {
       fn_jpeg_read_scanlines (&cinfo, buffer, 1);
-      for (x = 0; x < cinfo.output_width; ++x)
-	XPutPixel (ximg, x, y, colors[buffer[0][x]]);
+      for (x = 0; x < width; ++x)
+	*p++ = buffer[0][x];
     }
 
   /* Clean up.  */
@@ -6479,17 +7639,22 @@ jpeg_load (struct frame *f, struct image *img)
   if (fp)
     fclose ((FILE *) fp);
 
-  /* Maybe fill in the background field while we have ximg handy. */
-  if (NILP (image_spec_value (img->spec, QCbackground, NULL)))
-    /* Casting avoids a GCC warning.  */
-    IMAGE_BACKGROUND (img, f, (XImagePtr_or_DC)ximg);
-
-  /* Put the image into the pixmap.  */
-  x_put_x_image (f, ximg, img->pixmap, width, height);
-  x_destroy_x_image (ximg);
+  job->width = width;
+  job->height = height;
+  job->channels = 1;
+  job->pixels = pixels;
   return 1;
 }
 
+
+/* Load image IMG for use on frame F.  */
+
+static int
+jpeg_load (struct frame *f, struct image *img)
+{
+  return decode_and_load_image (f, img, jpeg_decode, jpeg_peek_size);
+}
+
 #else /* HAVE_JPEG */
 
 #ifdef HAVE_NS
@@ -8821,6 +9986,11 @@ non-numeric, there is no explicit limit on the size of images.  */);
   DEFSYM (Qcount, "count");
   DEFSYM (Qextension_data, "extension-data");
   DEFSYM (Qdelay, "delay");
+  DEFSYM (Qmemory, "memory");
+  DEFSYM (Qlimit, "limit");
+  DEFSYM (Qhits, "hits");
+  DEFSYM (Qmisses, "misses");
+  DEFSYM (Qevictions, "evictions");
 
   DEFSYM (QCascent, ":ascent");
   DEFSYM (QCmargin, ":margin");
@@ -8832,6 +10002,9 @@ non-numeric, there is no explicit limit on the size of images.  */);
   DEFSYM (QCgeometry, ":geometry");
   DEFSYM (QCcrop, ":crop");
   DEFSYM (QCrotation, ":rotation");
+  DEFSYM (QCmax_width, ":max-width");
+  DEFSYM (QCmax_height, ":max-height");
+  DEFSYM (QCscale, ":scale");
   DEFSYM (QCmatrix, ":matrix");
   DEFSYM (QCcolor_adjustment, ":color-adjustment");
   DEFSYM (QCmask, ":mask");
@@ -8908,6 +10081,7 @@ non-numeric, there is no explicit limit on the size of images.  */);
 #endif
   defsubr (&Sclear_image_cache);
   defsubr (&Simage_flush);
+  defsubr (&Simage_cache_statistics);
   defsubr (&Simage_size);
   defsubr (&Simage_mask_p);
   defsubr (&Simage_metadata);
@@ -8936,6 +10110,45 @@ The value can also be nil, meaning the cache is never cleared.
 
 The function `clear-image-cache' disregards this variable.  */);
   Vimage_cache_eviction_delay = make_number (300);
+
+  DEFVAR_LISP ("image-cache-memory-limit", Vimage_cache_memory_limit,
+    doc: /* Maximum amount of memory taken by the images in an image cache.
+When the decoded images in an image cache take more memory than this,
+Emacs frees the least recently displayed images, next time it is idle.
+
+If the value is an integer, it specifies the limit in bytes.  If it is
+a floating point number, it specifies the limit as a multiple of the
+memory needed for one frame-full of pixels, summed over all the frames
+that share the image cache.  If the value is nil, the memory taken by
+images is not limited.
+
+The most recently displayed image is never freed this way.  See
+`image-cache-statistics' for the current memory use.  */);
+  Vimage_cache_memory_limit = make_float (10.0);
+
+  DEFVAR_BOOL ("image-decode-asynchronously", image_decode_asynchronously,
+    doc: /* Non-nil means decode PNG and JPEG images in the background.
+If non-nil, these images are decoded in separate threads, and an empty
+rectangle of the right size is displayed in place of an image until it
+has been decoded.  If nil, images are decoded when they are displayed
+for the first time, which blocks Emacs meanwhile.
+
+Images are only decoded in the background on X, if Emacs was built
+with thread support.  */);
+  image_decode_asynchronously = 1;
+
+  DEFVAR_LISP ("image-thumbnail-cache-directory",
+	       Vimage_thumbnail_cache_directory,
+    doc: /* Directory caching scaled PNG and JPEG images, or nil.
+If this is a directory name, PNG and JPEG image files displayed with
+`:scale', `:max-width' or `:max-height' are stored there after they
+have been decoded and scaled.  Displaying such an image again, even in
+a later session, then reads the small cached copy instead of the
+original file.  A cached copy is used only while the size and
+modification time of the original file are unchanged.
+
+The files in this directory can be deleted at any time.  */);
+  Vimage_thumbnail_cache_directory = Qnil;
 #ifdef HAVE_IMAGEMAGICK
   DEFVAR_INT ("imagemagick-render-type", imagemagick_render_type,
     doc: /* Integer indicating which ImageMagick rendering method to use.
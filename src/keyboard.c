@@ -3473,7 +3473,6 @@ event_to_kboard (struct input_event *event)
     return FRAME_KBOARD (XFRAME (frame));
 }
 
-#ifdef subprocesses
 /* Return the number of slots occupied in kbd_buffer.  */
 
 static int
@@ -3486,7 +3485,25 @@ kbd_buffer_nr_stored (void)
        : ((kbd_buffer + KBD_BUFFER_SIZE) - kbd_fetch_ptr
           + (kbd_store_ptr - kbd_buffer)));
 }
-#endif	/* Store an event obtained at interrupt level into kbd_buffer, fifo */
+
+/* Return the slot of kbd_buffer that comes before PTR.  */
+
+static struct input_event *
+kbd_buffer_previous_event (struct input_event *ptr)
+{
+  return ptr == kbd_buffer ? kbd_buffer + KBD_BUFFER_SIZE - 1 : ptr - 1;
+}
+
+/* Return the number of wheel events that EVENT stands for.  Only a
+   count of 2 or more in the `arg' field means that events were
+   combined; some ports leave `arg' zeroed rather than nil.  */
+
+static EMACS_INT
+wheel_event_count (struct input_event *event)
+{
+  return (INTEGERP (event->arg) && XINT (event->arg) >= 2
+	  ? XINT (event->arg) : 1);
+}
 
 void
 kbd_buffer_store_event (register struct input_event *event)
@@ -3593,6 +3610,66 @@ kbd_buffer_store_event_hold (register struct input_event *event,
 		: kbd_store_ptr - 1)->kind) == BUFFER_SWITCH_EVENT)
     return;
 
+  /* Fold a wheel event into the last event in the buffer if that was
+     made by turning the same wheel the same way, so that scrolling
+     fast runs one command that scrolls by many lines instead of one
+     command per notch.  The count goes in the `arg' field.  Leave
+     alone an event that is about to be read, lest it be read while we
+     change it.  */
+  if ((event->kind == WHEEL_EVENT || event->kind == HORIZ_WHEEL_EVENT)
+      && coalesce_wheel_events
+      && kbd_buffer_nr_stored () > 1)
+    {
+      struct input_event *last = kbd_buffer_previous_event (kbd_store_ptr);
+
+      if (last->kind == event->kind
+	  && last->modifiers == event->modifiers
+	  && EQ (last->frame_or_window, event->frame_or_window)
+	  && (NILP (last->arg) || INTEGERP (last->arg))
+	  && wheel_event_count (last) < MOST_POSITIVE_FIXNUM)
+	{
+	  last->arg = make_number (wheel_event_count (last) + 1);
+	  last->x = event->x;
+	  last->y = event->y;
+	  last->timestamp = event->timestamp;
+	  return;
+	}
+    }
+
+  /* X reports the wheel as presses and releases of buttons 4 to 7.
+     When a release of one of those follows a press and a release of
+     the same button, drop the press and count the new release in the
+     earlier one.  The first press stays, so that the release is still
+     seen as a click.  */
+  if (event->kind == MOUSE_CLICK_EVENT
+      && coalesce_wheel_events
+      && 3 <= event->code && event->code <= 6
+      && (event->modifiers & up_modifier)
+      && FRAMEP (event->frame_or_window)
+      && FRAME_X_P (XFRAME (event->frame_or_window))
+      && kbd_buffer_nr_stored () > 2)
+    {
+      struct input_event *press = kbd_buffer_previous_event (kbd_store_ptr);
+      struct input_event *release = kbd_buffer_previous_event (press);
+
+      if (press->kind == MOUSE_CLICK_EVENT
+	  && release->kind == MOUSE_CLICK_EVENT
+	  && press->code == event->code
+	  && release->code == event->code
+	  && press->modifiers == ((event->modifiers & ~up_modifier)
+				  | down_modifier)
+	  && release->modifiers == event->modifiers
+	  && EQ (press->frame_or_window, event->frame_or_window)
+	  && EQ (release->frame_or_window, event->frame_or_window)
+	  && (NILP (release->arg) || INTEGERP (release->arg))
+	  && wheel_event_count (release) < MOST_POSITIVE_FIXNUM)
+	{
+	  release->arg = make_number (wheel_event_count (release) + 1);
+	  kbd_store_ptr = press;
+	  return;
+	}
+    }
+
   if (kbd_store_ptr - kbd_buffer == KBD_BUFFER_SIZE)
     kbd_store_ptr = kbd_buffer;
 
@@ -4250,6 +4327,11 @@ timer_start_idle (void)
   timer_idleness_start_time = current_emacs_time ();
   timer_last_idleness_start_time = timer_idleness_start_time;
 
+#ifdef HAVE_WINDOW_SYSTEM
+  /* Now is a good time to free images that are no longer needed.  */
+  clear_image_caches_when_idle ();
+#endif
+
   /* Mark all idle-time timers as once again candidates for running.  */
   for (timers = Vtimer_idle_list; CONSP (timers); timers = XCDR (timers))
     {
@@ -4496,6 +4578,13 @@ timer_check (void)
     }
   while (EMACS_SECS (nexttime) == 0 && EMACS_NSECS (nexttime) == 0);
 
+#ifdef HAVE_WINDOW_SYSTEM
+  /* Timers may display images while Emacs stays idle (Bug#6230), so
+     keep the image caches in check here as well.  */
+  if (EMACS_TIME_VALID_P (timer_idleness_start_time))
+    clear_image_caches_when_idle ();
+#endif
+
   return nexttime;
 }
 
@@ -5691,6 +5780,11 @@ make_lispy_event (struct input_event *event)
 			  Fcons (start_pos,
 				 Fcons (position,
 					Qnil)));
+	  /* Releases of the wheel buttons may have been combined.  */
+	  else if (event->kind == MOUSE_CLICK_EVENT
+		   && wheel_event_count (event) > 1)
+	    return list4 (head, position, make_number (double_click_count),
+			  event->arg);
 	  else if (event->modifiers & (double_modifier | triple_modifier))
 	    return Fcons (head,
 			  Fcons (position,
@@ -5797,7 +5891,11 @@ make_lispy_event (struct input_event *event)
 				      ASIZE (wheel_syms));
 	}
 
-	if (event->modifiers & (double_modifier | triple_modifier))
+	/* A count of several notches comes after the click count.  */
+	if (wheel_event_count (event) > 1)
+	  return list4 (head, position, make_number (double_click_count),
+			event->arg);
+	else if (event->modifiers & (double_modifier | triple_modifier))
 	  return Fcons (head,
 			Fcons (position,
 			       Fcons (make_number (double_click_count),
@@ -7368,6 +7466,72 @@ static Lisp_Object menu_bar_one_keymap_changed_items;
 static Lisp_Object menu_bar_items_vector;
 static int menu_bar_items_index;
 
+/* The last result of menu_bar_items, for reuse when nothing it depends
+   on has changed.  menu_bar_items_cache holds its items, including the
+   final four nils, and menu_bar_items_cache_defs holds the `menu-bar'
+   keymaps it was computed from.  menu_bar_items_cache_shape lists the
+   conses and bindings at the top level of those keymaps, to catch
+   changes made with `setcdr' and `nconc' rather than `define-key'.
+   The cache is nil unless computing the items evaluated no Lisp forms
+   and changed no keymaps.  */
+static Lisp_Object menu_bar_items_cache;
+static Lisp_Object menu_bar_items_cache_defs;
+static Lisp_Object menu_bar_items_cache_shape;
+static Lisp_Object menu_bar_items_cache_final_items;
+static Lisp_Object menu_bar_items_cache_enable_disabled;
+static EMACS_INT menu_bar_items_cache_tick;
+
+/* The number of times menu_item_eval_property has been called.  */
+static EMACS_INT menu_item_evaluations;
+
+/* Walk the top level of the keymap MAP, including the keymaps it
+   includes and its parents: each cons of the list, the element in it,
+   and the binding and menu item name of the element.  If RECORD is
+   nonzero, push these objects onto *SHAPE.  Otherwise compare them
+   with the objects at the front of the list *SHAPE, popping those that
+   match, and return 0 at the first one that does not.  */
+
+static int
+menu_bar_keymap_shape (Lisp_Object map, Lisp_Object *shape, int record)
+{
+  Lisp_Object tail;
+
+  for (tail = map; CONSP (tail); tail = XCDR (tail))
+    {
+      Lisp_Object elt = XCAR (tail), objs[5];
+      int n = 0, i;
+
+      objs[n++] = tail;
+      objs[n++] = elt;
+      if (CONSP (elt))
+	{
+	  Lisp_Object binding = XCDR (elt);
+
+	  objs[n++] = binding;
+	  if (CONSP (binding))
+	    {
+	      /* The name of an old-style item or `menu-item'.  */
+	      objs[n++] = XCAR (binding);
+	      if (EQ (XCAR (binding), Qmenu_item) && CONSP (XCDR (binding)))
+		objs[n++] = XCAR (XCDR (binding));
+	    }
+	}
+
+      for (i = 0; i < n; i++)
+	if (record)
+	  *shape = Fcons (objs[i], *shape);
+	else if (CONSP (*shape) && EQ (XCAR (*shape), objs[i]))
+	  *shape = XCDR (*shape);
+	else
+	  return 0;
+
+      if (CONSP (elt) && EQ (XCAR (elt), Qkeymap)
+	  && !menu_bar_keymap_shape (elt, shape, record))
+	return 0;
+    }
+  return 1;
+}
+
 
 static const char* separator_names[] = {
   "space",
@@ -7435,8 +7599,14 @@ menu_bar_items (Lisp_Object old)
 
   Lisp_Object def, tail;
 
+  /* defs[0..nmaps-1] are the `menu-bar' keymaps of the keymaps in MAPS,
+     or nil where there is none.  */
+  Lisp_Object *defs;
+
   ptrdiff_t mapno;
   Lisp_Object oquit;
+  EMACS_INT evaluations = menu_item_evaluations;
+  EMACS_INT tick = keymaps_modified_tick;
 
   /* In order to build the menus, we need to call the keymap
      accessors.  They all call QUIT.  But this function is called
@@ -7495,16 +7665,51 @@ menu_bar_items (Lisp_Object old)
 
   /* Look up in each map the dummy prefix key `menu-bar'.  */
 
+  defs = alloca (nmaps * sizeof *defs);
   for (mapno = nmaps - 1; mapno >= 0; mapno--)
-    if (!NILP (maps[mapno]))
-      {
+    {
+      def = Qnil;
+      if (!NILP (maps[mapno]))
 	def = get_keymap (access_keymap (maps[mapno], Qmenu_bar, 1, 0, 1),
 			  0, 1);
-	if (CONSP (def))
-	  {
-	    menu_bar_one_keymap_changed_items = Qnil;
-	    map_keymap_canonical (def, menu_bar_item, Qnil, NULL);
-	  }
+      defs[mapno] = CONSP (def) ? def : Qnil;
+    }
+
+  /* If the items were computed from the same keymaps before, and no
+     keymap has changed since, reuse them.  */
+  if (!NILP (menu_bar_items_cache)
+      && menu_bar_items_cache_tick == keymaps_modified_tick
+      && evaluations == menu_item_evaluations
+      && EQ (menu_bar_items_cache_final_items, Vmenu_bar_final_items)
+      && EQ (menu_bar_items_cache_enable_disabled,
+	     Venable_disabled_menus_and_buttons)
+      && ASIZE (menu_bar_items_cache_defs) == nmaps)
+    {
+      Lisp_Object shape = menu_bar_items_cache_shape;
+
+      for (mapno = 0; mapno < nmaps; mapno++)
+	if (!EQ (AREF (menu_bar_items_cache_defs, mapno), defs[mapno])
+	    || !menu_bar_keymap_shape (defs[mapno], &shape, 0))
+	  break;
+      if (mapno == nmaps && NILP (shape))
+	{
+	  ptrdiff_t size = ASIZE (menu_bar_items_cache);
+	  if (ASIZE (menu_bar_items_vector) < size)
+	    menu_bar_items_vector = Fmake_vector (make_number (size), Qnil);
+	  memcpy (XVECTOR (menu_bar_items_vector)->contents,
+		  XVECTOR (menu_bar_items_cache)->contents,
+		  size * sizeof (Lisp_Object));
+	  menu_bar_items_index = size;
+	  Vinhibit_quit = oquit;
+	  return menu_bar_items_vector;
+	}
+    }
+
+  for (mapno = nmaps - 1; mapno >= 0; mapno--)
+    if (CONSP (defs[mapno]))
+      {
+	menu_bar_one_keymap_changed_items = Qnil;
+	map_keymap_canonical (defs[mapno], menu_bar_item, Qnil, NULL);
       }
 
   /* Move to the end those items that should be at the end.  */
@@ -7550,6 +7755,28 @@ menu_bar_items (Lisp_Object old)
     menu_bar_items_index = i;
   }
 
+  /* Items that depend on the values of `:visible', `:enable' or
+     `:filter' forms, or on keymaps that were autoloaded meanwhile,
+     have to be computed again next time.  */
+  if (evaluations == menu_item_evaluations
+      && tick == keymaps_modified_tick)
+    {
+      menu_bar_items_cache
+	= Fvector (menu_bar_items_index,
+		   XVECTOR (menu_bar_items_vector)->contents);
+      menu_bar_items_cache_defs = Fvector (nmaps, defs);
+      menu_bar_items_cache_shape = Qnil;
+      for (mapno = 0; mapno < nmaps; mapno++)
+	menu_bar_keymap_shape (defs[mapno], &menu_bar_items_cache_shape, 1);
+      menu_bar_items_cache_shape = Fnreverse (menu_bar_items_cache_shape);
+      menu_bar_items_cache_final_items = Vmenu_bar_final_items;
+      menu_bar_items_cache_enable_disabled
+	= Venable_disabled_menus_and_buttons;
+      menu_bar_items_cache_tick = tick;
+    }
+  else
+    menu_bar_items_cache = Qnil;
+
   Vinhibit_quit = oquit;
   return menu_bar_items_vector;
 }
@@ -7658,6 +7885,7 @@ menu_item_eval_property (Lisp_Object sexpr)
 {
   ptrdiff_t count = SPECPDL_INDEX ();
   Lisp_Object val;
+  menu_item_evaluations++;
   specbind (Qinhibit_redisplay, Qt);
   val = internal_condition_case_1 (eval_dyn, sexpr, Qerror,
 				   menu_item_eval_property_1);
@@ -11262,8 +11490,8 @@ init_kboard (KBOARD *kb)
   KVAR (kb, Vsystem_key_alist) = Qnil;
   KVAR (kb, system_key_syms) = Qnil;
   KVAR (kb, Vwindow_system) = Qt;	/* Unset.  */
-  KVAR (kb, Vinput_decode_map) = Fmake_sparse_keymap (Qnil);
-  KVAR (kb, Vlocal_function_key_map) = Fmake_sparse_keymap (Qnil);
+  KVAR (kb, Vinput_decode_map) = Fmake_sparse_keymap (Qnil, Qnil);
+  KVAR (kb, Vlocal_function_key_map) = Fmake_sparse_keymap (Qnil, Qnil);
   Fset_keymap_parent (KVAR (kb, Vlocal_function_key_map), Vfunction_key_map);
   KVAR (kb, Vdefault_minibuffer_frame) = Qnil;
 }
@@ -11584,6 +11812,17 @@ syms_of_keyboard (void)
   menu_bar_items_vector = Qnil;
   staticpro (&menu_bar_items_vector);
 
+  menu_bar_items_cache = Qnil;
+  staticpro (&menu_bar_items_cache);
+  menu_bar_items_cache_defs = Qnil;
+  staticpro (&menu_bar_items_cache_defs);
+  menu_bar_items_cache_shape = Qnil;
+  staticpro (&menu_bar_items_cache_shape);
+  menu_bar_items_cache_final_items = Qnil;
+  staticpro (&menu_bar_items_cache_final_items);
+  menu_bar_items_cache_enable_disabled = Qnil;
+  staticpro (&menu_bar_items_cache_enable_disabled);
+
   help_form_saved_window_configs = Qnil;
   staticpro (&help_form_saved_window_configs);
 
@@ -11826,6 +12065,19 @@ output.  See also `translation-table-for-input'.
 This variable has a separate binding for each terminal.
 See Info node `(elisp)Multiple Terminals'.  */);
 
+  DEFVAR_BOOL ("coalesce-wheel-events", coalesce_wheel_events,
+	       doc: /* Non-nil means combine wheel events that arrive in a row.
+When the mouse wheel is turned faster than Emacs can process the
+resulting events, the events waiting to be processed are combined into
+one, which is followed by its click count and the number of events it
+stands for: (wheel-up POSITION CLICK-COUNT COUNT).  On X, where the
+wheel is reported as mouse buttons 4 to 7, successive clicks of the same
+button are combined the same way: (mouse-4 POSITION CLICK-COUNT COUNT).
+`event-line-count' returns COUNT.  `mwheel-scroll' scrolls COUNT times
+as far, but other commands bound to these events may act only once for
+the whole combined event, which is why this is nil by default.  */);
+  coalesce_wheel_events = 0;
+
   DEFVAR_BOOL ("cannot-suspend", cannot_suspend,
 	       doc: /* Non-nil means to always spawn a subshell instead of suspending.
 \(Even if the operating system has support for stopping a process.\)  */);
@@ -11999,14 +12251,14 @@ Function key definitions that apply to all terminal devices should go
 here.  If a mapping is defined in both the current
 `local-function-key-map' binding and this variable, then the local
 definition will take precedence.  */);
-  Vfunction_key_map = Fmake_sparse_keymap (Qnil);
+  Vfunction_key_map = Fmake_sparse_keymap (Qnil, Qnil);
 
   DEFVAR_LISP ("key-translation-map", Vkey_translation_map,
                doc: /* Keymap of key translations that can override keymaps.
 This keymap works like `function-key-map', but comes after that,
 and its non-prefix bindings override ordinary bindings.
 Another difference is that it is global rather than keyboard-local.  */);
-  Vkey_translation_map = Fmake_sparse_keymap (Qnil);
+  Vkey_translation_map = Fmake_sparse_keymap (Qnil, Qnil);
 
   DEFVAR_LISP ("deferred-action-list", Vdeferred_action_list,
 	       doc: /* List of deferred actions to be performed at a later time.
@@ -92,6 +92,11 @@ static Lisp_Object where_is_cache;
 /* Which keymaps are reverse-stored in the cache.  */
 static Lisp_Object where_is_cache_keymaps;
 
+/* Incremented whenever a binding is stored in a keymap or the parent
+   of a keymap is changed, so that caches of information computed from
+   keymaps, like the menu bar items, can tell when they are stale.  */
+EMACS_INT keymaps_modified_tick;
+
 static Lisp_Object store_in_keymap (Lisp_Object, Lisp_Object, Lisp_Object);
 
 static Lisp_Object define_as_prefix (Lisp_Object, Lisp_Object);
@@ -129,7 +134,7 @@ in case you use it as a menu with `x-popup-menu'.  */)
 		Fcons (Fmake_char_table (Qkeymap, Qnil), tail));
 }
 
-DEFUN ("make-sparse-keymap", Fmake_sparse_keymap, Smake_sparse_keymap, 0, 1, 0,
+DEFUN ("make-sparse-keymap", Fmake_sparse_keymap, Smake_sparse_keymap, 0, 2, 0,
        doc: /* Construct and return a new sparse keymap.
 Its car is `keymap' and its cdr is an alist of (CHAR . DEFINITION),
 which binds the character CHAR to DEFINITION, or (SYMBOL . DEFINITION),
@@ -137,16 +142,29 @@ which binds the function key or mouse event SYMBOL to DEFINITION.
 Initially the alist is nil.
 
 The optional arg STRING supplies a menu name for the keymap
-in case you use it as a menu with `x-popup-menu'.  */)
-  (Lisp_Object string)
+in case you use it as a menu with `x-popup-menu'.
+
+If the optional arg HASH is non-nil, the keymap starts out with a hash
+table instead, and `define-key' stores the bindings of single events
+in it.  Looking up a key in such a keymap takes the same time no matter
+how many bindings it has.  */)
+  (Lisp_Object string, Lisp_Object hash)
 {
+  Lisp_Object tail = Qnil;
+
   if (!NILP (string))
     {
       if (!NILP (Vpurify_flag))
 	string = Fpurecopy (string);
-      return Fcons (Qkeymap, Fcons (string, Qnil));
+      tail = Fcons (string, tail);
     }
-  return Fcons (Qkeymap, Qnil);
+  if (!NILP (hash))
+    tail = Fcons (make_hash_table (Qeq, make_number (DEFAULT_HASH_SIZE),
+				   make_float (DEFAULT_REHASH_SIZE),
+				   make_float (DEFAULT_REHASH_THRESHOLD),
+				   Qnil, Qnil, Qnil),
+		  tail);
+  return Fcons (Qkeymap, tail);
 }
 
 /* This function is used for installing the standard key bindings
@@ -328,6 +346,7 @@ Return PARENT.  PARENT should be nil or another keymap.  */)
 
   /* Flush any reverse-map cache.  */
   where_is_cache = Qnil; where_is_cache_keymaps = Qt;
+  keymaps_modified_tick++;
 
   GCPRO2 (keymap, parent);
   keymap = get_keymap (keymap, 1, 1);
@@ -506,6 +525,19 @@ access_keymap_1 (Lisp_Object map, Lisp_Object idx, int t_ok, int noinherit, int
 		  val = Qunbound;
 	      }
 	  }
+	else if (HASH_TABLE_P (binding))
+	  {
+	    struct Lisp_Hash_Table *h = XHASH_TABLE (binding);
+	    ptrdiff_t i = hash_lookup (h, idx, NULL);
+
+	    if (i >= 0)
+	      val = HASH_VALUE (h, i);
+	    else if (t_ok && (i = hash_lookup (h, Qt, NULL)) >= 0)
+	      {
+		t_binding = HASH_VALUE (h, i);
+		t_ok = 0;
+	      }
+	  }
 
 	/* If we found a binding, clean it up and return it.  */
 	if (!EQ (val, Qunbound))
@@ -618,6 +650,16 @@ map_keymap_internal (Lisp_Object map,
 				 Fcons (make_save_value (data, 0),
 					args)));
 	}
+      else if (HASH_TABLE_P (binding))
+	{
+	  struct Lisp_Hash_Table *h = XHASH_TABLE (binding);
+	  ptrdiff_t i;
+
+	  for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+	    if (!NILP (HASH_HASH (h, i)))
+	      map_keymap_item (fun, args, HASH_KEY (h, i),
+			       HASH_VALUE (h, i), data);
+	}
     }
   UNGCPRO;
   return tail;
@@ -796,6 +838,7 @@ store_in_keymap (Lisp_Object keymap, register Lisp_Object idx, Lisp_Object def)
   /* Flush any reverse-map cache.  */
   where_is_cache = Qnil;
   where_is_cache_keymaps = Qt;
+  keymaps_modified_tick++;
 
   if (EQ (idx, Qkeymap))
     error ("`keymap' is reserved for embedded parent maps");
@@ -890,6 +933,29 @@ store_in_keymap (Lisp_Object keymap, register Lisp_Object idx, Lisp_Object def)
 	      }
 	    insertion_point = tail;
 	  }
+	else if (HASH_TABLE_P (elt))
+	  {
+	    struct Lisp_Hash_Table *h = XHASH_TABLE (elt);
+
+	    if (!CONSP (idx))
+	      {
+		Fputhash (idx, def, elt);
+		return def;
+	      }
+	    else if (CHARACTERP (XCAR (idx)))
+	      {
+		/* Update the characters in the range that have bindings
+		   of their own; the rest go into a char-table.  */
+		ptrdiff_t i;
+		for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+		  if (!NILP (HASH_HASH (h, i))
+		      && NATNUMP (HASH_KEY (h, i))
+		      && XFASTINT (HASH_KEY (h, i)) >= XFASTINT (XCAR (idx))
+		      && XFASTINT (HASH_KEY (h, i)) <= XFASTINT (XCDR (idx)))
+		    ASET (h->key_and_value, 2 * i + 1, def);
+	      }
+	    insertion_point = tail;
+	  }
 	else if (CONSP (elt))
 	  {
 	    if (EQ (Qkeymap, XCAR (elt)))
@@ -1063,6 +1129,17 @@ is not copied.  */)
 	  for (i = 0; i < ASIZE (elt); i++)
 	    ASET (elt, i, copy_keymap_item (AREF (elt, i)));
 	}
+      else if (HASH_TABLE_P (elt))
+	{
+	  struct Lisp_Hash_Table *h;
+	  ptrdiff_t i;
+	  elt = Fcopy_hash_table (elt);
+	  h = XHASH_TABLE (elt);
+	  for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+	    if (!NILP (HASH_HASH (h, i)))
+	      ASET (h->key_and_value, 2 * i + 1,
+		    copy_keymap_item (HASH_VALUE (h, i)));
+	}
       else if (CONSP (elt))
 	{
 	  if (EQ (XCAR (elt), Qkeymap))
@@ -1325,7 +1402,7 @@ define_as_prefix (Lisp_Object keymap, Lisp_Object c)
 {
   Lisp_Object cmd;
 
-  cmd = Fmake_sparse_keymap (Qnil);
+  cmd = Fmake_sparse_keymap (Qnil, Qnil);
   store_in_keymap (keymap, c, cmd);
 
   return cmd;
@@ -1827,7 +1904,7 @@ This function returns COMMAND.  */)
   (Lisp_Object command, Lisp_Object mapvar, Lisp_Object name)
 {
   Lisp_Object map;
-  map = Fmake_sparse_keymap (name);
+  map = Fmake_sparse_keymap (name, Qnil);
   Ffset (command, map);
   if (!NILP (mapvar))
     Fset (mapvar, map);
@@ -3198,6 +3275,74 @@ describe_map_compare (const void *aa, const void *bb)
   return 0;
 }
 
+/* Put the binding of EVENT to BINDING in the sparse keymap MAP into
+   *ELT, unless describe_map should leave it out.  Return 1 if it was
+   put there, 0 otherwise.  KLUDGE is a vector of one element to use
+   for lookups, and SUPPRESS is the property that marks commands to
+   leave out, or nil.  The other arguments are as for describe_map.  */
+
+static int
+describe_map_binding (Lisp_Object event, Lisp_Object binding,
+		      Lisp_Object map, Lisp_Object kludge, Lisp_Object suppress,
+		      Lisp_Object shadow, int partial, int nomenu,
+		      int mention_shadow, struct describe_map_elt *elt)
+{
+  Lisp_Object definition = Qnil, tem;
+  int this_shadowed = 0;
+  struct gcpro gcpro1, gcpro2;
+
+  /* Ignore bindings whose "prefix" are not really valid events.
+     (We get these in the frames and buffers menu.)  */
+  if (!(SYMBOLP (event) || INTEGERP (event)))
+    return 0;
+
+  if (nomenu && EQ (event, Qmenu_bar))
+    return 0;
+
+  definition = get_keyelt (binding, 0);
+
+  /* Don't show undefined commands or suppressed commands.  */
+  if (NILP (definition)) return 0;
+  if (SYMBOLP (definition) && partial)
+    {
+      tem = Fget (definition, suppress);
+      if (!NILP (tem))
+	return 0;
+    }
+
+  /* Don't show a command that isn't really visible
+     because a local definition of the same key shadows it.  */
+
+  GCPRO2 (event, definition);
+  ASET (kludge, 0, event);
+  if (!NILP (shadow))
+    {
+      tem = shadow_lookup (shadow, kludge, Qt, 0);
+      if (!NILP (tem))
+	{
+	  /* If both bindings are keymaps, this key is a prefix key,
+	     so don't say it is shadowed.  */
+	  if (KEYMAPP (definition) && KEYMAPP (tem))
+	    ;
+	  /* Avoid generating duplicate entries if the
+	     shadowed binding has the same definition.  */
+	  else if (mention_shadow && !EQ (tem, definition))
+	    this_shadowed = 1;
+	  else
+	    RETURN_UNGCPRO (0);
+	}
+    }
+
+  tem = Flookup_key (map, kludge, Qt);
+  UNGCPRO;
+  if (!EQ (tem, definition)) return 0;
+
+  elt->event = event;
+  elt->definition = definition;
+  elt->shadowed = this_shadowed;
+  return 1;
+}
+
 /* Describe the contents of map MAP, assuming that this map itself is
    reached by the sequence of prefix keys PREFIX (a string or vector).
    PARTIAL, SHADOW, NOMENU are as in `describe_map_tree' above.  */
@@ -3208,7 +3353,7 @@ describe_map (Lisp_Object map, Lisp_Object prefix,
 	      int partial, Lisp_Object shadow,
 	      Lisp_Object *seen, int nomenu, int mention_shadow)
 {
-  Lisp_Object tail, definition, event;
+  Lisp_Object tail, definition;
   Lisp_Object tem;
   Lisp_Object suppress;
   Lisp_Object kludge;
@@ -3217,7 +3362,7 @@ describe_map (Lisp_Object map, Lisp_Object prefix,
 
   /* These accumulate the values from sparse keymap bindings,
      so we can sort them and handle them in order.  */
-  int length_needed = 0;
+  ptrdiff_t length_needed = 0;
   struct describe_map_elt *vect;
   int slots_used = 0;
   int i;
@@ -3238,7 +3383,10 @@ describe_map (Lisp_Object map, Lisp_Object prefix,
   map = call1 (Qkeymap_canonicalize, map);
 
   for (tail = map; CONSP (tail); tail = XCDR (tail))
-    length_needed++;
+    if (HASH_TABLE_P (XCAR (tail)))
+      length_needed += XHASH_TABLE (XCAR (tail))->count;
+    else
+      length_needed++;
 
   vect = ((struct describe_map_elt *)
 	  alloca (sizeof (struct describe_map_elt) * length_needed));
@@ -3253,59 +3401,25 @@ describe_map (Lisp_Object map, Lisp_Object prefix,
 			 prefix, Qnil, elt_describer, partial, shadow, map,
 			 1, mention_shadow);
       else if (CONSP (XCAR (tail)))
-	{
-	  int this_shadowed = 0;
-
-	  event = XCAR (XCAR (tail));
-
-	  /* Ignore bindings whose "prefix" are not really valid events.
-	     (We get these in the frames and buffers menu.)  */
-	  if (!(SYMBOLP (event) || INTEGERP (event)))
-	    continue;
-
-	  if (nomenu && EQ (event, Qmenu_bar))
-	    continue;
-
-	  definition = get_keyelt (XCDR (XCAR (tail)), 0);
-
-	  /* Don't show undefined commands or suppressed commands.  */
-	  if (NILP (definition)) continue;
-	  if (SYMBOLP (definition) && partial)
-	    {
-	      tem = Fget (definition, suppress);
-	      if (!NILP (tem))
-		continue;
-	    }
-
-	  /* Don't show a command that isn't really visible
-	     because a local definition of the same key shadows it.  */
-
-	  ASET (kludge, 0, event);
-	  if (!NILP (shadow))
-	    {
-	      tem = shadow_lookup (shadow, kludge, Qt, 0);
-	      if (!NILP (tem))
-		{
-		  /* If both bindings are keymaps, this key is a prefix key,
-		     so don't say it is shadowed.  */
-		  if (KEYMAPP (definition) && KEYMAPP (tem))
-		    ;
-		  /* Avoid generating duplicate entries if the
-		     shadowed binding has the same definition.  */
-		  else if (mention_shadow && !EQ (tem, definition))
-		    this_shadowed = 1;
-		  else
-		    continue;
-		}
-	    }
-
-	  tem = Flookup_key (map, kludge, Qt);
-	  if (!EQ (tem, definition)) continue;
-
-	  vect[slots_used].event = event;
-	  vect[slots_used].definition = definition;
-	  vect[slots_used].shadowed = this_shadowed;
-	  slots_used++;
+	slots_used += describe_map_binding (XCAR (XCAR (tail)),
+					    XCDR (XCAR (tail)), map,
+					    kludge, suppress, shadow,
+					    partial, nomenu,
+					    mention_shadow, vect + slots_used);
+      else if (HASH_TABLE_P (XCAR (tail)))
+	{
+	  struct Lisp_Hash_Table *h = XHASH_TABLE (XCAR (tail));
+	  ptrdiff_t j;
+
+	  for (j = 0;
+	       j < HASH_TABLE_SIZE (h) && slots_used < length_needed; j++)
+	    if (!NILP (HASH_HASH (h, j)))
+	      slots_used += describe_map_binding (HASH_KEY (h, j),
+						  HASH_VALUE (h, j), map,
+						  kludge, suppress, shadow,
+						  partial, nomenu,
+						  mention_shadow,
+						  vect + slots_used);
 	}
       else if (EQ (XCAR (tail), Qkeymap))
 	{
@@ -3657,12 +3771,14 @@ for each symbol and a symbol is mentioned only if that returns non-nil.
 Return list of symbols found.  */)
   (Lisp_Object regexp, Lisp_Object predicate)
 {
-  Lisp_Object tem;
+  Lisp_Object tem, args[2];
   CHECK_STRING (regexp);
   apropos_predicate = predicate;
   apropos_accumulate = Qnil;
   map_obarray (Vobarray, apropos_accum, regexp);
-  tem = Fsort (apropos_accumulate, Qstring_lessp);
+  args[0] = apropos_accumulate;
+  args[1] = Qstring_lessp;
+  tem = Fsort (2, args);
   apropos_accumulate = Qnil;
   apropos_predicate = Qnil;
   return tem;
@@ -3718,11 +3834,11 @@ don't alter it yourself.  */);
 
   DEFVAR_LISP ("minibuffer-local-map", Vminibuffer_local_map,
 	       doc: /* Default keymap to use when reading from the minibuffer.  */);
-  Vminibuffer_local_map = Fmake_sparse_keymap (Qnil);
+  Vminibuffer_local_map = Fmake_sparse_keymap (Qnil, Qnil);
 
   DEFVAR_LISP ("minibuffer-local-ns-map", Vminibuffer_local_ns_map,
 	       doc: /* Local keymap for the minibuffer when spaces are not allowed.  */);
-  Vminibuffer_local_ns_map = Fmake_sparse_keymap (Qnil);
+  Vminibuffer_local_ns_map = Fmake_sparse_keymap (Qnil, Qnil);
   Fset_keymap_parent (Vminibuffer_local_ns_map, Vminibuffer_local_map);
 
 
@@ -352,6 +352,9 @@ enum pvec_type
   PVEC_TERMINAL,
   PVEC_WINDOW_CONFIGURATION,
   PVEC_SUBR,
+  PVEC_STRING_BUILDER,
+  PVEC_NUMERIC_VECTOR,
+  PVEC_COMPLETION_INDEX,
   PVEC_OTHER,
   /* These last 4 are special because we OR them in fns.c:internal_equal,
      so they have to use a disjoint bit pattern:
@@ -539,6 +542,9 @@ clip_to_bounds (ptrdiff_t lower, EMACS_INT num, ptrdiff_t upper)
 #define XBOOL_VECTOR(a) (eassert (BOOL_VECTOR_P (a)), \
 			 ((struct Lisp_Bool_Vector *) \
 			  XUNTAG (a, Lisp_Vectorlike)))
+#define XNUMERIC_VECTOR(a) (eassert (NUMERIC_VECTOR_P (a)), \
+			    ((struct Lisp_Numeric_Vector *) \
+			     XUNTAG (a, Lisp_Vectorlike)))
 
 /* Construct a Lisp_Object from a value or address.  */
 
@@ -974,6 +980,43 @@ struct Lisp_Bool_Vector
     unsigned char data[1];
   };
 
+/* The element types of numeric vectors.  */
+enum numeric_vector_type
+  {
+    NUMERIC_VECTOR_UINT8,
+    NUMERIC_VECTOR_INT32,
+    NUMERIC_VECTOR_INT64,
+    NUMERIC_VECTOR_FLOAT64
+  };
+
+/* Size in bytes of an element of a numeric vector of type TYPE.  */
+#define NUMERIC_VECTOR_ELT_SIZE(type)		\
+  ((type) == NUMERIC_VECTOR_UINT8 ? 1		\
+   : (type) == NUMERIC_VECTOR_INT32 ? 4 : 8)
+
+/* A numeric vector is a kind of vectorlike whose elements are all
+   numbers of one machine type, stored unboxed, like the bits of a
+   bool vector.  */
+struct Lisp_Numeric_Vector
+  {
+    /* HEADER.SIZE is the vector's size field.  It doesn't have the real size,
+       just the subtype information.  */
+    struct vectorlike_header header;
+    /* This is the number of elements.  */
+    EMACS_INT size;
+    /* This is the type of the elements.  */
+    enum numeric_vector_type type;
+    /* This contains the elements, as an array of the C type
+       corresponding to TYPE.  */
+    union
+    {
+      uint8_t u8[1];
+      int32_t i32[1];
+      int64_t i64[1];
+      double f64[1];
+    } data;
+  };
+
 /* This structure describes a built-in function.
    It is generated by the DEFUN macro only.
    defsubr makes it into a Lisp object.
@@ -1133,6 +1176,16 @@ struct Lisp_Symbol
 			     Hash Tables
  ***********************************************************************/
 
+/* A slot of the index of a hash table.  ENTRY is the number of the
+   entry the slot refers to, or one of HASH_SLOT_EMPTY and
+   HASH_SLOT_DELETED.  HASH is the hash code of the entry.  */
+
+struct hash_table_slot
+{
+  EMACS_UINT hash;
+  ptrdiff_t entry;
+};
+
 /* The structure of a Lisp hash table.  */
 
 struct Lisp_Hash_Table
@@ -1156,23 +1209,11 @@ struct Lisp_Hash_Table
      ratio, a float.  */
   Lisp_Object rehash_threshold;
 
-  /* Vector of hash codes.. If hash[I] is nil, this means that that
-     entry I is unused.  */
+  /* Vector of hash codes.  If hash[I] is nil, this means that that
+     entry I is unused.  The size of this vector is the size of the
+     table.  */
   Lisp_Object hash;
 
-  /* Vector used to chain entries.  If entry I is free, next[I] is the
-     entry number of the next free item.  If entry I is non-free,
-     next[I] is the index of the next entry in the collision chain.  */
-  Lisp_Object next;
-
-  /* Index of first free entry in free list.  */
-  Lisp_Object next_free;
-
-  /* Bucket vector.  A non-nil entry is the index of the first item in
-     a collision chain.  This vector's size can be larger than the
-     hash table size to reduce collisions.  */
-  Lisp_Object index;
-
   /* User-supplied hash function, or nil.  */
   Lisp_Object user_hash_function;
 
@@ -1186,6 +1227,30 @@ struct Lisp_Hash_Table
   /* Number of key/value entries in the table.  */
   ptrdiff_t count;
 
+  /* Index of first free entry in free list, or -1 if the table is
+     full.  */
+  ptrdiff_t next_free;
+
+  /* The index maps hash codes to entries by open addressing with
+     linear probing.  It has INDEX_SIZE slots, a power of 2.  Each
+     slot records the hash code of its entry, so that a probe looks
+     at keys only when the hash codes are the same.  */
+  ptrdiff_t index_size;
+
+  /* Number of slots of the index that are marked deleted.  */
+  ptrdiff_t index_deleted;
+
+  /* Right shift that maps a scrambled hash code to its first slot.  */
+  int index_shift;
+
+  /* The slots of the index.  This is the start of a single malloc'ed
+     block that also holds NEXT.  */
+  struct hash_table_slot *index;
+
+  /* If entry I is free, next[I] is the entry number of the next free
+     entry, or -1.  */
+  ptrdiff_t *next;
+
   /* Vector of keys and values.  The key of item I is found at index
      2 * I, the value is found at index 2 * I + 1.
      This is gc_marked specially if the table is weak.  */
@@ -1224,23 +1289,13 @@ struct Lisp_Hash_Table
 
 #define HASH_VALUE(H, IDX) AREF ((H)->key_and_value, 2 * (IDX) + 1)
 
-/* Value is the index of the next entry following the one at IDX
-   in hash table H.  */
-
-#define HASH_NEXT(H, IDX)  AREF ((H)->next, (IDX))
-
 /* Value is the hash code computed for entry IDX in hash table H.  */
 
 #define HASH_HASH(H, IDX)  AREF ((H)->hash, (IDX))
 
-/* Value is the index of the element in hash table H that is the
-   start of the collision list at index IDX in the index vector of H.  */
-
-#define HASH_INDEX(H, IDX)  AREF ((H)->index, (IDX))
-
 /* Value is the size of hash table H.  */
 
-#define HASH_TABLE_SIZE(H) ASIZE ((H)->next)
+#define HASH_TABLE_SIZE(H) ASIZE ((H)->hash)
 
 /* Default size for hash tables if not specified.  */
 
@@ -1256,6 +1311,75 @@ enum DEFAULT_HASH_SIZE { DEFAULT_HASH_SIZE = 65 };
 
 #define DEFAULT_REHASH_SIZE 1.5
 
+
+/* A string builder accumulates text in a growable buffer outside the
+   Lisp heap, so that a string can be built piece by piece without
+   allocating a Lisp string for each intermediate result.  It has no
+   Lisp_Object slots; the buffer is freed when the builder is garbage
+   collected.  */
+
+struct Lisp_String_Builder
+{
+  struct vectorlike_header header;
+
+  /* The accumulated text, allocated with xmalloc, or NULL.  */
+  unsigned char *data;
+
+  /* Number of bytes allocated for DATA.  */
+  ptrdiff_t size;
+
+  /* Number of bytes and characters of text in DATA.  */
+  ptrdiff_t nbytes, nchars;
+
+  /* Nonzero if the text in DATA is multibyte.  */
+  unsigned multibyte : 1;
+};
+
+#define XSTRING_BUILDER(OBJ) \
+     ((struct Lisp_String_Builder *) XUNTAG (OBJ, Lisp_Vectorlike))
+
+#define STRING_BUILDER_P(OBJ)  PSEUDOVECTORP (OBJ, PVEC_STRING_BUILDER)
+
+#define CHECK_STRING_BUILDER(x) \
+  CHECK_TYPE (STRING_BUILDER_P (x), Qstring_builder_p, x)
+
+/* A completion index holds the candidates of a completion table in
+   sorted order, so that `try-completion', `all-completions' and
+   `test-completion' can find the candidates that begin with a prefix
+   by binary search instead of testing every one.  */
+
+struct Lisp_Completion_Index
+{
+  struct vectorlike_header header;
+
+  /* Vectors indexed by candidate, sorted by KEYS: the element passed
+     to the predicate (an alist element, a symbol or a hash table
+     key), the hash table value passed along with it or nil if the
+     index was not made from a hash table, and the candidate string.  */
+  Lisp_Object elements, values, strings;
+
+  /* Vector of the candidate strings converted to multibyte, and vector
+     of the positions of the candidates in the collection.  */
+  Lisp_Object keys, positions;
+
+  /* Vector of the keys with every character upcased, sorted, and a
+     vector mapping each of them to the index of its candidate.  Both
+     are nil until a query ignores case.  CASE_TABLE is the case table
+     they were computed with.  */
+  Lisp_Object folded, folded_order, case_table;
+
+  /* Number of candidates.  */
+  ptrdiff_t count;
+};
+
+#define XCOMPLETION_INDEX(OBJ) \
+     ((struct Lisp_Completion_Index *) XUNTAG (OBJ, Lisp_Vectorlike))
+
+#define COMPLETION_INDEX_P(OBJ)  PSEUDOVECTORP (OBJ, PVEC_COMPLETION_INDEX)
+
+#define CHECK_COMPLETION_INDEX(x) \
+  CHECK_TYPE (COMPLETION_INDEX_P (x), Qcompletion_index_p, x)
+
 
 /* These structures are used for various misc types.  */
 
@@ -1685,6 +1809,7 @@ typedef struct {
 #define CHAR_TABLE_P(x) PSEUDOVECTORP (x, PVEC_CHAR_TABLE)
 #define SUB_CHAR_TABLE_P(x) PSEUDOVECTORP (x, PVEC_SUB_CHAR_TABLE)
 #define BOOL_VECTOR_P(x) PSEUDOVECTORP (x, PVEC_BOOL_VECTOR)
+#define NUMERIC_VECTOR_P(x) PSEUDOVECTORP (x, PVEC_NUMERIC_VECTOR)
 #define FRAMEP(x) PSEUDOVECTORP (x, PVEC_FRAME)
 
 /* Test for image (image . spec)  */
@@ -1693,7 +1818,8 @@ typedef struct {
 /* Array types.  */
 
 #define ARRAYP(x) \
-  (VECTORP (x) || STRINGP (x) || CHAR_TABLE_P (x) || BOOL_VECTOR_P (x))
+  (VECTORP (x) || STRINGP (x) || CHAR_TABLE_P (x) || BOOL_VECTOR_P (x) \
+   || NUMERIC_VECTOR_P (x))
 
 #define CHECK_LIST(x) \
   CHECK_TYPE (CONSP (x) || NILP (x), Qlistp, x)
@@ -1722,6 +1848,12 @@ typedef struct {
 #define CHECK_VECTOR(x) \
   CHECK_TYPE (VECTORP (x), Qvectorp, x)
 
+#define CHECK_NUMERIC_VECTOR(x) \
+  CHECK_TYPE (NUMERIC_VECTOR_P (x), Qnumeric_vector_p, x)
+
+#define CHECK_BOOL_VECTOR(x) \
+  CHECK_TYPE (BOOL_VECTOR_P (x), Qbool_vector_p, x)
+
 #define CHECK_VECTOR_OR_STRING(x) \
   CHECK_TYPE (VECTORP (x) || STRINGP (x), Qarrayp, x)
 
@@ -2334,6 +2466,7 @@ extern Lisp_Object Qcircular_list;
 extern Lisp_Object Qintegerp, Qwholenump, Qsymbolp, Qlistp, Qconsp;
 extern Lisp_Object Qstringp, Qarrayp, Qsequencep, Qbufferp;
 extern Lisp_Object Qchar_or_string_p, Qmarkerp, Qinteger_or_marker_p, Qvectorp;
+extern Lisp_Object Qbool_vector_p, Qnumeric_vector_p;
 extern Lisp_Object Qbuffer_or_string_p;
 extern Lisp_Object Qfboundp;
 extern Lisp_Object Qchar_table_p, Qvector_or_char_table_p;
@@ -2389,6 +2522,12 @@ extern intmax_t cons_to_signed (Lisp_Object, intmax_t, intmax_t);
 extern uintmax_t cons_to_unsigned (Lisp_Object, uintmax_t);
 
 extern struct Lisp_Symbol *indirect_variable (struct Lisp_Symbol *);
+extern enum numeric_vector_type numeric_vector_type (Lisp_Object);
+extern Lisp_Object numeric_vector_ref (struct Lisp_Numeric_Vector *,
+				       ptrdiff_t);
+extern void numeric_vector_set (struct Lisp_Numeric_Vector *, ptrdiff_t,
+				Lisp_Object);
+extern void numeric_vector_fill (struct Lisp_Numeric_Vector *, Lisp_Object);
 extern _Noreturn void args_out_of_range (Lisp_Object, Lisp_Object);
 extern _Noreturn void args_out_of_range_3 (Lisp_Object, Lisp_Object,
 					   Lisp_Object);
@@ -2440,6 +2579,9 @@ EXFUN (Fidentity, 1) ATTRIBUTE_CONST;
 extern EMACS_INT next_almost_prime (EMACS_INT) ATTRIBUTE_CONST;
 extern Lisp_Object larger_vector (Lisp_Object, ptrdiff_t, ptrdiff_t);
 extern void sweep_weak_hash_tables (void);
+extern int marking_weak_tables;
+extern void weak_object_reached (Lisp_Object);
+extern void free_hash_table_index (struct Lisp_Hash_Table *);
 extern Lisp_Object Qcursor_in_echo_area;
 extern Lisp_Object Qstring_lessp;
 extern Lisp_Object QCsize, QCtest, QCweakness, Qequal, Qeq, Qeql;
@@ -2634,6 +2776,7 @@ extern Lisp_Object make_string (const char *, ptrdiff_t);
 extern Lisp_Object make_formatted_string (char *, const char *, ...)
   ATTRIBUTE_FORMAT_PRINTF (2, 3);
 extern Lisp_Object make_unibyte_string (const char *, ptrdiff_t);
+extern Lisp_Object make_numeric_vector (enum numeric_vector_type, EMACS_INT);
 
 /* Make unibyte string from C string when the length isn't known.  */
 
@@ -2942,6 +3085,8 @@ extern ptrdiff_t fast_c_string_match_ignore_case (Lisp_Object, const char *,
 extern ptrdiff_t fast_string_match_ignore_case (Lisp_Object, Lisp_Object);
 extern ptrdiff_t fast_looking_at (Lisp_Object, ptrdiff_t, ptrdiff_t,
                                   ptrdiff_t, ptrdiff_t, Lisp_Object);
+extern Lisp_Object regexp_necessary_substrings (Lisp_Object);
+extern int string_has_necessary_substrings (Lisp_Object, Lisp_Object);
 extern ptrdiff_t scan_buffer (int, ptrdiff_t, ptrdiff_t, ptrdiff_t,
 			      ptrdiff_t *, int);
 extern EMACS_INT scan_newline (ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t,
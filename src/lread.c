@@ -58,6 +58,13 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <fcntl.h>
 
+/* Directory listings are indexed only where the file names that
+   readdir returns are the names that stat accepts, up to ASCII case.  */
+#if defined HAVE_DIRENT_H && !defined DOS_NT
+#define LOAD_DIRECTORY_INDEX
+#include <dirent.h>
+#endif
+
 #ifdef HAVE_FSEEKO
 #define file_offset off_t
 #define file_tell ftello
@@ -1411,6 +1418,124 @@ directories, make sure the PREDICATE function returns `dir-ok' for them.  */)
 
 static Lisp_Object Qdir_ok;
 
+#ifdef LOAD_DIRECTORY_INDEX
+
+/* Return a hash table whose keys are the names of the files in the
+   directory named DIR, a unibyte string, with ASCII letters downcased.
+   Return nil if the directory cannot be read.  */
+
+static Lisp_Object
+read_directory_names (Lisp_Object dir)
+{
+  Lisp_Object names = Qnil;
+  DIR *d;
+  struct dirent *dp;
+
+  BLOCK_INPUT;
+  d = opendir (SSDATA (dir));
+  UNBLOCK_INPUT;
+  if (d == NULL)
+    return Qnil;
+
+  {
+    Lisp_Object args[2];
+    args[0] = QCtest;
+    args[1] = Qequal;
+    names = Fmake_hash_table (2, args);
+  }
+
+  for (;;)
+    {
+      Lisp_Object name;
+      ptrdiff_t i;
+
+      errno = 0;
+      dp = readdir (d);
+      if (dp == NULL)
+	break;
+      name = make_unibyte_string (dp->d_name, strlen (dp->d_name));
+      for (i = 0; i < SBYTES (name); i++)
+	if ('A' <= SREF (name, i) && SREF (name, i) <= 'Z')
+	  SSET (name, i, SREF (name, i) - 'A' + 'a');
+      Fputhash (name, Qt, names);
+    }
+  if (errno != 0)
+    names = Qnil;
+
+  BLOCK_INPUT;
+  closedir (d);
+  UNBLOCK_INPUT;
+  return names;
+}
+
+/* Return the entry of `load-directory-index' for the directory named
+   DIR, a unibyte string, after checking it against the directory and
+   updating it if needed.  The entry is t if the directory does not
+   exist, (MTIME . NAMES) where NAMES is a hash table of the files that
+   were in it when its modification time was MTIME, or nil if nothing
+   is known about the directory.  */
+
+static Lisp_Object
+load_directory_index_entry (Lisp_Object dir)
+{
+  Lisp_Object old = Fgethash (dir, Vload_directory_index, Qnil);
+  Lisp_Object entry = old;
+  struct stat st;
+
+  if (stat (SSDATA (dir), &st) != 0)
+    entry = (errno == ENOENT || errno == ENOTDIR) ? Qt : Qnil;
+  else if (!S_ISDIR (st.st_mode))
+    entry = Qt;
+  else
+    {
+      Lisp_Object mtime = make_lisp_time (get_stat_mtime (&st));
+
+      if (! (CONSP (entry) && !NILP (Fequal (XCAR (entry), mtime))))
+	{
+	  /* A file added within the clock resolution of the last change
+	     might not change the modification time, so do not trust the
+	     listing of a directory that changed lately.  */
+	  Lisp_Object names = (st.st_mtime < time (NULL) - 2
+			       ? read_directory_names (dir) : Qnil);
+	  entry = NILP (names) ? Qnil : Fcons (mtime, names);
+	}
+    }
+
+  if (NILP (entry))
+    Fremhash (dir, Vload_directory_index);
+  else if (!EQ (entry, old))
+    Fputhash (dir, entry, Vload_directory_index);
+  return entry;
+}
+
+/* Return zero if ENTRY, an entry of `load-directory-index', shows that
+   its directory has no file whose name is the NBYTES bytes at NAME.  */
+
+static int
+load_directory_index_has (Lisp_Object entry, const char *name,
+			  ptrdiff_t nbytes)
+{
+  Lisp_Object key;
+  ptrdiff_t i;
+
+  if (EQ (entry, Qt))
+    return 0;
+  if (! (CONSP (entry) && HASH_TABLE_P (XCDR (entry))))
+    return 1;
+
+  key = make_uninit_string (nbytes);
+  for (i = 0; i < nbytes; i++)
+    {
+      unsigned char c = name[i];
+      if (!ASCII_BYTE_P (c))
+	return 1;
+      SSET (key, i, 'A' <= c && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+  return !NILP (Fgethash (key, XCDR (entry), Qnil));
+}
+
+#endif /* LOAD_DIRECTORY_INDEX */
+
 /* Search for a file whose name is STR, looking in directories
    in the Lisp list PATH, and trying suffixes from SUFFIX.
    On success, returns a file descriptor.  On failure, returns -1.
@@ -1443,8 +1568,13 @@ openp (Lisp_Object path, Lisp_Object str, Lisp_Object suffixes, Lisp_Object *sto
   Lisp_Object filename;
   struct stat st;
   struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5, gcpro6;
-  Lisp_Object string, tail, encoded_fn;
+  Lisp_Object string, tail, encoded_fn, index_entry;
   ptrdiff_t max_suffix_len = 0;
+  /* Whether the directory index can be used at all, and where the
+     file name proper starts in FN.  */
+  int use_index = 1;
+  ptrdiff_t basepos = 0;
+  int prefixlen;
 
   CHECK_STRING (str);
 
@@ -1453,10 +1583,13 @@ openp (Lisp_Object path, Lisp_Object str, Lisp_Object suffixes, Lisp_Object *sto
       CHECK_STRING_CAR (tail);
       max_suffix_len = max (max_suffix_len,
 			    SBYTES (XCAR (tail)));
+      /* The index assumes that all the suffixes lead to one directory.  */
+      if (memchr (SDATA (XCAR (tail)), '/', SBYTES (XCAR (tail))))
+	use_index = 0;
     }
 
-  string = filename = encoded_fn = Qnil;
-  GCPRO6 (str, string, filename, path, suffixes, encoded_fn);
+  string = filename = encoded_fn = index_entry = Qnil;
+  GCPRO6 (str, string, filename, path, suffixes, index_entry);
 
   if (storeptr)
     *storeptr = Qnil;
@@ -1484,6 +1617,38 @@ openp (Lisp_Object path, Lisp_Object str, Lisp_Object suffixes, Lisp_Object *sto
       if (fn_size <= want_length)
 	fn = alloca (fn_size = 100 + want_length);
 
+      /* If the directory starts with /:, remove that.  */
+      prefixlen = ((SCHARS (filename) > 2
+		    && SREF (filename, 0) == '/'
+		    && SREF (filename, 1) == ':')
+		   ? 2 : 0);
+
+      index_entry = Qnil;
+#ifdef LOAD_DIRECTORY_INDEX
+      /* Consult the index of the directory, so that suffixes naming no
+	 file there are skipped without further ado.  Only local ASCII
+	 file names are looked up, whose bytes need no encoding.  */
+      if (use_index && (NILP (predicate) || NATNUMP (predicate))
+	  && HASH_TABLE_P (Vload_directory_index)
+	  && NILP (Ffind_file_name_handler (filename, Qfile_exists_p)))
+	{
+	  ptrdiff_t i;
+
+	  /* BASEPOS is relative to the name without its /: prefix,
+	     which is what FN holds.  */
+	  basepos = 0;
+	  for (i = prefixlen; i < SBYTES (filename); i++)
+	    if (!ASCII_BYTE_P (SREF (filename, i)))
+	      break;
+	    else if (SREF (filename, i) == '/')
+	      basepos = i + 1 - prefixlen;
+	  if (i == SBYTES (filename) && basepos > 0)
+	    index_entry = load_directory_index_entry
+	      (make_unibyte_string (SSDATA (filename) + prefixlen,
+				    basepos > 1 ? basepos - 1 : 1));
+	}
+#endif
+
       /* Loop over suffixes.  */
       for (tail = NILP (suffixes) ? Fcons (empty_unibyte_string, Qnil) : suffixes;
 	   CONSP (tail); tail = XCDR (tail))
@@ -1492,16 +1657,17 @@ openp (Lisp_Object path, Lisp_Object str, Lisp_Object suffixes, Lisp_Object *sto
 	  Lisp_Object handler;
 	  int exists;
 
-	  /* Concatenate path element/specified name with the suffix.
-	     If the directory starts with /:, remove that.  */
-	  int prefixlen = ((SCHARS (filename) > 2
-			    && SREF (filename, 0) == '/'
-			    && SREF (filename, 1) == ':')
-			   ? 2 : 0);
+	  /* Concatenate path element/specified name with the suffix.  */
 	  fnlen = SBYTES (filename) - prefixlen;
 	  memcpy (fn, SDATA (filename) + prefixlen, fnlen);
 	  memcpy (fn + fnlen, SDATA (XCAR (tail)), lsuffix + 1);
 	  fnlen += lsuffix;
+#ifdef LOAD_DIRECTORY_INDEX
+	  if (!NILP (index_entry)
+	      && !load_directory_index_has (index_entry, fn + basepos,
+					    fnlen - basepos))
+	    continue;
+#endif
 	  /* Check that the file exists and is not a directory.  */
 	  /* We used to only check for handlers on non-absolute file names:
 	        if (absolute)
@@ -4291,6 +4457,16 @@ init_lread (void)
     }
 #endif  /* CANNOT_DUMP */
 
+  /* Directories are not indexed while dumping, since the dumped
+     Emacs looks for its files elsewhere.  */
+  if (initialized)
+    {
+      Lisp_Object args[2];
+      args[0] = QCtest;
+      args[1] = Qequal;
+      Vload_directory_index = Fmake_hash_table (2, args);
+    }
+
   Vvalues = Qnil;
 
   load_in_progress = 0;
@@ -4420,6 +4596,22 @@ the loading functions recognize as compression suffixes, you should
 customize `jka-compr-load-suffixes' rather than the present variable.  */);
   Vload_file_rep_suffixes = Fcons (empty_unibyte_string, Qnil);
 
+  DEFVAR_LISP ("load-directory-index", Vload_directory_index,
+	       doc: /* Cache of the contents of directories searched by `load'.
+If this is a hash table, `load', `locate-file' and related functions
+use it to skip file names that are not in a directory, instead of
+asking the operating system about each suffix they try.  Its keys are
+directory names and each value is t, if the directory did not exist,
+or (MTIME . NAMES), where NAMES is a hash table of the file names in
+the directory as of its modification time MTIME, with ASCII letters
+downcased.  An entry is read again whenever the directory's
+modification time changes.
+
+The table can be saved with `prin1' and read back in a later session;
+entries for directories that changed in between are simply refreshed.
+If this is nil, no cache is used.  */);
+  Vload_directory_index = Qnil;
+
   DEFVAR_BOOL ("load-in-progress", load_in_progress,
 	       doc: /* Non-nil if inside of `load'.  */);
   DEFSYM (Qload_in_progress, "load-in-progress");
@@ -1207,7 +1207,534 @@ minibuf_conform_representation (Lisp_Object string, Lisp_Object basis)
   else
     return Fstring_make_multibyte (string);
 }
+
+/* Completion indexes.  */
+
+static Lisp_Object Qcompletion_index_p;
+
+/* Compare the multibyte strings A and B character by character.
+   Return a negative number, zero or a positive number if A sorts
+   before B, is equal to B or sorts after B.  */
+
+static int
+compare_completion_keys (Lisp_Object a, Lisp_Object b)
+{
+  const unsigned char *pa = SDATA (a), *pb = SDATA (b);
+  ptrdiff_t na = SBYTES (a), nb = SBYTES (b);
+  ptrdiff_t n = min (na, nb), i;
+  int ca, cb;
+
+  for (i = 0; i < n && pa[i] == pb[i]; i++)
+    continue;
+  if (i == n)
+    return na < nb ? -1 : na > nb;
+
+  /* The bytes before I are the same in both strings, so both have a
+     character starting at the same place before I.  Compare those
+     characters, not just the bytes.  */
+  while (i > 0 && !CHAR_HEAD_P (pa[i]))
+    i--;
+  ca = STRING_CHAR (pa + i);
+  cb = STRING_CHAR (pb + i);
+  return ca < cb ? -1 : ca > cb;
+}
+
+/* Return nonzero if the multibyte string KEY begins with the
+   multibyte string PREFIX.  */
+
+static inline int
+completion_key_prefix_p (Lisp_Object key, Lisp_Object prefix)
+{
+  return (SBYTES (key) >= SBYTES (prefix)
+	  && memcmp (SDATA (key), SDATA (prefix), SBYTES (prefix)) == 0);
+}
+
+/* Return the multibyte string KEY with every character upcased, the
+   way `compare-strings' compares characters when ignoring case.  */
+
+static Lisp_Object
+fold_completion_key (Lisp_Object key)
+{
+  ptrdiff_t nbytes = SBYTES (key), i, j;
+  unsigned char *buf;
+  int changed = 0;
+  Lisp_Object folded;
+  USE_SAFE_ALLOCA;
+
+  SAFE_NALLOCA (buf, MAX_MULTIBYTE_LENGTH, SCHARS (key) + 1);
+  for (i = j = 0; i < nbytes; )
+    {
+      int len, c = STRING_CHAR_AND_LENGTH (SDATA (key) + i, len);
+      int up = upcase (c);
+
+      i += len;
+      changed |= up != c;
+      j += CHAR_STRING (up, buf + j);
+    }
+  folded = (changed
+	    ? make_multibyte_string ((char *) buf, SCHARS (key), j)
+	    : key);
+  SAFE_FREE ();
+  return folded;
+}
+
+static Lisp_Object *completion_sort_keys, *completion_sort_positions;
+
+static int
+compare_completion_entries (const void *a, const void *b)
+{
+  ptrdiff_t i = *(const ptrdiff_t *) a, j = *(const ptrdiff_t *) b;
+  int c = compare_completion_keys (completion_sort_keys[i],
+				    completion_sort_keys[j]);
+
+  if (c)
+    return c;
+  if (completion_sort_positions)
+    {
+      i = XFASTINT (completion_sort_positions[i]);
+      j = XFASTINT (completion_sort_positions[j]);
+    }
+  return i < j ? -1 : i > j;
+}
+
+/* Return an array of the numbers 0 to N - 1, allocated with xmalloc,
+   sorted so that the elements of KEYS they index are in order.  Equal
+   keys are ordered by the elements of POSITIONS they index, or by
+   their own index if POSITIONS is null.  */
+
+static ptrdiff_t *
+sort_completion_keys (Lisp_Object *keys, Lisp_Object *positions, ptrdiff_t n)
+{
+  ptrdiff_t *order = xnmalloc (max (n, 1), sizeof *order);
+  ptrdiff_t i;
+
+  for (i = 0; i < n; i++)
+    order[i] = i;
+  completion_sort_keys = keys;
+  completion_sort_positions = positions;
+  qsort (order, n, sizeof *order, compare_completion_entries);
+  return order;
+}
+
+/* Make sure that the case-folded keys of CI are up to date with the
+   case table of the current buffer.  */
+
+static void
+completion_index_fold (struct Lisp_Completion_Index *ci)
+{
+  Lisp_Object table = BVAR (current_buffer, downcase_table);
+  Lisp_Object folded, sorted, order;
+  ptrdiff_t i, n = ci->count, *perm;
+
+  if (!NILP (ci->folded) && EQ (ci->case_table, table))
+    return;
+
+  folded = Fmake_vector (make_number (n), Qnil);
+  for (i = 0; i < n; i++)
+    ASET (folded, i, fold_completion_key (AREF (ci->keys, i)));
+  /* Candidates that are equal ignoring case stay in the order of the
+     collection, which is the one `assoc-string' finds them in.  */
+  perm = sort_completion_keys (XVECTOR (folded)->contents,
+			       XVECTOR (ci->positions)->contents, n);
+  sorted = Fmake_vector (make_number (n), Qnil);
+  order = Fmake_vector (make_number (n), Qnil);
+  for (i = 0; i < n; i++)
+    {
+      ASET (sorted, i, AREF (folded, perm[i]));
+      ASET (order, i, make_number (perm[i]));
+    }
+  xfree (perm);
+
+  ci->folded = sorted;
+  ci->folded_order = order;
+  ci->case_table = table;
+}
+
+/* Find the candidates of the completion index INDEX that begin with
+   STRING, ignoring case if `completion-ignore-case' is non-nil.  They
+   are at the positions from *START up to *END.  Set *ORDER to nil if
+   these positions are candidate indices, or else to a vector mapping
+   them to candidate indices.  */
+
+static void
+completion_index_range (Lisp_Object index, Lisp_Object string,
+			ptrdiff_t *start, ptrdiff_t *end, Lisp_Object *order)
+{
+  struct Lisp_Completion_Index *ci = XCOMPLETION_INDEX (index);
+  Lisp_Object prefix = string_to_multibyte (string), keys;
+  ptrdiff_t lo = 0, hi = ci->count, mid;
+
+  if (completion_ignore_case)
+    {
+      completion_index_fold (ci);
+      prefix = fold_completion_key (prefix);
+      keys = ci->folded;
+      *order = ci->folded_order;
+    }
+  else
+    {
+      keys = ci->keys;
+      *order = Qnil;
+    }
+
+  /* Find the first key that does not sort before PREFIX...  */
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (compare_completion_keys (AREF (keys, mid), prefix) < 0)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  *start = lo;
+
+  /* ...and the first one after it that does not begin with PREFIX.  */
+  hi = ci->count;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (completion_key_prefix_p (AREF (keys, mid), prefix))
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  *end = lo;
+}
+
+DEFUN ("make-completion-index", Fmake_completion_index,
+       Smake_completion_index, 1, 1, 0,
+       doc: /* Return a completion index of the possible completions in COLLECTION.
+COLLECTION can be a list of strings, an alist, an obarray or a hash
+table; its possible completions are the same as for `try-completion'.
+
+The index can be passed as COLLECTION to `try-completion',
+`all-completions', `test-completion' and `completing-read'.  These
+functions then find the completions that begin with a string by binary
+search, instead of testing every possible completion.  Make an index
+when the same large collection is completed against many times.
+
+The index records the possible completions of COLLECTION at the time it
+is made.  A predicate used with the index is called with the same
+arguments as with COLLECTION.  `all-completions' returns the matches
+in the index in sorted order.  */)
+  (Lisp_Object collection)
+{
+  struct Lisp_Completion_Index *ci;
+  Lisp_Object elements, values, strings, keys, tail, elt, eltstring, index;
+  ptrdiff_t n = 0, count = 0, i, *perm;
+  int hash = HASH_TABLE_P (collection);
+
+  /* Count the possible completions, and make room for them.  */
+  if (hash)
+    n = HASH_TABLE_SIZE (XHASH_TABLE (collection));
+  else if (VECTORP (collection))
+    {
+      collection = check_obarray (collection);
+      for (i = 0; i < ASIZE (collection); i++)
+	for (tail = AREF (collection, i); SYMBOLP (tail);
+	     XSETSYMBOL (tail, XSYMBOL (tail)->next))
+	  {
+	    n++;
+	    if (!XSYMBOL (tail)->next)
+	      break;
+	  }
+    }
+  else if (NILP (collection)
+	   || (CONSP (collection)
+	       && (!SYMBOLP (XCAR (collection)) || NILP (XCAR (collection)))))
+    for (tail = collection; CONSP (tail); tail = XCDR (tail))
+      n++;
+  else
+    error ("A completion function cannot be indexed");
+
+  elements = Fmake_vector (make_number (n), Qnil);
+  values = hash ? Fmake_vector (make_number (n), Qnil) : Qnil;
+  strings = Fmake_vector (make_number (n), Qnil);
+  keys = Fmake_vector (make_number (n), Qnil);
+
+  /* Collect them.  */
+  if (hash)
+    {
+      struct Lisp_Hash_Table *h = XHASH_TABLE (collection);
+
+      for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+	if (!NILP (HASH_HASH (h, i)))
+	  {
+	    elt = eltstring = HASH_KEY (h, i);
+	    if (SYMBOLP (eltstring))
+	      eltstring = Fsymbol_name (eltstring);
+	    if (STRINGP (eltstring))
+	      {
+		ASET (elements, count, elt);
+		ASET (values, count, HASH_VALUE (h, i));
+		ASET (strings, count++, eltstring);
+	      }
+	  }
+    }
+  else if (VECTORP (collection))
+    {
+      for (i = 0; i < ASIZE (collection); i++)
+	for (tail = AREF (collection, i); SYMBOLP (tail);
+	     XSETSYMBOL (tail, XSYMBOL (tail)->next))
+	  {
+	    ASET (elements, count, tail);
+	    ASET (strings, count++, Fsymbol_name (tail));
+	    if (!XSYMBOL (tail)->next)
+	      break;
+	  }
+    }
+  else
+    for (tail = collection; CONSP (tail); tail = XCDR (tail))
+      {
+	elt = XCAR (tail);
+	eltstring = CONSP (elt) ? XCAR (elt) : elt;
+	if (SYMBOLP (eltstring))
+	  eltstring = Fsymbol_name (eltstring);
+	if (STRINGP (eltstring))
+	  {
+	    ASET (elements, count, elt);
+	    ASET (strings, count++, eltstring);
+	  }
+      }
+
+  for (i = 0; i < count; i++)
+    ASET (keys, i, string_to_multibyte (AREF (strings, i)));
+
+  /* Sort them.  */
+  perm = sort_completion_keys (XVECTOR (keys)->contents, NULL, count);
+  ci = ALLOCATE_PSEUDOVECTOR (struct Lisp_Completion_Index, count,
+			      PVEC_COMPLETION_INDEX);
+  ci->elements = Fmake_vector (make_number (count), Qnil);
+  ci->values = hash ? Fmake_vector (make_number (count), Qnil) : Qnil;
+  ci->strings = Fmake_vector (make_number (count), Qnil);
+  ci->keys = Fmake_vector (make_number (count), Qnil);
+  ci->positions = Fmake_vector (make_number (count), Qnil);
+  for (i = 0; i < count; i++)
+    {
+      ASET (ci->elements, i, AREF (elements, perm[i]));
+      if (hash)
+	ASET (ci->values, i, AREF (values, perm[i]));
+      ASET (ci->strings, i, AREF (strings, perm[i]));
+      ASET (ci->keys, i, AREF (keys, perm[i]));
+      ASET (ci->positions, i, make_number (perm[i]));
+    }
+  xfree (perm);
+  ci->count = count;
+
+  XSETPSEUDOVECTOR (index, ci, PVEC_COMPLETION_INDEX);
+  return index;
+}
+
+DEFUN ("completion-index-p", Fcompletion_index_p, Scompletion_index_p,
+       1, 1, 0,
+       doc: /* Return t if OBJECT is a completion index.  */)
+  (Lisp_Object object)
+{
+  return COMPLETION_INDEX_P (object) ? Qt : Qnil;
+}
+
+/* A candidate found by `completion-index-flex-matches'.  */
+
+struct flex_match
+{
+  /* Index of the candidate.  */
+  ptrdiff_t candidate;
+  /* Number of runs of consecutive matched characters, position of the
+     first matched character and length of the candidate.  */
+  ptrdiff_t runs, first, length;
+};
+
+static int
+compare_flex_matches (const void *a, const void *b)
+{
+  const struct flex_match *x = a, *y = b;
+
+  if (x->runs != y->runs)
+    return x->runs < y->runs ? -1 : 1;
+  if (x->first != y->first)
+    return x->first < y->first ? -1 : 1;
+  if (x->length != y->length)
+    return x->length < y->length ? -1 : 1;
+  return x->candidate < y->candidate ? -1 : x->candidate > y->candidate;
+}
+
+/* Match the NPAT characters PAT against the NKEY characters KEY.  If
+   they all occur in KEY in order, return nonzero and store a score of
+   the match in M.  Each occurrence of the first character of PAT is
+   tried in turn as the start of the match, and the rest of PAT is
+   matched as early as possible after it; the best of these matches is
+   the one with the fewest runs, then the earliest.  */
+
+static int
+flex_match (const int *pat, ptrdiff_t npat, const int *key, ptrdiff_t nkey,
+	    struct flex_match *m)
+{
+  ptrdiff_t start, i, j, last, runs;
+
+  m->runs = PTRDIFF_MAX;
+  m->first = 0;
+  m->length = nkey;
+  if (npat == 0)
+    {
+      m->runs = 0;
+      return 1;
+    }
+
+  for (start = 0; start < nkey; start++)
+    {
+      if (key[start] != pat[0])
+	continue;
+      runs = 1;
+      last = start;
+      for (i = 1, j = start + 1; i < npat && j < nkey; j++)
+	if (key[j] == pat[i])
+	  {
+	    if (j != last + 1)
+	      runs++;
+	    last = j;
+	    i++;
+	  }
+      /* If the rest of PAT does not occur after this start, it does not
+	 occur after any later one either.  */
+      if (i < npat)
+	break;
+      if (runs < m->runs)
+	{
+	  m->runs = runs;
+	  m->first = start;
+	  if (runs == 1)
+	    break;
+	}
+    }
+  return m->runs != PTRDIFF_MAX;
+}
+
+/* Store the characters of the multibyte string STRING in BUF.  */
+
+static void
+completion_key_chars (Lisp_Object string, int *buf)
+{
+  const unsigned char *p = SDATA (string), *end = p + SBYTES (string);
+
+  while (p < end)
+    *buf++ = STRING_CHAR_ADVANCE (p);
+}
+
+DEFUN ("completion-index-flex-matches", Fcompletion_index_flex_matches,
+       Scompletion_index_flex_matches, 2, 3, 0,
+       doc: /* Return the completions in INDEX that match STRING flexibly.
+INDEX is a completion index made by `make-completion-index'.
+A completion matches if it contains all the characters of STRING in
+the same order, possibly with other characters between them.  Case is
+ignored if `completion-ignore-case' is non-nil.  PREDICATE and
+`completion-regexp-list' constrain the matches as for `all-completions'.
+
+The best matches come first in the value.  These are the completions
+in which the matched characters form the fewest separate runs; among
+those, the ones where the match starts earliest; and among those, the
+shortest ones.  */)
+  (Lisp_Object string, Lisp_Object index, Lisp_Object predicate)
+{
+  struct Lisp_Completion_Index *ci;
+  struct flex_match *matches;
+  Lisp_Object pattern, keys, order, result, regexps, elt, tem;
+  ptrdiff_t i, n, nmatches = 0, maxchars = 0, bindcount = -1;
+  int *pat, *key;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
+  USE_SAFE_ALLOCA;
+
+  CHECK_STRING (string);
+  CHECK_COMPLETION_INDEX (index);
+  ci = XCOMPLETION_INDEX (index);
+  n = ci->count;
+
+  pattern = string_to_multibyte (string);
+  if (completion_ignore_case)
+    {
+      completion_index_fold (ci);
+      pattern = fold_completion_key (pattern);
+      keys = ci->folded;
+      order = ci->folded_order;
+    }
+  else
+    {
+      keys = ci->keys;
+      order = Qnil;
+    }
+
+  for (i = 0; i < n; i++)
+    maxchars = max (maxchars, SCHARS (AREF (keys, i)));
+  SAFE_NALLOCA (pat, 1, SCHARS (pattern) + 1);
+  SAFE_NALLOCA (key, 1, maxchars + 1);
+  SAFE_NALLOCA (matches, 1, n + 1);
+  completion_key_chars (pattern, pat);
+
+  GCPRO4 (string, index, keys, order);
+  for (i = 0; i < n; i++)
+    {
+      struct flex_match *m = &matches[nmatches];
+      ptrdiff_t candidate = NILP (order) ? i : XFASTINT (AREF (order, i));
+
+      completion_key_chars (AREF (keys, i), key);
+      if (!flex_match (pat, SCHARS (pattern), key, SCHARS (AREF (keys, i)), m))
+	continue;
+      m->candidate = candidate;
+
+      /* Ignore this candidate if it fails to match all the regexps.  */
+      for (regexps = Vcompletion_regexp_list; CONSP (regexps);
+	   regexps = XCDR (regexps))
+	{
+	  if (bindcount < 0)
+	    {
+	      bindcount = SPECPDL_INDEX ();
+	      specbind (Qcase_fold_search,
+			completion_ignore_case ? Qt : Qnil);
+	    }
+	  if (NILP (Fstring_match (XCAR (regexps),
+				   AREF (ci->strings, candidate), Qnil)))
+	    break;
+	}
+      if (CONSP (regexps))
+	continue;
+
+      /* Ignore this candidate if there is a predicate
+	 and the predicate doesn't like it.  */
+      if (!NILP (predicate))
+	{
+	  elt = AREF (ci->elements, candidate);
+	  if (EQ (predicate, Qcommandp))
+	    tem = Fcommandp (elt, Qnil);
+	  else
+	    {
+	      if (bindcount >= 0)
+		{
+		  unbind_to (bindcount, Qnil);
+		  bindcount = -1;
+		}
+	      tem = (NILP (ci->values)
+		     ? call1 (predicate, elt)
+		     : call2 (predicate, elt, AREF (ci->values, candidate)));
+	    }
+	  if (NILP (tem))
+	    continue;
+	}
+
+      nmatches++;
+    }
+  UNGCPRO;
 
+  if (bindcount >= 0)
+    unbind_to (bindcount, Qnil);
+
+  qsort (matches, nmatches, sizeof *matches, compare_flex_matches);
+  result = Qnil;
+  for (i = nmatches - 1; i >= 0; i--)
+    result = Fcons (AREF (ci->strings, matches[i].candidate), result);
+
+  SAFE_FREE ();
+  return result;
+}
+
 DEFUN ("try-completion", Ftry_completion, Stry_completion, 2, 3, 0,
        doc: /* Return common substring of all completions of STRING in COLLECTION.
 Test each possible completion specified by COLLECTION
@@ -1246,25 +1773,27 @@ is used to further constrain the set of candidates.  */)
   ptrdiff_t bestmatchsize = 0;
   /* These are in bytes, too.  */
   ptrdiff_t compare, matchsize;
-  enum { function_table, list_table, obarray_table, hash_table}
+  enum { function_table, list_table, obarray_table, hash_table,
+	 index_table}
     type = (HASH_TABLE_P (collection) ? hash_table
+	    : COMPLETION_INDEX_P (collection) ? index_table
 	    : VECTORP (collection) ? obarray_table
 	    : ((NILP (collection)
 		|| (CONSP (collection)
 		    && (!SYMBOLP (XCAR (collection))
 			|| NILP (XCAR (collection)))))
 	       ? list_table : function_table));
-  ptrdiff_t idx = 0, obsize = 0;
+  ptrdiff_t idx = 0, obsize = 0, candidate = 0;
   int matchcount = 0;
   ptrdiff_t bindcount = -1;
-  Lisp_Object bucket, zero, end, tem;
-  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
+  Lisp_Object bucket, zero, end, tem, order;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5;
 
   CHECK_STRING (string);
   if (type == function_table)
     return call3 (collection, string, predicate, Qnil);
 
-  bestmatch = bucket = Qnil;
+  bestmatch = bucket = order = Qnil;
   zero = make_number (0);
 
   /* If COLLECTION is not a list, set TAIL just for gc pro.  */
@@ -1275,6 +1804,8 @@ is used to further constrain the set of candidates.  */)
       obsize = ASIZE (collection);
       bucket = AREF (collection, idx);
     }
+  else if (type == index_table)
+    completion_index_range (collection, string, &idx, &obsize, &order);
 
   while (1)
     {
@@ -1312,6 +1843,18 @@ is used to further constrain the set of candidates.  */)
 	      continue;
 	    }
 	}
+      else if (type == index_table)
+	{
+	  /* Only the candidates in the range found by binary search
+	     can begin with STRING.  */
+	  if (idx >= obsize)
+	    break;
+	  candidate = NILP (order) ? idx : XFASTINT (AREF (order, idx));
+	  idx++;
+	  elt = AREF (XCOMPLETION_INDEX (collection)->elements, candidate);
+	  eltstring = AREF (XCOMPLETION_INDEX (collection)->strings,
+			    candidate);
+	}
       else /* if (type == hash_table) */
 	{
 	  while (idx < HASH_TABLE_SIZE (XHASH_TABLE (collection))
@@ -1330,11 +1873,12 @@ is used to further constrain the set of candidates.  */)
 
       if (STRINGP (eltstring)
 	  && SCHARS (string) <= SCHARS (eltstring)
-	  && (tem = Fcompare_strings (eltstring, zero,
-				      make_number (SCHARS (string)),
-				      string, zero, Qnil,
-				      completion_ignore_case ? Qt : Qnil),
-	      EQ (Qt, tem)))
+	  && (type == index_table
+	      || (tem = Fcompare_strings (eltstring, zero,
+					  make_number (SCHARS (string)),
+					  string, zero, Qnil,
+					  completion_ignore_case ? Qt : Qnil),
+		  EQ (Qt, tem))))
 	{
 	  /* Yes.  */
 	  Lisp_Object regexps;
@@ -1371,11 +1915,16 @@ is used to further constrain the set of candidates.  */)
 		      unbind_to (bindcount, Qnil);
 		      bindcount = -1;
 		    }
-		  GCPRO4 (tail, string, eltstring, bestmatch);
+		  GCPRO5 (tail, string, eltstring, bestmatch, order);
 		  tem = (type == hash_table
 			 ? call2 (predicate, elt,
 				  HASH_VALUE (XHASH_TABLE (collection),
 					      idx - 1))
+			 : (type == index_table
+			    && !NILP (XCOMPLETION_INDEX (collection)->values))
+			 ? call2 (predicate, elt,
+				  AREF (XCOMPLETION_INDEX (collection)->values,
+					candidate))
 			 : call1 (predicate, elt));
 		  UNGCPRO;
 		}
@@ -1515,19 +2064,20 @@ with a space are ignored unless STRING itself starts with a space.  */)
   Lisp_Object tail, elt, eltstring;
   Lisp_Object allmatches;
   int type = HASH_TABLE_P (collection) ? 3
+    : COMPLETION_INDEX_P (collection) ? 4
     : VECTORP (collection) ? 2
     : NILP (collection) || (CONSP (collection)
 			    && (!SYMBOLP (XCAR (collection))
 				|| NILP (XCAR (collection))));
-  ptrdiff_t idx = 0, obsize = 0;
+  ptrdiff_t idx = 0, obsize = 0, candidate = 0;
   ptrdiff_t bindcount = -1;
-  Lisp_Object bucket, tem, zero;
-  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
+  Lisp_Object bucket, tem, zero, order;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5;
 
   CHECK_STRING (string);
   if (type == 0)
     return call3 (collection, string, predicate, Qt);
-  allmatches = bucket = Qnil;
+  allmatches = bucket = order = Qnil;
   zero = make_number (0);
 
   /* If COLLECTION is not a list, set TAIL just for gc pro.  */
@@ -1538,6 +2088,8 @@ with a space are ignored unless STRING itself starts with a space.  */)
       obsize = ASIZE (collection);
       bucket = AREF (collection, idx);
     }
+  else if (type == 4)
+    completion_index_range (collection, string, &idx, &obsize, &order);
 
   while (1)
     {
@@ -1575,6 +2127,18 @@ with a space are ignored unless STRING itself starts with a space.  */)
 	      continue;
 	    }
 	}
+      else if (type == 4)
+	{
+	  /* Only the candidates in the range found by binary search
+	     can begin with STRING.  */
+	  if (idx >= obsize)
+	    break;
+	  candidate = NILP (order) ? idx : XFASTINT (AREF (order, idx));
+	  idx++;
+	  elt = AREF (XCOMPLETION_INDEX (collection)->elements, candidate);
+	  eltstring = AREF (XCOMPLETION_INDEX (collection)->strings,
+			    candidate);
+	}
       else /* if (type == 3) */
 	{
 	  while (idx < HASH_TABLE_SIZE (XHASH_TABLE (collection))
@@ -1599,12 +2163,13 @@ with a space are ignored unless STRING itself starts with a space.  */)
 	      || (SBYTES (string) > 0
 		  && SREF (string, 0) == ' ')
 	      || SREF (eltstring, 0) != ' ')
-	  && (tem = Fcompare_strings (eltstring, zero,
-				      make_number (SCHARS (string)),
-				      string, zero,
-				      make_number (SCHARS (string)),
-				      completion_ignore_case ? Qt : Qnil),
-	      EQ (Qt, tem)))
+	  && (type == 4
+	      || (tem = Fcompare_strings (eltstring, zero,
+					  make_number (SCHARS (string)),
+					  string, zero,
+					  make_number (SCHARS (string)),
+					  completion_ignore_case ? Qt : Qnil),
+		  EQ (Qt, tem))))
 	{
 	  /* Yes.  */
 	  Lisp_Object regexps;
@@ -1640,10 +2205,14 @@ with a space are ignored unless STRING itself starts with a space.  */)
 		    unbind_to (bindcount, Qnil);
 		    bindcount = -1;
 		  }
-		  GCPRO4 (tail, eltstring, allmatches, string);
+		  GCPRO5 (tail, eltstring, allmatches, string, order);
 		  tem = type == 3
 		    ? call2 (predicate, elt,
 			     HASH_VALUE (XHASH_TABLE (collection), idx - 1))
+		    : type == 4 && !NILP (XCOMPLETION_INDEX (collection)->values)
+		    ? call2 (predicate, elt,
+			     AREF (XCOMPLETION_INDEX (collection)->values,
+				   candidate))
 		    : call1 (predicate, elt);
 		  UNGCPRO;
 		}
@@ -1821,6 +2390,44 @@ the values STRING, PREDICATE and `lambda'.  */)
       if (!STRINGP (tem))
 	return Qnil;
     }
+  else if (COMPLETION_INDEX_P (collection))
+    {
+      struct Lisp_Completion_Index *ci = XCOMPLETION_INDEX (collection);
+      ptrdiff_t end;
+      Lisp_Object order;
+
+      /* An exact match sorts before the other candidates that begin
+	 with STRING.  */
+      completion_index_range (collection, string, &i, &end, &order);
+      if (i < end && !NILP (order)
+	  && (!NILP (ci->values) || SYMBOLP (AREF (ci->elements, 0))))
+	{
+	  /* An obarray or hash table is searched for STRING itself
+	     before any other string that is equal ignoring case.  The
+	     strings that are equal ignoring case come first.  */
+	  ptrdiff_t j;
+
+	  for (j = i;
+	       (j < end
+		&& SCHARS (AREF (ci->folded, j)) == SCHARS (string));
+	       j++)
+	    if (!NILP (Fstring_equal (AREF (ci->strings,
+					     XFASTINT (AREF (order, j))),
+				      string)))
+	      {
+		i = j;
+		break;
+	      }
+	}
+      if (i < end)
+	{
+	  if (!NILP (order))
+	    i = XFASTINT (AREF (order, i));
+	  tem = AREF (ci->strings, i);
+	}
+      if (!STRINGP (tem) || SCHARS (tem) != SCHARS (string))
+	return Qnil;
+    }
   else
     return call3 (collection, string, predicate, Qlambda);
 
@@ -1843,6 +2450,14 @@ the values STRING, PREDICATE and `lambda'.  */)
   /* Finally, check the predicate.  */
   if (!NILP (predicate))
     {
+      if (COMPLETION_INDEX_P (collection))
+	{
+	  struct Lisp_Completion_Index *ci = XCOMPLETION_INDEX (collection);
+	  return (NILP (ci->values)
+		  ? call1 (predicate, AREF (ci->elements, i))
+		  : call2 (predicate, AREF (ci->elements, i),
+			   AREF (ci->values, i)));
+	}
       return HASH_TABLE_P (collection)
 	? call2 (predicate, tem, HASH_VALUE (XHASH_TABLE (collection), i))
 	: call1 (predicate, tem);
@@ -1994,6 +2609,7 @@ syms_of_minibuf (void)
   DEFSYM (Qactivate_input_method, "activate-input-method");
   DEFSYM (Qcase_fold_search, "case-fold-search");
   DEFSYM (Qmetadata, "metadata");
+  DEFSYM (Qcompletion_index_p, "completion-index-p");
 
   DEFVAR_LISP ("read-expression-history", Vread_expression_history,
 	       doc: /* A history list for arguments that are Lisp expressions to evaluate.
@@ -2166,6 +2782,9 @@ properties.  */);
   defsubr (&Stry_completion);
   defsubr (&Sall_completions);
   defsubr (&Stest_completion);
+  defsubr (&Smake_completion_index);
+  defsubr (&Scompletion_index_p);
+  defsubr (&Scompletion_index_flex_matches);
   defsubr (&Sassoc_string);
   defsubr (&Scompleting_read);
 }
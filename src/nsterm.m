@@ -5164,6 +5164,7 @@ ns_term_shutdown (int sig)
       emacs_event->code = 0;
       emacs_event->modifiers = EV_MODIFIERS (theEvent) |
         ((delta > 0) ? up_modifier : down_modifier);
+      emacs_event->arg = Qnil;
     }
   else
     {
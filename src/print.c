@@ -1812,7 +1812,8 @@ print_object (Lisp_Object obj, register Lisp_Object printcharfun, int escapeflag
 	      PRINTCHAR (' ');
 	      strout (SDATA (SYMBOL_NAME (h->weak)), -1, -1, printcharfun);
 	      PRINTCHAR (' ');
-	      len = sprintf (buf, "%"pD"d/%"pD"d", h->count, ASIZE (h->next));
+	      len = sprintf (buf, "%"pD"d/%"pD"d", h->count,
+			     HASH_TABLE_SIZE (h));
 	      strout (buf, len, len, printcharfun);
 	    }
 	  len = sprintf (buf, " %p", h);
@@ -1822,7 +1823,7 @@ print_object (Lisp_Object obj, register Lisp_Object printcharfun, int escapeflag
 	  /* Implement a readable output, e.g.:
 	    #s(hash-table size 2 test equal data (k1 v1 k2 v2)) */
 	  /* Always print the size. */
-	  len = sprintf (buf, "#s(hash-table size %"pD"d", ASIZE (h->next));
+	  len = sprintf (buf, "#s(hash-table size %"pD"d", HASH_TABLE_SIZE (h));
 	  strout (buf, len, len, printcharfun);
 
 	  if (!NILP (h->test))
@@ -1894,6 +1895,51 @@ print_object (Lisp_Object obj, register Lisp_Object printcharfun, int escapeflag
 	{
 	  strout ("#<window-configuration>", -1, -1, printcharfun);
 	}
+      else if (NUMERIC_VECTOR_P (obj))
+	{
+	  /* There is no read syntax for numeric vectors, so print them
+	     as an unreadable object that still shows the elements.  */
+	  ptrdiff_t i, size = XNUMERIC_VECTOR (obj)->size;
+	  ptrdiff_t size_to_print = size;
+	  struct gcpro gcpro1;
+
+	  GCPRO1 (obj);
+	  strout ("#<numeric-vector ", -1, -1, printcharfun);
+	  print_object (Fnumeric_vector_type (obj), printcharfun, escapeflag);
+	  strout (" [", -1, -1, printcharfun);
+
+	  /* Don't print more elements than the specified maximum.  */
+	  if (NATNUMP (Vprint_length)
+	      && XFASTINT (Vprint_length) < size_to_print)
+	    size_to_print = XFASTINT (Vprint_length);
+
+	  for (i = 0; i < size_to_print; i++)
+	    {
+	      if (i) PRINTCHAR (' ');
+	      print_object (numeric_vector_ref (XNUMERIC_VECTOR (obj), i),
+			    printcharfun, escapeflag);
+	    }
+	  if (size_to_print < size)
+	    strout (" ...", 4, 4, printcharfun);
+	  strout ("]>", -1, -1, printcharfun);
+	  UNGCPRO;
+	}
+      else if (STRING_BUILDER_P (obj))
+	{
+	  int len;
+	  strout ("#<string-builder ", -1, -1, printcharfun);
+	  len = sprintf (buf, "%"pD"d", XSTRING_BUILDER (obj)->nchars);
+	  strout (buf, len, len, printcharfun);
+	  PRINTCHAR ('>');
+	}
+      else if (COMPLETION_INDEX_P (obj))
+	{
+	  int len;
+	  strout ("#<completion-index ", -1, -1, printcharfun);
+	  len = sprintf (buf, "%"pD"d", XCOMPLETION_INDEX (obj)->count);
+	  strout (buf, len, len, printcharfun);
+	  PRINTCHAR ('>');
+	}
       else if (FRAMEP (obj))
 	{
 	  int len;
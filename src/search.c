@@ -43,6 +43,9 @@ struct regexp_cache
 {
   struct regexp_cache *next;
   Lisp_Object regexp, whitespace_regexp;
+  /* Hash code of the bytes of REGEXP, compared before the strings
+     themselves.  */
+  EMACS_UINT hash;
   /* Syntax table for which the regexp applies.  We need this because
      of character classes.  If this is t, then the compiled pattern is valid
      for any syntax-table.  */
@@ -161,6 +164,7 @@ compile_pattern_1 (struct regexp_cache *cp, Lisp_Object pattern, Lisp_Object tra
     xsignal1 (Qinvalid_regexp, build_string (val));
 
   cp->regexp = Fcopy_sequence (pattern);
+  cp->hash = hash_string (SSDATA (pattern), SBYTES (pattern));
 }
 
 /* Shrink each compiled regexp buffer in the cache
@@ -212,6 +216,8 @@ struct re_pattern_buffer *
 compile_pattern (Lisp_Object pattern, struct re_registers *regp, Lisp_Object translate, int posix, int multibyte)
 {
   struct regexp_cache *cp, **cpp;
+  EMACS_UINT hash = 0;
+  int hashed = 0;
 
   for (cpp = &searchbuf_head; ; cpp = &cp->next)
     {
@@ -224,15 +230,25 @@ compile_pattern (Lisp_Object pattern, struct re_registers *regp, Lisp_Object tra
       if (NILP (cp->regexp))
 	goto compile_it;
       if (SCHARS (cp->regexp) == SCHARS (pattern)
-	  && STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
-	  && !NILP (Fstring_equal (cp->regexp, pattern))
-	  && EQ (cp->buf.translate, (! NILP (translate) ? translate : make_number (0)))
-	  && cp->posix == posix
-	  && (EQ (cp->syntax_table, Qt)
-	      || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
-	  && !NILP (Fequal (cp->whitespace_regexp, Vsearch_spaces_regexp))
-	  && cp->buf.charset_unibyte == charset_unibyte)
-	break;
+	  && STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern))
+	{
+	  /* Compare hash codes before the strings.  Compute the hash
+	     code of PATTERN only once, and only if needed.  */
+	  if (!hashed)
+	    {
+	      hash = hash_string (SSDATA (pattern), SBYTES (pattern));
+	      hashed = 1;
+	    }
+	  if (cp->hash == hash
+	      && !NILP (Fstring_equal (cp->regexp, pattern))
+	      && EQ (cp->buf.translate, (! NILP (translate) ? translate : make_number (0)))
+	      && cp->posix == posix
+	      && (EQ (cp->syntax_table, Qt)
+		  || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
+	      && !NILP (Fequal (cp->whitespace_regexp, Vsearch_spaces_regexp))
+	      && cp->buf.charset_unibyte == charset_unibyte)
+	    break;
+	}
 
       /* If we're at the end of the cache, compile into the nil cell
 	 we found, or the last (least recently used) cell with a
@@ -591,6 +607,500 @@ fast_looking_at (Lisp_Object regexp, ptrdiff_t pos, ptrdiff_t pos_byte, ptrdiff_
   return len;
 }
 
+
+/* Necessary substrings of regular expressions.
+
+   regexp_necessary_substrings finds strings that must occur in any
+   match of a regexp, so that callers matching the same regexps against
+   many strings, like find-file-name-handler, can reject most strings
+   without running the matcher.  The analysis is conservative: whatever
+   it does not understand imposes no requirement.  */
+
+/* A summary of part of a regexp.  If EXACT is nonzero, the part matches
+   exactly the strings in the list SET.  Otherwise every match of it
+   contains, for each element of the list REQS, one of the strings in
+   that element.  */
+
+struct rx_summary
+{
+  int exact;
+  Lisp_Object set, reqs;
+};
+
+/* Limit on the number of strings in a set, and on the nesting of
+   groups.  */
+enum { RX_MAX_SET = 32, RX_MAX_DEPTH = 20 };
+
+static int rx_parse_alternatives (const unsigned char **,
+				  const unsigned char *, int,
+				  struct rx_summary *);
+
+/* Set S to a summary that imposes no requirement.  */
+
+static void
+rx_none (struct rx_summary *s)
+{
+  s->exact = 0;
+  s->set = s->reqs = Qnil;
+}
+
+/* Set S to the summary of a part that matches the empty string only,
+   like an anchor.  */
+
+static void
+rx_empty (struct rx_summary *s)
+{
+  s->exact = 1;
+  s->set = Fcons (empty_unibyte_string, Qnil);
+  s->reqs = Qnil;
+}
+
+/* Return nonzero if SET, a list of strings, contains the empty string.  */
+
+static int
+rx_set_has_empty (Lisp_Object set)
+{
+  for (; CONSP (set); set = XCDR (set))
+    if (SBYTES (XCAR (set)) == 0)
+      return 1;
+  return 0;
+}
+
+/* Return the list of concatenations of a string in SET1 with a string
+   in SET2, or nil if there would be too many of them.  */
+
+static Lisp_Object
+rx_product (Lisp_Object set1, Lisp_Object set2)
+{
+  Lisp_Object result = Qnil, s1, s2;
+
+  if (XFASTINT (Flength (set1)) * XFASTINT (Flength (set2)) > RX_MAX_SET)
+    return Qnil;
+  for (s1 = set1; CONSP (s1); s1 = XCDR (s1))
+    for (s2 = set2; CONSP (s2); s2 = XCDR (s2))
+      {
+	ptrdiff_t n1 = SBYTES (XCAR (s1)), n2 = SBYTES (XCAR (s2));
+	Lisp_Object str = make_uninit_string (n1 + n2);
+
+	memcpy (SDATA (str), SDATA (XCAR (s1)), n1);
+	memcpy (SDATA (str) + n1, SDATA (XCAR (s2)), n2);
+	result = Fcons (str, result);
+      }
+  return result;
+}
+
+/* Return the length of the shortest string in SET.  */
+
+static ptrdiff_t
+rx_set_min_length (Lisp_Object set)
+{
+  ptrdiff_t len = PTRDIFF_MAX;
+
+  for (; CONSP (set); set = XCDR (set))
+    len = min (len, SBYTES (XCAR (set)));
+  return len;
+}
+
+/* Return the element of REQS that is most selective, or nil if REQS is
+   empty.  */
+
+static Lisp_Object
+rx_best_requirement (Lisp_Object reqs)
+{
+  Lisp_Object best = Qnil;
+  ptrdiff_t best_len = -1;
+
+  for (; CONSP (reqs); reqs = XCDR (reqs))
+    {
+      ptrdiff_t len = rx_set_min_length (XCAR (reqs));
+      if (len > best_len)
+	{
+	  best = XCAR (reqs);
+	  best_len = len;
+	}
+    }
+  return best;
+}
+
+/* Add the strings matched so far by an exact part, RUN, to REQS if
+   they make a requirement, and return the new REQS.  */
+
+static Lisp_Object
+rx_flush (Lisp_Object run, Lisp_Object reqs)
+{
+  if (CONSP (run) && !rx_set_has_empty (run))
+    reqs = Fcons (run, reqs);
+  return reqs;
+}
+
+/* Parse the character or construct at *P, before END, into S, and
+   advance *P past it.  Return zero if *P starts `\|' or `\)', or if the
+   regexp is malformed or too obscure to summarize.  */
+
+static int
+rx_parse_atom (const unsigned char **p, const unsigned char *end,
+	       int depth, struct rx_summary *s)
+{
+  const unsigned char *q = *p;
+  unsigned char c = *q++;
+
+  switch (c)
+    {
+    case '.': case '^': case '$': case '*': case '+': case '?':
+      /* `^' and `$' may be anchors or ordinary characters, and a
+	 leading repetition operator is an ordinary character; in any
+	 case they break the run of known characters.  */
+      rx_none (s);
+      break;
+
+    case '[':
+      /* Skip the character alternative.  A `]' right after the
+	 opening `[' or `[^' is an ordinary character.  */
+      if (q < end && *q == '^')
+	q++;
+      if (q < end && *q == ']')
+	q++;
+      while (q < end && *q != ']')
+	{
+	  if (*q == '[' && q + 1 < end && q[1] == ':')
+	    {
+	      q += 2;
+	      while (q + 1 < end && ! (q[0] == ':' && q[1] == ']'))
+		q++;
+	      if (q + 1 >= end)
+		return 0;
+	      q++;
+	    }
+	  q++;
+	}
+      if (q >= end)
+	return 0;
+      q++;
+      rx_none (s);
+      break;
+
+    case '\\':
+      if (q >= end)
+	return 0;
+      c = *q++;
+      switch (c)
+	{
+	case '|': case ')':
+	  return 0;
+
+	case '(':
+	  /* A group, possibly shy or explicitly numbered.  */
+	  if (depth >= RX_MAX_DEPTH)
+	    return 0;
+	  if (q < end && *q == '?')
+	    {
+	      q++;
+	      while (q < end && '0' <= *q && *q <= '9')
+		q++;
+	      if (q >= end || *q != ':')
+		return 0;
+	      q++;
+	    }
+	  if (!rx_parse_alternatives (&q, end, depth + 1, s))
+	    return 0;
+	  if (q + 1 >= end || q[0] != '\\' || q[1] != ')')
+	    return 0;
+	  q += 2;
+	  break;
+
+	case '`': case '\'': case '=': case 'b': case 'B': case '<': case '>':
+	case '_':
+	  if (c == '_' && q++ >= end)
+	    return 0;
+	  /* A repetition operator after an assertion applies to whatever
+	     precedes the assertion; do not try to make sense of that.  */
+	  if (q < end && (*q == '*' || *q == '+' || *q == '?'
+			  || (*q == '\\' && q + 1 < end && q[1] == '{')))
+	    return 0;
+	  rx_empty (s);
+	  break;
+
+	case 's': case 'S': case 'c': case 'C':
+	  if (q >= end)
+	    return 0;
+	  q++;
+	  rx_none (s);
+	  break;
+
+	case 'w': case 'W': case '{': case '}':
+	case '1': case '2': case '3': case '4': case '5':
+	case '6': case '7': case '8': case '9':
+	  rx_none (s);
+	  break;
+
+	default:
+	  goto ordinary;
+	}
+      break;
+
+    default:
+    ordinary:
+      /* Only ASCII characters are known to be the same bytes in the
+	 regexp and in the strings it is matched against.  */
+      if (ASCII_BYTE_P (c))
+	{
+	  s->exact = 1;
+	  s->set = Fcons (make_unibyte_string ((char *) &c, 1), Qnil);
+	  s->reqs = Qnil;
+	}
+      else
+	rx_none (s);
+      break;
+    }
+
+  *p = q;
+  return 1;
+}
+
+/* Apply the repetition operators at *P, before END, if any, to S, and
+   advance *P past them.  Return zero if an operator is malformed.  */
+
+static int
+rx_parse_repetition (const unsigned char **p, const unsigned char *end,
+		     struct rx_summary *s)
+{
+  const unsigned char *q = *p;
+
+  while (q < end)
+    {
+      /* Whether the operator repeats its operand at least once.  */
+      int at_least_once;
+
+      if (*q == '*' || *q == '+' || *q == '?')
+	{
+	  if (*q == '?' && s->exact)
+	    {
+	      /* The operand may also match the empty string.  */
+	      if (!rx_set_has_empty (s->set))
+		s->set = Fcons (empty_unibyte_string, s->set);
+	      q++;
+	      if (q < end && *q == '?')
+		q++;
+	      continue;
+	    }
+	  at_least_once = *q++ == '+';
+	  if (q < end && *q == '?')
+	    q++;
+	}
+      else if (*q == '\\' && q + 1 < end && q[1] == '{')
+	{
+	  q += 2;
+	  at_least_once = q < end && '1' <= *q && *q <= '9';
+	  while (q < end && *q != '\\')
+	    q++;
+	  if (q + 1 >= end || q[1] != '}')
+	    return 0;
+	  q += 2;
+	}
+      else
+	break;
+
+      if (!at_least_once)
+	rx_none (s);
+      else if (s->exact)
+	{
+	  /* The operand occurs, but repeated, so it does not extend the
+	     run of known characters.  */
+	  s->reqs = rx_flush (s->set, Qnil);
+	  s->exact = 0;
+	  s->set = Qnil;
+	}
+    }
+
+  *p = q;
+  return 1;
+}
+
+/* Parse the sequence at *P, before END, into S, and advance *P to the
+   `\|' or `\)' that ends it, or to END.  Return zero if the regexp is
+   malformed.  */
+
+static int
+rx_parse_sequence (const unsigned char **p, const unsigned char *end,
+		   int depth, struct rx_summary *s)
+{
+  Lisp_Object run = Fcons (empty_unibyte_string, Qnil);
+  Lisp_Object reqs = Qnil;
+  int exact = 1;
+
+  while (*p < end
+	 && ! (**p == '\\' && *p + 1 < end && ((*p)[1] == '|'
+						|| (*p)[1] == ')')))
+    {
+      struct rx_summary atom;
+
+      if (!rx_parse_atom (p, end, depth, &atom)
+	  || !rx_parse_repetition (p, end, &atom))
+	return 0;
+
+      if (atom.exact)
+	{
+	  Lisp_Object product = rx_product (run, atom.set);
+	  if (NILP (product))
+	    {
+	      /* Too many strings; start a new run.  */
+	      reqs = rx_flush (run, reqs);
+	      exact = 0;
+	      run = atom.set;
+	    }
+	  else
+	    run = product;
+	}
+      else
+	{
+	  reqs = rx_flush (run, reqs);
+	  exact = 0;
+	  run = Fcons (empty_unibyte_string, Qnil);
+	  reqs = nconc2 (Fcopy_sequence (atom.reqs), reqs);
+	}
+    }
+
+  s->exact = exact;
+  if (exact)
+    {
+      s->set = run;
+      s->reqs = Qnil;
+    }
+  else
+    {
+      s->set = Qnil;
+      s->reqs = rx_flush (run, reqs);
+    }
+  return 1;
+}
+
+/* Parse the alternatives at *P, before END, into S, and advance *P to
+   the `\)' that ends them, or to END.  Return zero if the regexp is
+   malformed.  */
+
+static int
+rx_parse_alternatives (const unsigned char **p, const unsigned char *end,
+		       int depth, struct rx_summary *s)
+{
+  struct rx_summary branch;
+  /* The union of the exact sets of the branches, and of the best
+     requirement of each branch.  */
+  Lisp_Object set = Qnil, best = Qnil;
+  int exact = 1, required = 1;
+
+  while (1)
+    {
+      Lisp_Object req;
+
+      if (!rx_parse_sequence (p, end, depth, &branch))
+	return 0;
+
+      if (branch.exact)
+	{
+	  set = nconc2 (Fcopy_sequence (branch.set), set);
+	  req = rx_set_has_empty (branch.set) ? Qnil : branch.set;
+	}
+      else
+	{
+	  exact = 0;
+	  req = rx_best_requirement (branch.reqs);
+	}
+      if (NILP (req))
+	required = 0;
+      else
+	best = nconc2 (Fcopy_sequence (req), best);
+
+      if (*p + 1 < end && (*p)[0] == '\\' && (*p)[1] == '|')
+	*p += 2;
+      else
+	break;
+    }
+
+  if (exact && XFASTINT (Flength (set)) <= RX_MAX_SET)
+    {
+      s->exact = 1;
+      s->set = set;
+      s->reqs = Qnil;
+    }
+  else
+    {
+      s->exact = 0;
+      s->set = Qnil;
+      s->reqs = (required && XFASTINT (Flength (best)) <= RX_MAX_SET
+		 ? Fcons (best, Qnil) : Qnil);
+    }
+  return 1;
+}
+
+/* Return a list of requirements on the strings that REGEXP matches,
+   when searched for with `string-match' and the like without case
+   folding.  Each requirement is a list of unibyte strings, one of which
+   occurs in any string that REGEXP matches.  Signal an error if REGEXP
+   is invalid, as the matcher would, since the strings that a caller
+   rejects never reach the matcher.  */
+
+Lisp_Object
+regexp_necessary_substrings (Lisp_Object regexp)
+{
+  const unsigned char *p;
+  const unsigned char *end;
+  struct rx_summary s;
+
+  compile_pattern (regexp, NULL, Qnil, 0, STRING_MULTIBYTE (regexp));
+  p = SDATA (regexp);
+  end = p + SBYTES (regexp);
+  if (!rx_parse_alternatives (&p, end, 0, &s) || p != end)
+    /* A stray `\)' or worse; leave it to the matcher to complain.  */
+    return Qnil;
+  if (s.exact)
+    return rx_flush (s.set, Qnil);
+  return s.reqs;
+}
+
+/* Return nonzero if STRING has the bytes of NEEDLE as a substring.  */
+
+static int
+string_has_substring (Lisp_Object string, Lisp_Object needle)
+{
+  const unsigned char *p = SDATA (string);
+  const unsigned char *end = p + SBYTES (string);
+  const unsigned char *n = SDATA (needle);
+  ptrdiff_t len = SBYTES (needle);
+
+  if (len == 0)
+    return 1;
+  while (end - p >= len)
+    {
+      p = memchr (p, n[0], end - p - len + 1);
+      if (!p)
+	return 0;
+      if (memcmp (p, n, len) == 0)
+	return 1;
+      p++;
+    }
+  return 0;
+}
+
+/* Return nonzero if STRING satisfies REQUIREMENTS, a value returned by
+   regexp_necessary_substrings.  If it does not, the regexp cannot
+   match STRING.  */
+
+int
+string_has_necessary_substrings (Lisp_Object string, Lisp_Object requirements)
+{
+  for (; CONSP (requirements); requirements = XCDR (requirements))
+    {
+      Lisp_Object alternatives = XCAR (requirements);
+
+      for (; CONSP (alternatives); alternatives = XCDR (alternatives))
+	if (string_has_substring (string, XCAR (alternatives)))
+	  break;
+      if (NILP (alternatives))
+	return 0;
+    }
+  return 1;
+}
+
 
 /* The newline cache: remembering which sections of text have no newlines.  */
 
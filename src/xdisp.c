@@ -325,7 +325,7 @@ Lisp_Object Qwindow_scroll_functions;
 static Lisp_Object Qwindow_text_change_functions;
 static Lisp_Object Qredisplay_end_trigger_functions;
 Lisp_Object Qinhibit_point_motion_hooks;
-static Lisp_Object QCeval, QCpropertize;
+static Lisp_Object QCeval, QCpropertize, QCcache;
 Lisp_Object QCfile, QCdata;
 static Lisp_Object Qfontified;
 static Lisp_Object Qgrow_only;
@@ -10846,6 +10846,15 @@ static enum {
    Each element is (PROPERTIZED-STRING . PROPERTY-LIST).  */
 static Lisp_Object mode_line_proptrans_alist;
 
+/* List caching the results of (:cache DEPENDENCIES ELT) mode line
+   constructs.  Each element is a vector [CONSTRUCT WINDOW BUFFER VALUES
+   STRING], where STRING is ELT formatted for WINDOW showing BUFFER at a
+   time when the dependencies had the values in the list VALUES.  */
+static Lisp_Object mode_line_cache;
+
+/* Maximum number of elements in mode_line_cache.  */
+#define MODE_LINE_CACHE_SIZE 100
+
 /* List of strings making up the mode-line.  */
 static Lisp_Object mode_line_string_list;
 
@@ -13625,9 +13634,11 @@ redisplay_internal (void)
     }
 
 #ifdef HAVE_WINDOW_SYSTEM
+  /* Freeing images is left to clear_image_caches_when_idle, so that it
+     doesn't slow down redisplay.  */
   if (clear_image_cache_count > CLEAR_IMAGE_CACHE_COUNT)
     {
-      clear_image_caches (Qnil);
+      image_cache_cleanup_pending = 1;
       clear_image_cache_count = 0;
     }
 #endif /* HAVE_WINDOW_SYSTEM */
@@ -20380,6 +20391,99 @@ move_elt_to_front (Lisp_Object elt, Lisp_Object list)
   return list;
 }
 
+/* Return the string that the mode line construct ELT, of the form
+   (:cache DEPENDENCIES ELT), displays in window W.  Reuse the string
+   computed for W the last time, unless W's buffer or the values of
+   DEPENDENCIES have changed since then.  */
+
+static Lisp_Object
+mode_line_cached_string (struct window *w, Lisp_Object elt)
+{
+  Lisp_Object window, values, tail, next, prev, entry, found, string;
+  struct gcpro gcpro1, gcpro2;
+
+  XSETWINDOW (window, w);
+  values = Qnil;
+  GCPRO2 (elt, values);
+
+  /* Compute the current values of the dependencies.  A symbol stands
+     for its value; anything else is a form to evaluate.  */
+  for (tail = XCAR (XCDR (elt)); CONSP (tail); tail = XCDR (tail))
+    {
+      Lisp_Object dep = XCAR (tail), value;
+
+      if (SYMBOLP (dep))
+	{
+	  value = find_symbol_value (dep);
+	  if (EQ (value, Qunbound))
+	    value = Qnil;
+	}
+      else
+	value = safe_eval (dep);
+      values = Fcons (value, values);
+    }
+
+  /* Look for the entry of ELT in W.  Drop the entries of deleted
+     windows and killed buffers on the way, since they can never be
+     used again.  */
+  found = prev = Qnil;
+  for (tail = mode_line_cache; CONSP (tail); tail = next)
+    {
+      next = XCDR (tail);
+      entry = XCAR (tail);
+      if (!WINDOW_LIVE_P (AREF (entry, 1))
+	  || (BUFFERP (AREF (entry, 2))
+	      && NILP (BVAR (XBUFFER (AREF (entry, 2)), name))))
+	{
+	  if (NILP (prev))
+	    mode_line_cache = next;
+	  else
+	    XSETCDR (prev, next);
+	  continue;
+	}
+      if (NILP (found)
+	  && EQ (AREF (entry, 0), elt) && EQ (AREF (entry, 1), window))
+	found = entry;
+      prev = tail;
+    }
+
+  if (!NILP (found))
+    {
+      if (EQ (AREF (found, 2), w->buffer)
+	  && !NILP (Fequal (AREF (found, 3), values)))
+	{
+	  mode_line_cache = move_elt_to_front (found, mode_line_cache);
+	  UNGCPRO;
+	  return AREF (found, 4);
+	}
+
+      /* The entry is out of date.  */
+      mode_line_cache = Fdelq (found, mode_line_cache);
+    }
+
+  string = (CONSP (XCDR (XCDR (elt)))
+	    ? Fformat_mode_line (XCAR (XCDR (XCDR (elt))), Qnil, window,
+				 w->buffer)
+	    : empty_unibyte_string);
+
+  entry = Fmake_vector (make_number (5), Qnil);
+  ASET (entry, 0, elt);
+  ASET (entry, 1, window);
+  ASET (entry, 2, w->buffer);
+  ASET (entry, 3, values);
+  ASET (entry, 4, string);
+  mode_line_cache = Fcons (entry, mode_line_cache);
+
+  /* Truncate mode_line_cache to at most MODE_LINE_CACHE_SIZE
+     elements.  */
+  tail = Fnthcdr (make_number (MODE_LINE_CACHE_SIZE - 1), mode_line_cache);
+  if (CONSP (tail))
+    XSETCDR (tail, Qnil);
+
+  UNGCPRO;
+  return string;
+}
+
 /* Contribute ELT to the mode line for window IT->w.  How it
    translates into text depends on its data type.
 
@@ -20724,6 +20828,22 @@ display_mode_element (struct it *it, int depth, int field_width, int precision,
 					   risky);
 	      }
 	  }
+	else if (EQ (car, QCcache))
+	  {
+	    /* An element of the form (:cache DEPENDENCIES ELT) means
+	       display ELT, but format it only when DEPENDENCIES have
+	       changed.  The formatted string is displayed literally.  */
+
+	    if (risky)
+	      break;
+
+	    if (CONSP (XCDR (elt)))
+	      {
+		elt = mode_line_cached_string (it->w, elt);
+		literal = 1;
+		goto tail_recurse;
+	      }
+	  }
 	else if (EQ (car, QCpropertize))
 	  {
 	    /* An element of the form (:propertize ELT PROPS...)
@@ -28702,6 +28822,7 @@ syms_of_xdisp (void)
   DEFSYM (QCrelative_height, ":relative-height");
   DEFSYM (QCeval, ":eval");
   DEFSYM (QCpropertize, ":propertize");
+  DEFSYM (QCcache, ":cache");
   DEFSYM (QCfile, ":file");
   DEFSYM (Qfontified, "fontified");
   DEFSYM (Qfontification_functions, "fontification-functions");
@@ -28756,6 +28877,8 @@ syms_of_xdisp (void)
 
   mode_line_proptrans_alist = Qnil;
   staticpro (&mode_line_proptrans_alist);
+  mode_line_cache = Qnil;
+  staticpro (&mode_line_cache);
   mode_line_string_list = Qnil;
   staticpro (&mode_line_string_list);
   mode_line_string_face = Qnil;
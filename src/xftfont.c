@@ -507,6 +507,8 @@ xftfont_close (FRAME_PTR f, struct font *font)
   if (xftfont_info->otf)
     OTF_close (xftfont_info->otf);
 #endif
+  /* Pending glyphs may use this font.  */
+  xftfont_flush_glyphs ();
   BLOCK_INPUT;
   XftUnlockFace (xftfont_info->xftfont);
   XftFontClose (xftfont_info->display, xftfont_info->xftfont);
@@ -629,6 +631,100 @@ xftfont_get_xft_draw (FRAME_PTR f)
   return xft_draw;
 }
 
+/* Glyphs drawn by xftfont_draw are not sent to the X server right
+   away.  They are collected in batches, one for each combination of
+   XftDraw, foreground color and clipping, and each batch is drawn with
+   a single XftDrawGlyphFontSpec call, whatever fonts its glyphs use.
+   xftfont_flush_glyphs draws the batches; it is called when all the
+   glyph strings built by draw_glyphs have been drawn, and before lines
+   are drawn over text.  Backgrounds are drawn right away, so that all
+   text in the glyph strings is drawn over all their backgrounds, which
+   is what the overhang handling of draw_glyphs arranges for anyway.  */
+
+struct xftfont_batch
+{
+  XftDraw *xft_draw;
+  XftColor fg;
+  int num_clips;
+  XRectangle clip[2];
+  XftGlyphFontSpec *specs;
+  ptrdiff_t nspecs, size;
+};
+
+/* Maximum number of batches.  If glyphs need another one, all
+   batches are drawn first.  */
+
+#define XFTFONT_MAX_BATCHES 8
+
+static struct xftfont_batch xftfont_batches[XFTFONT_MAX_BATCHES];
+static int xftfont_nbatches;
+
+/* Draw all glyphs collected by xftfont_draw.  */
+
+void
+xftfont_flush_glyphs (void)
+{
+  int i;
+
+  if (xftfont_nbatches == 0)
+    return;
+
+  BLOCK_INPUT;
+  for (i = 0; i < xftfont_nbatches; i++)
+    {
+      struct xftfont_batch *batch = xftfont_batches + i;
+
+      if (batch->num_clips > 0)
+	XftDrawSetClipRectangles (batch->xft_draw, 0, 0,
+				  batch->clip, batch->num_clips);
+      else
+	XftDrawSetClip (batch->xft_draw, NULL);
+      XftDrawGlyphFontSpec (batch->xft_draw, &batch->fg,
+			    batch->specs, batch->nspecs);
+      batch->nspecs = 0;
+    }
+  xftfont_nbatches = 0;
+  UNBLOCK_INPUT;
+}
+
+/* Return the batch collecting glyphs drawn into XFT_DRAW in color FG
+   with the clipping of glyph string S, with room for N more glyphs.  */
+
+static struct xftfont_batch *
+xftfont_get_batch (XftDraw *xft_draw, XftColor *fg, struct glyph_string *s,
+		   int n)
+{
+  struct xftfont_batch *batch;
+  int i;
+
+  for (i = 0; i < xftfont_nbatches; i++)
+    if (xftfont_batches[i].xft_draw == xft_draw
+	&& xftfont_batches[i].fg.pixel == fg->pixel
+	&& xftfont_batches[i].num_clips == s->num_clips
+	&& memcmp (xftfont_batches[i].clip, s->clip,
+		   s->num_clips * sizeof *s->clip) == 0)
+      break;
+
+  if (i == xftfont_nbatches)
+    {
+      if (xftfont_nbatches == XFTFONT_MAX_BATCHES)
+	xftfont_flush_glyphs ();
+      batch = xftfont_batches + xftfont_nbatches++;
+      batch->xft_draw = xft_draw;
+      batch->fg = *fg;
+      batch->num_clips = s->num_clips;
+      memcpy (batch->clip, s->clip, s->num_clips * sizeof *s->clip);
+    }
+  else
+    batch = xftfont_batches + i;
+
+  if (batch->size - batch->nspecs < n)
+    batch->specs = xpalloc (batch->specs, &batch->size,
+			    n - (batch->size - batch->nspecs), -1,
+			    sizeof *batch->specs);
+  return batch;
+}
+
 static int
 xftfont_draw (struct glyph_string *s, int from, int to, int x, int y, int with_background)
 {
@@ -637,8 +733,10 @@ xftfont_draw (struct glyph_string *s, int from, int to, int x, int y, int with_b
   struct xftfont_info *xftfont_info = (struct xftfont_info *) s->font;
   struct xftface_info *xftface_info = NULL;
   XftDraw *xft_draw = xftfont_get_xft_draw (f);
-  FT_UInt *code;
   XftColor fg, bg;
+  struct xftfont_batch *batch;
+  XftGlyphFontSpec *spec;
+  Lisp_Object gstring = Qnil;
   int len = to - from;
   int i;
 
@@ -647,26 +745,65 @@ xftfont_draw (struct glyph_string *s, int from, int to, int x, int y, int with_b
   xftfont_get_colors (f, face, s->gc, xftface_info,
 		      &fg, with_background ? &bg : NULL);
   BLOCK_INPUT;
-  if (s->num_clips > 0)
-    XftDrawSetClipRectangles (xft_draw, 0, 0, s->clip, s->num_clips);
-  else
-    XftDrawSetClip (xft_draw, NULL);
-
   if (with_background)
-    XftDrawRect (xft_draw, &bg,
-		 x, y - s->font->ascent, s->width, s->font->height);
-  code = alloca (sizeof (FT_UInt) * len);
-  for (i = 0; i < len; i++)
-    code[i] = ((XCHAR2B_BYTE1 (s->char2b + from + i) << 8)
-	       | XCHAR2B_BYTE2 (s->char2b + from + i));
-
-  if (s->padding_p)
-    for (i = 0; i < len; i++)
-      XftDrawGlyphs (xft_draw, &fg, xftfont_info->xftfont,
-		     x + i, y, code + i, 1);
-  else
-    XftDrawGlyphs (xft_draw, &fg, xftfont_info->xftfont,
-		   x, y, code, len);
+    {
+      if (s->num_clips > 0)
+	XftDrawSetClipRectangles (xft_draw, 0, 0, s->clip, s->num_clips);
+      else
+	XftDrawSetClip (xft_draw, NULL);
+      XftDrawRect (xft_draw, &bg,
+		   x, y - s->font->ascent, s->width, s->font->height);
+    }
+
+  if (s->first_glyph->type == COMPOSITE_GLYPH
+      && s->first_glyph->u.cmp.automatic)
+    gstring = composition_gstring_from_id (s->cmp_id);
+  batch = xftfont_get_batch (xft_draw, &fg, s, len);
+  spec = batch->specs + batch->nspecs;
+  for (i = 0; i < len; i++, spec++)
+    {
+      FT_UInt code = ((XCHAR2B_BYTE1 (s->char2b + from + i) << 8)
+		      | XCHAR2B_BYTE2 (s->char2b + from + i));
+
+      spec->font = xftfont_info->xftfont;
+      spec->glyph = code;
+      if (s->padding_p)
+	{
+	  spec->x = x + i;
+	  spec->y = y;
+	}
+      else
+	{
+	  /* Advance like XftDrawGlyphs does, by the widths the glyphs
+	     got when they were laid out, less any box lines.  Only the
+	     glyphs drawn for glyphless characters have no width of their
+	     own.  */
+	  spec->x = x;
+	  spec->y = y;
+	  if (s->first_glyph->type == CHAR_GLYPH)
+	    {
+	      struct glyph *glyph = s->first_glyph + from + i;
+
+	      x += glyph->pixel_width;
+	      if (face->box != FACE_NO_BOX)
+		x -= (glyph->left_box_line_p + glyph->right_box_line_p)
+		     * eabs (face->box_line_width);
+	    }
+	  else if (s->first_glyph->type == COMPOSITE_GLYPH
+		   && s->first_glyph->u.cmp.automatic)
+	    x += LGLYPH_WIDTH (LGSTRING_GLYPH (gstring, from + i));
+	  else
+	    {
+	      XGlyphInfo extents;
+
+	      XftGlyphExtents (xftfont_info->display, xftfont_info->xftfont,
+			       &code, 1, &extents);
+	      x += extents.xOff;
+	      y += extents.yOff;
+	    }
+	}
+    }
+  batch->nspecs += len;
   UNBLOCK_INPUT;
 
   return len;
@@ -703,6 +840,7 @@ xftfont_end_for_frame (FRAME_PTR f)
 
   if (xft_draw)
     {
+      xftfont_flush_glyphs ();
       BLOCK_INPUT;
       XftDrawDestroy (xft_draw);
       UNBLOCK_INPUT;
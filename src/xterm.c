@@ -2816,6 +2816,15 @@ x_draw_glyph_string (struct glyph_string *s)
       abort ();
     }
 
+#ifdef HAVE_XFT
+  /* Lines drawn below must be drawn over the text.  */
+  if (!s->for_overlaps
+      && (s->face->underline_p || s->face->overline_p
+	  || s->face->strike_through_p
+	  || (!relief_drawn_p && s->face->box != FACE_NO_BOX)))
+    xftfont_flush_glyphs ();
+#endif
+
   if (!s->for_overlaps)
     {
       /* Draw underline.  */
@@ -2994,6 +3003,13 @@ x_draw_glyph_string (struct glyph_string *s)
   /* Reset clipping.  */
   XSetClipMask (s->display, s->gc, None);
   s->num_clips = 0;
+
+#ifdef HAVE_XFT
+  /* Draw the glyphs Xft has collected when the last glyph string of
+     draw_glyphs has been drawn.  */
+  if (!s->next)
+    xftfont_flush_glyphs ();
+#endif
 }
 
 /* Shift display to make room for inserted glyphs.   */
@@ -0,0 +1,197 @@
+;;; data-tests.el --- Tests for data.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(defun data-tests-both (fun &rest args)
+  "Apply FUN to ARGS, both interpreted and byte-compiled.
+Check that the results are the same, and return the result."
+  (let ((interpreted (apply fun args))
+	(compiled (apply (byte-compile `(lambda (&rest args)
+					  (apply ',fun args)))
+			 args))
+	(inline (apply (byte-compile
+			(let ((vars (mapcar (lambda (_) (make-symbol "x"))
+					    args)))
+			  `(lambda ,vars (,fun ,@vars))))
+		       args)))
+    (should (eql interpreted compiled))
+    (should (eql interpreted inline))
+    interpreted))
+
+(ert-deftest data-tests-arith-in-range ()
+  (should (eql (data-tests-both '+ 2 3) 5))
+  (should (eql (data-tests-both '- 2 3) -1))
+  (should (eql (data-tests-both '- 7) -7))
+  (should (eql (data-tests-both '* 6 7) 42))
+  (should (eql (data-tests-both '/ -7 2) -3))
+  (should (eql (data-tests-both '1+ 41) 42))
+  (should (eql (data-tests-both '1- 43) 42))
+  (should (eql (data-tests-both '+ (1- most-positive-fixnum) 1)
+	       most-positive-fixnum))
+  (should (eql (data-tests-both '- (1+ most-negative-fixnum) 1)
+	       most-negative-fixnum))
+  (should (eql (data-tests-both '+ 1 2.5) 3.5))
+  (should (eql (data-tests-both '* 2 0.5) 1.0)))
+
+(ert-deftest data-tests-arith-overflow-wraps ()
+  "Integer arithmetic wraps around at the fixnum boundaries."
+  (should (eql (data-tests-both '1+ most-positive-fixnum)
+	       most-negative-fixnum))
+  (should (eql (data-tests-both '1- most-negative-fixnum)
+	       most-positive-fixnum))
+  (should (eql (data-tests-both '+ most-positive-fixnum 1)
+	       most-negative-fixnum))
+  (should (eql (data-tests-both '- most-negative-fixnum 1)
+	       most-positive-fixnum))
+  (should (eql (data-tests-both '- most-negative-fixnum)
+	       most-negative-fixnum))
+  (should (eql (data-tests-both 'abs most-negative-fixnum)
+	       most-negative-fixnum))
+  (should (eql (data-tests-both '* most-positive-fixnum 2) -2))
+  (should (eql (data-tests-both '* most-positive-fixnum most-positive-fixnum)
+	       1))
+  (should (eql (data-tests-both '+ most-positive-fixnum most-positive-fixnum
+				most-positive-fixnum)
+	       (- most-positive-fixnum 2))))
+
+;;; Bool-vectors.
+
+(defvar data-tests-bool-vector-lengths '(0 1 7 8 9 63 64 65 130 1000)
+  "Lengths of the bool-vectors to test, around the byte and word sizes.")
+
+(defun data-tests-random-bool-vector (length)
+  "Return a bool-vector of LENGTH random elements."
+  (let ((bv (make-bool-vector length nil)))
+    (dotimes (i length)
+      (aset bv i (zerop (random 2))))
+    bv))
+
+(defun data-tests-bool-vector (&rest elements)
+  "Return a bool-vector holding ELEMENTS."
+  (let ((bv (make-bool-vector (length elements) nil))
+	(i 0))
+    (dolist (elt elements bv)
+      (aset bv i elt)
+      (setq i (1+ i)))))
+
+(defun data-tests-bool-vector-map (fun a b)
+  "Return the bool-vector of FUN applied to the elements of A and B."
+  (let ((bv (make-bool-vector (length a) nil)))
+    (dotimes (i (length a))
+      (aset bv i (and (funcall fun (aref a i) (aref b i)) t)))
+    bv))
+
+(ert-deftest data-tests-bool-vector-set-operations ()
+  (dolist (length data-tests-bool-vector-lengths)
+    (let ((a (data-tests-random-bool-vector length))
+	  (b (data-tests-random-bool-vector length)))
+      (should (equal (bool-vector-union a b)
+		     (data-tests-bool-vector-map (lambda (x y) (or x y))
+						 a b)))
+      (should (equal (bool-vector-intersection a b)
+		     (data-tests-bool-vector-map (lambda (x y) (and x y))
+						 a b)))
+      (should (equal (bool-vector-set-difference a b)
+		     (data-tests-bool-vector-map (lambda (x y) (and x (not y)))
+						 a b)))
+      (should (equal (bool-vector-exclusive-or a b)
+		     (data-tests-bool-vector-map (lambda (x y) (not (eq x y)))
+						 a b)))
+      (should (equal (bool-vector-not a)
+		     (data-tests-bool-vector-map (lambda (x _) (not x)) a a)))
+      ;; The bits past the end stay clear, so that the complement of
+      ;; the complement is equal to the original.
+      (should (equal (bool-vector-not (bool-vector-not a)) a))
+      (should (bool-vector-subsetp (bool-vector-intersection a b) a))
+      (should (bool-vector-subsetp a (bool-vector-union a b)))
+      (should (eq (bool-vector-subsetp a b)
+		  (equal (bool-vector-intersection a b) a))))))
+
+(ert-deftest data-tests-bool-vector-destination ()
+  (let* ((a (data-tests-bool-vector t t nil nil t))
+	 (b (data-tests-bool-vector t nil t nil t))
+	 (c (make-bool-vector 5 t)))
+    (should (eq (bool-vector-intersection a b c) c))
+    (should (equal c (data-tests-bool-vector t nil nil nil t)))
+    (should (eq (bool-vector-not a c) c))
+    (should (equal c (data-tests-bool-vector nil nil t t nil)))
+    (should (equal a (data-tests-bool-vector t t nil nil t)))
+    (should-error (bool-vector-union a (make-bool-vector 6 nil))
+		  :type 'wrong-length-argument)
+    (should-error (bool-vector-union a b (make-bool-vector 4 nil)))
+    (should-error (bool-vector-union a [t nil t nil t])
+		  :type 'wrong-type-argument)))
+
+(ert-deftest data-tests-bool-vector-counts ()
+  (dolist (length data-tests-bool-vector-lengths)
+    (let ((a (data-tests-random-bool-vector length))
+	  (count 0))
+      (dotimes (i length)
+	(if (aref a i) (setq count (1+ count))))
+      (should (eql (bool-vector-count-population a) count))
+      (should (eql (bool-vector-count-population (bool-vector-not a))
+		   (- length count)))
+      (dolist (b '(nil t))
+	(dotimes (i (1+ length))
+	  (let ((j i))
+	    (while (and (< j length) (eq (aref a j) b))
+	      (setq j (1+ j)))
+	    (should (eql (bool-vector-count-consecutive a b i) (- j i))))))
+      (should (eql (bool-vector-count-consecutive
+		    (make-bool-vector length t) t 0)
+		   length))
+      (should-error (bool-vector-count-consecutive a t (1+ length))
+		    :type 'args-out-of-range))))
+
+;;; Numeric vectors.
+
+(ert-deftest data-tests-numeric-vector-sequence ()
+  (dolist (type '(uint8 int32 int64 float64))
+    (let ((v (numeric-vector type 1 2 3))
+	  (elts (if (eq type 'float64) '(1.0 2.0 3.0) '(1 2 3))))
+      (should (arrayp v))
+      (should (sequencep v))
+      (should (eql (length v) 3))
+      (should (eql (elt v 1) (nth 1 elts)))
+      (should (equal (append v nil) elts))
+      (should (equal (vconcat v) (vconcat elts)))
+      (should (equal (mapcar #'identity v) elts))
+      (should (equal (mapconcat #'number-to-string v ",")
+		     (mapconcat #'number-to-string elts ",")))
+      (should (equal (copy-sequence v) v))
+      (should-not (eq (copy-sequence v) v))
+      ;; The elements can be read back into an equal vector.
+      (should (equal (apply #'numeric-vector (numeric-vector-type v)
+			    (append v nil))
+		     v))))
+  (should (equal (concat (numeric-vector 'uint8 ?a ?b)) "ab"))
+  (should-error (concat (numeric-vector 'float64 97)))
+  (should (equal (append (make-numeric-vector 'int32 0) nil) nil)))
+
+(ert-deftest data-tests-numeric-vector-print ()
+  (let ((v (numeric-vector 'int32 1 -2)))
+    (should (equal (prin1-to-string v) "#<numeric-vector int32 [1 -2]>"))
+    (should-error (read (prin1-to-string v)) :type 'invalid-read-syntax)))
+
+;;; data-tests.el ends here
@@ -0,0 +1,246 @@
+;;; dired-tests.el --- Tests for dired.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(defun dired-tests-directory-name-p (name)
+  "Return non-nil if NAME ends with a slash."
+  (and (> (length name) 0) (eq (aref name (1- (length name))) ?/)))
+
+(defmacro dired-tests-with-directory (var files &rest body)
+  "Bind VAR to a new temporary directory holding FILES, and run BODY.
+Each element of FILES is a file name, or a directory name ending in a
+slash.  The directory is deleted afterwards."
+  (declare (indent 2))
+  `(let ((,var (file-name-as-directory (make-temp-file "dired-tests" t))))
+     (unwind-protect
+	 (progn
+	   (dolist (file ,files)
+	     (if (dired-tests-directory-name-p file)
+		 (make-directory (expand-file-name file ,var) t)
+	       (make-directory (file-name-directory
+				(expand-file-name file ,var))
+			       t)
+	       (write-region file nil (expand-file-name file ,var)
+			     nil 'silent)))
+	   ,@body)
+       (delete-directory ,var t))))
+
+;;; Directory files and attributes.
+
+(defun dired-tests-without-access-time (entries)
+  "Return ENTRIES of `directory-files-and-attributes' without access times.
+Listing a directory may update its access time."
+  (mapcar (lambda (entry)
+	    (let ((attributes (copy-sequence (cdr entry))))
+	      (setcar (nthcdr 4 attributes) nil)
+	      (cons (car entry) attributes)))
+	  entries))
+
+(defun dired-tests-attributes-one-by-one (dir &optional full id-format)
+  "Return what `directory-files-and-attributes' should return for DIR.
+The attributes are looked up with `file-attributes', one file at a
+time.  FULL and ID-FORMAT are as for `directory-files-and-attributes'."
+  (mapcar (lambda (file)
+	    (cons file (file-attributes (expand-file-name file dir)
+					id-format)))
+	  (directory-files dir full)))
+
+(defvar dired-tests-files
+  (append '("a.txt" "b.el" "sub/" "sub/c.el")
+	  (let (files)
+	    (dotimes (i 100 files)
+	      (push (format "f%03d" i) files))))
+  "Files to list.  There are enough for the lookups to be batched.")
+
+(ert-deftest dired-tests-directory-files-and-attributes ()
+  (dired-tests-with-directory dir dired-tests-files
+    (make-symbolic-link "a.txt" (expand-file-name "link" dir))
+    (dolist (threads '(1 4))
+      (let ((directory-files-and-attributes-threads threads))
+	(dolist (full '(nil t))
+	  (dolist (id-format '(integer string))
+	    (should (equal (dired-tests-without-access-time
+			    (directory-files-and-attributes dir full nil nil
+							    id-format))
+			   (dired-tests-without-access-time
+			    (dired-tests-attributes-one-by-one
+			     dir full id-format))))))))
+    (let ((entries (directory-files-and-attributes dir)))
+      (should (equal (mapcar #'car entries) (directory-files dir)))
+      (should (eq (nth 0 (cdr (assoc "sub" entries))) t))
+      (should (equal (nth 0 (cdr (assoc "link" entries))) "a.txt"))
+      (should (eql (nth 7 (cdr (assoc "a.txt" entries))) 5)))))
+
+(ert-deftest dired-tests-directory-files-and-attributes-match ()
+  (dired-tests-with-directory dir dired-tests-files
+    (should (equal (mapcar #'car (directory-files-and-attributes
+				  dir nil "\\.el\\'"))
+		   '("b.el")))
+    (should (equal (mapcar #'car (directory-files-and-attributes
+				  dir t "\\.txt\\'"))
+		   (list (expand-file-name "a.txt" dir))))
+    (should (equal (sort (mapcar #'car (directory-files-and-attributes
+					dir nil nil t))
+			 #'string<)
+		   (directory-files dir)))
+    (should-not (directory-files-and-attributes dir nil "nothing"))))
+
+(ert-deftest dired-tests-directory-files-and-attributes-subset ()
+  (dired-tests-with-directory dir dired-tests-files
+    (let ((all (directory-files-and-attributes dir))
+	  (some (directory-files-and-attributes dir nil nil nil nil '(0 7 5))))
+      (should (equal (mapcar #'car some) (mapcar #'car all)))
+      (while all
+	(dolist (i '(0 7 5))
+	  (should (equal (nth i (cdar some)) (nth i (cdar all)))))
+	(setq all (cdr all) some (cdr some))))
+    (should-error (directory-files-and-attributes dir nil nil nil nil '(12))
+		  :type 'args-out-of-range)
+    (should-error (directory-files-and-attributes dir nil nil nil nil '(x))
+		  :type 'wrong-type-argument)))
+
+;;; Recursive listings.
+
+(defvar dired-tests-tree '("a.el" "b.txt" "sub/c.el" "sub/deep/d.el" "z.el")
+  "Files of the tree to list recursively.")
+
+(defun dired-tests-recursively (dir &rest args)
+  "Call `directory-files-recursively' on DIR with ARGS.
+Return the file names relative to DIR."
+  (mapcar (lambda (file) (file-relative-name file dir))
+	  (apply #'directory-files-recursively dir args)))
+
+(ert-deftest dired-tests-directory-files-recursively ()
+  (dired-tests-with-directory dir dired-tests-tree
+    (make-symbolic-link "sub" (expand-file-name "link" dir))
+    ;; The files of a directory come after those of its
+    ;; subdirectories.
+    (should (equal (dired-tests-recursively dir "\\.el\\'")
+		   '("sub/deep/d.el" "sub/c.el" "a.el" "z.el")))
+    (should (equal (dired-tests-recursively dir "")
+		   '("sub/deep/d.el" "sub/c.el" "a.el" "b.txt" "z.el")))
+    (should (equal (dired-tests-recursively dir "^[ab]")
+		   '("a.el" "b.txt")))
+    (should-not (dired-tests-recursively dir "nothing"))
+    (should (equal (directory-files-recursively dir "^a")
+		   (list (expand-file-name "a.el" dir))))
+    ;; Directories come after their contents.
+    (should (equal (dired-tests-recursively dir "" t)
+		   '("link" "sub/deep/d.el" "sub/deep" "sub/c.el" "sub"
+		     "a.el" "b.txt" "z.el")))
+    (should (equal (dired-tests-recursively dir "deep" t)
+		   '("sub/deep")))
+    ;; Symbolic links to directories are entered only on request.
+    (should (equal (dired-tests-recursively dir "\\.el\\'" nil nil t)
+		   '("link/deep/d.el" "link/c.el" "sub/deep/d.el" "sub/c.el"
+		     "a.el" "z.el")))))
+
+(ert-deftest dired-tests-directory-files-recursively-predicate ()
+  (dired-tests-with-directory dir dired-tests-tree
+    (let (entered)
+      (should (equal (dired-tests-recursively
+		      dir "" nil
+		      (lambda (subdir)
+			(push (file-relative-name subdir dir) entered)
+			(not (string-match "deep" subdir))))
+		     '("sub/c.el" "a.el" "b.txt" "z.el")))
+      (should (equal (nreverse entered) '("sub" "sub/deep"))))
+    (should (equal (dired-tests-recursively dir "" nil t)
+		   (dired-tests-recursively dir "")))
+    (let ((case-fold-search t))
+      (should (equal (dired-tests-recursively dir "^A\\.EL$") '("a.el"))))
+    (let ((case-fold-search nil))
+      (should-not (dired-tests-recursively dir "^A\\.EL$")))
+    (should-error (directory-files-recursively
+		   (expand-file-name "missing" dir) "")
+		  :type 'file-error)
+    (should-error (directory-files-recursively dir 'x)
+		  :type 'wrong-type-argument)))
+
+;;; File name completion.
+
+(defun dired-tests-set-old (dir &optional hours)
+  "Set the modification time of DIR to HOURS hours ago, 1 by default.
+Completion only caches the listings of directories that did not
+change lately."
+  (let ((then (- (floor (float-time)) (* 3600 (or hours 1)))))
+    (set-file-times dir (list (floor then 65536) (mod then 65536)))))
+
+(defun dired-tests-completions (dir)
+  "Return the results of some file name completions in DIR."
+  (let (results)
+    (dolist (file '("" "f" "f0" "f09" "f099" "f1" "s" "sub" "l" "b" "q"))
+      (push (list file
+		  (file-name-completion file dir)
+		  (file-name-all-completions file dir)
+		  (file-name-completion file dir #'file-directory-p))
+	    results))
+    (nreverse results)))
+
+(ert-deftest dired-tests-file-name-completion-cache ()
+  (dired-tests-with-directory dir dired-tests-files
+    (make-symbolic-link "sub" (expand-file-name "link" dir))
+    (dired-tests-set-old dir)
+    (let* ((file-name-completion-cache (make-hash-table :test 'equal))
+	   (cached (dired-tests-completions dir))
+	   (key (directory-file-name dir)))
+      (should (gethash key file-name-completion-cache))
+      (should (equal cached (dired-tests-completions dir)))
+      (let ((file-name-completion-cache nil))
+	(should (equal cached (dired-tests-completions dir))))
+      ;; Directories, and links to them, end in a slash.
+      (should (equal (file-name-completion "su" dir) "sub/"))
+      (should (equal (file-name-completion "sub" dir) "sub/"))
+      (should (equal (file-name-all-completions "l" dir) '("link/")))
+      (should (equal (file-name-completion "f09" dir) "f09"))
+      (should (equal (length (file-name-all-completions "f09" dir)) 10))
+      ;; A file added to the directory is seen, even if the
+      ;; modification time is set back to another old time.
+      (write-region "" nil (expand-file-name "f0999" dir) nil 'silent)
+      (should (member "f0999" (file-name-all-completions "f0" dir)))
+      (dired-tests-set-old dir 2)
+      (should (member "f0999" (file-name-all-completions "f0" dir)))
+      (should (equal (file-name-completion "f099" dir) "f099"))
+      (delete-file (expand-file-name "f0999" dir))
+      (dired-tests-set-old dir 3)
+      (should-not (member "f0999" (file-name-all-completions "f0" dir)))
+      ;; A link whose target changes is looked at again.
+      (delete-directory (expand-file-name "sub" dir) t)
+      (write-region "" nil (expand-file-name "sub" dir) nil 'silent)
+      (dired-tests-set-old dir 4)
+      (should (equal (file-name-all-completions "l" dir) '("link"))))))
+
+(ert-deftest dired-tests-file-name-completion-ignored ()
+  (dired-tests-with-directory dir '("a.el" "a.elc" "b.o" "c.o" "d/")
+    (dired-tests-set-old dir)
+    (dolist (file-name-completion-cache
+	     (list nil (make-hash-table :test 'equal)))
+      (let ((completion-ignored-extensions '(".elc" ".o" "d/")))
+	(should (equal (file-name-completion "a" dir) "a.el"))
+	(should (equal (file-name-completion "b" dir) "b.o"))
+	(should (equal (file-name-completion "" dir) "a.el"))
+	(should (equal (sort (file-name-all-completions "" dir) #'string<)
+		       '("../" "./" "a.el" "a.elc" "b.o" "c.o" "d/")))))))
+
+;;; dired-tests.el ends here
@@ -0,0 +1,122 @@
+;;; editfns-tests.el --- Tests for editfns.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; Format.
+
+;; `format' copies each run of literal text with a single copy, and
+;; converts a %d without flags or precision, and a %s without width or
+;; precision, in fast paths.
+
+(ert-deftest editfns-tests-format-percent ()
+  (should (equal (format "%%") "%"))
+  (should (equal (format "%%abc") "%abc"))
+  (should (equal (format "ab%%cd") "ab%cd"))
+  (should (equal (format "abc%%") "abc%"))
+  (should (equal (format "%%%%") "%%"))
+  (should (equal (format "%%%d%%" 5) "%5%"))
+  (should (equal (format "%s%%%s" "a" "b") "a%b"))
+  (should (equal (format "é%%à%%") "é%à%"))
+  (should (equal (format "%%é%s" "à") "%éà")))
+
+(ert-deftest editfns-tests-format-decimal ()
+  (dolist (n (list 0 1 -1 9 -9 10 -10 99 100 12345 -12345
+		   most-positive-fixnum most-negative-fixnum
+		   (1+ most-negative-fixnum)))
+    (should (equal (format "%d" n) (number-to-string n)))
+    (should (equal (format "<%d>" n) (concat "<" (number-to-string n) ">"))))
+  (should (equal (format "%d" -0.0) "0"))
+  (should (equal (format "%d" -3.7) "-3"))
+  (should (equal (format "%d %d %d" 0 -7 70) "0 -7 70")))
+
+(ert-deftest editfns-tests-format-decimal-flags ()
+  ;; These still go through sprintf.
+  (should (equal (format "%5d" 42) "   42"))
+  (should (equal (format "%5d" -42) "  -42"))
+  (should (equal (format "%-5d|" 42) "42   |"))
+  (should (equal (format "%05d" -42) "-0042"))
+  (should (equal (format "%+d %+d" 5 -5) "+5 -5"))
+  (should (equal (format "% d % d" 5 -5) " 5 -5"))
+  (should (equal (format "%.3d" 7) "007"))
+  (should (equal (format "%+.3d" -7) "-007"))
+  (should (equal (format "%1d" 123) "123"))
+  (should (equal (format "%3d" most-negative-fixnum)
+		 (number-to-string most-negative-fixnum))))
+
+(ert-deftest editfns-tests-format-multibyte ()
+  ;; Literal multibyte runs next to unibyte arguments.
+  (should (equal (format "é%sà" "abc") "éabcà"))
+  (should (equal (format "日本%d語%s" 12 "x") "日本12語x"))
+  (should (equal (format "é%s" "\351")
+		 (concat "é" (string-to-multibyte "\351"))))
+  (should (multibyte-string-p (format "é%s" "abc")))
+  ;; A unibyte format with a multibyte argument: the raw bytes of the
+  ;; format become raw-byte characters.
+  (let ((result (format "a\351b%s\377" "é")))
+    (should (multibyte-string-p result))
+    (should (equal result (concat (string-to-multibyte "a\351b") "é"
+				  (string-to-multibyte "\377")))))
+  (should (equal (format "a\351b%s" "c") "a\351bc"))
+  (should-not (multibyte-string-p (format "a\351b%s" "c"))))
+
+(ert-deftest editfns-tests-format-properties ()
+  ;; Properties of the format string stay on the literal text around
+  ;; the conversions, at their positions in the result.
+  (should (ert-equal-including-properties
+	   (format (concat "ab" (propertize "cd" 'p 1) "%s"
+			   (propertize "ef" 'p 2))
+		   "XYZ")
+	   (concat "ab" (propertize "cd" 'p 1) "XYZ" (propertize "ef" 'p 2))))
+  (should (ert-equal-including-properties
+	   (format (concat "éé" (propertize "à%sà" 'p 1) "ü") "XY")
+	   (concat "éé" (propertize "àXYà" 'p 1) "ü")))
+  (should (ert-equal-including-properties
+	   (format (concat (propertize "éé" 'p 1) "%s" (propertize "ab" 'p 2)
+			   "à%s" (propertize "üc" 'p 3))
+		   "XY" "Z")
+	   (concat (propertize "éé" 'p 1) "XY" (propertize "ab" 'p 2)
+		   "àZ" (propertize "üc" 'p 3))))
+  (should (ert-equal-including-properties
+	   (format (concat "%%" (propertize "ab" 'p 1) "%s%%"
+			   (propertize "c" 'p 2))
+		   "Z")
+	   (concat "%" (propertize "ab" 'p 1) "Z%" (propertize "c" 'p 2))))
+  (should (ert-equal-including-properties
+	   (format (propertize "%d" 'p 1) 123)
+	   (propertize "123" 'p 1)))
+  ;; Properties of %s arguments.
+  (should (ert-equal-including-properties
+	   (format "ab%sc" (propertize "xy" 'q 1))
+	   (concat "ab" (propertize "xy" 'q 1) "c")))
+  (should (ert-equal-including-properties
+	   (format "é%sà%s" (propertize "xy" 'q 1) (propertize "z" 'q 2))
+	   (concat "é" (propertize "xy" 'q 1) "à" (propertize "z" 'q 2))))
+  (should (ert-equal-including-properties
+	   (format (concat (propertize "ab" 'p 1) "%s") (propertize "é" 'q 1))
+	   (concat (propertize "ab" 'p 1) (propertize "é" 'q 1))))
+  (should (ert-equal-including-properties
+	   (format "%5s|" (propertize "xy" 'q 1))
+	   (concat "   " (propertize "xy" 'q 1) "|"))))
+
+;;; editfns-tests.el ends here
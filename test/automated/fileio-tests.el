@@ -0,0 +1,199 @@
+;;; fileio-tests.el --- Tests for fileio.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; File name handlers.
+
+;; `find-file-name-handler' skips the regexps of
+;; `file-name-handler-alist' that cannot match, judging by the strings
+;; they require.  These tests check that it still finds the handler
+;; that matching each regexp with `string-match' would find.
+
+(defun fileio-tests-find-handler (filename operation)
+  "Return the handler for FILENAME and OPERATION, found with `string-match'.
+Return `error' if a regexp is invalid."
+  (condition-case nil
+      (let ((case-fold-search nil)
+	    (pos -1)
+	    result)
+	(dolist (elt file-name-handler-alist result)
+	  (when (and (consp elt) (stringp (car elt)))
+	    (let ((match (string-match (car elt) filename))
+		  (operations (and (symbolp (cdr elt))
+				   (get (cdr elt) 'operations))))
+	      (when (and match (> match pos)
+			 (or (null operations) (memq operation operations)))
+		(setq result (cdr elt)
+		      pos match))))))
+    (invalid-regexp 'error)))
+
+(defun fileio-tests-handler-mismatches (filenames &optional operation)
+  "Return the FILENAMES for which `find-file-name-handler' is wrong.
+Each element of the result is (FILENAME ACTUAL EXPECTED).  OPERATION
+defaults to `fileio-tests-operation'."
+  (let ((operation (or operation 'fileio-tests-operation))
+	mismatches)
+    (dolist (filename filenames)
+      (let ((actual (condition-case nil
+			(find-file-name-handler filename operation)
+		      (invalid-regexp 'error)))
+	    (expected (fileio-tests-find-handler filename operation)))
+	(unless (eq actual expected)
+	  (push (list filename actual expected) mismatches))))
+    (nreverse mismatches)))
+
+(defun fileio-tests-check-regexps (regexps filenames)
+  "Check `find-file-name-handler' for each of REGEXPS on FILENAMES.
+Each regexp is alone in `file-name-handler-alist'.  Return a list of
+the mismatches, each with its regexp."
+  (let (mismatches)
+    (dolist (regexp regexps)
+      (let ((file-name-handler-alist
+	     (list (cons regexp 'fileio-tests-handler))))
+	(dolist (mismatch (fileio-tests-handler-mismatches filenames))
+	  (push (cons regexp mismatch) mismatches))))
+    (nreverse mismatches)))
+
+(defvar fileio-tests-regexps
+  '(;; Alternation, including with an empty branch.
+    "\\.gz\\'\\|\\.bz2\\'" "\\.\\(gz\\|bz2\\|Z\\)\\(~\\|\\.~[0-9]+~\\)?\\'"
+    "\\(\\|x\\)y" "a\\|" "\\(?:ab\\|cd\\)e" "\\(?2:ab\\)\\|c"
+    ;; Bounded repetition.
+    "a\\{0,3\\}b" "xa\\{1,2\\}b" "\\(ab\\)\\{0,2\\}c" "\\(ab\\)\\{2\\}"
+    "a\\{,2\\}" "\\(?:\\.gz\\)\\{1,\\}"
+    ;; Optional and repeated parts.
+    "\\.el?\\'" "\\.elc?\\'" "ab*c" "ab+c" "a*?b" "x\\(ab\\)?y" "x\\(ab\\)*y"
+    "\\(?:\\.z\\)+" "*a" "+a" "?a"
+    ;; Character classes and wildcards.
+    "[.]gz" "[^/]foo" "[]a]b" "[^]a]b" "[[:alpha:]]z" "a.b" "a[.]b"
+    "[a-c]\\.el"
+    ;; Back-references.
+    "\\(ab\\)\\1" "\\(a\\|b\\)x\\1" "\\(?:a\\)\\(b\\)\\1"
+    ;; Anchors and other assertions.
+    "\\`/:" "\\`/[^/:]+:" "gz\\'" "^/:" "x$" "\\`\\'" "\\bfoo" "\\<ab\\>"
+    "\\`a\\|b\\'" "a\\'\\|\\`b"
+    ;; Syntax classes and non-ASCII characters.
+    "\\sw\\.el" "\\w+:" "é\\.el" "\\.é"
+    ;; Invalid regexps.
+    "\\(ab" "ab\\)" "[ab" "a\\{2,1\\}")
+  "Regexps that are hard to summarize.")
+
+(defvar fileio-tests-filenames
+  '("" "a" "b" "y" "xy" "ab" "abc" "ac" "abbc" "abab" "axa" "axb" "abx"
+    "aaab" "xab" "xaab" "xaaab" "xaby" "xababy" "xy" "abe" "cde" "ce"
+    "/:foo" "x/:foo" "/ssh:host:x" "foo.gz" "foo.bz2" "foo.Z" "foo.Z~"
+    "foo.gz.~1~" "foo.gzip" "foo.el" "foo.elc" "foo.e" "foo.e.z.z"
+    "a.b" "axb" "]b" "cb" "b.el" "/foo" "//foo" "foo" "a foo" "zz"
+    "é.el" "foo.é" "x" "ax" "x\nab")
+  "File names to look up handlers for.")
+
+(ert-deftest fileio-tests-find-file-name-handler ()
+  (should (null (fileio-tests-check-regexps fileio-tests-regexps
+					    fileio-tests-filenames))))
+
+(ert-deftest fileio-tests-find-file-name-handler-alist ()
+  ;; The handler whose match starts last wins, and a handler is
+  ;; skipped for the operations it does not handle.
+  (let ((file-name-handler-alist
+	 (append '(("\\.gz\\'" . fileio-tests-gz)
+		   ("\\`/[^/:]+:" . fileio-tests-remote)
+		   ("\\.el\\'" . fileio-tests-el)
+		   ("\\`/:" . fileio-tests-quoted))
+		 file-name-handler-alist)))
+    (put 'fileio-tests-el 'operations '(fileio-tests-operation))
+    (unwind-protect
+	(progn
+	  (should (null (fileio-tests-handler-mismatches
+			 fileio-tests-filenames)))
+	  (should (null (fileio-tests-handler-mismatches
+			 fileio-tests-filenames 'file-exists-p)))
+	  (should (eq (find-file-name-handler "/h:x.el.gz" 'file-exists-p)
+		      'fileio-tests-gz))
+	  (should (eq (find-file-name-handler "/h:x.el"
+					      'fileio-tests-operation)
+		      'fileio-tests-el))
+	  (should (eq (find-file-name-handler "/h:x.el" 'file-exists-p)
+		      'fileio-tests-remote))
+	  ;; The alist and its regexps can be changed in place.
+	  (setcar (nth 2 file-name-handler-alist) "\\.elc\\'")
+	  (should-not (eq (find-file-name-handler "/x.el"
+						  'fileio-tests-operation)
+			  'fileio-tests-el))
+	  (should (eq (find-file-name-handler "/x.elc"
+					      'fileio-tests-operation)
+		      'fileio-tests-el))
+	  (setcdr (last file-name-handler-alist)
+		  (list (cons "\\.txt\\'" 'fileio-tests-txt)))
+	  (should (eq (find-file-name-handler "/x.txt" 'file-exists-p)
+		      'fileio-tests-txt)))
+      (put 'fileio-tests-el 'operations nil))))
+
+(defun fileio-tests-random-element (sequence)
+  "Return a random element of SEQUENCE."
+  (elt sequence (random (length sequence))))
+
+(defun fileio-tests-random-regexp (depth)
+  "Return a random regexp with groups nested at most DEPTH deep."
+  (let ((branches (list (fileio-tests-random-sequence depth))))
+    (while (zerop (random 3))
+      (push (fileio-tests-random-sequence depth) branches))
+    (mapconcat #'identity branches "\\|")))
+
+(defun fileio-tests-random-sequence (depth)
+  "Return a random regexp without `\\|' at top level.
+Its groups are nested at most DEPTH deep."
+  (let (atoms)
+    (dotimes (_ (random 5))
+      (push (concat
+	     (if (and (> depth 0) (zerop (random 5)))
+		 (concat (fileio-tests-random-element '("\\(" "\\(?:"))
+			 (fileio-tests-random-regexp (1- depth))
+			 "\\)")
+	       (fileio-tests-random-element
+		'("a" "b" "a" "b" "." "\\." "/" ":" "é" "[ab]" "[^a]" "[.:]"
+		  "[[:alpha:]]" "^" "$" "\\`" "\\'" "\\1" "\\w" "\\b")))
+	     (if (zerop (random 3))
+		 (fileio-tests-random-element
+		  '("*" "+" "?" "*?" "\\{0,2\\}" "\\{1,2\\}" "\\{2\\}"))
+	       ""))
+	    atoms))
+    (apply #'concat atoms)))
+
+(defun fileio-tests-random-filename ()
+  "Return a short random file name."
+  (let ((chars (make-string (random 8) ?a)))
+    (dotimes (i (length chars))
+      (aset chars i (fileio-tests-random-element "ab./:é")))
+    chars))
+
+(ert-deftest fileio-tests-find-file-name-handler-random ()
+  (random "fileio-tests")
+  (let (regexps filenames)
+    (dotimes (_ 1000)
+      (push (fileio-tests-random-regexp 2) regexps))
+    (dotimes (_ 40)
+      (push (fileio-tests-random-filename) filenames))
+    (should (null (fileio-tests-check-regexps regexps filenames)))))
+
+;;; fileio-tests.el ends here
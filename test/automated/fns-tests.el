@@ -0,0 +1,634 @@
+;;; fns-tests.el --- Tests for fns.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; String builders.
+
+(defun fns-tests-build (&rest pieces)
+  "Append PIECES to a new string builder and return the result.
+Strings are appended with `string-builder-append-string', characters
+with `string-builder-append-char', and floats with
+`string-builder-append-number'."
+  (let ((builder (make-string-builder)))
+    (dolist (piece pieces)
+      (cond ((stringp piece) (string-builder-append-string builder piece))
+	    ((floatp piece) (string-builder-append-number builder piece))
+	    (t (string-builder-append-char builder piece))))
+    (string-builder-finish builder)))
+
+(ert-deftest fns-tests-string-builder ()
+  (let ((builder (make-string-builder)))
+    (should (string-builder-p builder))
+    (should-not (string-builder-p "abc"))
+    (should (equal (string-builder-finish builder) ""))
+    (should (eq (string-builder-append-string builder "abc") builder))
+    (should (eq (string-builder-append-char builder ?d) builder))
+    (should (eq (string-builder-append-number builder 42) builder))
+    (should (eql (string-builder-length builder) 6))
+    (should (equal (string-builder-finish builder) "abcd42"))
+    ;; The builder is empty again, and can be reused.
+    (should (eql (string-builder-length builder) 0))
+    (string-builder-append-string builder "x")
+    (should (equal (string-builder-finish builder) "x"))
+    (should-error (string-builder-append-string builder 'x)
+		  :type 'wrong-type-argument)
+    (should-error (string-builder-append-char builder -1)
+		  :type 'wrong-type-argument)
+    (should-error (string-builder-length "x")
+		  :type 'wrong-type-argument)))
+
+(ert-deftest fns-tests-string-builder-numbers ()
+  (let ((builder (make-string-builder)))
+    (dolist (number (list 0 -1 most-positive-fixnum most-negative-fixnum
+			  0.5 -1.0e+INF 1e100 float-pi))
+      (string-builder-append-number builder number)
+      (should (equal (string-builder-finish builder)
+		     (number-to-string number))))))
+
+(ert-deftest fns-tests-string-builder-multibyte ()
+  ;; Unibyte until a multibyte string or non-ASCII character comes.
+  (should-not (multibyte-string-p (fns-tests-build "abc" ?d)))
+  (should (multibyte-string-p (fns-tests-build "abc" ?é)))
+  (should (equal (fns-tests-build "abc" ?é "ü") "abcéü"))
+  ;; Unibyte text already appended is converted the way `concat'
+  ;; converts it.
+  (let ((raw (string-to-unibyte "\351x")))
+    (should (equal (fns-tests-build raw "é") (concat raw "é")))
+    (should (equal (fns-tests-build "é" raw) (concat "é" raw))))
+  (should (eql (length (fns-tests-build "é" "ü" ?x)) 3))
+  (let ((builder (make-string-builder)))
+    (string-builder-append-string builder "é")
+    (string-builder-append-string builder "abc")
+    (should (eql (string-builder-length builder) 4))))
+
+(ert-deftest fns-tests-string-builder-large ()
+  (let ((builder (make-string-builder 1))
+	pieces)
+    (dotimes (i 10000)
+      (push (format "%d é\n" i) pieces)
+      (string-builder-append-number builder i)
+      (string-builder-append-string builder " ")
+      (string-builder-append-char builder ?é)
+      (string-builder-append-char builder ?\n))
+    (should (equal (string-builder-finish builder)
+		   (apply #'concat (nreverse pieces))))))
+
+(ert-deftest fns-tests-string-builder-ignores-properties ()
+  (should-not (text-properties-at
+	       0 (fns-tests-build (propertize "abc" 'face 'bold)))))
+
+;;; Equal.
+
+(defun fns-tests-deep-list (depth leaf)
+  "Return LEAF nested in DEPTH lists."
+  (dotimes (_ depth leaf)
+    (setq leaf (list leaf))))
+
+(defun fns-tests-deep-vector (depth leaf)
+  "Return LEAF nested in DEPTH vectors and lists, alternately."
+  (dotimes (i depth leaf)
+    (setq leaf (if (zerop (% i 2)) (vector 1 leaf) (list leaf 'a)))))
+
+(ert-deftest fns-tests-equal-deep ()
+  ;; Use `null' rather than `should-not', whose explanation of the
+  ;; difference would recurse through the whole structure.
+  (dolist (depth '(10 1000 100000))
+    (should (equal (fns-tests-deep-list depth 1)
+		   (fns-tests-deep-list depth 1)))
+    (should (null (equal (fns-tests-deep-list depth 1)
+			 (fns-tests-deep-list depth 2))))
+    (should (null (equal (fns-tests-deep-list depth 1)
+			 (fns-tests-deep-list (1+ depth) 1))))
+    (should (equal (fns-tests-deep-vector depth "x")
+		   (fns-tests-deep-vector depth "x")))
+    (should (null (equal (fns-tests-deep-vector depth "x")
+			 (fns-tests-deep-vector depth "y"))))))
+
+(ert-deftest fns-tests-equal-long ()
+  (let ((a (number-sequence 1 100000))
+	(b (number-sequence 1 100000)))
+    (should (equal a b))
+    (setcar (last b) 0)
+    (should-not (equal a b))
+    (should-not (equal a (butlast a))))
+  (let ((a (make-vector 1000 "abc"))
+	(b (make-vector 1000 "abc")))
+    (should (equal a b))
+    (aset b 999 "abd")
+    (should-not (equal a b))
+    (aset b 999 'abc)
+    (should-not (equal a b))
+    (aset b 999 (list "abc"))
+    (should-not (equal a b))))
+
+(ert-deftest fns-tests-equal-shared ()
+  (let* ((tree (fns-tests-deep-vector 20 (list 1 2 3)))
+	 (a (list tree tree tree))
+	 (b (list tree tree (fns-tests-deep-vector 20 (list 1 2 3)))))
+    (should (equal a b))
+    (should (equal (vector a b) (vector b a)))))
+
+(ert-deftest fns-tests-equal-atoms ()
+  (should (equal 0.0 0.0))
+  (should-not (equal 1 1.0))
+  (should (equal (list 1.5 "a" ?b) (list 1.5 "a" ?b)))
+  (should (equal (make-bool-vector 10 t) (make-bool-vector 10 t)))
+  (should-not (equal (make-bool-vector 10 t) (make-bool-vector 11 t)))
+  (should-not (equal [1 2] '(1 2)))
+  (should-not (equal "abc" (string-to-multibyte "\341bc")))
+  (should (equal (point-marker) (point-marker))))
+
+(ert-deftest fns-tests-equal-properties ()
+  (let ((a (list (propertize "abc" 'face 'bold) [x]))
+	(b (list "abc" [x])))
+    (should (equal a b))
+    (should-not (equal-including-properties a b))
+    (should (equal-including-properties
+	     a (list (propertize "abc" 'face 'bold) [x])))))
+
+(ert-deftest fns-tests-equal-circular ()
+  ;; A circular chain of cdrs signals an error.
+  (let ((a (list 1 2 3))
+	(b (list 1 2 3)))
+    (setcdr (cddr a) a)
+    (setcdr (cddr b) b)
+    (should-error (equal a b) :type 'circular-list))
+  ;; Cycles through cars and vector elements terminate.
+  (let ((a (list 1 (vector 2 nil)))
+	(b (list 1 (vector 2 nil)))
+	(c (list 1 (vector 2 nil) 3)))
+    (aset (nth 1 a) 1 a)
+    (aset (nth 1 b) 1 b)
+    (aset (nth 1 c) 1 c)
+    (should (equal a b))
+    (should-not (equal a c))))
+
+;;; Sorting.
+
+(defun fns-tests-sort-data (n keys)
+  "Return a list of N conses (KEY . I), in order of I.
+The keys are below KEYS, and come in ascending and descending runs
+of random lengths, so that the runs get merged with parts skipped."
+  (let (data (i 0))
+    (while (< i n)
+      (let ((run (sort (let (run)
+			 (dotimes (_ (1+ (random 200)) run)
+			   (push (random keys) run)))
+		       #'<)))
+	(when (zerop (random 3))
+	  (setq run (nreverse run)))
+	(dolist (key run)
+	  (when (< i n)
+	    (push (cons key i) data)
+	    (setq i (1+ i))))))
+    (nreverse data)))
+
+(defun fns-tests-sort-reference (data keys)
+  "Return DATA, conses (KEY . I) with KEY below KEYS, sorted stably."
+  (let ((buckets (make-vector keys nil))
+	(key keys)
+	result)
+    (dolist (elt data)
+      (aset buckets (car elt) (cons elt (aref buckets (car elt)))))
+    (while (> key 0)
+      (setq key (1- key))
+      (setq result (nconc (nreverse (aref buckets key)) result)))
+    result))
+
+(ert-deftest fns-tests-sort-stable ()
+  (random "fns-tests")
+  (dolist (n '(0 1 2 10 63 64 65 1000 5000))
+    (dolist (keys '(1 3 1000))
+      (let* ((data (fns-tests-sort-data n keys))
+	     (expected (fns-tests-sort-reference data keys)))
+	(should (equal (sort (copy-sequence data) #'car-less-than-car)
+		       expected))
+	(should (equal (sort (vconcat data) #'car-less-than-car)
+		       (vconcat expected)))
+	(should (equal (sort (copy-sequence data) #'< :key #'car)
+		       expected))
+	(should (equal (sort (vconcat data)
+			     (lambda (a b) (< (car a) (car b))))
+		       (vconcat expected)))))))
+
+(ert-deftest fns-tests-sort-merges ()
+  ;; Long sorted runs that interleave, that follow one another, and
+  ;; that are made of one key, so that merging skips their ends.
+  (let ((data (append (mapcar (lambda (i) (cons i 0)) (number-sequence 0 999))
+		      (mapcar (lambda (i) (cons i 1)) (number-sequence 500 1499))
+		      (mapcar (lambda (i) (cons i 2)) (number-sequence 2000 2999))
+		      (mapcar (lambda (i) (cons 700 i)) (number-sequence 3 1002))
+		      (mapcar (lambda (i) (cons i 3)) (number-sequence 999 0 -1))
+		      (mapcar (lambda (i) (cons i 4)) (number-sequence 0 2999 2)))))
+    (should (equal (sort (copy-sequence data) #'car-less-than-car)
+		   (fns-tests-sort-reference data 3000)))
+    (should (equal (sort (vconcat data) #'car-less-than-car)
+		   (vconcat (fns-tests-sort-reference data 3000))))))
+
+(ert-deftest fns-tests-sort-predicates ()
+  ;; The predicates that are called directly sort like the same
+  ;; predicates called through a lambda.
+  (random "fns-tests")
+  (let ((numbers (let (l)
+		   (dotimes (i 2000 l)
+		     (push (if (zerop (% i 3))
+			       (/ (random 1000) 10.0)
+			     (- (random 200) 100))
+			   l))))
+	(strings (let (l)
+		   (dotimes (_ 2000 l)
+		     (push (format "%c%d" (+ ?a (random 3)) (random 50)) l))))
+	(conses (let (l)
+		  (dotimes (i 2000 l)
+		    (push (cons (random 100) i) l)))))
+    (dolist (case `((< ,numbers) (> ,numbers) (string-lessp ,strings)
+		    (string< ,strings) (car-less-than-car ,conses)))
+      (let* ((predicate (car case))
+	     (wrapped (lambda (a b) (funcall predicate a b)))
+	     (seq (cadr case))
+	     (expected (sort (copy-sequence seq) wrapped)))
+	(should (equal (sort (copy-sequence seq) predicate) expected))
+	(should (equal (sort (vconcat seq) predicate) (vconcat expected)))))
+    ;; Mixed fixnums and floats that compare equal keep their order.
+    (should (equal (sort (list 2 1.0 1 2.0 0) #'<) '(0 1.0 1 2 2.0)))
+    (should (equal (sort (list 1 2.0 2 1.0) #'>) '(2.0 2 1 1.0)))
+    (should-error (sort (list 1 'a) #'<) :type 'wrong-type-argument)))
+
+(ert-deftest fns-tests-sort-key ()
+  (let ((calls 0))
+    (should (equal (sort (list "bb" "a" "ccc" "dd")
+			 #'< :key (lambda (s) (setq calls (1+ calls))
+				    (length s)))
+		   '("a" "bb" "dd" "ccc")))
+    (should (eql calls 4)))
+  (should (equal (sort (vector '(2 . a) '(1 . b) '(2 . c)) #'< :key #'car)
+		 [(1 . b) (2 . a) (2 . c)]))
+  (should (equal (sort (list 3 1 2) #'< :key nil) '(1 2 3)))
+  (should (equal (sort [] #'<) []))
+  (should (equal (sort nil #'<) nil))
+  (should-error (sort (list 1) #'< :foo 1))
+  (should-error (sort (list 1) #'< :key))
+  (should-error (sort "abc" #'<) :type 'wrong-type-argument))
+
+(ert-deftest fns-tests-sort-nonlocal-exit ()
+  ;; A predicate or key that exits nonlocally leaves the sequence
+  ;; with all its elements.
+  (let* ((original (number-sequence 1 500))
+	 (list (copy-sequence (reverse original)))
+	 (vector (vconcat (reverse original))))
+    (dolist (seq (list list vector))
+      (let ((calls 0))
+	(should (eq (catch 'fns-tests
+		      (sort seq (lambda (a b)
+				  (when (> (setq calls (1+ calls)) 300)
+				    (throw 'fns-tests 'thrown))
+				  (< a b))))
+		    'thrown)))
+      (should (equal (sort (append seq nil) #'<) original))
+      (let ((calls 0))
+	(should-error (sort seq #'<
+			    :key (lambda (x)
+				   (when (> (setq calls (1+ calls)) 100)
+				     (error "Key failed"))
+				   x))))
+      (should (equal (sort (append seq nil) #'<) original)))))
+
+(ert-deftest fns-tests-sort-gc ()
+  ;; The garbage collector may run while the predicate is called, and
+  ;; must not free the arrays used for sorting.  Large ones are
+  ;; allocated separately from small vectors.
+  (dolist (n '(100 3000))
+    (let ((list (number-sequence n 1 -1))
+	  (calls 0))
+      (dolist (seq (list (copy-sequence list) (vconcat list)))
+	(should (equal (append (sort seq
+				     (lambda (a b)
+				       (when (zerop (% (setq calls (1+ calls))
+						       500))
+					 (garbage-collect))
+				       (< (car a) (car b)))
+				     :key #'list)
+			       nil)
+		       (number-sequence 1 n)))))))
+
+(ert-deftest fns-tests-cl-sort ()
+  (require 'cl-lib)
+  (should (equal (cl-sort (list '(2 . a) '(1 . b) '(2 . c)) #'< :key #'car)
+		 '((1 . b) (2 . a) (2 . c))))
+  (should (equal (cl-sort (vector '(2 . a) '(1 . b) '(2 . c)) #'< :key #'car)
+		 [(1 . b) (2 . a) (2 . c)]))
+  (should (equal (cl-sort (list "bb" "a" "ccc") #'< :key #'length)
+		 '("a" "bb" "ccc")))
+  (should (equal (cl-sort (list 3 1 2) #'> :key #'identity) '(3 2 1)))
+  (should (equal (cl-sort (vector 3 1 2) #'<) [1 2 3]))
+  (should (equal (cl-sort (copy-sequence "cab") #'<) "abc")))
+
+;;; Hash tables.
+
+(defun fns-tests-hash-key (test i)
+  "Return a new key number I for a hash table with TEST.
+Keys with the same number are equal for TEST, and keys with different
+numbers are not."
+  (cond ((eq test 'eq)
+	 (if (zerop (% i 2)) i (intern (format "fns-tests-%d" i))))
+	((eq test 'eql)
+	 (if (zerop (% i 2)) (* i 1.5) i))
+	(t
+	 (if (zerop (% i 2)) (format "k%d" i) (list i (format "%d" i))))))
+
+(defun fns-tests-hash-alist (table)
+  "Return the entries of TABLE as an alist, sorted."
+  (let (alist)
+    (maphash (lambda (key value) (push (cons key value) alist)) table)
+    (sort alist (lambda (a b)
+		  (string< (prin1-to-string a) (prin1-to-string b))))))
+
+(defun fns-tests-hash-model-alist (test model)
+  "Return the entries of MODEL, a vector of values or nil, as an alist.
+The keys are those of a hash table with TEST.  The alist is sorted."
+  (let (alist)
+    (dotimes (i (length model))
+      (when (aref model i)
+	(push (cons (fns-tests-hash-key test i) (aref model i)) alist)))
+    (sort alist (lambda (a b)
+		  (string< (prin1-to-string a) (prin1-to-string b))))))
+
+(defun fns-tests-hash-lookups (test table)
+  "Return the values of the keys of a hash table with TEST in TABLE.
+Return a vector of the values of all keys numbered below 3000, with
+`none' for those that are missing."
+  (let ((values (make-vector 3000 nil)))
+    (dotimes (i 3000)
+      (aset values i (gethash (fns-tests-hash-key test i) table 'none)))
+    values))
+
+(ert-deftest fns-tests-hash-table-churn ()
+  (random "fns-tests")
+  (dolist (test '(eq eql equal))
+    (let ((table (make-hash-table :test test :size 8))
+	  (model (make-vector 3000 nil)))
+      (dotimes (step 30000)
+	;; Grow the table at first, then keep its size about constant,
+	;; so that removed entries are reused.
+	(let ((i (random (if (< step 10000) (1+ (/ step 4)) 3000))))
+	  (if (zerop (random (if (< step 10000) 4 2)))
+	      (progn
+		(remhash (fns-tests-hash-key test i) table)
+		(aset model i nil))
+	    (puthash (fns-tests-hash-key test i) step table)
+	    (aset model i step)))
+	(when (zerop (% step 5000))
+	  (should (equal (fns-tests-hash-alist table)
+			 (fns-tests-hash-model-alist test model)))))
+      (let ((alist (fns-tests-hash-model-alist test model))
+	    (count 0))
+	(should (eql (hash-table-count table) (length alist)))
+	(maphash (lambda (_key _value) (setq count (1+ count))) table)
+	(should (eql count (length alist)))
+	(should (equal (fns-tests-hash-lookups test table)
+		       (vconcat (mapcar (lambda (value) (or value 'none))
+					model))))
+	;; A copy is independent of the original.
+	(let ((copy (copy-hash-table table)))
+	  (should (equal (fns-tests-hash-alist copy) alist))
+	  (dotimes (i 3000)
+	    (if (zerop (% i 2))
+		(remhash (fns-tests-hash-key test i) copy)
+	      (puthash (fns-tests-hash-key test i) 'copy copy)))
+	  (should (equal (fns-tests-hash-alist table) alist))
+	  (let ((expected (make-vector 3000 'copy)))
+	    (dotimes (i 1500)
+	      (aset expected (* i 2) 'none))
+	    (should (equal (fns-tests-hash-lookups test copy) expected))))
+	;; A cleared table can be filled again.
+	(clrhash table)
+	(should (eql (hash-table-count table) 0))
+	(should-not (fns-tests-hash-alist table))
+	(dotimes (i 3000)
+	  (puthash (fns-tests-hash-key test i) i table))
+	(should (eql (hash-table-count table) 3000))
+	(should (equal (fns-tests-hash-lookups test table)
+		       (vconcat (number-sequence 0 2999))))))))
+
+;;; Sxhash.
+
+(defun fns-tests-sxhash-copy (object)
+  "Return a copy of OBJECT that is `equal' to it but shares nothing.
+Strings, floats, lists and all kinds of vectors are copied, at all
+levels."
+  (cond ((stringp object)
+	 (let ((copy (copy-sequence object)))
+	   (set-text-properties 0 (length copy) nil copy)
+	   copy))
+	((floatp object) (* object 1.0))
+	((consp object)
+	 (cons (fns-tests-sxhash-copy (car object))
+	       (fns-tests-sxhash-copy (cdr object))))
+	((vectorp object) (vconcat (mapcar #'fns-tests-sxhash-copy object)))
+	((or (bool-vector-p object) (numeric-vector-p object))
+	 (copy-sequence object))
+	(t object)))
+
+(defvar fns-tests-sxhash-objects
+  (let ((nan (/ 0.0 0.0))
+	(long (make-string 100 ?x)))
+    (list
+     ;; Strings, whose hash codes are computed eight bytes at a time
+     ;; and in several lanes for the longer ones.
+     "" "a" "abcdefg" "abcdefgh" "abcdefghi" long (concat long "y")
+     (make-string 47 ?y) (make-string 48 ?y) (make-string 49 ?y)
+     (make-string 1000 ?z) "\351\0\377"
+     ;; Multibyte strings.
+     "é" "aé" "日本語" (make-string 50 ?é) (concat long "é")
+     (string-to-multibyte "abc") (string-to-multibyte long)
+     ;; Strings with text properties.
+     (propertize "abc" 'face 'bold)
+     (concat (propertize "ab" 'face 'bold) "cd" (propertize "é" 'x 1))
+     ;; Floats, including those that are `equal' without being `eql'.
+     1.5 (/ 1.0 3) 1e300 -1e-300 0.0 -0.0 nan (- nan)
+     ;; Symbols and integers.
+     'a nil t 0 -1 most-positive-fixnum most-negative-fixnum
+     ;; Lists and vectors, nested and long.
+     '(1 . 2) '("a" 1.5 (b . "c")) (list (list (list "deep" (list 1.0))))
+     (list "a" (vector "b" (list "c" (vector 0.0 "é"))))
+     [] ["a" 1.5] (vector (vector (vector "x" -0.0)))
+     (number-sequence 1 100) (mapcar #'number-to-string (number-sequence 1 50))
+     (make-list 40 "same") (vconcat (make-list 40 (list "x" 2.5)))
+     (make-bool-vector 10 t) (make-bool-vector 100 nil)
+     (numeric-vector 'float64 1.5 -0.0 nan)
+     (numeric-vector 'int32 1 2 3)))
+  "Objects whose `equal' copies must have the same hash codes.")
+
+(ert-deftest fns-tests-sxhash-equal ()
+  (let ((nan (/ 0.0 0.0))
+	(pairs (mapcar (lambda (object)
+			 (cons object (fns-tests-sxhash-copy object)))
+		       fns-tests-sxhash-objects))
+	mismatches)
+    ;; Floats and numeric vectors of floats are compared with `=', and
+    ;; all NaNs are `equal'.  Text properties and the multibyteness of
+    ;; ASCII strings do not matter either.
+    (setq pairs (append (list (cons 0.0 -0.0) (cons nan (- nan))
+			      (cons (numeric-vector 'float64 0.0 nan)
+				    (numeric-vector 'float64 -0.0 (- nan)))
+			      (cons (list 0.0 (vector nan))
+				    (list -0.0 (vector (- nan))))
+			      (cons "abc" (string-to-multibyte "abc"))
+			      (cons "abc" (propertize "abc" 'face 'bold)))
+			pairs))
+    (dolist (pair pairs)
+      (unless (and (equal (car pair) (cdr pair))
+		   (eql (sxhash (car pair)) (sxhash (cdr pair))))
+	(push pair mismatches)))
+    (should (null mismatches))))
+
+(ert-deftest fns-tests-sxhash-hash-table ()
+  (let ((table (make-hash-table :test 'equal))
+	(objects fns-tests-sxhash-objects)
+	missing)
+    (dotimes (i (length objects))
+      (puthash (nth i objects) i table))
+    (dotimes (i (length objects))
+      (unless (eql (gethash (fns-tests-sxhash-copy (nth i objects)) table)
+		   (or (gethash (nth i objects) table) 'none))
+	(push (nth i objects) missing)))
+    (should (null missing))
+    (should (eql (gethash -0.0 table) (gethash 0.0 table)))
+    (should (eql (gethash (numeric-vector 'float64 1.5 0.0 (/ 0.0 0.0))
+			  table)
+		 (gethash (numeric-vector 'float64 1.5 -0.0 (- (/ 0.0 0.0)))
+			  table)))))
+
+;;; Weak hash tables.
+
+;; The stack is scanned conservatively, so these tests do not hold the
+;; keys and values of the tables in local variables: stale copies in
+;; the frames of the interpreter could keep them alive.  Instead, the
+;; helpers below make the objects and choose which of them to keep.
+
+(defvar fns-tests-weak-kept nil
+  "The objects that the weak hash table tests keep alive.")
+
+(defun fns-tests-weak-keep (table function)
+  "Keep the keys and values of TABLE for which FUNCTION is non-nil.
+Stop keeping the objects kept before.  Return nil."
+  (let (kept)
+    (maphash (lambda (key value)
+	       (when (funcall function key)
+		 (push key kept))
+	       (when (funcall function value)
+		 (push value kept)))
+	     table)
+    (setq fns-tests-weak-kept kept)
+    nil))
+
+(defun fns-tests-weak-table (weak n chain function)
+  "Return a hash table with WEAK holding N entries.
+Entry I maps (key I) to (value I).  If CHAIN is non-nil, it maps
+\(key I) to (key I+1) instead, except for the last entry.  Keep
+the keys and values for which FUNCTION is non-nil, as
+`fns-tests-weak-keep' does."
+  (let ((table (make-hash-table :test 'eq :weakness weak))
+	(objects nil)
+	(next (list 'value (1- n))))
+    ;; Keep all the objects until the table is complete.
+    (dotimes (i n)
+      (let ((key (list 'key (- n i 1))))
+	(puthash key (if chain next (list 'value (- n i 1))) table)
+	(push key objects)
+	(push (gethash key table) objects)
+	(setq next key)))
+    (fns-tests-weak-keep table function)
+    table))
+
+(defun fns-tests-weak-clobber (depth)
+  "Recurse DEPTH times, overwriting the stack below the caller."
+  (let ((n (* depth 2)))
+    (if (> depth 0)
+	(fns-tests-weak-clobber (1- depth))
+      n)))
+
+(defun fns-tests-weak-count (table)
+  "Return the number of entries of TABLE after a garbage collection."
+  ;; Stale pointers left on the stack by earlier calls could keep
+  ;; dropped objects alive.
+  (fns-tests-weak-clobber 50)
+  (garbage-collect)
+  (hash-table-count table))
+
+(ert-deftest fns-tests-weak-key-chain ()
+  ;; Each entry keeps alive the key of the next one, so the whole
+  ;; chain survives as long as its first key does.
+  (let ((table (fns-tests-weak-table 'key 1000 t
+				     (lambda (x) (equal x '(key 0))))))
+    (should (eql (fns-tests-weak-count table) 1000))
+    (should (eql (fns-tests-weak-count table) 1000))
+    (fns-tests-weak-keep table (lambda (x) (equal x '(key 500))))
+    (should (eql (fns-tests-weak-count table) 500))
+    (fns-tests-weak-keep table #'ignore)
+    (should (eql (fns-tests-weak-count table) 0))))
+
+(ert-deftest fns-tests-weak-key-or-value ()
+  ;; An entry survives if its key or its value does, and then keeps
+  ;; both alive.  Keeping the last key of a chain keeps the entry
+  ;; mapping to it, and so on back to the first entry.  Keeping a key
+  ;; in the middle keeps the entries on both sides.
+  (let ((table (fns-tests-weak-table 'key-or-value 1000 t
+				     (lambda (x) (equal x '(key 999))))))
+    (should (eql (fns-tests-weak-count table) 1000))
+    (fns-tests-weak-keep table (lambda (x) (equal x '(key 500))))
+    (should (eql (fns-tests-weak-count table) 1000))
+    (fns-tests-weak-keep table #'ignore)
+    (should (eql (fns-tests-weak-count table) 0)))
+  (let ((table (fns-tests-weak-table 'key-or-value 100 nil
+				     (lambda (x)
+				       (if (eq (car x) 'key)
+					   (< (cadr x) 30)
+					 (>= (cadr x) 70))))))
+    (should (eql (fns-tests-weak-count table) 60))
+    (fns-tests-weak-keep table (lambda (x) (eq (car x) 'value)))
+    (should (eql (fns-tests-weak-count table) 60))
+    (fns-tests-weak-keep table #'ignore)
+    (should (eql (fns-tests-weak-count table) 0))))
+
+(ert-deftest fns-tests-weak-key-and-value ()
+  ;; An entry survives only if both its key and its value do, and it
+  ;; keeps neither alive.
+  (let ((table (fns-tests-weak-table 'key-and-value 1000 t #'identity)))
+    (should (eql (fns-tests-weak-count table) 1000))
+    ;; Dropping every other key removes the entries mapping to it and
+    ;; from it.
+    (fns-tests-weak-keep table (lambda (x) (zerop (% (cadr x) 2))))
+    (should (eql (fns-tests-weak-count table) 0)))
+  (let ((table (fns-tests-weak-table 'key-and-value 100 nil
+				     (lambda (x)
+				       (or (eq (car x) 'key)
+					   (>= (cadr x) 50))))))
+    (should (eql (fns-tests-weak-count table) 50))
+    (fns-tests-weak-keep table (lambda (x) (< (cadr x) 90)))
+    (should (eql (fns-tests-weak-count table) 40))
+    (fns-tests-weak-keep table #'ignore)
+    (should (eql (fns-tests-weak-count table) 0))))
+
+;;; fns-tests.el ends here
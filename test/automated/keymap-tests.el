@@ -0,0 +1,136 @@
+;;; keymap-tests.el --- Tests for keymap.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; Hash tables in keymaps.
+
+(defun keymap-tests-make (hash)
+  "Return a keymap with a few bindings.
+If HASH is non-nil, the keymap keeps its bindings in a hash table."
+  (let ((map (make-sparse-keymap nil hash)))
+    (define-key map "a" 'keymap-tests-a)
+    (define-key map "b" 'keymap-tests-a)
+    (define-key map "c" 'keymap-tests-a)
+    (define-key map [f5] 'keymap-tests-f5)
+    (define-key map [C-f5] 'keymap-tests-f5)
+    (define-key map "\C-xq" 'keymap-tests-q)
+    (define-key map [remap kill-line] 'keymap-tests-kill)
+    map))
+
+(ert-deftest keymap-tests-hash-table-lookup ()
+  (let ((map (keymap-tests-make t)))
+    (should (hash-table-p (cadr map)))
+    (should (eq (lookup-key map "a") 'keymap-tests-a))
+    (should (eq (lookup-key map [f5]) 'keymap-tests-f5))
+    (should (eq (lookup-key map "\C-xq") 'keymap-tests-q))
+    (should (keymapp (lookup-key map "\C-x")))
+    (should (eq (lookup-key map "\C-xqz") 2))
+    (should-not (lookup-key map "d"))
+    (should (eq (command-remapping 'kill-line nil (list map))
+		'keymap-tests-kill))
+    (define-key map "a" nil)
+    (should-not (lookup-key map "a"))
+    (define-key map [t] 'keymap-tests-default)
+    (should (eq (lookup-key map "d" t) 'keymap-tests-default))
+    (should-not (lookup-key map "d"))))
+
+(defun keymap-tests-sort (list)
+  "Sort LIST by the printed representation of its elements."
+  (sort list (lambda (a b) (string< (prin1-to-string a) (prin1-to-string b)))))
+
+(defun keymap-tests-commands (map)
+  "Return the events and commands that `map-keymap' finds in MAP."
+  (let (bindings)
+    (map-keymap (lambda (event binding)
+		  (unless (keymapp binding)
+		    (push (cons event binding) bindings)))
+		map)
+    (keymap-tests-sort bindings)))
+
+(ert-deftest keymap-tests-hash-table-like-alist ()
+  (let ((hashed (keymap-tests-make t))
+	(alist (keymap-tests-make nil)))
+    (should (equal (keymap-tests-commands hashed)
+		   (keymap-tests-commands alist)))
+    (should (equal (keymap-tests-sort
+		    (where-is-internal 'keymap-tests-a hashed))
+		   '([?a] [?b] [?c])))
+    (should (equal (where-is-internal 'keymap-tests-q hashed)
+		   '([24 113])))
+    (should (equal (keymap-tests-sort
+		    (mapcar #'car (accessible-keymaps hashed)))
+		   (keymap-tests-sort
+		    (mapcar #'car (accessible-keymaps alist)))))))
+
+(ert-deftest keymap-tests-hash-table-copy ()
+  (let* ((map (keymap-tests-make t))
+	 (copy (copy-keymap map)))
+    (define-key copy "a" 'keymap-tests-other)
+    (define-key copy "\C-xq" 'keymap-tests-other)
+    (should (eq (lookup-key map "a") 'keymap-tests-a))
+    (should (eq (lookup-key map "\C-xq") 'keymap-tests-q))
+    (should (eq (lookup-key copy "a") 'keymap-tests-other))
+    (should (eq (lookup-key copy "\C-xq") 'keymap-tests-other))))
+
+(ert-deftest keymap-tests-hash-table-range ()
+  (let ((map (make-sparse-keymap nil t)))
+    (define-key map "b" 'keymap-tests-b)
+    (define-key map [(?a . ?z)] 'keymap-tests-letter)
+    (should (eq (lookup-key map "b") 'keymap-tests-letter))
+    (should (eq (lookup-key map "q") 'keymap-tests-letter))
+    (should-not (lookup-key map "A"))))
+
+(defvar keymap-tests-map)
+
+(defun keymap-tests-describe (map)
+  "Return the description of MAP made by `substitute-command-keys'.
+The lines are sorted, since the order of prefix keys depends on the
+order of the bindings in MAP."
+  (let ((keymap-tests-map map))
+    (mapconcat #'identity
+	       (sort (split-string (substitute-command-keys
+				    "\\{keymap-tests-map}")
+				   "\n" t)
+		     #'string<)
+	       "\n")))
+
+(ert-deftest keymap-tests-hash-table-describe ()
+  (let ((alist (keymap-tests-describe (keymap-tests-make nil))))
+    (should (string-match "^a \\.\\. c\t+keymap-tests-a$" alist))
+    (should (string-match "^<remap> <kill-line>\t+keymap-tests-kill$" alist))
+    (should (string-match "^<f5>\t+keymap-tests-f5$" alist))
+    (should (string-match "^C-x q\t+keymap-tests-q$" alist))
+    (should (equal (keymap-tests-describe (keymap-tests-make t)) alist))
+    ;; `keymap-canonicalize' normally turns the table into an alist
+    ;; before the bindings are described.  Check that the table is
+    ;; described the same way without it.
+    (let ((canonicalize (symbol-function 'keymap-canonicalize)))
+      (unwind-protect
+	  (progn
+	    (fset 'keymap-canonicalize #'identity)
+	    (should (equal (keymap-tests-describe (keymap-tests-make t))
+			   alist)))
+	(fset 'keymap-canonicalize canonicalize)))))
+
+;;; keymap-tests.el ends here
@@ -0,0 +1,81 @@
+;;; lread-tests.el --- Tests for lread.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; Load directory index.
+
+(defun lread-tests-set-old (dir &optional hours)
+  "Set the modification time of DIR to HOURS hours ago, 1 by default.
+The index only keeps the listings of directories that did not change
+lately."
+  (let ((then (- (floor (float-time)) (* 3600 (or hours 1)))))
+    (set-file-times dir (list (floor then 65536) (mod then 65536)))))
+
+(defmacro lread-tests-with-directory (var files &rest body)
+  "Bind VAR to a new temporary directory holding FILES, and run BODY.
+The directory is made to look old, and is deleted afterwards."
+  (declare (indent 2))
+  `(let ((,var (make-temp-file "lread-tests" t)))
+     (unwind-protect
+	 (progn
+	   (dolist (file ,files)
+	     (write-region "" nil (expand-file-name file ,var) nil 'silent))
+	   (lread-tests-set-old ,var)
+	   ,@body)
+       (delete-directory ,var t))))
+
+(ert-deftest lread-tests-load-directory-index ()
+  (lread-tests-with-directory dir '("lread-a.el" "lread-b.elc")
+    (let ((load-directory-index (make-hash-table :test 'equal))
+	  (suffixes '(".elc" ".el" "")))
+      (should (equal (locate-file "lread-a" (list dir) suffixes)
+		     (expand-file-name "lread-a.el" dir)))
+      (should (equal (locate-file "lread-b" (list dir) suffixes)
+		     (expand-file-name "lread-b.elc" dir)))
+      (should (gethash dir load-directory-index))
+      (should-not (locate-file "lread-c" (list dir) suffixes))
+      ;; A file added after the directory was indexed is found once
+      ;; the modification time of the directory changes.
+      (write-region "" nil (expand-file-name "lread-c.el" dir) nil 'silent)
+      (lread-tests-set-old dir 2)
+      (should (equal (locate-file "lread-c" (list dir) suffixes)
+		     (expand-file-name "lread-c.el" dir)))
+      ;; A missing directory is skipped.
+      (should (equal (locate-file "lread-a"
+				  (list (expand-file-name "missing" dir) dir)
+				  suffixes)
+		     (expand-file-name "lread-a.el" dir))))))
+
+(ert-deftest lread-tests-load-directory-index-quoted ()
+  (lread-tests-with-directory dir '("lread-a.el")
+    (let ((file-name-handler-alist nil)
+	  (quoted (concat "/:" dir))
+	  (found (expand-file-name "lread-a.el" dir)))
+      (dolist (load-directory-index
+	       (list nil (make-hash-table :test 'equal)))
+	(should (equal (locate-file "lread-a" (list quoted) '(".el"))
+		       found))
+	(should-not (locate-file "lread-b" (list quoted) '(".el")))))))
+
+;;; lread-tests.el ends here
@@ -0,0 +1,143 @@
+;;; minibuf-tests.el --- Tests for minibuf.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; Completion indexes.
+
+(defvar minibuf-tests-candidates
+  '("foo" "foobar" "foobaz" "Foo" "FOOBAR" "fo" "bar" "barfoo" ""
+    "été" "Été" "étage" "x-y-z" "x-y" "abc" "abc")
+  "Possible completions, with case variants, duplicates and non-ASCII.")
+
+(defun minibuf-tests-strings (candidates)
+  "Return strings to complete against CANDIDATES.
+These are all the prefixes of the candidates, in lower and upper case,
+and a few strings that match nothing."
+  (let ((strings (list "" "q" "foobarx" "ÉTÉ")))
+    (dolist (candidate candidates)
+      (dotimes (i (1+ (length candidate)))
+	(let ((prefix (substring candidate 0 i)))
+	  (push prefix strings)
+	  (push (upcase prefix) strings)
+	  (push (downcase prefix) strings))))
+    (delete-dups strings)))
+
+(defun minibuf-tests-check-index (collection &optional predicate strings)
+  "Check that an index of COLLECTION completes the way COLLECTION does.
+PREDICATE is passed to the completion functions.  STRINGS are the
+strings to complete, and default to all those that matter."
+  (let ((index (make-completion-index collection))
+	(strings (or strings
+		     (minibuf-tests-strings minibuf-tests-candidates))))
+    (should (completion-index-p index))
+    (dolist (completion-ignore-case '(nil t))
+      (dolist (string strings)
+	(should (equal (list string
+			     (try-completion string index predicate))
+		       (list string
+			     (try-completion string collection predicate))))
+	(should (equal (list string
+			     (test-completion string index predicate))
+		       (list string
+			     (test-completion string collection predicate))))
+	;; An index returns all the completions in sorted order, but
+	;; ignoring case if `completion-ignore-case' is non-nil.
+	(let ((all (all-completions string index predicate)))
+	  (unless completion-ignore-case
+	    (should (equal all (sort (copy-sequence all) #'string<))))
+	  (should (equal (list string (sort all #'string<))
+			 (list string
+			       (sort (all-completions string collection
+						      predicate)
+				     #'string<)))))))))
+
+(ert-deftest minibuf-tests-completion-index-list ()
+  (minibuf-tests-check-index minibuf-tests-candidates)
+  (minibuf-tests-check-index minibuf-tests-candidates
+			     (lambda (s) (> (length s) 3)))
+  (let ((completion-regexp-list '("o" "\\`[^b]")))
+    (minibuf-tests-check-index minibuf-tests-candidates))
+  (minibuf-tests-check-index nil)
+  (should-not (all-completions "" (make-completion-index nil)))
+  (should-not (completion-index-p minibuf-tests-candidates)))
+
+(ert-deftest minibuf-tests-completion-index-alist ()
+  (let ((alist (let ((i 0))
+		 (mapcar (lambda (s) (cons (if (zerop (% (setq i (1+ i)) 3))
+					       (intern s)
+					     s)
+					   i))
+			 minibuf-tests-candidates))))
+    (minibuf-tests-check-index alist)
+    ;; The predicate is called with the elements of the alist.
+    (minibuf-tests-check-index alist (lambda (elt) (= (% (cdr elt) 2) 1)))))
+
+(ert-deftest minibuf-tests-completion-index-obarray ()
+  (let ((ob (make-vector 7 0)))
+    (dolist (s minibuf-tests-candidates)
+      (intern s ob))
+    ;; `test-completion' on an obarray does not ignore the case of
+    ;; non-ASCII strings, so only compare ASCII strings.
+    (let ((strings (delq nil (mapcar (lambda (s)
+				       (unless (multibyte-string-p s) s))
+				     (minibuf-tests-strings
+				      minibuf-tests-candidates)))))
+      (minibuf-tests-check-index ob nil strings)
+      (minibuf-tests-check-index
+       ob (lambda (sym) (> (length (symbol-name sym)) 2)) strings))))
+
+(ert-deftest minibuf-tests-completion-index-hash-table ()
+  (let ((table (make-hash-table :test 'equal))
+	(i 0))
+    (dolist (s minibuf-tests-candidates)
+      (puthash s (setq i (1+ i)) table))
+    (minibuf-tests-check-index table)
+    ;; The predicate is called with the key and the value.
+    (minibuf-tests-check-index table (lambda (_key value) (zerop (% value 2))))))
+
+(ert-deftest minibuf-tests-completion-index-snapshot ()
+  (let* ((list (list "abc" "abd"))
+	 (index (make-completion-index list)))
+    (setcar list "xyz")
+    (should (equal (all-completions "ab" index) '("abc" "abd")))
+    (should (equal (try-completion "ab" index) "ab"))
+    (should (eq (try-completion "abc" index) t))))
+
+(ert-deftest minibuf-tests-completion-index-flex ()
+  (let ((index (make-completion-index '("find-file" "diff" "ff" "FF"))))
+    (should (equal (completion-index-flex-matches "ff" index)
+		   '("ff" "diff" "find-file")))
+    (let ((completion-ignore-case t))
+      (should (equal (sort (completion-index-flex-matches "ff" index)
+			   #'string<)
+		     '("FF" "diff" "ff" "find-file"))))
+    (should (equal (completion-index-flex-matches
+		    "ff" index (lambda (s) (> (length s) 2)))
+		   '("diff" "find-file")))
+    (should (eql (length (completion-index-flex-matches "" index)) 4))
+    (should-not (completion-index-flex-matches "fff" index))
+    (should-error (completion-index-flex-matches "ff" '("ff"))
+		  :type 'wrong-type-argument)))
+
+;;; minibuf-tests.el ends here
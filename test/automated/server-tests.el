@@ -0,0 +1,96 @@
+;;; server-tests.el --- Tests for server.el and emacsclient.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+(require 'server)
+
+(defvar server-tests-emacsclient
+  (expand-file-name "emacsclient" exec-directory)
+  "File name of the emacsclient program to run.")
+
+(defmacro server-tests-with-server (&rest body)
+  "Run BODY with a server listening on a socket in a temporary directory."
+  (declare (indent 0))
+  `(let* ((server-socket-dir (file-name-as-directory
+			      (make-temp-file "server-tests" t)))
+	  (server-name "server-tests")
+	  (server-use-tcp nil)
+	  (server-log nil)
+	  (file-name-coding-system 'utf-8)
+	  (server-process nil))
+     (unwind-protect
+	 (progn
+	   (server-start)
+	   ,@body)
+       (server-start t)
+       (delete-directory server-socket-dir t))))
+
+(defun server-tests-stream (lines count)
+  "Send LINES to an `emacsclient --stream' and return its output.
+Wait for COUNT lines of output, which include those written on
+standard error.  Give up after 30 seconds."
+  (with-temp-buffer
+    (let* ((process-connection-type nil)
+	   (coding-system-for-read 'utf-8-unix)
+	   (coding-system-for-write 'utf-8-unix)
+	   (proc (start-process "emacsclient" (current-buffer)
+				server-tests-emacsclient
+				"-s" (expand-file-name server-name
+						       server-socket-dir)
+				"--stream"))
+	   (deadline (+ (float-time) 30)))
+      (unwind-protect
+	  (progn
+	    (dolist (line lines)
+	      (process-send-string proc (concat line "\n")))
+	    (process-send-eof proc)
+	    (while (and (< (count-lines (point-min) (point-max)) count)
+			(< (float-time) deadline))
+	      (accept-process-output nil 0.05))
+	    (buffer-string))
+	(delete-process proc)))))
+
+;;; Stream mode.
+
+(ert-deftest server-tests-stream ()
+  (should (file-executable-p server-tests-emacsclient))
+  (server-tests-with-server
+    (let ((long (make-string 100000 ?x)))
+      (should (equal (server-tests-stream
+		      (list "(+ 1 2)"
+			    ""
+			    "(car 1)"
+			    (format "(length %S)" long)
+			    "(concat \"a\" \"\\n\" \"é\")"
+			    "'(1 . \"2,3\")"
+			    (format "(substring %S 99998)" long))
+		      7)
+		     (concat "3\n"
+			     "*ERROR*: Wrong type argument: listp, 1\n"
+			     "\n"
+			     "100000\n"
+			     "\"a\\né\"\n"
+			     "(1 . \"2,3\")\n"
+			     "\"xx\"\n"))))))
+
+;;; server-tests.el ends here
@@ -0,0 +1,47 @@
+;;; subr-tests.el --- Tests for subr.el.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; Events.
+
+(ert-deftest subr-tests-event-line-count ()
+  (let ((position (list (selected-window) 1 '(0 . 0) 0)))
+    ;; Events that were not combined stand for one event each.
+    (should (= (event-line-count 'wheel-up) 1))
+    (should (= (event-line-count (list 'wheel-up position)) 1))
+    (should (= (event-line-count (list 'double-wheel-down position 2)) 1))
+    (should (= (event-line-count (list 'mouse-4 position)) 1))
+    (should (= (event-line-count (list 'mouse-1 position 3)) 1))
+    ;; Combined events record their count after the click count.
+    (should (= (event-line-count (list 'wheel-up position 1 3)) 3))
+    (should (= (event-line-count (list 'triple-wheel-down position 3 7)) 7))
+    (should (= (event-line-count (list 'S-wheel-left position 1 2)) 2))
+    (should (= (event-line-count (list 'mouse-5 position 1 12)) 12))
+    ;; The count does not change the click count or the position.
+    (let ((event (list 'double-wheel-up position 2 5)))
+      (should (= (event-click-count event) 2))
+      (should (eq (event-start event) position))
+      (should (eq (event-end event) position)))))
+
+;;; subr-tests.el ends here
@@ -0,0 +1,208 @@
+;;; xdisp-tests.el --- Tests for xdisp.c.
+
+;; Copyright (C) 2012  Free Software Foundation, Inc.
+
+;; Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;;; Cached mode line constructs.
+
+;; `format-mode-line' returns an empty string in batch mode, so the
+;; tests then run it in another Emacs displaying on a terminal.
+
+(defvar xdisp-tests-file (or load-file-name buffer-file-name)
+  "The file of these tests.")
+
+(defun xdisp-tests-write-value (file function)
+  "Write the value of calling FUNCTION to FILE, and exit Emacs."
+  (let ((value (condition-case err
+		   (funcall function)
+		 (error (list 'error err))))
+	(temp (concat file ".tmp")))
+    (with-temp-file temp
+      (let ((print-length nil)
+	    (print-level nil))
+	(prin1 value (current-buffer))))
+    (rename-file temp file)
+    (kill-emacs 0)))
+
+(defun xdisp-tests-call-with-display (function)
+  "Call FUNCTION in an Emacs that displays mode lines.
+Return the value of FUNCTION, or nil if it could not be called.  In
+batch mode, call FUNCTION in an Emacs displaying on a terminal, and
+read back its value.  Give up if that Emacs exits without a value,
+or after 60 seconds."
+  (if (not noninteractive)
+      (funcall function)
+    (let* ((file (make-temp-name
+		  (expand-file-name "xdisp-tests" temporary-file-directory)))
+	   (process-connection-type t)
+	   (process-environment (cons "TERM=xterm" process-environment))
+	   (proc (start-process
+		  "xdisp-tests" nil
+		  (expand-file-name invocation-name invocation-directory)
+		  "-Q" "-nw" "-l" xdisp-tests-file
+		  "--eval" (format "(xdisp-tests-write-value %S '%S)"
+				   file function)))
+	   (deadline (+ (float-time) 60)))
+      (unwind-protect
+	  (progn
+	    (while (and (not (file-exists-p file))
+			(process-live-p proc)
+			(< (float-time) deadline))
+	      (accept-process-output nil 0.1))
+	    (when (file-exists-p file)
+	      (with-temp-buffer
+		(insert-file-contents file)
+		(read (current-buffer)))))
+	(delete-process proc)
+	(when (file-exists-p file)
+	  (delete-file file))))))
+
+(defvar xdisp-tests-dependency nil
+  "A dependency of the cached mode line constructs of these tests.")
+
+(defvar xdisp-tests-formatted 0
+  "The number of times the cached constructs were formatted.")
+
+(defvar xdisp-tests-results nil
+  "The mode lines formatted so far, most recent first.")
+
+(defun xdisp-tests-cached-construct (dependencies)
+  "Return a new construct (:cache DEPENDENCIES ELT).
+ELT counts in `xdisp-tests-formatted' how many times it is formatted,
+and displays that count and the value of `xdisp-tests-dependency'."
+  (list :cache dependencies
+	'(:eval (format "%s:%d" xdisp-tests-dependency
+			(setq xdisp-tests-formatted
+			      (1+ xdisp-tests-formatted))))))
+
+(defun xdisp-tests-format (construct &optional window)
+  "Format CONSTRUCT for WINDOW, and record the result."
+  (push (format-mode-line construct nil window) xdisp-tests-results))
+
+(defmacro xdisp-tests-with-buffers (&rest body)
+  "Run BODY with the selected window showing a new buffer.
+Return the mode lines that BODY formatted with `xdisp-tests-format',
+in order.  Restore the buffer of the window and kill the new buffers
+afterwards."
+  (declare (indent 0))
+  `(let ((old-buffer (window-buffer))
+	 (xdisp-tests-dependency nil)
+	 (xdisp-tests-formatted 0)
+	 (xdisp-tests-results nil)
+	 (buffer-1 (generate-new-buffer "xdisp-tests-1"))
+	 (buffer-2 (generate-new-buffer "xdisp-tests-2")))
+     (unwind-protect
+	 (progn
+	   (set-window-buffer nil buffer-1)
+	   ,@body
+	   (nreverse xdisp-tests-results))
+       (set-window-buffer nil old-buffer)
+       (kill-buffer buffer-1)
+       (kill-buffer buffer-2))))
+
+(defun xdisp-tests-cache-reuse ()
+  "Format a cached construct again without changing anything."
+  (xdisp-tests-with-buffers
+    (let ((construct (xdisp-tests-cached-construct '(xdisp-tests-dependency))))
+      (xdisp-tests-format construct)
+      (xdisp-tests-format construct)
+      (xdisp-tests-format (list "<" construct ">"))
+      ;; A construct that is only `equal' has an entry of its own.
+      (xdisp-tests-format
+       (xdisp-tests-cached-construct '(xdisp-tests-dependency)))
+      (xdisp-tests-format construct))))
+
+(ert-deftest xdisp-tests-mode-line-cache-reuse ()
+  (should (equal (xdisp-tests-call-with-display 'xdisp-tests-cache-reuse)
+		 '("nil:1" "nil:1" "<nil:1>" "nil:2" "nil:1"))))
+
+(defun xdisp-tests-cache-dependencies ()
+  "Format a cached construct after changing its dependencies."
+  (xdisp-tests-with-buffers
+    (let ((construct (xdisp-tests-cached-construct
+		      '(xdisp-tests-dependency (buffer-modified-p)))))
+      (xdisp-tests-format construct)
+      ;; A change of a variable.
+      (setq xdisp-tests-dependency 'a)
+      (xdisp-tests-format construct)
+      (xdisp-tests-format construct)
+      ;; A new value that is `equal' to the old one.
+      (setq xdisp-tests-dependency (list "x"))
+      (xdisp-tests-format construct)
+      (setq xdisp-tests-dependency (list "x"))
+      (xdisp-tests-format construct)
+      ;; A change of the value of a form.
+      (with-current-buffer buffer-1
+	(insert "x"))
+      (xdisp-tests-format construct)
+      (xdisp-tests-format construct))))
+
+(ert-deftest xdisp-tests-mode-line-cache-dependencies ()
+  (should (equal (xdisp-tests-call-with-display
+		  'xdisp-tests-cache-dependencies)
+		 '("nil:1" "a:2" "a:2" "(x):3" "(x):3" "(x):4" "(x):4"))))
+
+(defun xdisp-tests-cache-buffer ()
+  "Format a cached construct after changing the buffer of the window.
+Also delete a window and kill a buffer that have entries in the cache."
+  (xdisp-tests-with-buffers
+    (let ((construct (xdisp-tests-cached-construct '(xdisp-tests-dependency))))
+      (xdisp-tests-format construct)
+      (set-window-buffer nil buffer-2)
+      (xdisp-tests-format construct)
+      (xdisp-tests-format construct)
+      (set-window-buffer nil buffer-1)
+      (xdisp-tests-format construct)
+      (let ((window (split-window)))
+	(xdisp-tests-format construct window)
+	(xdisp-tests-format construct window)
+	(delete-window window))
+      (set-window-buffer nil buffer-2)
+      (xdisp-tests-format construct)
+      (set-window-buffer nil buffer-1)
+      (kill-buffer buffer-2)
+      (xdisp-tests-format construct)
+      (xdisp-tests-format construct))))
+
+(ert-deftest xdisp-tests-mode-line-cache-buffer ()
+  (should (equal (xdisp-tests-call-with-display 'xdisp-tests-cache-buffer)
+		 '("nil:1" "nil:2" "nil:2" "nil:3" "nil:4" "nil:4"
+		   "nil:5" "nil:6" "nil:6"))))
+
+(defun xdisp-tests-cache-error ()
+  "Format a cached construct with a dependency that signals an error."
+  (xdisp-tests-with-buffers
+    (let ((construct (xdisp-tests-cached-construct
+		      '((error "Broken dependency") xdisp-tests-dependency))))
+      (xdisp-tests-format construct)
+      (xdisp-tests-format construct)
+      (setq xdisp-tests-dependency 'a)
+      (xdisp-tests-format (list "[" construct "]")))))
+
+(ert-deftest xdisp-tests-mode-line-cache-error ()
+  ;; A form dependency that signals an error counts as nil, and the
+  ;; mode line is still displayed.
+  (should (equal (xdisp-tests-call-with-display 'xdisp-tests-cache-error)
+		 '("nil:1" "nil:1" "[a:2]"))))
+
+;;; xdisp-tests.el ends here
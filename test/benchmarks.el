@@ -0,0 +1,587 @@
+;;; benchmarks.el --- Benchmarks for the speed of Emacs internals.
+
+;; Copyright (C) 2012 Free Software Foundation, Inc.
+
+;; Keywords:       internal
+;; Human-Keywords: internal
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Type M-x benchmarks-run RET and the name of a benchmark, or `all',
+;; to run benchmarks; the results appear in the buffer *Benchmarks*.
+;; Byte-compile this file first, so that the interpreter does not
+;; dominate the timings.  From the command line, run
+;;
+;;   emacs -batch -f batch-byte-compile test/benchmarks.el
+;;   emacs -batch -l test/benchmarks.elc -f benchmarks-batch [NAME...]
+;;
+;; to run the benchmarks called NAME..., or all of them if no name is
+;; given.  Each benchmark is defined with `define-benchmark', and
+;; reports its results with `benchmarks-line'.  Most benchmarks have
+;; variables named after them that set their sizes.
+
+;;; Code:
+
+(defvar benchmarks-list nil
+  "Names of the benchmarks, in the order in which they are run.")
+
+(defmacro define-benchmark (name doc &rest body)
+  "Define a benchmark called NAME, which runs BODY.
+The first line of DOC describes the results, and is shown before them.
+The benchmark is run by the function `benchmarks-NAME'."
+  (declare (doc-string 2) (indent 1))
+  `(progn
+     (defun ,(intern (format "benchmarks-%s" name)) ()
+       ,doc
+       ,@body)
+     (add-to-list 'benchmarks-list ',name t)
+     ',name))
+
+(defmacro benchmarks-time (rounds &rest body)
+  "Run BODY ROUNDS times and return the elapsed time in seconds."
+  (declare (indent 1))
+  (let ((start (make-symbol "start")))
+    `(let ((,start (float-time)))
+       (dotimes (_ ,rounds)
+	 ,@body)
+       (- (float-time) ,start))))
+
+(defun benchmarks-line (string)
+  "Insert STRING and show it right away."
+  (insert string)
+  (if noninteractive
+      (princ string)
+    (sit-for 0)))
+
+(defun benchmarks-insert (names)
+  "Insert the results of the benchmarks called NAMES into the buffer."
+  (dolist (name names)
+    (unless (memq name benchmarks-list)
+      (error "No benchmark called `%s'" name)))
+  (dolist (name names)
+    (let ((fun (intern (format "benchmarks-%s" name))))
+      (benchmarks-line
+       (format "%s: %s\n\n" name
+	       (car (split-string (documentation fun) "\n"))))
+      (funcall fun)
+      (benchmarks-line "\n"))))
+
+(defun benchmarks-run (name)
+  "Run the benchmark called NAME and show the results.
+Interactively, read NAME.  If NAME is `all', run all the benchmarks."
+  (interactive
+   (list (intern (completing-read
+		  "Run benchmark: "
+		  (cons "all" (mapcar #'symbol-name benchmarks-list))
+		  nil t))))
+  (pop-to-buffer (get-buffer-create "*Benchmarks*"))
+  (erase-buffer)
+  (benchmarks-insert (if (eq name 'all) benchmarks-list (list name))))
+
+(defun benchmarks-batch ()
+  "Run the benchmarks named on the command line and print the results.
+Run all the benchmarks if no name is given."
+  (let ((names (mapcar #'intern command-line-args-left)))
+    (setq command-line-args-left nil)
+    (with-temp-buffer
+      (benchmarks-insert (or names benchmarks-list)))))
+
+;;; Hash tables.
+
+(defvar benchmarks-hash-table-sizes '(1000 10000 100000 1000000 10000000)
+  "Numbers of entries of the tables to benchmark.
+The largest tables need a few gigabytes of memory.")
+
+(defvar benchmarks-hash-table-operations 1000000
+  "Number of operations to time for each test, at least.")
+
+(defun benchmarks-hash-table-keys (kind n)
+  "Return a vector of N distinct keys of KIND.
+KIND is one of `fixnum', `symbol', `float' or `string'."
+  (let ((keys (make-vector n nil)))
+    (dotimes (i n)
+      (aset keys i
+	    (cond ((eq kind 'fixnum) (* i 8))
+		  ((eq kind 'symbol) (make-symbol (format "k%d" i)))
+		  ((eq kind 'float) (+ i 0.5))
+		  (t (format "key-%d" i)))))
+    keys))
+
+(defun benchmarks-shuffle (vector)
+  "Put the elements of VECTOR in random order."
+  (let ((i (length vector)))
+    (while (> i 1)
+      (let* ((j (random i))
+	     (tmp (aref vector (setq i (1- i)))))
+	(aset vector i (aref vector j))
+	(aset vector j tmp)))
+    vector))
+
+(defun benchmarks-hash-table-1 (test kind n)
+  "Benchmark a table with test TEST holding N keys of KIND.
+Value is a list of the nanoseconds per operation for filling the table
+with `puthash', for successful and failing `gethash', and for `remhash'.
+All operations visit the keys in random order, since keys that are
+allocated one after the other favor some table layouts."
+  (let* ((keys (benchmarks-hash-table-keys kind n))
+	 (missing (benchmarks-hash-table-keys kind n))
+	 (rounds (max 1 (/ benchmarks-hash-table-operations n)))
+	 (ops (float (* rounds n)))
+	 table put get miss rem)
+    ;; Keys that are not in the table.
+    (dotimes (i n)
+      (let ((k (aref missing i)))
+	(aset missing i (if (stringp k) (concat "x" k)
+			  (if (numberp k) (- -1 k) (make-symbol "x"))))))
+    (benchmarks-shuffle keys)
+    (benchmarks-shuffle missing)
+    (garbage-collect)
+    (setq put (benchmarks-time rounds
+		(setq table (make-hash-table :test test))
+		(dotimes (i n)
+		  (puthash (aref keys i) i table))))
+    (setq get (benchmarks-time rounds
+		(dotimes (i n)
+		  (gethash (aref keys i) table))))
+    (setq miss (benchmarks-time rounds
+		 (dotimes (i n)
+		   (gethash (aref missing i) table))))
+    (setq rem (benchmarks-time 1
+		(dotimes (i n)
+		  (remhash (aref keys i) table))))
+    (unless (zerop (hash-table-count table))
+      (error "Table not empty after removing all keys"))
+    (list (/ (* put 1e9) ops) (/ (* get 1e9) ops)
+	  (/ (* miss 1e9) ops) (/ (* rem 1e9) n))))
+
+(define-benchmark hash-table
+  "Nanoseconds per hash table operation, by table size."
+  (benchmarks-line
+   (format "%-6s %-7s %9s %9s %9s %9s %9s\n"
+	   "test" "keys" "entries" "puthash" "gethash" "miss" "remhash"))
+  (dolist (test '((eq fixnum) (eq symbol) (eql float) (equal string)))
+    (dolist (n benchmarks-hash-table-sizes)
+      (let ((times (apply #'benchmarks-hash-table-1
+			  (append test (list n)))))
+	(benchmarks-line
+	 (apply #'format "%-6s %-7s %9d %9.1f %9.1f %9.1f %9.1f\n"
+		(append test (list n) times)))))))
+
+(defvar benchmarks-hash-table-gc-entries 100000
+  "Number of entries of the weak tables in the GC benchmark.")
+
+(defun benchmarks-hash-table-gc-1 (kind n)
+  "Return the milliseconds `garbage-collect' takes with a weak table.
+The table is weak on its keys and has N entries.  KIND says how the
+entries are laid out: `live' means all keys are referenced from
+elsewhere, `dead' means none are, and `chain' means the value of each
+entry is the key of another, so that only the entry whose key is
+referenced from elsewhere starts a chain that keeps all other
+entries alive.  The chain is visited in the worst order, which makes
+the cost of collection quadratic in N unless weak tables are marked
+with a worklist."
+  (let ((table (make-hash-table :test 'eq :weakness 'key :size n))
+	(keys (make-vector n nil))
+	root time)
+    (dotimes (i n)
+      (aset keys i (list i)))
+    (dotimes (i n)
+      (puthash (aref keys i)
+	       (if (and (eq kind 'chain) (> i 0)) (aref keys (1- i)) i)
+	       table))
+    (if (eq kind 'chain)
+	(setq root (aref keys (1- n))))
+    (unless (eq kind 'live)
+      (setq keys nil))
+    (setq time (benchmarks-time 1
+		 (garbage-collect)))
+    (unless (= (hash-table-count table)
+	       (if (eq kind 'dead) (hash-table-count table) n))
+      (error "Weak table lost live entries"))
+    (ignore root keys)
+    (* time 1e3)))
+
+(define-benchmark hash-table-gc
+  "Milliseconds per garbage collection with a large weak hash table."
+  (let ((n benchmarks-hash-table-gc-entries))
+    (garbage-collect)
+    (benchmarks-line
+     (format "%-8s %9s %9.1f ms\n" "none" 0
+	     (* (benchmarks-time 1 (garbage-collect)) 1e3)))
+    (dolist (kind '(live dead chain))
+      (benchmarks-line
+       (format "%-8s %9d %9.1f ms\n" kind n
+	       (benchmarks-hash-table-gc-1 kind n))))))
+
+;;; Sxhash.
+
+(defvar benchmarks-sxhash-keys 100000
+  "Number of keys in each key set of the sxhash collision benchmark.")
+
+(defun benchmarks-sxhash-key-sets (n)
+  "Return an alist of key sets with N keys each, by name."
+  (let ((prefix (make-string 200 ?x))
+	sets)
+    (dolist (set '(short path prefix list vector float))
+      (let (keys)
+	(dotimes (i n)
+	  (push (cond
+		 ((eq set 'short) (format "k%d" i))
+		 ((eq set 'path)
+		  (format "/usr/share/emacs/site-lisp/pkg-%d/file-%d.el"
+			  (/ i 100) (% i 100)))
+		 ((eq set 'prefix) (concat prefix (number-to-string i)))
+		 ((eq set 'list)
+		  (append '(a b c d e f g h i j) (list i)))
+		 ((eq set 'vector)
+		  (vector 'node 'binop (vector 'leaf (% i 317))
+			  (vector 'leaf (/ i 317))))
+		 (t (/ i 7.0)))
+		keys))
+	(push (cons set keys) sets)))
+    (nreverse sets)))
+
+(defun benchmarks-sxhash-count-collisions (keys)
+  "Return collision statistics for the list KEYS.
+Value is a list (DISTINCT BUCKET-COLLISIONS EXPECTED)."
+  (let ((codes (make-hash-table :test 'eql :size (length keys)))
+	(buckets (make-vector 65536 0))
+	(n (length keys))
+	(collisions 0))
+    (dolist (key keys)
+      (let* ((code (sxhash key))
+	     (bucket (logand code 65535)))
+	(puthash code t codes)
+	(unless (zerop (aref buckets bucket))
+	  (setq collisions (1+ collisions)))
+	(aset buckets bucket (1+ (aref buckets bucket)))))
+    (list (hash-table-count codes) collisions
+	  ;; N keys minus the expected number of occupied buckets.
+	  (round (- n (* 65536 (- 1 (expt (- 1 (/ 1.0 65536)) n))))))))
+
+(define-benchmark sxhash-collisions
+  "Distinct `sxhash' codes, and collisions in a table of 2^16 buckets.
+The table is indexed by the low bits of the hash code, the way `equal'
+hash tables and obarrays use them.  A good hash function gets about
+`keys' distinct codes and about `expected' collisions."
+  (benchmarks-line
+   (format "%-8s %8s %9s %10s %9s\n"
+	   "keys" "keys" "distinct" "collisions" "expected"))
+  (dolist (set (benchmarks-sxhash-key-sets benchmarks-sxhash-keys))
+    (benchmarks-line
+     (apply #'format "%-8s %8d %9d %10d %9d\n"
+	    (car set) (length (cdr set))
+	    (benchmarks-sxhash-count-collisions (cdr set))))))
+
+(define-benchmark sxhash-speed
+  "Megabytes per second hashed by `sxhash', by string length."
+  (benchmarks-line (format "%8s %10s\n" "length" "MB/s"))
+  (dolist (length '(8 16 64 256 4096 65536))
+    (let* ((string (make-string length ?a))
+	   (rounds (max 10 (/ 200000000 (+ length 64)))))
+      (benchmarks-line
+       (format "%8d %10.1f\n" length
+	       (/ (* rounds length)
+		  (benchmarks-time rounds (sxhash string))
+		  1e6))))))
+
+;;; Sorting.
+
+(defvar benchmarks-sort-length 1000000
+  "Number of elements to sort.")
+
+(defun benchmarks-sort-data (order n)
+  "Return a list of N numbers in ORDER.
+ORDER is `random', `sorted', `reversed' or `mostly', which means
+sorted except for one element in a hundred."
+  (let (list)
+    (dotimes (i n)
+      (push (cond ((eq order 'random) (random n))
+		  ((eq order 'sorted) (- n i))
+		  ((eq order 'reversed) i)
+		  ((zerop (random 100)) (random n))
+		  (t (- n i)))
+	    list))
+    list))
+
+(defun benchmarks-sort-1 (seq predicate &optional key)
+  "Return the milliseconds it takes to sort a copy of SEQ.
+PREDICATE and KEY are passed to `sort'."
+  (let ((copy (copy-sequence seq)))
+    (garbage-collect)
+    (* (benchmarks-time 1
+	 (if key
+	     (sort copy predicate :key key)
+	   (sort copy predicate)))
+       1e3)))
+
+(define-benchmark sort
+  "Milliseconds per `sort', by initial order and kind of predicate."
+  (benchmarks-line
+   (format "%-9s %9s %9s %9s %9s %9s\n"
+	   "order" "list <" "vector <" "lambda" "string<" ":key car"))
+  (dolist (order '(random sorted reversed mostly))
+    (let* ((list (benchmarks-sort-data order benchmarks-sort-length))
+	   (vector (vconcat list))
+	   (strings (mapcar #'number-to-string list))
+	   (conses (mapcar #'list list)))
+      (benchmarks-line
+       (format "%-9s %9.1f %9.1f %9.1f %9.1f %9.1f\n" order
+	       (benchmarks-sort-1 list #'<)
+	       (benchmarks-sort-1 vector #'<)
+	       (benchmarks-sort-1 list (lambda (a b) (< a b)))
+	       (benchmarks-sort-1 strings #'string<)
+	       (benchmarks-sort-1 conses #'< #'car))))))
+
+;;; String builders.
+
+(defvar benchmarks-string-builder-pieces '(10 100 1000 10000)
+  "Numbers of pieces of the strings to build.")
+
+(defun benchmarks-string-builder-concat (n)
+  "Build a string of N pieces with `concat'."
+  (let ((string ""))
+    (dotimes (i n)
+      (setq string (concat string "item " (number-to-string i) "\n")))
+    string))
+
+(defun benchmarks-string-builder-buffer (n)
+  "Build a string of N pieces in a temporary buffer."
+  (with-temp-buffer
+    (dotimes (i n)
+      (insert "item " (number-to-string i) ?\n))
+    (buffer-string)))
+
+(defun benchmarks-string-builder-builder (n)
+  "Build a string of N pieces with a string builder."
+  (let ((builder (make-string-builder)))
+    (dotimes (i n)
+      (string-builder-append-string builder "item ")
+      (string-builder-append-number builder i)
+      (string-builder-append-char builder ?\n))
+    (string-builder-finish builder)))
+
+(define-benchmark string-builder
+  "Milliseconds to build a string with `concat', a buffer and a builder.
+Each piece of the string is a short string, a number and a character."
+  (benchmarks-line
+   (format "%8s %10s %10s %10s\n" "pieces" "concat" "buffer" "builder"))
+  (dolist (n benchmarks-string-builder-pieces)
+    (let ((rounds (max 1 (/ 10000 n))))
+      (benchmarks-line
+       (apply #'format "%8d %10.3f %10.3f %10.3f\n" n
+	      (mapcar (lambda (f)
+			(garbage-collect)
+			(/ (* (benchmarks-time rounds (funcall f n)) 1e3)
+			   rounds))
+		      '(benchmarks-string-builder-concat
+			benchmarks-string-builder-buffer
+			benchmarks-string-builder-builder)))))))
+
+;;; Searching load-path.
+
+(defvar benchmarks-load-path-directories 300
+  "Number of directories in the path searched by `locate-file'.")
+
+(defvar benchmarks-load-path-repeat 100
+  "Number of times to repeat each search of the path.")
+
+(defun benchmarks-load-path-make (root)
+  "Make the directories to search under ROOT and return them.
+Each directory holds a few Lisp files.  The modification times of the
+directories are set to an hour ago, so that they can be indexed."
+  (let ((then (- (floor (float-time)) 3600))
+	dirs)
+    (dotimes (i benchmarks-load-path-directories)
+      (let ((dir (expand-file-name (format "pkg-%d" i) root)))
+	(make-directory dir)
+	(dolist (name (list (format "pkg-%d.el" i) (format "pkg-%d.elc" i)
+			    (format "pkg-%d-autoloads.el" i)))
+	  (write-region "" nil (expand-file-name name dir) nil 'silent))
+	(set-file-times dir (list (floor then 65536) (mod then 65536)))
+	(push dir dirs)))
+    (nreverse dirs)))
+
+(defun benchmarks-load-path-1 (file path index)
+  "Return the microseconds it takes to locate FILE in PATH.
+INDEX is the value to give `load-directory-index'."
+  (let ((load-directory-index index)
+	(suffixes (get-load-suffixes)))
+    (locate-file file path suffixes)
+    (garbage-collect)
+    (/ (* (benchmarks-time benchmarks-load-path-repeat
+	    (locate-file file path suffixes))
+	  1e6)
+       benchmarks-load-path-repeat)))
+
+(define-benchmark load-path
+  "Microseconds to find a file in a long path, without and with an index.
+The search is done by `locate-file', the way `load' searches
+`load-path', with `load-directory-index' nil and then a hash table."
+  (let* ((root (make-temp-file "benchmarks" t))
+	 (path (benchmarks-load-path-make root))
+	 (last (format "pkg-%d" (1- benchmarks-load-path-directories))))
+    (unwind-protect
+	(progn
+	  (benchmarks-line
+	   (format "%-16s %12s %12s\n" "file" "no index" "index"))
+	  (dolist (file (list "pkg-0" last "missing"))
+	    (benchmarks-line
+	     (format "%-16s %12.1f %12.1f\n" file
+		     (benchmarks-load-path-1 file path nil)
+		     (benchmarks-load-path-1
+		      file path (make-hash-table :test 'equal))))))
+      (delete-directory root t))))
+
+;;; Completion.
+
+(defvar benchmarks-completion-size 100000
+  "Number of candidates to complete among.")
+
+(defvar benchmarks-completion-repeat 20
+  "Number of times to repeat each completion.")
+
+(defun benchmarks-completion-candidates ()
+  "Return a list of `benchmarks-completion-size' file-like names."
+  (let (names)
+    (dotimes (i benchmarks-completion-size)
+      (push (format "src/module-%d/file-%d.c" (/ i 100) i) names))
+    names))
+
+(defun benchmarks-completion-1 (function string collection ignore-case)
+  "Return the microseconds it takes to call FUNCTION on STRING and COLLECTION.
+IGNORE-CASE is the value to give `completion-ignore-case'."
+  (let ((completion-ignore-case ignore-case))
+    (funcall function string collection)
+    (garbage-collect)
+    (/ (* (benchmarks-time benchmarks-completion-repeat
+	    (funcall function string collection))
+	  1e6)
+       benchmarks-completion-repeat)))
+
+(define-benchmark completion
+  "Microseconds to complete in a long list, without and with an index.
+The functions marked /i ignore case.  The index is made by
+`make-completion-index'."
+  (let* ((list (benchmarks-completion-candidates))
+	 (start (float-time))
+	 (index (make-completion-index list)))
+    (benchmarks-line
+     (format "making the index: %.1f ms\n" (* (- (float-time) start) 1e3)))
+    (benchmarks-line
+     (format "%-18s %-16s %12s %12s\n" "function" "string" "list" "index"))
+    (dolist (function '(all-completions try-completion))
+      (dolist (ignore-case '(nil t))
+	(dolist (string '("src/module-99/" "SRC/MODULE-999/FILE-9999"))
+	  (benchmarks-line
+	   (format "%-18s %-16s %12.1f %12.1f\n"
+		   (if ignore-case (format "%s/i" function) function)
+		   (substring string 0 (min 16 (length string)))
+		   (benchmarks-completion-1 function string list ignore-case)
+		   (benchmarks-completion-1
+		    function string index ignore-case))))))
+    (benchmarks-line
+     (format "flex matching: %.1f ms\n"
+	     (* (benchmarks-time 1
+		  (completion-index-flex-matches "m99f99c" index))
+		1e3)))))
+
+;;; Evaluating through the server.
+
+(require 'server)
+
+(defvar benchmarks-server-count 200
+  "Number of expressions to evaluate through the server.")
+
+(defvar benchmarks-server-expression "(+ 1 2)"
+  "Expression to evaluate through the server.")
+
+(defvar benchmarks-server-emacsclient
+  (expand-file-name "emacsclient" exec-directory)
+  "File name of the emacsclient program to run.")
+
+(defun benchmarks-server-socket-args ()
+  "Return the emacsclient arguments that name the running server."
+  (if server-use-tcp
+      (list "-f" (expand-file-name server-name server-auth-dir))
+    (list "-s" (expand-file-name server-name server-socket-dir))))
+
+(defun benchmarks-server-wait (buffer lines)
+  "Wait until BUFFER holds LINES lines of output."
+  (while (< (with-current-buffer buffer
+	      (count-lines (point-min) (point-max)))
+	    lines)
+    (accept-process-output nil 0.01)))
+
+(defun benchmarks-server-eval (buffer)
+  "Return the evaluations per second with an emacsclient for each.
+The output goes to BUFFER."
+  (/ benchmarks-server-count
+     (benchmarks-time benchmarks-server-count
+       (with-current-buffer buffer
+	 (erase-buffer))
+       (let ((proc (apply 'start-process "emacsclient" buffer
+			  benchmarks-server-emacsclient
+			  (append (benchmarks-server-socket-args)
+				  (list "--eval"
+					benchmarks-server-expression)))))
+	 (benchmarks-server-wait buffer 1)
+	 (delete-process proc)))))
+
+(defun benchmarks-server-stream (buffer)
+  "Return the evaluations per second through one `emacsclient --stream'.
+The output goes to BUFFER."
+  (with-current-buffer buffer
+    (erase-buffer))
+  (/ benchmarks-server-count
+     (benchmarks-time 1
+       (let* ((process-connection-type nil)
+	      (proc (apply 'start-process "emacsclient" buffer
+			   benchmarks-server-emacsclient
+			   (append (benchmarks-server-socket-args)
+				   (list "--stream")))))
+	 (dotimes (_ benchmarks-server-count)
+	   (process-send-string
+	    proc (concat benchmarks-server-expression "\n")))
+	 (process-send-eof proc)
+	 (benchmarks-server-wait buffer benchmarks-server-count)
+	 (delete-process proc)))))
+
+(define-benchmark server
+  "Evaluations per second through the server, by emacsclient.
+The expressions are sent by an emacsclient process for each, the way
+`emacsclient --eval' is used from scripts, and then by a single
+`emacsclient --stream' process.  A server is started for the benchmark
+if none is running."
+  (let ((running (and server-process (process-live-p server-process)))
+	(buffer (generate-new-buffer " *benchmarks-server*")))
+    (unless running
+      (server-start))
+    (unwind-protect
+	(progn
+	  (benchmarks-line (format "%-16s %12s\n" "client" "evals/sec"))
+	  (benchmarks-line
+	   (format "%-16s %12.1f\n" "--eval" (benchmarks-server-eval buffer)))
+	  (benchmarks-line
+	   (format "%-16s %12.1f\n" "--stream"
+		   (benchmarks-server-stream buffer))))
+      (kill-buffer buffer)
+      (unless running
+	(server-start t)))))
+
+;;; benchmarks.el ends here